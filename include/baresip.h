@@ -76,9 +76,145 @@ const char *account_stun_host(const struct account *acc);
 #define AULEVEL_MAX    (0.0)
 
 
+/** Level statistics of a set of audio samples */
+struct aulevel {
+	uint64_t sumsq;         /**< Sum of the squared samples     */
+	size_t sampc;           /**< Number of samples              */
+	uint32_t peak;          /**< Largest magnitude, 0 - 32768   */
+	uint32_t clip;          /**< Samples at full scale          */
+};
+
+void   aulevel_calc(struct aulevel *lvl, const int16_t *sampv, size_t sampc);
+void   aulevel_add(struct aulevel *lvl, const struct aulevel *add);
+double aulevel_dbov(const struct aulevel *lvl);
+double aulevel_peak_dbov(const struct aulevel *lvl);
 double aulevel_calc_dbov(const int16_t *sampv, size_t sampc);
 
 
+/*
+ * Audio resampler
+ */
+
+/** Resampler quality presets */
+enum resampler_quality {
+	RESAMPLER_FAST = 0,
+	RESAMPLER_MEDIUM,
+	RESAMPLER_HIGH,
+};
+
+struct resampler;
+
+int  resampler_alloc(struct resampler **rsp, enum resampler_quality q,
+		     uint32_t irate, uint8_t ich,
+		     uint32_t orate, uint8_t och);
+int  resampler_process(struct resampler *rs, int16_t *outv, size_t *outc,
+		       const int16_t *inv, size_t inc);
+const char *resampler_quality_name(enum resampler_quality q);
+int  resampler_quality_resolve(enum resampler_quality *qp,
+			       const struct pl *name);
+
+
+/*
+ * G.711 batch conversion
+ */
+
+void g711_ulaw_enc(uint8_t *dst, const int16_t *src, size_t n);
+void g711_alaw_enc(uint8_t *dst, const int16_t *src, size_t n);
+void g711_ulaw_dec(int16_t *dst, const uint8_t *src, size_t n);
+void g711_alaw_dec(int16_t *dst, const uint8_t *src, size_t n);
+
+
+/*
+ * Voice Activity Detection and Comfort Noise (RFC 3389)
+ */
+
+extern const char cn_rtpfmt[];
+
+/** Voice Activity Detector */
+struct vad {
+	double floor;           /**< Estimated noise floor [dBov]   */
+	double noise;           /**< Smoothed level in pauses       */
+	double rise;            /**< Noise floor rise per frame     */
+	uint32_t hang;          /**< Frames left of hangover        */
+	uint32_t hang_n;        /**< Hangover in frames             */
+	bool active;            /**< Voice activity detected        */
+};
+
+/** Comfort Noise generator */
+struct cngen {
+	uint32_t amp;           /**< Peak amplitude, 0 for silence  */
+	uint32_t seed;          /**< Random number state            */
+};
+
+void vad_init(struct vad *vad, uint32_t ptime);
+bool vad_process(struct vad *vad, const int16_t *sampv, size_t sampc);
+bool vad_process_level(struct vad *vad, double level);
+int  cn_encode(struct mbuf *mb, double level);
+int  cn_decode(double *level, const struct mbuf *mb);
+void cngen_set_level(struct cngen *cg, double level);
+void cngen_generate(struct cngen *cg, int16_t *sampv, size_t sampc,
+		    uint8_t ch);
+
+
+/*
+ * Packet Loss Concealment
+ */
+
+struct auplc;
+
+int  auplc_alloc(struct auplc **plcp, uint32_t srate, uint8_t ch);
+void auplc_conceal(struct auplc *plc, int16_t *sampv, size_t sampc);
+void auplc_rx(struct auplc *plc, int16_t *sampv, size_t sampc);
+
+
+/*
+ * Audio encoder control
+ */
+
+struct auenc_param;
+
+/** Adaptive encoder control from RTCP feedback and encoder load */
+struct auctrl {
+	double loss;            /**< Smoothed packet loss [%]       */
+	double load;            /**< Smoothed encoder load [0-1]    */
+	uint32_t rtt;           /**< Round-trip time [ms]           */
+	uint32_t bw;            /**< Available bandwidth [bit/s]    */
+	uint32_t bitrate;       /**< Bitrate limit, 0 for none      */
+	uint32_t pkt_loss;      /**< Expected packet loss [%]       */
+	uint32_t complexity;    /**< Encoder complexity 1-10        */
+	uint32_t n_reports;     /**< RTCP reports received          */
+	uint32_t n_frames;      /**< Frames since last load check   */
+	bool changed;           /**< Parameters have changed        */
+};
+
+void auctrl_init(struct auctrl *ctl);
+void auctrl_feedback(struct auctrl *ctl, double loss, uint32_t rtt,
+		     uint32_t bw, uint32_t send_bps);
+void auctrl_load(struct auctrl *ctl, uint32_t enc_usec, uint32_t frame_usec);
+bool auctrl_update(struct auctrl *ctl, struct auenc_param *prm);
+uint32_t auctrl_remb_decode(const struct mbuf *mb);
+int  auctrl_debug(struct re_printf *pf, const struct auctrl *ctl);
+
+
+/*
+ * Far-end reference for echo cancellation
+ */
+
+struct aecref;
+
+int  aecref_alloc(struct aecref **refp, uint32_t srate);
+int  aecref_player_set(struct aecref *ref, uint32_t srate, uint8_t ch);
+int  aecref_play(struct aecref *ref, const int16_t *sampv, size_t sampc,
+		 uint32_t srate, uint8_t ch, uint64_t usec);
+void aecref_capture(struct aecref *ref, size_t sampc,
+		    uint32_t srate, uint8_t ch, uint64_t usec);
+void aecref_frame(struct aecref *ref, size_t pending);
+int  aecref_read(struct aecref *ref, int16_t *refv, size_t sampc,
+		 bool *jump);
+uint32_t aecref_srate(const struct aecref *ref);
+int  aecref_debug(struct re_printf *pf, const struct aecref *ref);
+
+
 /*
  * Call
  */
@@ -176,6 +312,8 @@ struct config_sip {
 	char uuid[64];          /**< Universally Unique Identifier  */
 	char local[64];         /**< Local SIP Address              */
 	char cert[256];         /**< SIP Certificate                */
+	uint32_t reg_rate;      /**< Max REGISTER per second, 0=off */
+	uint32_t reg_spread;    /**< Random spread of expiry [%]    */
 };
 
 /** Call config */
@@ -199,11 +337,17 @@ struct config_audio {
 	uint32_t srate_src;     /**< Opt. sampling rate for source  */
 	uint32_t channels_play; /**< Opt. channels for player       */
 	uint32_t channels_src;  /**< Opt. channels for source       */
+	enum resampler_quality resamp;  /**< Resampler quality      */
 	bool src_first;         /**< Audio source opened first      */
 	enum audio_mode txmode; /**< Audio transmit mode            */
 	bool level;             /**< Enable audio level indication  */
 	int src_fmt;            /**< Audio source sample format     */
 	int play_fmt;           /**< Audio playback sample format   */
+	uint32_t silence_skip;  /**< Skip decode below -N [dBov]    */
+	bool cn;                /**< VAD and Comfort Noise (CN)     */
+	bool adaptive;          /**< Adapt encoder to RTCP reports  */
+	uint32_t pps_max;       /**< Packet rate budget, 0 for none */
+	bool plc;               /**< Packet Loss Concealment        */
 };
 
 #ifdef USE_VIDEO
@@ -230,6 +374,8 @@ struct config_avt {
 	struct range jbuf_del;  /**< Delay, number of frames        */
 	bool rtp_stats;         /**< Enable RTP statistics          */
 	uint32_t rtp_timeout;   /**< RTP Timeout in seconds (0=off) */
+	uint32_t rtp_pool;      /**< Size of RTP socket pool        */
+	uint32_t media_threads; /**< Number of media worker threads */
 };
 
 /* Network */
@@ -438,6 +584,7 @@ struct aufilt_prm {
 	uint32_t srate;       /**< Sampling rate in [Hz]        */
 	uint8_t  ch;          /**< Number of channels           */
 	uint32_t ptime;       /**< Wanted packet-time in [ms]   */
+	const struct audio *au;  /**< Parent audio object       */
 };
 
 typedef int (aufilt_encupd_h)(struct aufilt_enc_st **stp, void **ctx,
@@ -561,6 +708,9 @@ int  play_tone(struct play **playp, struct player *player,
 	       uint32_t srate, uint8_t ch, int repeat);
 int  play_init(struct player **playerp);
 void play_set_path(struct player *player, const char *path);
+int  play_cache_get(struct player *player, struct mbuf **mbp,
+		    uint32_t *srate, uint8_t *ch, const char *path);
+int  play_cache_debug(struct re_printf *pf, const struct player *player);
 
 
 /*
@@ -647,6 +797,7 @@ int  uag_event_register(ua_event_h *eh, void *arg);
 void uag_event_unregister(ua_event_h *eh);
 void uag_set_sub_handler(sip_msg_h *subh);
 int  ua_print_sip_status(struct re_printf *pf, void *unused);
+int  ua_print_memory(struct re_printf *pf, void *unused);
 int  uag_set_extra_params(const char *eprm);
 struct ua   *uag_find(const struct pl *cuser);
 struct ua   *uag_find_aor(const char *aor);
@@ -823,7 +974,10 @@ const struct vidisp *vidisp_find(const struct list *vidispl, const char *name);
 
 /** Audio Codec parameters */
 struct auenc_param {
-	uint32_t ptime;  /**< Packet time in [ms]   */
+	uint32_t ptime;       /**< Packet time in [ms]                 */
+	uint32_t bitrate;     /**< Bitrate limit [bit/s], 0 for none   */
+	uint32_t pkt_loss;    /**< Expected packet loss in [%]         */
+	uint32_t complexity;  /**< Complexity 1-10, 0 for default      */
 };
 
 struct auenc_state;
@@ -900,6 +1054,7 @@ typedef int (viddec_update_h)(struct viddec_state **vdsp,
 typedef int (viddec_decode_h)(struct viddec_state *vds, struct vidframe *frame,
                               bool *intra, bool marker, uint16_t seq,
                               struct mbuf *mb);
+typedef bool (videnc_discard_h)(const uint8_t *hdr, size_t hdr_len);
 
 struct vidcodec {
 	struct le le;
@@ -913,6 +1068,7 @@ struct vidcodec {
 	viddec_decode_h *dech;
 	sdp_fmtp_enc_h *fmtp_ench;
 	sdp_fmtp_cmp_h *fmtp_cmph;
+	videnc_discard_h *discardh;  /* packet can be dropped (optional) */
 };
 
 void vidcodec_register(struct list *vidcodecl, struct vidcodec *vc);
@@ -981,7 +1137,11 @@ void audio_set_devicename(struct audio *a, const char *src, const char *play);
 int  audio_set_source(struct audio *au, const char *mod, const char *device);
 int  audio_set_player(struct audio *au, const char *mod, const char *device);
 void audio_encoder_cycle(struct audio *audio);
+int  audio_set_ptime(struct audio *a, uint32_t ptime);
+struct aecref *audio_aecref(const struct audio *a);
 int  audio_level_get(const struct audio *au, double *level);
+int  audio_level_frame(const struct audio *au, bool tx,
+		       struct aulevel *lvl);
 int  audio_debug(struct re_printf *pf, const struct audio *a);
 
 
@@ -999,9 +1159,11 @@ void  video_vidsrc_set_device(struct video *v, const char *dev);
 int   video_set_source(struct video *v, const char *name, const char *dev);
 void  video_set_devicename(struct video *v, const char *src, const char *disp);
 void  video_encoder_cycle(struct video *video);
+int   video_encoder_share(void *arg, void *leader);
 int   video_debug(struct re_printf *pf, const struct video *v);
 uint32_t video_calc_rtp_timestamp(int64_t pts, unsigned fps);
 double video_calc_seconds(uint32_t rtp_ts);
+unsigned video_calc_threads(const struct vidsz *size, unsigned nmax);
 
 
 /*
@@ -1150,6 +1312,7 @@ static inline bool h264_is_keyframe(int type)
 int module_preload(const char *module);
 int  module_load(const char *name);
 void module_unload(const char *name);
+int  module_print_timing(struct re_printf *pf, void *unused);
 
 
 /*
@@ -42,7 +42,7 @@
 #   USE_PULSE         Pulseaudio audio driver
 #   USE_SDL           libSDL video output
 #   USE_SILK          SILK (Skype) audio codec
-#   USE_SNDFILE       sndfile wav dumper
+#   USE_SNDFILE       sndfile audio recorder
 #   USE_SPEEX         Speex audio codec
 #   USE_SPEEX_AEC     Speex Acoustic Echo Canceller
 #   USE_SPEEX_PP      Speex preprocessor
@@ -272,6 +272,7 @@ endif
 MODULES   += $(EXTRA_MODULES)
 MODULES   += stun turn ice natbd auloop presence
 MODULES   += menu contact vumeter mwi account natpmp httpd
+MODULES   += aec
 MODULES   += srtp
 MODULES   += uuid
 MODULES   += debug_cmd
@@ -281,12 +282,12 @@ MODULES   += mqtt
 endif
 
 ifneq ($(HAVE_PTHREAD),)
-MODULES   += aubridge aufile
+MODULES   += aubridge aufile auconf
 endif
 ifneq ($(USE_VIDEO),)
 MODULES   += vidloop selfview vidbridge
 ifneq ($(HAVE_PTHREAD),)
-MODULES   += fakevideo
+MODULES   += fakevideo vidmcu
 endif
 endif
 
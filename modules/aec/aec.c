@@ -0,0 +1,776 @@
+/**
+ * @file aec.c  Acoustic Echo Cancellation
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+
+
+/**
+ * @defgroup aec aec
+ *
+ * Acoustic Echo Cancellation (AEC) in floating point
+ *
+ * The far-end reference is what the audio player has played, aligned
+ * with the capture by the core. This module estimates the remaining
+ * delay of the devices and of the acoustic path. It correlates the
+ * energy envelopes of the reference and the capture to do so.
+ *
+ * The echo path is modelled by a partitioned-block frequency-domain
+ * adaptive filter (overlap-save), which covers TAIL_MS after the
+ * estimated delay. The filter is only adapted while the far-end alone
+ * is talking. Double-talk is detected with a Geigel detector. While
+ * only the far-end talks, the residual echo is also attenuated.
+ *
+ * The capture is processed in blocks of about 4 ms, which is the added
+ * latency.
+ *
+ * Commands:
+ *
+ \verbatim
+ aec_stats      Show the ERLE and the delay estimate
+ \endverbatim
+ */
+
+
+#define MU          0.4f    /* step size of the adaptive filter      */
+#define GEIGEL      1.0f    /* near-end talks above far-end peak *   */
+#define FAREND_MIN  0.003f  /* far-end talks above peak (-50 dBFS)   */
+#define NLP_GAIN    0.25f   /* residual echo attenuation (-12 dB)    */
+#define NLP_SMOOTH  0.005f  /* gain change per sample                */
+#define REG         0.05f   /* step size regularisation, of the mean */
+#define ENV_SMOOTH  0.01f   /* weight of a block in the correlation  */
+#define DELAY_HYST  1.2f    /* correlation gain to move the filter   */
+#define ERLE_SMOOTH 0.02f   /* weight of a block in the ERLE         */
+#define ERLE_SLOW   0.002f  /* same, during double-talk              */
+#define RESIDUAL    12.0f   /* double-talk below the ERLE by [dB]    */
+
+enum {
+	BLOCK_MS    = 4,    /* max. block length [ms]                    */
+	TAIL_MS     = 64,   /* echo tail after the delay [ms]            */
+	DELAY_MS    = 480,  /* max. delay estimate [ms]                  */
+	DELAY_PRE   = 2,    /* blocks of filter before the echo peak     */
+	DELAY_CHECK = 50,   /* blocks between delay decisions            */
+	DELAY_WARM  = 250,  /* far-end blocks before the first decision  */
+	HANGOVER    = 12,   /* blocks of double-talk hangover            */
+	DIVERGE_MAX = 50,   /* blocks of divergence before a reset       */
+};
+
+
+struct aec {
+	struct aufilt_enc_st af;  /* base class */
+	struct le le;             /* member of aecl */
+
+	struct aecref *ref;
+	uint32_t srate;
+	size_t frame;             /* max. samples per frame              */
+	size_t B;                 /* block length                        */
+	size_t N;                 /* FFT size, 2*B                       */
+	size_t P;                 /* filter partitions                   */
+	size_t L;                 /* delay lags, in blocks               */
+
+	float *cosv, *sinv;       /* FFT twiddle factors                 */
+	size_t *revv;             /* FFT bit reversal                    */
+
+	int16_t *refv;            /* reference of one frame              */
+	float *xh;                /* reference history                   */
+	size_t xhsz;
+	uint64_t xn;              /* reference samples so far            */
+	float *din, *dout;        /* capture and output queues           */
+	size_t dinc, doutc;
+	uint64_t bn;              /* blocks processed                    */
+
+	float *Xr, *Xi;           /* reference spectra, P partitions     */
+	float *xmax;              /* peak of the reference per partition */
+	size_t xk;                /* newest partition                    */
+	float *Wr, *Wi;           /* filter, P partitions                */
+	float *Yr, *Yi;           /* work buffers                        */
+	float *Er, *Ei;
+	float *ps;                /* reference power per bin             */
+	size_t cpart;             /* next partition to constrain         */
+
+	float *envx;              /* reference envelope, L blocks        */
+	float *corr;              /* envelope correlation per lag        */
+	float mx, md;             /* envelope means                      */
+	size_t envk;
+	uint32_t n_far;           /* far-end blocks                      */
+	size_t delay;             /* delay estimate in blocks            */
+	size_t cand;              /* candidate for the next estimate     */
+
+	unsigned hang;            /* double-talk hangover                */
+	unsigned diverge;         /* blocks of divergence                */
+	float nlp;                /* gain of the non-linear processor    */
+
+	float erle;               /* smoothed ERLE in [dB]               */
+	uint64_t n_jump;
+	uint64_t n_reset;
+	uint64_t n_near;          /* blocks with near-end speech         */
+};
+
+
+static struct list aecl;
+
+
+static void destructor(void *arg)
+{
+	struct aec *st = arg;
+
+	list_unlink(&st->le);
+	list_unlink(&st->af.le);
+
+	mem_deref(st->ref);
+	mem_deref(st->cosv);
+	mem_deref(st->sinv);
+	mem_deref(st->revv);
+	mem_deref(st->refv);
+	mem_deref(st->xh);
+	mem_deref(st->din);
+	mem_deref(st->dout);
+	mem_deref(st->Xr);
+	mem_deref(st->Xi);
+	mem_deref(st->xmax);
+	mem_deref(st->Wr);
+	mem_deref(st->Wi);
+	mem_deref(st->Yr);
+	mem_deref(st->Yi);
+	mem_deref(st->Er);
+	mem_deref(st->Ei);
+	mem_deref(st->ps);
+	mem_deref(st->envx);
+	mem_deref(st->corr);
+}
+
+
+static float *falloc(size_t n, int *err)
+{
+	float *v = mem_zalloc(n * sizeof(float), NULL);
+
+	if (!v)
+		*err = ENOMEM;
+
+	return v;
+}
+
+
+/* in-place radix-2 FFT, not scaled */
+static void fft(const struct aec *st, float *re, float *im, bool inv)
+{
+	const size_t n = st->N;
+	size_t i, k, len;
+
+	for (i=0; i<n; i++) {
+
+		const size_t j = st->revv[i];
+
+		if (j > i) {
+			float t;
+
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for (len=2; len<=n; len<<=1) {
+
+		const size_t half = len / 2;
+		const size_t step = n / len;
+
+		for (i=0; i<n; i+=len) {
+			for (k=0; k<half; k++) {
+
+				const float wr = st->cosv[k * step];
+				const float wi = inv ? st->sinv[k * step]
+						     : -st->sinv[k * step];
+				float *ar = &re[i + k], *ai = &im[i + k];
+				float *br = &re[i + k + half];
+				float *bi = &im[i + k + half];
+				const float tr = wr * *br - wi * *bi;
+				const float ti = wr * *bi + wi * *br;
+
+				*br = *ar - tr;
+				*bi = *ai - ti;
+				*ar += tr;
+				*ai += ti;
+			}
+		}
+	}
+}
+
+
+static inline float ref_sample(const struct aec *st, int64_t i)
+{
+	if (i < 0 || (uint64_t)i >= st->xn ||
+	    (uint64_t)i + st->xhsz < st->xn)
+		return 0.0f;
+
+	return st->xh[(uint64_t)i % st->xhsz];
+}
+
+
+/*
+ * Spectrum of partition k, for the block bn: the 2*B reference samples
+ * that end with the block, shifted by the delay and k blocks.
+ */
+static void ref_spectrum(struct aec *st, size_t slot, uint64_t bn, size_t k)
+{
+	const int64_t end = (int64_t)((bn + 1) * st->B)
+		- (int64_t)((st->delay + k) * st->B);
+	float *xr = &st->Xr[slot * st->N];
+	float *xi = &st->Xi[slot * st->N];
+	float peak = 0.0f;
+	size_t i;
+
+	for (i=0; i<st->N; i++) {
+		xr[i] = ref_sample(st, end - (int64_t)st->N + (int64_t)i);
+		xi[i] = 0.0f;
+
+		if (i >= st->B)
+			peak = max(peak, fabsf(xr[i]));
+	}
+
+	st->xmax[slot] = peak;
+
+	fft(st, xr, xi, false);
+}
+
+
+/* after a delay change, the spectra of all partitions are recomputed */
+static void delay_shift(struct aec *st, size_t delay)
+{
+	const int64_t m = (int64_t)delay - (int64_t)st->delay;
+	const size_t N = st->N, P = st->P;
+	size_t k;
+
+	info("aec: echo delay %u ms\n",
+	     (unsigned)(delay * st->B * 1000 / st->srate));
+
+	/* the filter moves by the change of the delay */
+	if (m > 0) {
+		for (k=0; k<P; k++) {
+			if (k + m < P) {
+				memcpy(&st->Wr[k * N], &st->Wr[(k + m) * N],
+				       N * sizeof(float));
+				memcpy(&st->Wi[k * N], &st->Wi[(k + m) * N],
+				       N * sizeof(float));
+			}
+			else {
+				memset(&st->Wr[k * N], 0, N * sizeof(float));
+				memset(&st->Wi[k * N], 0, N * sizeof(float));
+			}
+		}
+	}
+	else if (m < 0) {
+		for (k=P; k-- > 0;) {
+			if (k >= (size_t)-m) {
+				memcpy(&st->Wr[k * N], &st->Wr[(k + m) * N],
+				       N * sizeof(float));
+				memcpy(&st->Wi[k * N], &st->Wi[(k + m) * N],
+				       N * sizeof(float));
+			}
+			else {
+				memset(&st->Wr[k * N], 0, N * sizeof(float));
+				memset(&st->Wi[k * N], 0, N * sizeof(float));
+			}
+		}
+	}
+
+	st->delay = delay;
+
+	/* partition k of the previous block is in slot xk + k */
+	for (k=0; k<P; k++) {
+		if (st->bn)
+			ref_spectrum(st, (st->xk + k) % P, st->bn - 1, k);
+	}
+}
+
+
+/*
+ * The capture envelope follows the reference envelope at the lag of
+ * the echo. The correlation of the two is tracked for all lags.
+ */
+static void delay_update(struct aec *st, const float *d)
+{
+	const int64_t start = (int64_t)(st->bn * st->B);
+	float ex = 0.0f, ed = 0.0f, peak = 0.0f, lx, ld;
+	size_t i, l, best = 0;
+
+	for (i=0; i<st->B; i++) {
+		const float x = ref_sample(st, start + (int64_t)i);
+
+		ex += x * x;
+		ed += d[i] * d[i];
+		peak = max(peak, fabsf(x));
+	}
+
+	lx = 10.0f * log10f(ex / st->B + 1e-10f);
+	ld = 10.0f * log10f(ed / st->B + 1e-10f);
+
+	st->envk = (st->envk + 1) % st->L;
+	st->envx[st->envk] = lx;
+
+	/* near-end speech hides the echo */
+	if (peak < FAREND_MIN || st->hang)
+		return;
+
+	if (st->n_far++) {
+		st->mx += (lx - st->mx) * ENV_SMOOTH;
+		st->md += (ld - st->md) * ENV_SMOOTH;
+	}
+	else {
+		st->mx = lx;
+		st->md = ld;
+	}
+
+	for (l=0; l<st->L; l++) {
+
+		const float x = st->envx[(st->envk + st->L - l) % st->L];
+
+		st->corr[l] += ((ld - st->md) * (x - st->mx) - st->corr[l])
+			* ENV_SMOOTH;
+	}
+
+	if (st->n_far < DELAY_WARM || st->n_far % DELAY_CHECK)
+		return;
+
+	for (l=1; l<st->L; l++) {
+		if (st->corr[l] > st->corr[best])
+			best = l;
+	}
+
+	if (st->corr[best] <= 0.0f)
+		return;
+
+	best = best > DELAY_PRE ? best - DELAY_PRE : 0;
+	best = min(best, st->L - st->P);
+
+	/* only a clear improvement, seen twice, moves the filter */
+	if (best == st->delay || st->corr[best + DELAY_PRE]
+	    < DELAY_HYST * st->corr[st->delay + DELAY_PRE])
+		st->cand = st->delay;
+	else if (best != st->cand)
+		st->cand = best;
+	else
+		delay_shift(st, best);
+}
+
+
+static void filter_reset(struct aec *st)
+{
+	const size_t sz = st->P * st->N * sizeof(float);
+
+	memset(st->Wr, 0, sz);
+	memset(st->Wi, 0, sz);
+
+	++st->n_reset;
+}
+
+
+static void adapt(struct aec *st, const float *e)
+{
+	const size_t B = st->B, N = st->N, P = st->P;
+	float *tr = st->Yr, *ti = st->Yi;
+	float mean = 0.0f, reg;
+	size_t f, k, c;
+
+	memset(st->Er, 0, B * sizeof(float));
+	memcpy(&st->Er[B], e, B * sizeof(float));
+	memset(st->Ei, 0, N * sizeof(float));
+	fft(st, st->Er, st->Ei, false);
+
+	/* reference power of all partitions, per bin */
+	memset(st->ps, 0, N * sizeof(float));
+
+	for (k=0; k<P; k++) {
+
+		const float *xr = &st->Xr[k * N], *xi = &st->Xi[k * N];
+
+		for (f=0; f<N; f++)
+			st->ps[f] += xr[f] * xr[f] + xi[f] * xi[f];
+	}
+
+	for (f=0; f<N; f++)
+		mean += st->ps[f];
+
+	/* bins without far-end must not amplify the near-end */
+	reg = mean / N * REG + 1e-6f * N;
+
+	for (f=0; f<N; f++) {
+		const float g = MU / (st->ps[f] + reg);
+
+		st->Er[f] *= g;
+		st->Ei[f] *= g;
+	}
+
+	/* W += mu * conj(X) * E / ps */
+	for (k=0; k<P; k++) {
+
+		const size_t s = (st->xk + k) % P;
+		const float *xr = &st->Xr[s * N], *xi = &st->Xi[s * N];
+		float *wr = &st->Wr[k * N], *wi = &st->Wi[k * N];
+
+		for (f=0; f<N; f++) {
+			wr[f] += xr[f] * st->Er[f] + xi[f] * st->Ei[f];
+			wi[f] += xr[f] * st->Ei[f] - xi[f] * st->Er[f];
+		}
+	}
+
+	/* keep one partition at a time a linear convolution */
+	c = st->cpart++ % P;
+
+	memcpy(tr, &st->Wr[c * N], N * sizeof(float));
+	memcpy(ti, &st->Wi[c * N], N * sizeof(float));
+	fft(st, tr, ti, true);
+
+	for (f=0; f<B; f++) {
+		tr[f] /= N;
+		ti[f] = 0.0f;
+	}
+	for (; f<N; f++)
+		tr[f] = ti[f] = 0.0f;
+
+	fft(st, tr, ti, false);
+	memcpy(&st->Wr[c * N], tr, N * sizeof(float));
+	memcpy(&st->Wi[c * N], ti, N * sizeof(float));
+}
+
+
+static void process_block(struct aec *st, const float *d, float *out)
+{
+	const size_t B = st->B, N = st->N, P = st->P;
+	float ed = 0.0f, ee = 0.0f, dmax = 0.0f, xmax = 0.0f, erle;
+	bool farend, near;
+	size_t f, k;
+
+	delay_update(st, d);
+
+	/* the newest partition */
+	st->xk = (st->xk + P - 1) % P;
+	ref_spectrum(st, st->xk, st->bn, 0);
+
+	/* echo estimate, Y = sum of W * X */
+	memset(st->Yr, 0, N * sizeof(float));
+	memset(st->Yi, 0, N * sizeof(float));
+
+	for (k=0; k<P; k++) {
+
+		const size_t s = (st->xk + k) % P;
+		const float *xr = &st->Xr[s * N], *xi = &st->Xi[s * N];
+		const float *wr = &st->Wr[k * N], *wi = &st->Wi[k * N];
+
+		for (f=0; f<N; f++) {
+			st->Yr[f] += wr[f] * xr[f] - wi[f] * xi[f];
+			st->Yi[f] += wr[f] * xi[f] + wi[f] * xr[f];
+		}
+
+		xmax = max(xmax, st->xmax[s]);
+	}
+
+	fft(st, st->Yr, st->Yi, true);
+
+	for (f=0; f<B; f++) {
+		out[f] = d[f] - st->Yr[B + f] / N;
+
+		ed += d[f] * d[f];
+		ee += out[f] * out[f];
+		dmax = max(dmax, fabsf(d[f]));
+	}
+
+	farend = xmax > FAREND_MIN;
+	erle   = 10.0f * log10f((ed + 1e-10f) / (min(ee, ed) + 1e-10f));
+
+	/*
+	 * Double-talk: the capture is louder than the far-end peak (Geigel
+	 * detector), or the residual is well above the echo return loss
+	 * enhancement so far.
+	 */
+	if (dmax > GEIGEL * xmax || (farend && erle < st->erle - RESIDUAL)) {
+		st->hang = HANGOVER;
+		++st->n_near;
+	}
+	else if (st->hang) {
+		--st->hang;
+	}
+
+	near = st->hang > 0;
+
+	/* the filter adds echo instead of removing it */
+	if (ee > ed && ed > 0.0f) {
+		memcpy(out, d, B * sizeof(float));
+
+		if (++st->diverge >= DIVERGE_MAX) {
+			filter_reset(st);
+			st->diverge = 0;
+		}
+	}
+	else {
+		st->diverge = 0;
+	}
+
+	/* slowly during double-talk, to recover from echo path changes */
+	if (farend) {
+		const float w = near ? ERLE_SLOW : ERLE_SMOOTH;
+
+		st->erle += (erle - st->erle) * w;
+	}
+
+	if (farend && !near)
+		adapt(st, out);
+
+	/* attenuate the residual echo while the far-end talks alone */
+	for (f=0; f<B; f++) {
+		const float target = (farend && !near) ? NLP_GAIN : 1.0f;
+
+		st->nlp += (target - st->nlp) * NLP_SMOOTH;
+		out[f] *= st->nlp;
+	}
+
+	++st->bn;
+}
+
+
+static inline int16_t saturate(float v)
+{
+	v *= 32768.0f;
+
+	if (v > 32767.0f)
+		return 32767;
+	else if (v < -32768.0f)
+		return -32768;
+
+	return (int16_t)lrintf(v);
+}
+
+
+static size_t pow2_below(size_t n)
+{
+	size_t p = 1;
+
+	while (p * 2 <= n)
+		p *= 2;
+
+	return p;
+}
+
+
+static int aec_init(struct aec *st, uint32_t srate, size_t frame)
+{
+	size_t i, bits = 0;
+	int err = 0;
+
+	st->srate = srate;
+	st->frame = frame;
+	st->B     = pow2_below(srate * BLOCK_MS / 1000);
+	st->N     = 2 * st->B;
+	st->P     = (srate * TAIL_MS / 1000 + st->B - 1) / st->B;
+	st->L     = (srate * DELAY_MS / 1000) / st->B + st->P;
+	st->xhsz  = (st->L + st->P + 2) * st->B + frame;
+	st->nlp   = 1.0f;
+
+	st->cosv = falloc(st->N / 2, &err);
+	st->sinv = falloc(st->N / 2, &err);
+	st->revv = mem_zalloc(st->N * sizeof(size_t), NULL);
+	st->refv = mem_zalloc(frame * sizeof(int16_t), NULL);
+	if (!st->revv || !st->refv)
+		err = ENOMEM;
+
+	st->xh   = falloc(st->xhsz, &err);
+	st->din  = falloc(frame + st->B, &err);
+	st->dout = falloc(frame + 2 * st->B, &err);
+	st->Xr   = falloc(st->P * st->N, &err);
+	st->Xi   = falloc(st->P * st->N, &err);
+	st->xmax = falloc(st->P, &err);
+	st->Wr   = falloc(st->P * st->N, &err);
+	st->Wi   = falloc(st->P * st->N, &err);
+	st->Yr   = falloc(st->N, &err);
+	st->Yi   = falloc(st->N, &err);
+	st->Er   = falloc(st->N, &err);
+	st->Ei   = falloc(st->N, &err);
+	st->ps   = falloc(st->N, &err);
+	st->envx = falloc(st->L, &err);
+	st->corr = falloc(st->L, &err);
+	if (err)
+		return err;
+
+	for (i=0; i<st->N / 2; i++) {
+		st->cosv[i] = (float)cos(2 * M_PI * i / st->N);
+		st->sinv[i] = (float)sin(2 * M_PI * i / st->N);
+	}
+
+	while (((size_t)1 << bits) < st->N)
+		++bits;
+
+	for (i=0; i<st->N; i++) {
+		size_t r = 0, b;
+
+		for (b=0; b<bits; b++)
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+
+		st->revv[i] = r;
+	}
+
+	/* the output is one block behind the capture */
+	st->doutc = st->B;
+
+	return 0;
+}
+
+
+static int encode_update(struct aufilt_enc_st **stp, void **ctx,
+			 const struct aufilt *af, struct aufilt_prm *prm)
+{
+	struct aecref *ref;
+	struct aec *st;
+	int err = 0;
+	(void)ctx;
+	(void)af;
+
+	if (!stp || !prm)
+		return EINVAL;
+
+	if (*stp)
+		return 0;
+
+	ref = audio_aecref(prm->au);
+
+	if (!ref || aecref_srate(ref) != prm->srate || prm->ch != 1) {
+		warning("aec: no far-end reference for %uHz/%uch,"
+			" echo is not cancelled\n", prm->srate, prm->ch);
+		ref = NULL;
+	}
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	if (ref) {
+		const size_t frame = prm->srate * prm->ptime / 1000;
+
+		err = aec_init(st, prm->srate, frame);
+		if (err)
+			goto out;
+
+		st->ref = mem_ref(ref);
+
+		info("aec: %uHz, %zu sample blocks, %u ms tail\n", prm->srate,
+		     st->B,
+		     (unsigned)(st->P * st->B * 1000 / prm->srate));
+	}
+
+	list_append(&aecl, &st->le, st);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = (struct aufilt_enc_st *)st;
+
+	return err;
+}
+
+
+static int encode(struct aufilt_enc_st *afst, int16_t *sampv, size_t *sampc)
+{
+	struct aec *st = (struct aec *)afst;
+	const size_t n = *sampc;
+	bool jump;
+	size_t i;
+
+	if (!st->ref || !n || n > st->frame)
+		return 0;
+
+	(void)aecref_read(st->ref, st->refv, n, &jump);
+	if (jump)
+		++st->n_jump;
+
+	for (i=0; i<n; i++) {
+		st->xh[(st->xn + i) % st->xhsz] = st->refv[i] / 32768.0f;
+		st->din[st->dinc + i] = sampv[i] / 32768.0f;
+	}
+
+	st->xn   += n;
+	st->dinc += n;
+
+	while (st->dinc >= st->B) {
+
+		process_block(st, st->din, &st->dout[st->doutc]);
+		st->doutc += st->B;
+
+		st->dinc -= st->B;
+		memmove(st->din, &st->din[st->B], st->dinc * sizeof(float));
+	}
+
+	for (i=0; i<n; i++)
+		sampv[i] = saturate(st->dout[i]);
+
+	st->doutc -= n;
+	memmove(st->dout, &st->dout[n], st->doutc * sizeof(float));
+
+	return 0;
+}
+
+
+static int print_stats(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int err = 0;
+	(void)unused;
+
+	for (le = aecl.head; le; le = le->next) {
+
+		const struct aec *st = le->data;
+
+		if (!st->ref) {
+			err |= re_hprintf(pf, "aec: bypassed\n");
+			continue;
+		}
+
+		err |= re_hprintf(pf, "aec: %uHz delay=%ums erle=%.1fdB"
+				  " near=%.1f%% resets=%llu jumps=%llu\n",
+				  st->srate,
+				  (unsigned)(st->delay * st->B * 1000
+					     / st->srate),
+				  st->erle,
+				  st->bn ? 100.0 * st->n_near / st->bn : 0.0,
+				  st->n_reset, st->n_jump);
+	}
+
+	return err;
+}
+
+
+static struct aufilt aec = {
+	LE_INIT, "aec", encode_update, encode, NULL, NULL
+};
+
+
+static const struct cmd cmdv[] = {
+	{"aec_stats", 0, 0, "Show echo canceller statistics", print_stats},
+};
+
+
+static int module_init(void)
+{
+	aufilt_register(baresip_aufiltl(), &aec);
+
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+}
+
+
+static int module_close(void)
+{
+	cmd_unregister(baresip_commands(), cmdv);
+	aufilt_unregister(&aec);
+
+	return 0;
+}
+
+
+EXPORT_SYM const struct mod_export DECL_EXPORTS(aec) = {
+	"aec",
+	"filter",
+	module_init,
+	module_close
+};
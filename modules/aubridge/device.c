@@ -53,7 +53,7 @@ static void *device_thread(void *arg)
 {
 	uint64_t now, ts = tmr_jiffies();
 	struct device *dev = arg;
-	struct auresamp rs;
+	struct resampler *rs = NULL;
 	int16_t *sampv_in, *sampv_out;
 	size_t sampc_in;
 	size_t sampc_out;
@@ -62,18 +62,25 @@ static void *device_thread(void *arg)
 	sampc_in = dev->auplay->prm.srate * dev->auplay->prm.ch * PTIME/1000;
 	sampc_out = dev->ausrc->prm.srate * dev->ausrc->prm.ch * PTIME/1000;
 
-	auresamp_init(&rs);
-
 	sampv_in  = mem_alloc(2 * sampc_in, NULL);
 	sampv_out = mem_alloc(2 * sampc_out, NULL);
 	if (!sampv_in || !sampv_out)
 		goto out;
 
-	err = auresamp_setup(&rs,
-			     dev->auplay->prm.srate, dev->auplay->prm.ch,
-			     dev->ausrc->prm.srate, dev->ausrc->prm.ch);
-	if (err)
-		goto out;
+	if (dev->auplay->prm.srate != dev->ausrc->prm.srate ||
+	    dev->auplay->prm.ch != dev->ausrc->prm.ch) {
+
+		err = resampler_alloc(&rs, conf_config()->audio.resamp,
+				      dev->auplay->prm.srate,
+				      dev->auplay->prm.ch,
+				      dev->ausrc->prm.srate,
+				      dev->ausrc->prm.ch);
+		if (err) {
+			warning("aubridge: resampler setup failed (%m)\n",
+				err);
+			goto out;
+		}
+	}
 
 	while (dev->run) {
 
@@ -91,18 +98,19 @@ static void *device_thread(void *arg)
 			dev->auplay->wh(sampv_in, sampc_in, dev->auplay->arg);
 		}
 
-		if (rs.resample) {
-			err = auresamp(&rs,
-				       sampv_out, &sampc_out,
-				       sampv_in, sampc_in);
+		if (rs) {
+			size_t sampc = sampc_out;
+
+			err = resampler_process(rs, sampv_out, &sampc,
+						sampv_in, sampc_in);
 			if (err) {
-				warning("aubridge: auresamp error"
+				warning("aubridge: resampler error"
 					" sampc_out=%zu, sampc_in=%zu (%m)\n",
 					sampc_out, sampc_in, err);
 			}
 
 			if (dev->ausrc && dev->ausrc->rh) {
-				dev->ausrc->rh(sampv_out, sampc_out,
+				dev->ausrc->rh(sampv_out, sampc,
 					       dev->ausrc->arg);
 			}
 		}
@@ -117,6 +125,7 @@ static void *device_thread(void *arg)
 	}
 
  out:
+	mem_deref(rs);
 	mem_deref(sampv_in);
 	mem_deref(sampv_out);
 
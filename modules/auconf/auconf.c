@@ -0,0 +1,560 @@
+/**
+ * @file auconf.c  Audio conference mixer
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+
+
+/**
+ * @defgroup auconf auconf
+ *
+ * Audio conference mixer (N-1 mixing)
+ *
+ * This module is an audio filter that connects all calls into one
+ * audio conference. The decoded audio of each call is collected by the
+ * decoder filter, and the encoder filter replaces the outgoing audio
+ * with the mix of all other participants.
+ *
+ * All participants are mixed in one processing tick. The total mix is
+ * computed once, and each participant gets the total minus its own
+ * contribution, so the cost grows linearly with the number of calls.
+ * Only the loudest speakers are mixed, using the RFC 6464 audio level
+ * of each call if available, otherwise the level of the decoded audio.
+ * The mixer thread sleeps on a condition until the next tick.
+ *
+ * All participants must use the same sampling rate and channels.
+ *
+ * Example config:
+ \verbatim
+  module                  auconf.so
+  auconf_speakers         3     # Number of mixed speakers
+ \endverbatim
+ */
+
+
+enum {
+	PTIME = 20,
+	SPEAKERS_MAX = 16,
+	BUF_FRAMES = 8,
+};
+
+
+struct participant {
+	struct le le;
+	struct aubuf *inbuf;       /* decoded audio from the peer  */
+	struct aubuf *outbuf;      /* mixed audio to the peer      */
+	const struct audio *au;
+	int16_t *frame;            /* one tick of input            */
+	double level;              /* audio level, mixer lock      */
+	bool speaker;
+	bool joined;
+	uint32_t srate;
+	uint8_t ch;
+};
+
+struct enc_st {
+	struct aufilt_enc_st af;  /* base class */
+	struct participant *part;
+};
+
+struct dec_st {
+	struct aufilt_dec_st af;  /* base class */
+	struct participant *part;
+};
+
+struct mixer {
+	struct list partl;
+	struct lock *lock;
+	pthread_t thread;
+	pthread_mutex_t mutex;     /* protects run, for cond       */
+	pthread_cond_t cond;       /* signalled when stopping      */
+	bool run;
+	int32_t *total;
+	int16_t *out;
+	size_t sampc;
+	uint32_t srate;
+	uint8_t ch;
+};
+
+
+static struct mixer *mixer;
+static uint32_t n_speakers = 3;
+
+
+static void mixer_destructor(void *arg)
+{
+	struct mixer *mix = arg;
+
+	if (mix->run) {
+		pthread_mutex_lock(&mix->mutex);
+		mix->run = false;
+		pthread_cond_signal(&mix->cond);
+		pthread_mutex_unlock(&mix->mutex);
+
+		pthread_join(mix->thread, NULL);
+	}
+
+	pthread_cond_destroy(&mix->cond);
+	pthread_mutex_destroy(&mix->mutex);
+
+	mem_deref(mix->total);
+	mem_deref(mix->out);
+	mem_deref(mix->lock);
+
+	mixer = NULL;
+}
+
+
+static inline int16_t saturate_s16(int32_t v)
+{
+	if (v > 32767)
+		return 32767;
+	if (v < -32768)
+		return -32768;
+
+	return (int16_t)v;
+}
+
+
+/* Select the loudest speakers, without sorting all participants */
+static void select_speakers(struct mixer *mix)
+{
+	struct participant *top[SPEAKERS_MAX];
+	unsigned i, quietest, n = 0;
+	unsigned k = min(n_speakers, (uint32_t)SPEAKERS_MAX);
+	struct le *le;
+
+	for (le = mix->partl.head; le; le = le->next) {
+
+		struct participant *part = le->data;
+
+		part->speaker = false;
+
+		if (!part->joined)
+			continue;
+
+		if (n < k) {
+			top[n++] = part;
+			continue;
+		}
+
+		/* replace the quietest of the current speakers */
+		quietest = 0;
+		for (i=1; i<n; i++) {
+			if (top[i]->level < top[quietest]->level)
+				quietest = i;
+		}
+
+		if (part->level > top[quietest]->level)
+			top[quietest] = part;
+	}
+
+	for (i=0; i<n; i++)
+		top[i]->speaker = true;
+}
+
+
+static void mixer_tick(struct mixer *mix)
+{
+	struct le *le;
+	size_t i;
+
+	select_speakers(mix);
+
+	memset(mix->total, 0, mix->sampc * sizeof(*mix->total));
+
+	for (le = mix->partl.head; le; le = le->next) {
+
+		struct participant *part = le->data;
+
+		if (!part->joined)
+			continue;
+
+		aubuf_read_samp(part->inbuf, part->frame, mix->sampc);
+
+		if (!part->speaker)
+			continue;
+
+		for (i=0; i<mix->sampc; i++)
+			mix->total[i] += part->frame[i];
+	}
+
+	/* the mix for all listeners is the same, compute it only once */
+	for (i=0; i<mix->sampc; i++)
+		mix->out[i] = saturate_s16(mix->total[i]);
+
+	for (le = mix->partl.head; le; le = le->next) {
+
+		struct participant *part = le->data;
+
+		if (!part->joined)
+			continue;
+
+		if (!part->speaker) {
+			(void)aubuf_write_samp(part->outbuf, mix->out,
+					       mix->sampc);
+			continue;
+		}
+
+		/* total minus self */
+		for (i=0; i<mix->sampc; i++) {
+			part->frame[i] = saturate_s16(mix->total[i] -
+						      part->frame[i]);
+		}
+
+		(void)aubuf_write_samp(part->outbuf, part->frame, mix->sampc);
+	}
+}
+
+
+static void *mixer_thread(void *arg)
+{
+	struct mixer *mix = arg;
+	struct timespec ts;
+	uint64_t ns;
+
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+
+	pthread_mutex_lock(&mix->mutex);
+
+	while (mix->run) {
+
+		/* sleep until the next tick, or until the mixer stops */
+		if (ETIMEDOUT != pthread_cond_timedwait(&mix->cond,
+							&mix->mutex, &ts))
+			continue;
+
+		pthread_mutex_unlock(&mix->mutex);
+
+		lock_write_get(mix->lock);
+		mixer_tick(mix);
+		lock_rel(mix->lock);
+
+		/* a late tick is caught up by the next wait */
+		ns = ts.tv_nsec + (uint64_t)PTIME * 1000000;
+		ts.tv_sec  += ns / 1000000000;
+		ts.tv_nsec  = ns % 1000000000;
+
+		pthread_mutex_lock(&mix->mutex);
+	}
+
+	pthread_mutex_unlock(&mix->mutex);
+
+	return NULL;
+}
+
+
+static int mixer_get(struct mixer **mixp)
+{
+	struct mixer *mix;
+	int err;
+
+	if (mixer) {
+		*mixp = mem_ref(mixer);
+		return 0;
+	}
+
+	mix = mem_zalloc(sizeof(*mix), mixer_destructor);
+	if (!mix)
+		return ENOMEM;
+
+	pthread_mutex_init(&mix->mutex, NULL);
+	pthread_cond_init(&mix->cond, NULL);
+
+	err = lock_alloc(&mix->lock);
+	if (err)
+		goto out;
+
+	mixer = mix;
+
+ out:
+	if (err)
+		mem_deref(mix);
+	else
+		*mixp = mix;
+
+	return err;
+}
+
+
+static void part_destructor(void *arg)
+{
+	struct participant *part = arg;
+
+	if (mixer) {
+		lock_write_get(mixer->lock);
+		list_unlink(&part->le);
+		lock_rel(mixer->lock);
+	}
+
+	mem_deref(part->inbuf);
+	mem_deref(part->outbuf);
+	mem_deref(part->frame);
+
+	/* the mixer is referenced by each participant */
+	mem_deref(mixer);
+}
+
+
+/* The first participant decides the format of the conference */
+static int mixer_join(struct mixer *mix, struct participant *part)
+{
+	int err = 0;
+
+	lock_write_get(mix->lock);
+
+	if (!mix->srate) {
+
+		mix->srate = part->srate;
+		mix->ch    = part->ch;
+		mix->sampc = mix->srate * mix->ch * PTIME / 1000;
+
+		mix->total = mem_zalloc(mix->sampc * sizeof(*mix->total),
+					NULL);
+		mix->out   = mem_zalloc(mix->sampc * sizeof(*mix->out),
+					NULL);
+		if (!mix->total || !mix->out) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		mix->run = true;
+		err = pthread_create(&mix->thread, NULL, mixer_thread, mix);
+		if (err) {
+			mix->run = false;
+			goto out;
+		}
+	}
+
+	if (part->srate != mix->srate || part->ch != mix->ch) {
+		warning("auconf: participant format %uHz/%uch does not"
+			" match conference %uHz/%uch\n",
+			part->srate, part->ch, mix->srate, mix->ch);
+		err = ENOTSUP;
+		goto out;
+	}
+
+	part->frame = mem_zalloc(mix->sampc * sizeof(int16_t), NULL);
+	if (!part->frame) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = aubuf_alloc(&part->inbuf, 0, BUF_FRAMES * mix->sampc * 2);
+	err |= aubuf_alloc(&part->outbuf, 0, BUF_FRAMES * mix->sampc * 2);
+	if (err)
+		goto out;
+
+	part->level  = -127.0;
+	part->joined = true;
+
+ out:
+	list_append(&mix->partl, &part->le, part);
+	lock_rel(mix->lock);
+
+	if (!err) {
+		info("auconf: %u participants\n", list_count(&mix->partl));
+	}
+
+	return err;
+}
+
+
+static int part_alloc(struct participant **partp, void **ctx,
+		      const struct aufilt_prm *prm)
+{
+	struct participant *part;
+	struct mixer *mix;
+	int err;
+
+	if (!partp || !ctx || !prm)
+		return EINVAL;
+
+	if (*ctx) {
+		*partp = mem_ref(*ctx);
+		return 0;
+	}
+
+	err = mixer_get(&mix);
+	if (err)
+		return err;
+
+	part = mem_zalloc(sizeof(*part), part_destructor);
+	if (!part) {
+		mem_deref(mix);
+		return ENOMEM;
+	}
+
+	part->au    = prm->au;
+	part->srate = prm->srate;
+	part->ch    = prm->ch;
+
+	/* a participant with another format is not mixed */
+	(void)mixer_join(mix, part);
+
+	*ctx = *partp = part;
+
+	return 0;
+}
+
+
+static void enc_destructor(void *arg)
+{
+	struct enc_st *st = arg;
+
+	list_unlink(&st->af.le);
+	mem_deref(st->part);
+}
+
+
+static void dec_destructor(void *arg)
+{
+	struct dec_st *st = arg;
+
+	list_unlink(&st->af.le);
+	mem_deref(st->part);
+}
+
+
+static int encode_update(struct aufilt_enc_st **stp, void **ctx,
+			 const struct aufilt *af, struct aufilt_prm *prm)
+{
+	struct enc_st *st;
+	int err;
+
+	if (!stp || !ctx || !af || !prm)
+		return EINVAL;
+
+	if (*stp)
+		return 0;
+
+	st = mem_zalloc(sizeof(*st), enc_destructor);
+	if (!st)
+		return ENOMEM;
+
+	err = part_alloc(&st->part, ctx, prm);
+	if (err)
+		mem_deref(st);
+	else
+		*stp = (struct aufilt_enc_st *)st;
+
+	return err;
+}
+
+
+static int decode_update(struct aufilt_dec_st **stp, void **ctx,
+			 const struct aufilt *af, struct aufilt_prm *prm)
+{
+	struct dec_st *st;
+	int err;
+
+	if (!stp || !ctx || !af || !prm)
+		return EINVAL;
+
+	if (*stp)
+		return 0;
+
+	st = mem_zalloc(sizeof(*st), dec_destructor);
+	if (!st)
+		return ENOMEM;
+
+	err = part_alloc(&st->part, ctx, prm);
+	if (err)
+		mem_deref(st);
+	else
+		*stp = (struct aufilt_dec_st *)st;
+
+	return err;
+}
+
+
+/* Replace the outgoing audio with the mix of the other participants */
+static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
+{
+	struct enc_st *est = (struct enc_st *)st;
+
+	if (!st || !sampv || !sampc)
+		return EINVAL;
+
+	if (est->part->joined)
+		aubuf_read_samp(est->part->outbuf, sampv, *sampc);
+
+	return 0;
+}
+
+
+static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
+{
+	struct dec_st *dst = (struct dec_st *)st;
+	struct participant *part;
+	struct aulevel lvl;
+	double level;
+	int err;
+
+	if (!st || !sampv || !sampc)
+		return EINVAL;
+
+	part = dst->part;
+
+	if (!part->joined)
+		return 0;
+
+	/* the level is read in the receive thread, from the RTP header
+	 * extension if present, otherwise from the last played frame */
+	err = audio_level_get(part->au, &level);
+	if (err && 0 == audio_level_frame(part->au, false, &lvl)) {
+		level = aulevel_dbov(&lvl);
+		err = 0;
+	}
+
+	/* the mixer is referenced by each participant */
+	if (!err) {
+		lock_write_get(mixer->lock);
+		part->level = level;
+		lock_rel(mixer->lock);
+	}
+
+	return aubuf_write_samp(part->inbuf, sampv, *sampc);
+}
+
+
+static struct aufilt auconf = {
+	LE_INIT, "auconf", encode_update, encode, decode_update, decode
+};
+
+
+static int module_init(void)
+{
+	(void)conf_get_u32(conf_cur(), "auconf_speakers", &n_speakers);
+
+	if (n_speakers < 1 || n_speakers > SPEAKERS_MAX) {
+		warning("auconf: speakers must be 1-%u\n", SPEAKERS_MAX);
+		return EINVAL;
+	}
+
+	aufilt_register(baresip_aufiltl(), &auconf);
+
+	return 0;
+}
+
+
+static int module_close(void)
+{
+	aufilt_unregister(&auconf);
+
+	return 0;
+}
+
+
+EXPORT_SYM const struct mod_export DECL_EXPORTS(auconf) = {
+	"auconf",
+	"filter",
+	module_init,
+	module_close
+};
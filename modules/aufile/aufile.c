@@ -6,6 +6,7 @@
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
 #include <pthread.h>
+#include <string.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -21,8 +22,8 @@
 struct ausrc_st {
 	const struct ausrc *as;  /* base class */
 	struct tmr tmr;
-	struct aufile *aufile;
-	struct aubuf *aubuf;
+	struct mbuf *mb;         /* decoded file, shared read-only */
+	size_t pos;
 	uint32_t ptime;
 	size_t sampc;
 	bool run;
@@ -47,8 +48,7 @@ static void destructor(void *arg)
 
 	tmr_cancel(&st->tmr);
 
-	mem_deref(st->aufile);
-	mem_deref(st->aubuf);
+	mem_deref(st->mb);
 }
 
 
@@ -57,6 +57,7 @@ static void *play_thread(void *arg)
 	uint64_t now, ts = tmr_jiffies();
 	struct ausrc_st *st = arg;
 	int16_t *sampv;
+	size_t n;
 
 	sampv = mem_alloc(st->sampc * 2, NULL);
 	if (!sampv)
@@ -71,7 +72,12 @@ static void *play_thread(void *arg)
 		if (ts > now)
 			continue;
 
-		aubuf_read_samp(st->aubuf, sampv, st->sampc);
+		n = min(st->sampc * 2, st->mb->end - st->pos);
+
+		memcpy(sampv, st->mb->buf + st->pos, n);
+		memset((uint8_t *)sampv + n, 0, st->sampc * 2 - n);
+
+		st->pos += n;
 
 		st->rh(sampv, st->sampc, st->arg);
 
@@ -92,8 +98,8 @@ static void timeout(void *arg)
 
 	tmr_start(&st->tmr, 1000, timeout, st);
 
-	/* check if audio buffer is empty */
-	if (aubuf_cur_size(st->aubuf) < (2 * st->sampc)) {
+	/* check if all samples have been read */
+	if (st->mb->end - st->pos < (2 * st->sampc)) {
 
 		info("aufile: end of file\n");
 
@@ -104,55 +110,14 @@ static void timeout(void *arg)
 }
 
 
-static int read_file(struct ausrc_st *st)
-{
-	struct mbuf *mb;
-	int err;
-
-	for (;;) {
-		uint16_t *sampv;
-		size_t i;
-
-		mb = mbuf_alloc(4096);
-		if (!mb)
-			return ENOMEM;
-
-		mb->end = mb->size;
-
-		err = aufile_read(st->aufile, mb->buf, &mb->end);
-		if (err)
-			break;
-
-		if (mb->end == 0) {
-			info("aufile: end of file\n");
-			break;
-		}
-
-		/* convert from Little-Endian to Native-Endian */
-		sampv = (void *)mb->buf;
-		for (i=0; i<mb->end/2; i++) {
-			sampv[i] = sys_ltohs(sampv[i]);
-		}
-
-		aubuf_append(st->aubuf, mb);
-
-		mb = mem_deref(mb);
-	}
-
-	info("aufile: loaded %zu bytes\n", aubuf_cur_size(st->aubuf));
-
-	mem_deref(mb);
-	return err;
-}
-
-
 static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 			 struct media_ctx **ctx,
 			 struct ausrc_prm *prm, const char *dev,
 			 ausrc_read_h *rh, ausrc_error_h *errh, void *arg)
 {
 	struct ausrc_st *st;
-	struct aufile_prm fprm;
+	uint32_t srate = 0;
+	uint8_t ch = 0;
 	int err;
 	(void)ctx;
 
@@ -176,52 +141,36 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 	st->errh = errh;
 	st->arg  = arg;
 
-	err = aufile_open(&st->aufile, &fprm, dev, AUFILE_READ);
+	/* the decoded file is shared by all sources playing it */
+	err = play_cache_get(baresip_player(), &st->mb,
+			     &srate, &ch, dev);
 	if (err) {
 		warning("aufile: failed to open file '%s' (%m)\n", dev, err);
 		goto out;
 	}
 
-	info("aufile: %s: %u Hz, %d channels\n",
-	     dev, fprm.srate, fprm.channels);
+	info("aufile: %s: %u Hz, %d channels, %zu bytes\n",
+	     dev, srate, ch, st->mb->end);
 
-	if (fprm.srate != prm->srate) {
+	if (srate != prm->srate) {
 		warning("aufile: input file (%s) must have sample-rate"
 			" %u Hz\n", dev, prm->srate);
 		err = ENODEV;
 		goto out;
 	}
-	if (fprm.channels != prm->ch) {
+	if (ch != prm->ch) {
 		warning("aufile: input file (%s) must have channels = %d\n",
 			dev, prm->ch);
 		err = ENODEV;
 		goto out;
 	}
-	if (fprm.fmt != AUFMT_S16LE) {
-		warning("aufile: input file must have format S16LE\n");
-		err = ENODEV;
-		goto out;
-	}
 
 	st->sampc = prm->srate * prm->ch * prm->ptime / 1000;
 
 	st->ptime = prm->ptime;
 
-	info("aufile: audio ptime=%u sampc=%zu aubuf=[%u:%u]\n",
-	     st->ptime, st->sampc,
-	     prm->srate * prm->ch * 2,
-	     prm->srate * prm->ch * 40);
-
-	/* 1 - inf seconds of audio */
-	err = aubuf_alloc(&st->aubuf,
-			  prm->srate * prm->ch * 2,
-			  0);
-	if (err)
-		goto out;
-
-	err = read_file(st);
-	if (err)
-		goto out;
+	info("aufile: audio ptime=%u sampc=%zu\n",
+	     st->ptime, st->sampc);
 
 	tmr_start(&st->tmr, 1000, timeout, st);
 
@@ -336,13 +336,14 @@ static void destructor(void* arg)
 }
 
 
-static int module_init(void)
+/*
+ * The Avahi client connects to the system D-Bus, which can take a
+ * while. Do it from the main loop, so that it does not delay startup.
+ */
+static void avahi_start(void* arg)
 {
 	int err;
-	avahi = mem_zalloc(sizeof(struct avahi_st), destructor);
-	if (!avahi) {
-		return ENOMEM;
-	}
+	(void)arg;
 
 	avahi->poll = avahi_simple_poll_new();
 	avahi->client = avahi_client_new(
@@ -352,20 +353,31 @@ static int module_init(void)
 	/* Check wether creating the client object succeeded */
 	if (!avahi->client) {
 		warning("Failed to create client: %s\n", avahi_strerror(err));
-		return err;
+		return;
 	}
 
 	avahi->browser = avahi_service_browser_new(avahi->client,
 		AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, "_sipuri._udp", NULL,
 		0, browse_callback, 0);
 
-	tmr_init(&avahi->poll_timer);
 	avahi_update(0);
 
 	/* Register services when UA is ready */
 	if (!avahi->group) {
 		create_services(avahi->client);
 	}
+}
+
+
+static int module_init(void)
+{
+	avahi = mem_zalloc(sizeof(struct avahi_st), destructor);
+	if (!avahi) {
+		return ENOMEM;
+	}
+
+	tmr_init(&avahi->poll_timer);
+	tmr_start(&avahi->poll_timer, 0, avahi_start, 0);
 
 	return 0;
 }
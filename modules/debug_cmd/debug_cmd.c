@@ -98,17 +98,27 @@ static int cmd_play_file(struct re_printf *pf, void *arg)
 }
 
 
+static int cmd_play_cache(struct re_printf *pf, void *unused)
+{
+	(void)unused;
+	return play_cache_debug(pf, baresip_player());
+}
+
+
 static const struct cmd debugcmdv[] = {
 {"main",     0,       0, "Main loop debug",          re_debug             },
 {"config",   0,       0, "Print configuration",      cmd_config_print     },
 {"sipstat", 'i',      0, "SIP debug",                ua_print_sip_status  },
 {"modules",  0,       0, "Module debug",             mod_debug            },
+{"modtime",  0,       0, "Module load time",         module_print_timing  },
 {"netstat", 'n',      0, "Network debug",            cmd_net_debug        },
 {"sysinfo", 's',      0, "System info",              print_system_info    },
 {"timers",   0,       0, "Timer debug",              tmr_status           },
 {"uastat",  'u',      0, "UA debug",                 cmd_ua_debug         },
 {"memstat", 'y',      0, "Memory status",            mem_status           },
+{"callmem",  0,       0, "Memory used by calls",     ua_print_memory      },
 {"play",     0, CMD_PRM, "Play audio file",          cmd_play_file        },
+{"playcache", 0,      0, "Audio file cache",         cmd_play_cache       },
 };
 
 
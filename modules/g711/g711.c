@@ -29,8 +29,7 @@ static int pcmu_encode(struct auenc_state *aes, uint8_t *buf,
 
 	*len = sampc;
 
-	while (sampc--)
-		*buf++ = g711_pcm2ulaw(*sampv++);
+	g711_ulaw_enc(buf, sampv, sampc);
 
 	return 0;
 }
@@ -49,8 +48,7 @@ static int pcmu_decode(struct audec_state *ads, int16_t *sampv,
 
 	*sampc = len;
 
-	while (len--)
-		*sampv++ = g711_ulaw2pcm(*buf++);
+	g711_ulaw_dec(sampv, buf, len);
 
 	return 0;
 }
@@ -69,8 +67,7 @@ static int pcma_encode(struct auenc_state *aes, uint8_t *buf,
 
 	*len = sampc;
 
-	while (sampc--)
-		*buf++ = g711_pcm2alaw(*sampv++);
+	g711_alaw_enc(buf, sampv, sampc);
 
 	return 0;
 }
@@ -89,8 +86,7 @@ static int pcma_decode(struct audec_state *ads, int16_t *sampv,
 
 	*sampc = len;
 
-	while (len--)
-		*sampv++ = g711_alaw2pcm(*buf++);
+	g711_alaw_dec(sampv, buf, len);
 
 	return 0;
 }
@@ -367,6 +367,27 @@ static void gst_destructor(void *arg)
 }
 
 
+/*
+ * gst_init() loads the Gstreamer plugin registry, which is slow.
+ * Do it when the first source is opened instead of at module load.
+ */
+static void gst_lazy_init(void)
+{
+	gchar *s;
+
+	if (gst_is_initialized())
+		return;
+
+	gst_init(0, NULL);
+
+	s = gst_version_string();
+
+	info("gst: init: %s\n", s);
+
+	g_free(s);
+}
+
+
 static int gst_alloc(struct ausrc_st **stp, const struct ausrc *as,
 		     struct media_ctx **ctx,
 		     struct ausrc_prm *prm, const char *device,
@@ -389,6 +410,8 @@ static int gst_alloc(struct ausrc_st **stp, const struct ausrc *as,
 		return ENOTSUP;
 	}
 
+	gst_lazy_init();
+
 	st = mem_zalloc(sizeof(*st), gst_destructor);
 	if (!st)
 		return ENOMEM;
@@ -434,23 +457,14 @@ static int gst_alloc(struct ausrc_st **stp, const struct ausrc *as,
 
 static int mod_gst_init(void)
 {
-	gchar *s;
-
-	gst_init(0, NULL);
-
-	s = gst_version_string();
-
-	info("gst: init: %s\n", s);
-
-	g_free(s);
-
 	return ausrc_register(&ausrc, baresip_ausrcl(), "gst", gst_alloc);
 }
 
 
 static int mod_gst_close(void)
 {
-	gst_deinit();
+	if (gst_is_initialized())
+		gst_deinit();
 	ausrc = mem_deref(ausrc);
 	return 0;
 }
@@ -423,6 +423,17 @@ int gst_video1_encoder_set(struct videnc_state **stp,
 		return EINVAL;
 
 	if (!st) {
+		/* Gstreamer is initialised on first use, see module_init */
+		if (!gst_is_initialized()) {
+			gchar *s;
+
+			gst_init(NULL, NULL);
+
+			s = gst_version_string();
+			info("gst_video: using gstreamer (%s)\n", s);
+			g_free(s);
+		}
+
 		err = allocate_resources(stp);
 		if (err) {
 			warning("gst_video: resource allocation failed\n");
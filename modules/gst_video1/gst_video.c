@@ -36,14 +36,14 @@ static struct vidcodec h264 = {
 };
 
 
+/*
+ * Loading the Gstreamer plugin registry is slow, so gst_init() is
+ * deferred until the first encoder is created.
+ */
 static int module_init(void)
 {
-	gst_init(NULL, NULL);
-
 	vidcodec_register(baresip_vidcodecl(), &h264);
 
-	info("gst_video: using gstreamer (%s)\n", gst_version_string());
-
 	return 0;
 }
 
@@ -52,7 +52,8 @@ static int module_close(void)
 {
 	vidcodec_unregister(&h264);
 
-	gst_deinit();
+	if (gst_is_initialized())
+		gst_deinit();
 
 	return 0;
 }
@@ -14,7 +14,7 @@ struct auplay_st {
 	const struct auplay *ap;  /* pointer to base-class (inheritance) */
 
 	struct auplay_prm prm;
-	int16_t *sampv;
+	void *sampv;              /* in the format of prm.fmt */
 	size_t sampc;             /* includes number of channels */
 	auplay_write_h *wh;
 	void *arg;
@@ -39,33 +39,41 @@ static inline float ausamp_short2float(int16_t in)
  * The process callback for this JACK application is called in a
  * special realtime thread once for each audio cycle.
  *
- * This client does nothing more than copy data from its input
- * port to its output port. It will exit when stopped by
- * the user (e.g. using Ctrl-C on a unix-ish operating system)
- *
- * XXX avoid memory allocations in this function
+ * This client does nothing more than copy data from the application
+ * to its output ports. With the float sample format, the samples are
+ * not converted.
  */
 static int process_handler(jack_nframes_t nframes, void *arg)
 {
 	struct auplay_st *st = arg;
-	size_t sampc = nframes * st->prm.ch;
+	const size_t nch = st->prm.ch;
+	size_t sampc = nframes * nch;
 	size_t ch, j;
 
-	/* 1. read data from app (signed 16-bit) interleaved */
+	/* 1. read data from app, interleaved */
 	st->wh(st->sampv, sampc, st->arg);
 
-	/* 2. convert from 16-bit to float and copy to Jack */
-
-	/* 3. de-interleave [LRLRLRLR] -> [LLLLL]+[RRRRR] */
-	for (ch = 0; ch < st->prm.ch; ch++) {
+	/* 2. de-interleave [LRLRLRLR] -> [LLLLL]+[RRRRR] */
+	for (ch = 0; ch < nch; ch++) {
 
 		jack_default_audio_sample_t *buffer;
 
 		buffer = jack_port_get_buffer(st->portv[ch], st->nframes);
 
-		for (j = 0; j < nframes; j++) {
-			int16_t samp = st->sampv[j*st->prm.ch + ch];
-			buffer[j] = ausamp_short2float(samp);
+		/* 3. copy float as it is, or convert from 16-bit */
+		if (st->prm.fmt == AUFMT_FLOAT) {
+			const float *sampv = st->sampv;
+
+			for (j = 0; j < nframes; j++)
+				buffer[j] = sampv[j*nch + ch];
+		}
+		else {
+			const int16_t *sampv = st->sampv;
+
+			for (j = 0; j < nframes; j++) {
+				int16_t samp = sampv[j*nch + ch];
+				buffer[j] = ausamp_short2float(samp);
+			}
 		}
 	}
 
@@ -201,7 +209,7 @@ int jack_play_alloc(struct auplay_st **stp, const struct auplay *ap,
 	if (prm->ch > ARRAY_SIZE(st->portv))
 		return EINVAL;
 
-	if (prm->fmt != AUFMT_S16LE) {
+	if (prm->fmt != AUFMT_S16LE && prm->fmt != AUFMT_FLOAT) {
 		warning("jack: playback: unsupported sample format (%s)\n",
 			aufmt_name(prm->fmt));
 		return ENOTSUP;
@@ -221,13 +229,13 @@ int jack_play_alloc(struct auplay_st **stp, const struct auplay *ap,
 		goto out;
 
 	st->sampc = st->nframes * prm->ch;
-	st->sampv = mem_alloc(st->sampc * sizeof(int16_t), NULL);
+	st->sampv = mem_alloc(st->sampc * aufmt_sample_size(prm->fmt), NULL);
 	if (!st->sampv) {
 		err = ENOMEM;
 		goto out;
 	}
 
-	info("jack: sampc=%zu\n", st->sampc);
+	info("jack: sampc=%zu (%s)\n", st->sampc, aufmt_name(prm->fmt));
 
  out:
 	if (err)
@@ -15,7 +15,7 @@ struct ausrc_st {
 	const struct ausrc *as;  /* pointer to base-class (inheritance) */
 
 	struct ausrc_prm prm;
-	int16_t *sampv;
+	void *sampv;              /* in the format of prm.fmt */
 	size_t sampc;             /* includes number of channels */
 	ausrc_read_h *rh;
 	void *arg;
@@ -46,29 +46,43 @@ static inline int16_t ausamp_float2short(float in)
 }
 
 
+/*
+ * The process callback runs in the realtime thread of JACK. It only
+ * interleaves the samples and hands them to the application. Use
+ * "audio_txmode thread" to encode in a separate thread.
+ */
 static int process_handler(jack_nframes_t nframes, void *arg)
 {
 	struct ausrc_st *st = arg;
-	size_t sampc = nframes * st->prm.ch;
+	const size_t nch = st->prm.ch;
+	size_t sampc = nframes * nch;
 	size_t ch, j;
 
-	/* 2. convert from 16-bit to float and copy to Jack */
-
-	/* 3. de-interleave [LRLRLRLR] -> [LLLLL]+[RRRRR] */
-	for (ch = 0; ch < st->prm.ch; ch++) {
+	/* 1. interleave [LLLLL]+[RRRRR] -> [LRLRLRLR] */
+	for (ch = 0; ch < nch; ch++) {
 
 		const jack_default_audio_sample_t *buffer;
 
 		buffer = jack_port_get_buffer(st->portv[ch], st->nframes);
 
-		for (j = 0; j < nframes; j++) {
-			int16_t samp;
-			samp = ausamp_float2short(buffer[j]);
-			st->sampv[j*st->prm.ch + ch] = samp;
+		/* 2. float is passed on as it is, or converted to 16-bit */
+		if (st->prm.fmt == AUFMT_FLOAT) {
+			float *sampv = st->sampv;
+
+			for (j = 0; j < nframes; j++)
+				sampv[j*nch + ch] = buffer[j];
+		}
+		else {
+			int16_t *sampv = st->sampv;
+
+			for (j = 0; j < nframes; j++) {
+				int16_t samp = ausamp_float2short(buffer[j]);
+				sampv[j*nch + ch] = samp;
+			}
 		}
 	}
 
-	/* 1. read data from app (signed 16-bit) interleaved */
+	/* 3. write data to app, interleaved */
 	st->rh(st->sampv, sampc, st->arg);
 
 	return 0;
@@ -196,7 +210,7 @@ int jack_src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 	if (prm->ch > ARRAY_SIZE(st->portv))
 		return EINVAL;
 
-	if (prm->fmt != AUFMT_S16LE) {
+	if (prm->fmt != AUFMT_S16LE && prm->fmt != AUFMT_FLOAT) {
 		warning("jack: source: unsupported sample format (%s)\n",
 			aufmt_name(prm->fmt));
 		return ENOTSUP;
@@ -216,13 +230,14 @@ int jack_src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 		goto out;
 
 	st->sampc = st->nframes * prm->ch;
-	st->sampv = mem_alloc(st->sampc * sizeof(int16_t), NULL);
+	st->sampv = mem_alloc(st->sampc * aufmt_sample_size(prm->fmt), NULL);
 	if (!st->sampv) {
 		err = ENOMEM;
 		goto out;
 	}
 
-	info("jack: source sampc=%zu\n", st->sampc);
+	info("jack: source sampc=%zu (%s)\n", st->sampc,
+	     aufmt_name(prm->fmt));
 
  out:
 	if (err)
@@ -490,6 +490,29 @@ static int call_audioenc_cycle(struct re_printf *pf, void *unused)
 }
 
 
+static int call_audio_ptime(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	struct audio *audio = call_audio(ua_call(uag_cur()));
+	uint32_t ptime = 0;
+	int err;
+
+	if (str_isset(carg->prm))
+		ptime = atoi(carg->prm);
+
+	err = audio_set_ptime(audio, ptime);
+	if (err) {
+		return re_hprintf(pf, "could not set ptime %u ms (%m)\n",
+				  ptime, err);
+	}
+
+	if (ptime)
+		return re_hprintf(pf, "audio ptime: %u ms\n", ptime);
+	else
+		return re_hprintf(pf, "audio ptime: automatic\n");
+}
+
+
 static int call_reinvite(struct re_printf *pf, void *unused)
 {
 	(void)pf;
@@ -779,6 +802,7 @@ static const struct cmd callcmdv[] = {
 {"resume",    'X',        0, "Call resume",         cmd_call_resume       },
 {"audio_debug",'A',       0, "Audio stream",        call_audio_debug      },
 {"audio_cycle",'e',       0, "Cycle audio encoder", call_audioenc_cycle   },
+{"audio_ptime",0,  CMD_PRM, "Audio packet time",   call_audio_ptime      },
 {"mute",      'm',        0, "Call mute/un-mute",   call_mute             },
 {"transfer",  't', CMD_IPRM, "Transfer call",       call_xfer             },
 {"hold",      'x',        0, "Call hold",           cmd_call_hold         },
@@ -50,15 +50,13 @@ int mpa_encode_update(struct auenc_state **aesp, const struct aucodec *ac,
 	if (!aesp || !ac || !ac->ch)
 		return EINVAL;
 
-	aes = *aesp;
-	if (!aes) {
-		aes = mem_zalloc(sizeof(*aes), destructor);
-		if (!aes)
-			return ENOMEM;
+	/* the encoder has a fixed bitrate, there is nothing to update */
+	if (*aesp)
+		return 0;
 
-	}
-	else
-		memset(aes,0,sizeof(*aes));
+	aes = mem_zalloc(sizeof(*aes), destructor);
+	if (!aes)
+		return ENOMEM;
 
 	aes->enc = twolame_init();
 	if (!aes->enc) {
@@ -74,8 +74,6 @@ int opus_encode_update(struct auenc_state **aesp, const struct aucodec *ac,
 	opus_int32 fch, vbr;
 	const struct aucodec *auc = ac;
 
-	(void)param;
-
 	if (!aesp || !ac || !ac->ch)
 		return EINVAL;
 
@@ -131,6 +129,15 @@ int opus_encode_update(struct auenc_state **aesp, const struct aucodec *ac,
 	     (conf_prm.bitrate < prm.bitrate)))
 		prm.bitrate = conf_prm.bitrate;
 
+	/* limits from the adaptive encoder control */
+	if (param && param->bitrate &&
+	    (prm.bitrate == OPUS_AUTO ||
+	     (opus_int32)param->bitrate < prm.bitrate))
+		prm.bitrate = param->bitrate;
+
+	if (param && param->pkt_loss)
+		prm.inband_fec = 1;
+
 	fch = prm.stereo ? OPUS_AUTO : 1;
 	vbr = prm.cbr ? 0 : 1;
 
@@ -142,6 +149,16 @@ int opus_encode_update(struct auenc_state **aesp, const struct aucodec *ac,
 	(void)opus_encoder_ctl(aes->enc, OPUS_SET_INBAND_FEC(prm.inband_fec));
 	(void)opus_encoder_ctl(aes->enc, OPUS_SET_DTX(prm.dtx));
 
+	if (param) {
+		(void)opus_encoder_ctl(aes->enc,
+				OPUS_SET_PACKET_LOSS_PERC(param->pkt_loss));
+
+		if (param->complexity) {
+			(void)opus_encoder_ctl(aes->enc,
+				OPUS_SET_COMPLEXITY(param->complexity));
+		}
+	}
+
 
 #if 0
 	{
@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re.h>
 #include <baresip.h>
 #include "presence.h"
@@ -13,13 +14,21 @@
  *
  * For each entry in the address book marked with ;presence=p2p,
  * we send a SUBSCRIBE to that person, and expect to receive
- * a NOTIFY when her status changes.
+ * a NOTIFY when her status changes. The initial SUBSCRIBEs are
+ * spread out in time, at most presence_sub_rate per second.
+ *
+ * If presence_rls is set, a single SUBSCRIBE is sent to that
+ * resource list (RFC 4662) instead, and the status of all contacts
+ * is received as multipart/related NOTIFYs.
  */
 
 
 /** Constants */
 enum {
-	SHUTDOWN_DELAY = 500  /**< Delay before un-registering [ms] */
+	SHUTDOWN_DELAY = 500,   /**< Delay before un-registering [ms]   */
+	STARTUP_DELAY  = 1000,  /**< Delay before first SUBSCRIBE [ms]  */
+	SUB_EXPIRES    = 600,   /**< Subscription expiry [s]            */
+	SUB_RATE       = 50,    /**< Default SUBSCRIBE rate [1/s]       */
 };
 
 
@@ -30,11 +39,15 @@ struct presence {
 	enum presence_status status;
 	unsigned failc;
 	struct contact *contact;
+	char *rls;              /**< Resource list URI, or NULL */
 	struct ua *ua;
 	bool shutdown;
 };
 
 static struct list presencel;
+static uint32_t sub_rate = SUB_RATE;
+static uint64_t slot_next;
+static bool use_rls;
 
 
 static void tmr_handler(void *arg);
@@ -81,13 +94,166 @@ static uint32_t wait_fail(unsigned failc)
 }
 
 
+static enum presence_status pidf_status(const struct pl *body)
+{
+	enum presence_status status = PRESENCE_CLOSED;
+	struct pl pl;
+
+	if (!re_regex(body->p, body->l,
+		      "<basic[ \t]*>[^<]+</basic[ \t]*>", NULL, &pl, NULL)) {
+	    if (!pl_strcasecmp(&pl, "open"))
+		status = PRESENCE_OPEN;
+	}
+
+	if (!re_regex(body->p, body->l, "<rpid:away[ \t]*/>", NULL)) {
+
+		status = PRESENCE_CLOSED;
+	}
+	else if (!re_regex(body->p, body->l, "<rpid:busy[ \t]*/>", NULL)) {
+
+		status = PRESENCE_BUSY;
+	}
+	else if (!re_regex(body->p, body->l,
+			   "<rpid:on-the-phone[ \t]*/>", NULL)) {
+
+		status = PRESENCE_BUSY;
+	}
+
+	return status;
+}
+
+
+/* Update the contact given by the entity of a PIDF document */
+static void pidf_entity_update(const struct pl *body)
+{
+	struct contact *contact;
+	struct pl entity;
+	char uri[256];
+
+	if (re_regex(body->p, body->l, "entity=\"[^\"]+\"", &entity))
+		return;
+
+	/* RFC 3859 pres: URI maps to the SIP URI of the contact */
+	if (!re_regex(entity.p, entity.l, "^pres:[^]+", &entity)) {
+		if (re_snprintf(uri, sizeof(uri), "sip:%r", &entity) < 0)
+			return;
+	}
+	else {
+		pl_strcpy(&entity, uri, sizeof(uri));
+	}
+
+	contact = contact_find(baresip_contacts(), uri);
+	if (!contact) {
+		debug("presence: rls: unknown resource <%s>\n", uri);
+		return;
+	}
+
+	contact_set_presence(contact, pidf_status(body));
+}
+
+
+/*
+ * Find the next delimiter "--boundary" in a multipart body, and get
+ * what follows it. The boundary is compared as it is, since it may
+ * contain characters that have a meaning in a regular expression.
+ */
+static int next_delim(struct pl *rest, const struct pl *pl,
+		      const struct pl *bnd)
+{
+	size_t i;
+
+	for (i=0; i + 2 + bnd->l <= pl->l; i++) {
+
+		if (pl->p[i] != '-' || pl->p[i+1] != '-')
+			continue;
+
+		if (memcmp(pl->p + i + 2, bnd->p, bnd->l))
+			continue;
+
+		rest->p = pl->p + i + 2 + bnd->l;
+		rest->l = pl->l - i - 2 - bnd->l;
+
+		return 0;
+	}
+
+	return ENOENT;
+}
+
+
+/*
+ * Decode a multipart/related RLMI document (RFC 4662) and update
+ * all contacts that have a PIDF part
+ */
+static int rls_decode(const struct pl *ctype_prm, const struct pl *body)
+{
+	struct pl bnd, s, e, p;
+	int err;
+
+	err = re_regex(ctype_prm->p, ctype_prm->l,
+		       "boundary=[\"]*[^\";]+", NULL, &bnd);
+	if (err)
+		return err;
+
+	/* find 1st boundary */
+	err = next_delim(&s, body, &bnd);
+	if (err)
+		return err;
+
+	/* iterate over each part */
+	while (s.l >= 2) {
+		struct pl hdrs, ctype;
+		size_t i;
+
+		/* close delimiter */
+		if (s.p[0] == '-' && s.p[1] == '-')
+			break;
+
+		/* a delimiter is followed by CRLF */
+		if (s.p[0] != '\r' || s.p[1] != '\n')
+			return EBADMSG;
+
+		if (next_delim(&e, &s, &bnd))
+			break;
+
+		p.p = s.p + 2;
+		if ((size_t)(e.p - p.p) < bnd.l + 2)
+			return EBADMSG;
+
+		p.l = e.p - p.p - bnd.l - 2;
+		s = e;
+
+		/* split part headers and body */
+		for (i=0; i+4 <= p.l; i++) {
+			if (0 == memcmp(p.p + i, "\r\n\r\n", 4))
+				break;
+		}
+		if (i+4 > p.l)
+			continue;
+
+		hdrs.p = p.p;
+		hdrs.l = i;
+		p.p += i + 4;
+		p.l -= i + 4;
+
+		if (re_regex(hdrs.p, hdrs.l, "Content-Type:[ \t]*[^;\r\n]+",
+			     NULL, &ctype))
+			continue;
+
+		if (0 == pl_strcasecmp(&ctype, "application/pidf+xml"))
+			pidf_entity_update(&p);
+	}
+
+	return 0;
+}
+
+
 static void notify_handler(struct sip *sip, const struct sip_msg *msg,
 			   void *arg)
 {
 	enum presence_status status = PRESENCE_CLOSED;
 	struct presence *pres = arg;
 	const struct sip_hdr *type_hdr, *length_hdr;
-	struct pl pl;
+	struct pl body;
 
 	if (pres->shutdown)
 		goto done;
@@ -106,6 +272,20 @@ static void notify_handler(struct sip *sip, const struct sip_msg *msg,
 		}
 	}
 
+	body.p = (const char *)mbuf_buf(msg->mb);
+	body.l = mbuf_get_left(msg->mb);
+
+	if (pres->rls && type_hdr &&
+	    msg_ctype_cmp(&msg->ctyp, "multipart", "related")) {
+
+		if (rls_decode(&msg->ctyp.params, &body)) {
+			warning("presence: rls: could not decode"
+				" multipart body\n");
+		}
+
+		goto done;
+	}
+
 	if (!type_hdr ||
 	    0 != pl_strcasecmp(&type_hdr->val, "application/pidf+xml")) {
 
@@ -115,46 +295,43 @@ static void notify_handler(struct sip *sip, const struct sip_msg *msg,
 
 		sip_treplyf(NULL, NULL, sip, msg, false,
 			    415, "Unsupported Media Type",
-			    "Accept: application/pidf+xml\r\n"
+			    "Accept: %s\r\n"
 			    "Content-Length: 0\r\n"
-			    "\r\n");
+			    "\r\n",
+			    pres->rls ?
+			    "application/pidf+xml, application/rlmi+xml,"
+			    " multipart/related" :
+			    "application/pidf+xml");
 		return;
 	}
 
-	if (!re_regex((const char *)mbuf_buf(msg->mb), mbuf_get_left(msg->mb),
-		      "<basic[ \t]*>[^<]+</basic[ \t]*>", NULL, &pl, NULL)) {
-	    if (!pl_strcasecmp(&pl, "open"))
-		status = PRESENCE_OPEN;
-	}
-
-	if (!re_regex((const char *)mbuf_buf(msg->mb), mbuf_get_left(msg->mb),
-		      "<rpid:away[ \t]*/>", NULL)) {
-
-		status = PRESENCE_CLOSED;
-	}
-	else if (!re_regex((const char *)mbuf_buf(msg->mb),
-			   mbuf_get_left(msg->mb),
-			   "<rpid:busy[ \t]*/>", NULL)) {
-
-		status = PRESENCE_BUSY;
+	if (pres->rls) {
+		pidf_entity_update(&body);
+		goto done;
 	}
-	else if (!re_regex((const char *)mbuf_buf(msg->mb),
-			   mbuf_get_left(msg->mb),
-			   "<rpid:on-the-phone[ \t]*/>", NULL)) {
 
-		status = PRESENCE_BUSY;
-	}
+	status = pidf_status(&body);
 
 done:
 	(void)sip_treply(NULL, sip, msg, 200, "OK");
 
-	contact_set_presence(pres->contact, status);
+	if (!pres->rls)
+		contact_set_presence(pres->contact, status);
 
 	if (pres->shutdown)
 		mem_deref(pres);
 }
 
 
+static int print_uri(struct re_printf *pf, const struct presence *pres)
+{
+	if (pres->rls)
+		return re_hprintf(pf, "%s", pres->rls);
+
+	return re_hprintf(pf, "%r", &contact_addr(pres->contact)->auri);
+}
+
+
 static void close_handler(int err, const struct sip_msg *msg,
 			  const struct sipevent_substate *substate, void *arg)
 {
@@ -163,8 +340,7 @@ static void close_handler(int err, const struct sip_msg *msg,
 
 	pres->sub = mem_deref(pres->sub);
 
-	info("presence: subscriber closed <%r>: ",
-	     &contact_addr(pres->contact)->auri);
+	info("presence: subscriber closed <%H>: ", print_uri, pres);
 
 	if (substate) {
 		info("%s", sipevent_reason_name(substate->reason));
@@ -196,6 +372,7 @@ static void destructor(void *arg)
 	list_unlink(&pres->le);
 	tmr_cancel(&pres->tmr);
 	mem_deref(pres->contact);
+	mem_deref(pres->rls);
 	mem_deref(pres->sub);
 	mem_deref(pres->ua);
 }
@@ -220,6 +397,7 @@ static int subscribe(struct presence *pres)
 	const char *routev[1];
 	struct ua *ua;
 	char uri[256];
+	uint32_t expires;
 	int err;
 
 	/* We use the first UA */
@@ -232,16 +410,30 @@ static int subscribe(struct presence *pres)
 	mem_deref(pres->ua);
 	pres->ua = mem_ref(ua);
 
-	pl_strcpy(&contact_addr(pres->contact)->auri, uri, sizeof(uri));
+	if (pres->rls) {
+		str_ncpy(uri, pres->rls, sizeof(uri));
+	}
+	else {
+		pl_strcpy(&contact_addr(pres->contact)->auri,
+			  uri, sizeof(uri));
+	}
 
 	routev[0] = ua_outbound(ua);
 
+	/* a random expiry spreads the refresh of many subscriptions */
+	expires = SUB_EXPIRES - rand_u16() % (SUB_EXPIRES / 10);
+
 	err = sipevent_subscribe(&pres->sub, uag_sipevent_sock(), uri, NULL,
-				 ua_aor(ua), "presence", NULL, 600,
+				 ua_aor(ua), "presence", NULL, expires,
 				 ua_cuser(ua), routev, routev[0] ? 1 : 0,
 				 auth_handler, ua_account(ua), true, NULL,
 				 notify_handler, close_handler, pres,
-				 "%H", ua_print_supported, ua);
+				 "%H%s", ua_print_supported, ua,
+				 pres->rls ?
+				 "Supported: eventlist\r\n"
+				 "Accept: application/pidf+xml,"
+				 " application/rlmi+xml,"
+				 " multipart/related\r\n" : "");
 	if (err) {
 		warning("presence: sipevent_subscribe failed: %m\n", err);
 	}
@@ -261,6 +453,22 @@ static void tmr_handler(void *arg)
 }
 
 
+/* Delay of the next initial SUBSCRIBE, at most sub_rate per second */
+static uint32_t start_delay(void)
+{
+	const uint64_t now = tmr_jiffies();
+	uint64_t slot;
+
+	if (!sub_rate)
+		return STARTUP_DELAY;
+
+	slot = max(now + STARTUP_DELAY, slot_next);
+	slot_next = slot + 1000 / sub_rate;
+
+	return (uint32_t)(slot - now);
+}
+
+
 static int presence_alloc(struct contact *contact)
 {
 	struct presence *pres;
@@ -273,7 +481,33 @@ static int presence_alloc(struct contact *contact)
 	pres->contact = mem_ref(contact);
 
 	tmr_init(&pres->tmr);
-	tmr_start(&pres->tmr, 1000, tmr_handler, pres);
+	tmr_start(&pres->tmr, start_delay(), tmr_handler, pres);
+
+	list_append(&presencel, &pres->le, pres);
+
+	return 0;
+}
+
+
+static int rls_alloc(const char *uri)
+{
+	struct presence *pres;
+	int err;
+
+	pres = mem_zalloc(sizeof(*pres), destructor);
+	if (!pres)
+		return ENOMEM;
+
+	pres->status = PRESENCE_UNKNOWN;
+
+	err = str_dup(&pres->rls, uri);
+	if (err) {
+		mem_deref(pres);
+		return err;
+	}
+
+	tmr_init(&pres->tmr);
+	tmr_start(&pres->tmr, STARTUP_DELAY, tmr_handler, pres);
 
 	list_append(&presencel, &pres->le, pres);
 
@@ -290,6 +524,10 @@ static void contact_handler(struct contact *contact,
 	struct sip_addr *addr = contact_addr(contact);
 	(void)arg;
 
+	/* all contacts are covered by the resource list */
+	if (use_rls)
+		return;
+
 	if (0 == msg_param_decode(&addr->params, "presence", &val) &&
 				0 == pl_strcasecmp(&val, "p2p")) {
 		if (!removed) {
@@ -322,9 +560,22 @@ static void contact_handler(struct contact *contact,
 int subscriber_init(void)
 {
 	struct contacts *contacts = baresip_contacts();
+	char rls[256] = "";
 	struct le *le;
 	int err = 0;
 
+	(void)conf_get_u32(conf_cur(), "presence_sub_rate", &sub_rate);
+	(void)conf_get_str(conf_cur(), "presence_rls", rls, sizeof(rls));
+
+	if (str_isset(rls)) {
+
+		use_rls = true;
+
+		info("presence: subscribing to resource list <%s>\n", rls);
+
+		return rls_alloc(rls);
+	}
+
 	for (le = list_head(contact_list(contacts)); le; le = le->next) {
 
 		struct contact *c = le->data;
@@ -350,6 +601,9 @@ void subscriber_close(void)
 {
 	contact_set_update_handler(baresip_contacts(), NULL, NULL);
 	list_flush(&presencel);
+
+	use_rls   = false;
+	slot_next = 0;
 }
 
 
@@ -4,8 +4,6 @@
  * Copyright (C) 2010 - 2016 Creytiv.com
  */
 #include <pulse/pulseaudio.h>
-#include <pulse/simple.h>
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -15,12 +13,10 @@
 struct auplay_st {
 	const struct auplay *ap;      /* inheritance */
 
-	pa_simple *s;
-	pthread_t thread;
-	bool run;
-	void *sampv;
-	size_t sampc;
+	struct pulse_conn pa;
+	pa_stream *stream;
 	size_t sampsz;
+	size_t framesz;               /* bytes per frame, all channels */
 	auplay_write_h *wh;
 	void *arg;
 };
@@ -30,48 +26,43 @@ static void auplay_destructor(void *arg)
 {
 	struct auplay_st *st = arg;
 
-	/* Wait for termination of other thread */
-	if (st->run) {
-		debug("pulse: stopping playback thread\n");
-		st->run = false;
-		(void)pthread_join(st->thread, NULL);
-	}
-
-	if (st->s)
-		pa_simple_free(st->s);
-
-	mem_deref(st->sampv);
+	pulse_disconnect(&st->pa, st->stream);
 }
 
 
-static void *write_thread(void *arg)
+/*
+ * The server asks for more audio. The samples are written directly to
+ * the buffer of the stream, without a copy.
+ */
+static void stream_write_handler(pa_stream *stream, size_t nbytes,
+				 void *arg)
 {
 	struct auplay_st *st = arg;
-	const size_t num_bytes = st->sampc * st->sampsz;
-	int ret, pa_error = 0;
 
-	while (st->run) {
+	while (nbytes >= st->framesz) {
 
-		st->wh(st->sampv, st->sampc, st->arg);
+		size_t sz = nbytes;
+		void *data = NULL;
 
-		ret = pa_simple_write(st->s, st->sampv, num_bytes, &pa_error);
-		if (ret < 0) {
-			warning("pulse: pa_simple_write error (%s)\n",
-				pa_strerror(pa_error));
-		}
-	}
+		if (pa_stream_begin_write(stream, &data, &sz) < 0 || !data)
+			break;
 
-	return NULL;
-}
+		sz -= sz % st->framesz;
+		if (!sz) {
+			pa_stream_cancel_write(stream);
+			break;
+		}
 
+		st->wh(data, sz / st->sampsz, st->arg);
 
-static int aufmt_to_pulse_format(enum aufmt fmt)
-{
-	switch (fmt) {
+		if (pa_stream_write(stream, data, sz, NULL, 0,
+				    PA_SEEK_RELATIVE) < 0) {
+			warning("pulse: pa_stream_write error (%s)\n",
+				pa_strerror(pa_context_errno(st->pa.context)));
+			break;
+		}
 
-	case AUFMT_S16LE:  return PA_SAMPLE_S16NE;
-	case AUFMT_FLOAT:  return PA_SAMPLE_FLOAT32NE;
-	default: return 0;
+		nbytes -= min(sz, nbytes);
 	}
 }
 
@@ -81,9 +72,9 @@ int pulse_player_alloc(struct auplay_st **stp, const struct auplay *ap,
 		       auplay_write_h *wh, void *arg)
 {
 	struct auplay_st *st;
-	pa_sample_spec ss;
 	pa_buffer_attr attr;
-	int err = 0, pa_error = 0;
+	size_t ptime_bytes;
+	int err = 0;
 
 	if (!stp || !ap || !prm || !wh)
 		return EINVAL;
@@ -99,49 +90,48 @@ int pulse_player_alloc(struct auplay_st **stp, const struct auplay *ap,
 	st->wh  = wh;
 	st->arg = arg;
 
-	st->sampc = prm->srate * prm->ch * prm->ptime / 1000;
-	st->sampsz = aufmt_sample_size(prm->fmt);
+	st->sampsz  = aufmt_sample_size(prm->fmt);
+	st->framesz = st->sampsz * prm->ch;
 
-	st->sampv = mem_alloc(st->sampsz * st->sampc, NULL);
-	if (!st->sampv) {
-		err = ENOMEM;
+	err = pulse_connect(&st->pa, "player");
+	if (err)
 		goto out;
-	}
 
-	ss.format   = aufmt_to_pulse_format(prm->fmt);
-	ss.channels = prm->ch;
-	ss.rate     = prm->srate;
+	pa_threaded_mainloop_lock(st->pa.mainloop);
+
+	err = pulse_stream_new(&st->stream, &st->pa, "VoIP Playback",
+			       prm->fmt, prm->srate, prm->ch);
+	if (err)
+		goto unlock;
+
+	pa_stream_set_write_callback(st->stream, stream_write_handler, st);
+
+	/* two packets in the server, refilled one packet at a time */
+	ptime_bytes = st->framesz * prm->srate * prm->ptime / 1000;
 
 	attr.maxlength = (uint32_t)-1;
-	attr.tlength   = (uint32_t)pa_usec_to_bytes(prm->ptime * 1000, &ss);
+	attr.tlength   = (uint32_t)(2 * ptime_bytes);
 	attr.prebuf    = (uint32_t)-1;
-	attr.minreq    = (uint32_t)-1;
+	attr.minreq    = (uint32_t)ptime_bytes;
 	attr.fragsize  = (uint32_t)-1;
 
-	st->s = pa_simple_new(NULL,
-			      "Baresip",
-			      PA_STREAM_PLAYBACK,
-			      str_isset(device) ? device : 0,
-			      "VoIP Playback",
-			      &ss,
-			      NULL,
-			      &attr,
-			      &pa_error);
-	if (!st->s) {
-		warning("pulse: could not connect to server (%s)\n",
-			pa_strerror(pa_error));
+	if (pa_stream_connect_playback(st->stream,
+				       str_isset(device) ? device : NULL,
+				       &attr, PA_STREAM_ADJUST_LATENCY,
+				       NULL, NULL) < 0) {
+		warning("pulse: could not connect playback (%s)\n",
+			pa_strerror(pa_context_errno(st->pa.context)));
 		err = ENODEV;
-		goto out;
+		goto unlock;
 	}
 
-	st->run = true;
-	err = pthread_create(&st->thread, NULL, write_thread, st);
-	if (err) {
-		st->run = false;
-		goto out;
-	}
+	err = pulse_stream_wait(&st->pa, st->stream);
+
+ unlock:
+	pa_threaded_mainloop_unlock(st->pa.mainloop);
 
-	debug("pulse: playback started\n");
+	if (!err)
+		debug("pulse: playback started\n");
 
  out:
 	if (err)
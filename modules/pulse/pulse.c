@@ -3,7 +3,8 @@
  *
  * Copyright (C) 2010 - 2016 Creytiv.com
  */
-
+#include <string.h>
+#include <pulse/pulseaudio.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -15,8 +16,10 @@
  *
  * Audio driver module for Pulseaudio
  *
- * This module is experimental and work-in-progress. It is using
- * the pulseaudio "simple" interface.
+ * This module is using the asynchronous pulseaudio interface. Each
+ * stream has its own threaded mainloop, and the audio is written and
+ * read from the stream callbacks, in 16-bit or float format. The
+ * buffer attributes request a latency of about one packet time.
  */
 
 
@@ -24,6 +27,221 @@ static struct auplay *auplay;
 static struct ausrc *ausrc;
 
 
+static void context_state_handler(pa_context *context, void *arg)
+{
+	pa_threaded_mainloop *mainloop = arg;
+
+	switch (pa_context_get_state(context)) {
+
+	case PA_CONTEXT_READY:
+	case PA_CONTEXT_FAILED:
+	case PA_CONTEXT_TERMINATED:
+		pa_threaded_mainloop_signal(mainloop, 0);
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+/**
+ * Connect to the pulseaudio server, with a new threaded mainloop
+ *
+ * @param pa   Connection to initialise
+ * @param name Name of the stream, for logging
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int pulse_connect(struct pulse_conn *pa, const char *name)
+{
+	pa_context_state_t state;
+	pa_mainloop_api *api;
+	int err = 0;
+
+	if (!pa)
+		return EINVAL;
+
+	memset(pa, 0, sizeof(*pa));
+
+	pa->mainloop = pa_threaded_mainloop_new();
+	if (!pa->mainloop)
+		return ENOMEM;
+
+	api = pa_threaded_mainloop_get_api(pa->mainloop);
+
+	pa->context = pa_context_new(api, "Baresip");
+	if (!pa->context) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	pa_context_set_state_callback(pa->context, context_state_handler,
+				      pa->mainloop);
+
+	pa_threaded_mainloop_lock(pa->mainloop);
+
+	if (pa_context_connect(pa->context, NULL, 0, NULL) < 0 ||
+	    pa_threaded_mainloop_start(pa->mainloop) < 0) {
+		pa_threaded_mainloop_unlock(pa->mainloop);
+		err = ENODEV;
+		goto out;
+	}
+
+	for (;;) {
+		state = pa_context_get_state(pa->context);
+		if (state == PA_CONTEXT_READY || !PA_CONTEXT_IS_GOOD(state))
+			break;
+
+		pa_threaded_mainloop_wait(pa->mainloop);
+	}
+
+	pa_threaded_mainloop_unlock(pa->mainloop);
+
+	if (state != PA_CONTEXT_READY)
+		err = ENODEV;
+
+ out:
+	if (err) {
+		warning("pulse: %s: could not connect to server (%s)\n",
+			name, pa->context ?
+			pa_strerror(pa_context_errno(pa->context)) : "");
+		pulse_disconnect(pa, NULL);
+	}
+
+	return err;
+}
+
+
+/**
+ * Stop the mainloop, and disconnect the stream and the server
+ *
+ * @param pa     Connection
+ * @param stream Stream to disconnect (optional)
+ */
+void pulse_disconnect(struct pulse_conn *pa, pa_stream *stream)
+{
+	if (!pa)
+		return;
+
+	/* no more callbacks after this */
+	if (pa->mainloop)
+		pa_threaded_mainloop_stop(pa->mainloop);
+
+	if (stream) {
+		pa_stream_disconnect(stream);
+		pa_stream_unref(stream);
+	}
+
+	if (pa->context) {
+		pa_context_disconnect(pa->context);
+		pa_context_unref(pa->context);
+		pa->context = NULL;
+	}
+
+	if (pa->mainloop) {
+		pa_threaded_mainloop_free(pa->mainloop);
+		pa->mainloop = NULL;
+	}
+}
+
+
+static void stream_state_handler(pa_stream *stream, void *arg)
+{
+	pa_threaded_mainloop *mainloop = arg;
+
+	switch (pa_stream_get_state(stream)) {
+
+	case PA_STREAM_READY:
+	case PA_STREAM_FAILED:
+	case PA_STREAM_TERMINATED:
+		pa_threaded_mainloop_signal(mainloop, 0);
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+/**
+ * Wait until a stream is ready. Must be called with the mainloop locked.
+ *
+ * @param pa     Connection
+ * @param stream Stream that was connected
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int pulse_stream_wait(struct pulse_conn *pa, pa_stream *stream)
+{
+	pa_stream_state_t state;
+
+	if (!pa || !stream)
+		return EINVAL;
+
+	for (;;) {
+		state = pa_stream_get_state(stream);
+		if (state == PA_STREAM_READY || !PA_STREAM_IS_GOOD(state))
+			break;
+
+		pa_threaded_mainloop_wait(pa->mainloop);
+	}
+
+	return state == PA_STREAM_READY ? 0 : ENODEV;
+}
+
+
+/**
+ * Create a new stream on the connection
+ *
+ * @param streamp Pointer to allocated stream
+ * @param pa      Connection
+ * @param name    Name of the stream
+ * @param fmt     Sample format
+ * @param srate   Sample rate in [Hz]
+ * @param ch      Number of channels
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int pulse_stream_new(pa_stream **streamp, struct pulse_conn *pa,
+		     const char *name, enum aufmt fmt,
+		     uint32_t srate, uint8_t ch)
+{
+	pa_sample_spec ss;
+	pa_stream *stream;
+
+	if (!streamp || !pa)
+		return EINVAL;
+
+	switch (fmt) {
+
+	case AUFMT_S16LE:  ss.format = PA_SAMPLE_S16NE;     break;
+	case AUFMT_FLOAT:  ss.format = PA_SAMPLE_FLOAT32NE; break;
+	default:
+		warning("pulse: unsupported sample format (%s)\n",
+			aufmt_name(fmt));
+		return ENOTSUP;
+	}
+
+	ss.channels = ch;
+	ss.rate     = srate;
+
+	stream = pa_stream_new(pa->context, name, &ss, NULL);
+	if (!stream) {
+		warning("pulse: pa_stream_new failed (%s)\n",
+			pa_strerror(pa_context_errno(pa->context)));
+		return ENOMEM;
+	}
+
+	pa_stream_set_state_callback(stream, stream_state_handler,
+				     pa->mainloop);
+
+	*streamp = stream;
+
+	return 0;
+}
+
+
 static int module_init(void)
 {
 	int err;
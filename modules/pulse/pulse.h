@@ -5,6 +5,19 @@
  */
 
 
+/** Connection to the pulseaudio server, for one stream */
+struct pulse_conn {
+	pa_threaded_mainloop *mainloop;
+	pa_context *context;
+};
+
+int  pulse_connect(struct pulse_conn *pa, const char *name);
+void pulse_disconnect(struct pulse_conn *pa, pa_stream *stream);
+int  pulse_stream_new(pa_stream **streamp, struct pulse_conn *pa,
+		      const char *name, enum aufmt fmt,
+		      uint32_t srate, uint8_t ch);
+int  pulse_stream_wait(struct pulse_conn *pa, pa_stream *stream);
+
 int pulse_player_alloc(struct auplay_st **stp, const struct auplay *ap,
 		       struct auplay_prm *prm, const char *device,
 		       auplay_write_h *wh, void *arg);
@@ -3,9 +3,8 @@
  *
  * Copyright (C) 2010 - 2016 Creytiv.com
  */
+#include <string.h>
 #include <pulse/pulseaudio.h>
-#include <pulse/simple.h>
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -15,13 +14,12 @@
 struct ausrc_st {
 	const struct ausrc *as;      /* inheritance */
 
-	pa_simple *s;
-	pthread_t thread;
-	bool run;
-	void *sampv;
+	struct pulse_conn pa;
+	pa_stream *stream;
+	uint8_t *sampv;
 	size_t sampc;
 	size_t sampsz;
-	uint32_t ptime;
+	size_t pos;                  /* bytes in sampv */
 	ausrc_read_h *rh;
 	void *arg;
 };
@@ -31,80 +29,54 @@ static void ausrc_destructor(void *arg)
 {
 	struct ausrc_st *st = arg;
 
-	/* Wait for termination of other thread */
-	if (st->run) {
-		debug("pulse: stopping record thread\n");
-		st->run = false;
-		(void)pthread_join(st->thread, NULL);
-	}
-
-	if (st->s)
-		pa_simple_free(st->s);
+	pulse_disconnect(&st->pa, st->stream);
 
 	mem_deref(st->sampv);
 }
 
 
-static void *read_thread(void *arg)
+/*
+ * Recorded audio is available. It is collected into frames of one
+ * packet time, which are handed to the application.
+ */
+static void stream_read_handler(pa_stream *stream, size_t nbytes,
+				void *arg)
 {
 	struct ausrc_st *st = arg;
 	const size_t num_bytes = st->sampc * st->sampsz;
-	int ret, pa_error = 0;
-	uint64_t now, last_read, diff;
-	unsigned dropped = 0;
-	bool init = true;
-
-	if (pa_simple_flush(st->s, &pa_error)) {
-		warning("pulse: pa_simple_flush error (%s)\n",
-		        pa_strerror(pa_error));
-	}
+	(void)nbytes;
 
-	last_read = tmr_jiffies();
+	while (pa_stream_readable_size(stream) > 0) {
 
-	while (st->run) {
+		const uint8_t *data;
+		size_t len;
 
-		ret = pa_simple_read(st->s, st->sampv, num_bytes, &pa_error);
-		if (ret < 0) {
-			warning("pulse: pa_simple_write error (%s)\n",
-				pa_strerror(pa_error));
+		if (pa_stream_peek(stream, (const void **)&data, &len) < 0 ||
+		    !len)
+			break;
+
+		/* a hole in the stream, e.g. after an overrun */
+		if (!data) {
+			pa_stream_drop(stream);
 			continue;
 		}
 
-		/* Some devices might send a burst of samples right after the
-		   initialization - filter them out */
-		if (init) {
-			now = tmr_jiffies();
-			diff = (now > last_read)? now - last_read : 0;
+		while (len) {
 
-			if (diff < st->ptime / 2) {
-				last_read = now;
-				++dropped;
-				continue;
-			}
-			else {
-				init = false;
+			const size_t n = min(len, num_bytes - st->pos);
+
+			memcpy(st->sampv + st->pos, data, n);
+			st->pos += n;
+			data    += n;
+			len     -= n;
 
-				if (dropped)
-					debug("pulse: dropped %u frames of "
-					      "garbage at the beginning of "
-					      "the recording\n", dropped);
+			if (st->pos == num_bytes) {
+				st->rh(st->sampv, st->sampc, st->arg);
+				st->pos = 0;
 			}
 		}
 
-		st->rh(st->sampv, st->sampc, st->arg);
-	}
-
-	return NULL;
-}
-
-
-static int aufmt_to_pulse_format(enum aufmt fmt)
-{
-	switch (fmt) {
-
-	case AUFMT_S16LE:  return PA_SAMPLE_S16NE;
-	case AUFMT_FLOAT:  return PA_SAMPLE_FLOAT32NE;
-	default: return 0;
+		pa_stream_drop(stream);
 	}
 }
 
@@ -115,16 +87,13 @@ int pulse_recorder_alloc(struct ausrc_st **stp, const struct ausrc *as,
 			 ausrc_read_h *rh, ausrc_error_h *errh, void *arg)
 {
 	struct ausrc_st *st;
-	pa_sample_spec ss;
 	pa_buffer_attr attr;
-	int pa_error;
 	int err;
 
 	(void)ctx;
-	(void)device;
 	(void)errh;
 
-	if (!stp || !as || !prm)
+	if (!stp || !as || !prm || !rh)
 		return EINVAL;
 
 	debug("pulse: opening recorder (%u Hz, %d channels, device '%s')\n",
@@ -140,7 +109,6 @@ int pulse_recorder_alloc(struct ausrc_st **stp, const struct ausrc *as,
 
 	st->sampc = prm->srate * prm->ch * prm->ptime / 1000;
 	st->sampsz = aufmt_sample_size(prm->fmt);
-	st->ptime = prm->ptime;
 
 	st->sampv = mem_alloc(st->sampsz * st->sampc, NULL);
 	if (!st->sampv) {
@@ -148,40 +116,42 @@ int pulse_recorder_alloc(struct ausrc_st **stp, const struct ausrc *as,
 		goto out;
 	}
 
-	ss.format   = aufmt_to_pulse_format(prm->fmt);
-	ss.channels = prm->ch;
-	ss.rate     = prm->srate;
+	err = pulse_connect(&st->pa, "recorder");
+	if (err)
+		goto out;
+
+	pa_threaded_mainloop_lock(st->pa.mainloop);
+
+	err = pulse_stream_new(&st->stream, &st->pa, "VoIP Record",
+			       prm->fmt, prm->srate, prm->ch);
+	if (err)
+		goto unlock;
+
+	pa_stream_set_read_callback(st->stream, stream_read_handler, st);
 
+	/* the server sends one packet at a time */
 	attr.maxlength = (uint32_t)-1;
 	attr.tlength   = (uint32_t)-1;
 	attr.prebuf    = (uint32_t)-1;
 	attr.minreq    = (uint32_t)-1;
-	attr.fragsize  = (uint32_t)pa_usec_to_bytes(prm->ptime * 1000, &ss);
-
-	st->s = pa_simple_new(NULL,
-			      "Baresip",
-			      PA_STREAM_RECORD,
-			      str_isset(device) ? device : 0,
-			      "VoIP Record",
-			      &ss,
-			      NULL,
-			      &attr,
-			      &pa_error);
-	if (!st->s) {
-		warning("pulse: could not connect to server (%s)\n",
-			pa_strerror(pa_error));
+	attr.fragsize  = (uint32_t)(st->sampc * st->sampsz);
+
+	if (pa_stream_connect_record(st->stream,
+				     str_isset(device) ? device : NULL,
+				     &attr, PA_STREAM_ADJUST_LATENCY) < 0) {
+		warning("pulse: could not connect record (%s)\n",
+			pa_strerror(pa_context_errno(st->pa.context)));
 		err = ENODEV;
-		goto out;
+		goto unlock;
 	}
 
-	st->run = true;
-	err = pthread_create(&st->thread, NULL, read_thread, st);
-	if (err) {
-		st->run = false;
-		goto out;
-	}
+	err = pulse_stream_wait(&st->pa, st->stream);
+
+ unlock:
+	pa_threaded_mainloop_unlock(st->pa.mainloop);
 
-	debug("pulse: recording started\n");
+	if (!err)
+		debug("pulse: recording started\n");
 
  out:
 	if (err)
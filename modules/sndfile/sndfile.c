@@ -1,37 +1,99 @@
 /**
- * @file sndfile.c  Audio dumper using libsndfile
+ * @file sndfile.c  Audio recorder using libsndfile
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <sndfile.h>
 #include <time.h>
+#include <pthread.h>
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
 
 
 /**
  * @defgroup sndfile sndfile
  *
- * Audio filter that writes audio samples to WAV-file
+ * Audio filter that records the audio of each call to a file
+ *
+ * The filters only copy the frames into a buffer per direction. A
+ * writer thread empties the buffers in batches and writes the file, so
+ * that a slow disk does not delay the audio. If the file cannot be
+ * opened, the call is not recorded and the filters pass the audio on.
+ *
+ * Both directions are recorded into one stereo file, the local audio
+ * on the left and the remote audio on the right channel. They can also
+ * be mixed into one mono file, or written to one file per direction.
+ * Files are written as WAV, FLAC or Ogg/Opus.
  *
  * Example Configuration:
  \verbatim
-  snd_path 					/tmp/
+  snd_path 		/tmp/
+  snd_format		wav		# wav, flac, opus
+  snd_mode		stereo		# stereo, mono, split
+  snd_flush		500		# write interval [ms]
+  snd_fsync		0		# fsync interval [s], 0 is off
  \endverbatim
  */
 
 
+/* SF_FORMAT_OPUS, libsndfile 1.0.29 or later */
+#define FORMAT_OPUS 0x0064
+
+
+enum {
+	BUF_MS = 4000,        /* max. audio in the buffers            */
+	LAG_MS = 200,         /* max. wait for the other direction    */
+};
+
+enum rec_mode {
+	REC_STEREO,
+	REC_MONO,
+	REC_SPLIT,
+};
+
+/** One direction of the audio */
+struct recdir {
+	struct aubuf *ab;         /**< Frames to write                */
+	struct aufilt_prm prm;    /**< Audio parameters               */
+	SNDFILE *sf;              /**< Own file, in split mode        */
+	int16_t *sampv;           /**< Samples read by the writer     */
+	int16_t *monov;           /**< Samples mixed to mono          */
+};
+
+/** Recording of the audio of one call */
+struct recording {
+	struct recdir tx;         /**< Local audio (encoder)          */
+	struct recdir rx;         /**< Remote audio (decoder)         */
+	SNDFILE *sf;              /**< File with both directions      */
+	enum rec_mode mode;
+	int16_t *outv;            /**< Interleaved or mixed samples   */
+	size_t blockc;            /**< Max. frames per write          */
+	uint64_t last_sync;       /**< Time of the last fsync [ms]    */
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool run;                 /**< Writer thread runs, mutex      */
+	bool active;              /**< Buffers are ready, atomic      */
+};
+
 struct sndfile_enc {
 	struct aufilt_enc_st af;  /* base class */
-	SNDFILE *enc;
+	struct recording *rec;
 };
 
 struct sndfile_dec {
 	struct aufilt_dec_st af;  /* base class */
-	SNDFILE *dec;
+	struct recording *rec;
 };
 
 static char file_path[256] = ".";
+static int file_format = SF_FORMAT_WAV;
+static enum rec_mode rec_mode = REC_STEREO;
+static uint32_t flush_ms = 500;
+static uint32_t fsync_s = 0;
 
 
 static int timestamp_print(struct re_printf *pf, const struct tm *tm)
@@ -45,81 +107,403 @@ static int timestamp_print(struct re_printf *pf, const struct tm *tm)
 }
 
 
-static void enc_destructor(void *arg)
+static const char *format_ext(int format)
 {
-	struct sndfile_enc *st = arg;
-
-	if (st->enc)
-		sf_close(st->enc);
-
-	list_unlink(&st->af.le);
-}
-
+	switch (format) {
 
-static void dec_destructor(void *arg)
-{
-	struct sndfile_dec *st = arg;
-
-	if (st->dec)
-		sf_close(st->dec);
-
-	list_unlink(&st->af.le);
+	case SF_FORMAT_FLAC:  return "flac";
+	case SF_FORMAT_OGG:   return "opus";
+	default:              return "wav";
+	}
 }
 
 
-static SNDFILE *openfile(const struct aufilt_prm *prm, bool enc)
+static SNDFILE *openfile_format(uint32_t srate, uint8_t ch,
+				const char *dir, int format)
 {
-	char filename[128];
+	char filename[384];
 	SF_INFO sfinfo;
 	time_t tnow = time(0);
 	struct tm *tm = localtime(&tnow);
 	SNDFILE *sf;
 
 	(void)re_snprintf(filename, sizeof(filename),
-			  "%s/dump-%H-%s.wav",
-				file_path,
-			  timestamp_print, tm, enc ? "enc" : "dec");
+			  "%s/dump-%H%s%s.%s",
+			  file_path, timestamp_print, tm,
+			  dir ? "-" : "", dir ? dir : "", format_ext(format));
+
+	memset(&sfinfo, 0, sizeof(sfinfo));
+	sfinfo.samplerate = srate;
+	sfinfo.channels   = ch;
 
-	sfinfo.samplerate = prm->srate;
-	sfinfo.channels   = prm->ch;
-	sfinfo.format     = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+	if (format == SF_FORMAT_OGG)
+		sfinfo.format = SF_FORMAT_OGG | FORMAT_OPUS;
+	else
+		sfinfo.format = format | SF_FORMAT_PCM_16;
+
+	if (!sf_format_check(&sfinfo))
+		return NULL;
 
 	sf = sf_open(filename, SFM_WRITE, &sfinfo);
 	if (!sf) {
-		warning("sndfile: could not open: %s\n", filename);
-		puts(sf_strerror(NULL));
+		warning("sndfile: could not open: %s (%s)\n",
+			filename, sf_strerror(NULL));
 		return NULL;
 	}
 
-	info("sndfile: dumping %s audio to %s\n",
-	     enc ? "encode" : "decode", filename);
+	info("sndfile: recording %s audio to %s\n",
+	     dir ? dir : "call", filename);
 
 	return sf;
 }
 
 
+/* the configured format, or WAV if it does not support the audio */
+static SNDFILE *openfile(uint32_t srate, uint8_t ch, const char *dir)
+{
+	SNDFILE *sf;
+
+	sf = openfile_format(srate, ch, dir, file_format);
+	if (sf || file_format == SF_FORMAT_WAV)
+		return sf;
+
+	warning("sndfile: %s not supported for %uHz, %uch -- using wav\n",
+		format_ext(file_format), srate, ch);
+
+	return openfile_format(srate, ch, dir, SF_FORMAT_WAV);
+}
+
+
+static inline size_t dir_avail(const struct recdir *dir)
+{
+	return aubuf_cur_size(dir->ab) / (2 * dir->prm.ch);
+}
+
+
+/* Read frames of one direction, padded with silence */
+static void dir_read(struct recdir *dir, size_t frames)
+{
+	const size_t n = min(dir_avail(dir), frames);
+
+	aubuf_read_samp(dir->ab, dir->sampv, n * dir->prm.ch);
+
+	memset(&dir->sampv[n * dir->prm.ch], 0,
+	       (frames - n) * dir->prm.ch * sizeof(int16_t));
+}
+
+
+static void dir_mono(struct recdir *dir, size_t frames)
+{
+	size_t i;
+
+	if (dir->prm.ch == 1) {
+		memcpy(dir->monov, dir->sampv, frames * sizeof(int16_t));
+		return;
+	}
+
+	for (i=0; i<frames; i++) {
+		const int32_t s = dir->sampv[2*i] + dir->sampv[2*i + 1];
+
+		dir->monov[i] = (int16_t)(s / 2);
+	}
+}
+
+
+static void write_split(struct recording *rec, struct recdir *dir)
+{
+	size_t n;
+
+	while ((n = min(dir_avail(dir), rec->blockc)) > 0) {
+
+		aubuf_read_samp(dir->ab, dir->sampv, n * dir->prm.ch);
+
+		sf_write_short(dir->sf, dir->sampv, n * dir->prm.ch);
+	}
+}
+
+
+/*
+ * Write the frames of both directions that are available. If one
+ * direction has no audio, e.g. while the peer sends Comfort Noise, it
+ * is filled with silence after LAG_MS.
+ */
+static void write_both(struct recording *rec, bool drain)
+{
+	const size_t lagc = rec->tx.prm.srate * LAG_MS / 1000;
+	size_t i;
+
+	for (;;) {
+
+		const size_t a = dir_avail(&rec->tx);
+		const size_t b = dir_avail(&rec->rx);
+		const size_t hi = max(a, b);
+		size_t n = min(a, b);
+
+		if (drain)
+			n = hi;
+		else if (hi > n + lagc)
+			n = hi - lagc;
+
+		n = min(n, rec->blockc);
+		if (!n)
+			break;
+
+		dir_read(&rec->tx, n);
+		dir_read(&rec->rx, n);
+		dir_mono(&rec->tx, n);
+		dir_mono(&rec->rx, n);
+
+		if (rec->mode == REC_STEREO) {
+
+			for (i=0; i<n; i++) {
+				rec->outv[2*i]     = rec->tx.monov[i];
+				rec->outv[2*i + 1] = rec->rx.monov[i];
+			}
+
+			sf_write_short(rec->sf, rec->outv, 2 * n);
+		}
+		else {
+			const int16_t *x = rec->tx.monov, *y = rec->rx.monov;
+
+			for (i=0; i<n; i++) {
+				int32_t s = x[i] + y[i];
+
+				s = min(max(s, -32768), 32767);
+
+				rec->outv[i] = (int16_t)s;
+			}
+
+			sf_write_short(rec->sf, rec->outv, n);
+		}
+	}
+}
+
+
+static void rec_write(struct recording *rec, bool drain)
+{
+	uint64_t now;
+
+	if (rec->mode == REC_SPLIT) {
+		write_split(rec, &rec->tx);
+		write_split(rec, &rec->rx);
+	}
+	else {
+		write_both(rec, drain);
+	}
+
+	if (!fsync_s)
+		return;
+
+	now = tmr_jiffies();
+	if (now - rec->last_sync < fsync_s * 1000)
+		return;
+
+	rec->last_sync = now;
+
+	if (rec->sf)
+		sf_write_sync(rec->sf);
+	if (rec->tx.sf)
+		sf_write_sync(rec->tx.sf);
+	if (rec->rx.sf)
+		sf_write_sync(rec->rx.sf);
+}
+
+
+static void *writer_thread(void *arg)
+{
+	struct recording *rec = arg;
+	struct timespec ts;
+	uint64_t ns;
+	bool run = true;
+
+	while (run) {
+
+		(void)clock_gettime(CLOCK_REALTIME, &ts);
+
+		ns = ts.tv_nsec + (uint64_t)flush_ms * 1000000;
+		ts.tv_sec  += ns / 1000000000;
+		ts.tv_nsec  = ns % 1000000000;
+
+		pthread_mutex_lock(&rec->mutex);
+		if (rec->run) {
+			(void)pthread_cond_timedwait(&rec->cond, &rec->mutex,
+						     &ts);
+		}
+		run = rec->run;
+		pthread_mutex_unlock(&rec->mutex);
+
+		rec_write(rec, !run);
+	}
+
+	return NULL;
+}
+
+
+static void recording_destructor(void *arg)
+{
+	struct recording *rec = arg;
+
+	if (rec->run) {
+		pthread_mutex_lock(&rec->mutex);
+		rec->run = false;
+		pthread_cond_signal(&rec->cond);
+		pthread_mutex_unlock(&rec->mutex);
+
+		/* the thread writes what is left before it exits */
+		pthread_join(rec->thread, NULL);
+
+		pthread_cond_destroy(&rec->cond);
+		pthread_mutex_destroy(&rec->mutex);
+	}
+
+	if (rec->sf)
+		sf_close(rec->sf);
+	if (rec->tx.sf)
+		sf_close(rec->tx.sf);
+	if (rec->rx.sf)
+		sf_close(rec->rx.sf);
+
+	mem_deref(rec->tx.ab);
+	mem_deref(rec->tx.sampv);
+	mem_deref(rec->tx.monov);
+	mem_deref(rec->rx.ab);
+	mem_deref(rec->rx.sampv);
+	mem_deref(rec->rx.monov);
+	mem_deref(rec->outv);
+}
+
+
+static int dir_alloc(struct recdir *dir, const struct aufilt_prm *prm,
+		     size_t blockc)
+{
+	const size_t sampc = blockc * prm->ch;
+	int err;
+
+	dir->prm = *prm;
+
+	err = aubuf_alloc(&dir->ab, 0,
+			  2 * prm->srate * prm->ch * BUF_MS / 1000);
+	if (err)
+		return err;
+
+	dir->sampv = mem_alloc(sampc * sizeof(int16_t), NULL);
+	dir->monov = mem_alloc(blockc * sizeof(int16_t), NULL);
+	if (!dir->sampv || !dir->monov)
+		return ENOMEM;
+
+	return 0;
+}
+
+
+/* the recording is started when both directions are known */
+static int recording_start(struct recording *rec,
+			   const struct aufilt_prm *encprm,
+			   const struct aufilt_prm *decprm)
+{
+	const uint32_t srate = max(encprm->srate, decprm->srate);
+	int err;
+
+	rec->mode   = rec_mode;
+	rec->blockc = srate * min(flush_ms, (uint32_t)BUF_MS) / 1000;
+	rec->blockc = max(rec->blockc, (size_t)1);
+
+	if (rec->mode != REC_SPLIT && encprm->srate != decprm->srate) {
+		info("sndfile: %uHz and %uHz audio, one file per direction\n",
+		     encprm->srate, decprm->srate);
+		rec->mode = REC_SPLIT;
+	}
+
+	err  = dir_alloc(&rec->tx, encprm, rec->blockc);
+	err |= dir_alloc(&rec->rx, decprm, rec->blockc);
+	if (err)
+		return err;
+
+	if (rec->mode == REC_SPLIT) {
+		rec->tx.sf = openfile(encprm->srate, encprm->ch, "enc");
+		rec->rx.sf = openfile(decprm->srate, decprm->ch, "dec");
+		if (!rec->tx.sf || !rec->rx.sf)
+			return EIO;
+	}
+	else {
+		const uint8_t ch = rec->mode == REC_STEREO ? 2 : 1;
+
+		rec->outv = mem_alloc(rec->blockc * ch * sizeof(int16_t),
+				      NULL);
+		if (!rec->outv)
+			return ENOMEM;
+
+		rec->sf = openfile(srate, ch, NULL);
+		if (!rec->sf)
+			return EIO;
+	}
+
+	rec->last_sync = tmr_jiffies();
+
+	pthread_mutex_init(&rec->mutex, NULL);
+	pthread_cond_init(&rec->cond, NULL);
+
+	rec->run = true;
+	err = pthread_create(&rec->thread, NULL, writer_thread, rec);
+	if (err) {
+		rec->run = false;
+		pthread_cond_destroy(&rec->cond);
+		pthread_mutex_destroy(&rec->mutex);
+		return err;
+	}
+
+	/* the audio threads use the buffers once they see the flag */
+	__atomic_store_n(&rec->active, true, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+
+static void enc_destructor(void *arg)
+{
+	struct sndfile_enc *st = arg;
+
+	list_unlink(&st->af.le);
+	mem_deref(st->rec);
+}
+
+
+static void dec_destructor(void *arg)
+{
+	struct sndfile_dec *st = arg;
+
+	list_unlink(&st->af.le);
+	mem_deref(st->rec);
+}
+
+
+/* the encoder is set up first, the decoder starts the recording */
 static int encode_update(struct aufilt_enc_st **stp, void **ctx,
 			 const struct aufilt *af, struct aufilt_prm *prm)
 {
 	struct sndfile_enc *st;
-	int err = 0;
-	(void)ctx;
+	struct recording *rec;
 	(void)af;
 
-	st = mem_zalloc(sizeof(*st), enc_destructor);
-	if (!st)
+	if (!stp || !ctx || !prm)
 		return EINVAL;
 
-	st->enc = openfile(prm, true);
-	if (!st->enc)
-		err = ENOMEM;
+	st = mem_zalloc(sizeof(*st), enc_destructor);
+	if (!st)
+		return ENOMEM;
 
-	if (err)
+	rec = mem_zalloc(sizeof(*rec), recording_destructor);
+	if (!rec) {
 		mem_deref(st);
-	else
-		*stp = (struct aufilt_enc_st *)st;
+		return ENOMEM;
+	}
 
-	return err;
+	rec->tx.prm = *prm;
+
+	st->rec = rec;
+	*ctx = rec;
+	*stp = (struct aufilt_enc_st *)st;
+
+	return 0;
 }
 
 
@@ -127,42 +511,57 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 			 const struct aufilt *af, struct aufilt_prm *prm)
 {
 	struct sndfile_dec *st;
-	int err = 0;
-	(void)ctx;
+	int err;
 	(void)af;
 
+	if (!stp || !ctx || !*ctx || !prm)
+		return EINVAL;
+
 	st = mem_zalloc(sizeof(*st), dec_destructor);
 	if (!st)
-		return EINVAL;
+		return ENOMEM;
 
-	st->dec = openfile(prm, false);
-	if (!st->dec)
-		err = ENOMEM;
+	st->rec = mem_ref(*ctx);
 
-	if (err)
-		mem_deref(st);
-	else
-		*stp = (struct aufilt_dec_st *)st;
+	/* the other audio filters of the call are still set up,
+	   only the recording is missing */
+	err = recording_start(st->rec, &st->rec->tx.prm, prm);
+	if (err) {
+		warning("sndfile: could not start recording,"
+			" call is not recorded (%m)\n", err);
+	}
+
+	*stp = (struct aufilt_dec_st *)st;
 
-	return err;
+	return 0;
 }
 
 
+/*
+ * The filters run in the audio threads, and only copy the frame
+ *
+ * @note This function has REAL-TIME properties
+ */
 static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
 {
 	struct sndfile_enc *sf = (struct sndfile_enc *)st;
 
-	sf_write_short(sf->enc, sampv, *sampc);
+	if (__atomic_load_n(&sf->rec->active, __ATOMIC_ACQUIRE))
+		(void)aubuf_write_samp(sf->rec->tx.ab, sampv, *sampc);
 
 	return 0;
 }
 
 
+/*
+ * @note This function has REAL-TIME properties
+ */
 static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
 {
 	struct sndfile_dec *sf = (struct sndfile_dec *)st;
 
-	sf_write_short(sf->dec, sampv, *sampc);
+	if (__atomic_load_n(&sf->rec->active, __ATOMIC_ACQUIRE))
+		(void)aubuf_write_samp(sf->rec->rx.ab, sampv, *sampc);
 
 	return 0;
 }
@@ -173,13 +572,51 @@ static struct aufilt sndfile = {
 };
 
 
+static void config_parse(void)
+{
+	struct pl pl;
+
+	conf_get_str(conf_cur(), "snd_path", file_path, sizeof(file_path));
+
+	if (0 == conf_get(conf_cur(), "snd_format", &pl)) {
+
+		if (0 == pl_strcasecmp(&pl, "wav"))
+			file_format = SF_FORMAT_WAV;
+		else if (0 == pl_strcasecmp(&pl, "flac"))
+			file_format = SF_FORMAT_FLAC;
+		else if (0 == pl_strcasecmp(&pl, "opus"))
+			file_format = SF_FORMAT_OGG;
+		else
+			warning("sndfile: unsupported format (%r)\n", &pl);
+	}
+
+	if (0 == conf_get(conf_cur(), "snd_mode", &pl)) {
+
+		if (0 == pl_strcasecmp(&pl, "stereo"))
+			rec_mode = REC_STEREO;
+		else if (0 == pl_strcasecmp(&pl, "mono"))
+			rec_mode = REC_MONO;
+		else if (0 == pl_strcasecmp(&pl, "split"))
+			rec_mode = REC_SPLIT;
+		else
+			warning("sndfile: unsupported mode (%r)\n", &pl);
+	}
+
+	(void)conf_get_u32(conf_cur(), "snd_flush", &flush_ms);
+	(void)conf_get_u32(conf_cur(), "snd_fsync", &fsync_s);
+
+	flush_ms = max(flush_ms, 20u);
+}
+
+
 static int module_init(void)
 {
 	aufilt_register(baresip_aufiltl(), &sndfile);
 
-	conf_get_str(conf_cur(), "snd_path", file_path, sizeof(file_path));
+	config_parse();
 
-	info("sndfile: saving files in %s\n", file_path);
+	info("sndfile: saving files in %s (%s)\n",
+	     file_path, format_ext(file_format));
 
 	return 0;
 }
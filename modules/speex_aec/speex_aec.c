@@ -15,11 +15,18 @@
  * @defgroup speex_aec speex_aec
  *
  * Acoustic Echo Cancellation (AEC) from libspeexdsp
+ *
+ * If the audio stream has a far-end reference, which is aligned with
+ * the capture, it is used as the echo reference. Otherwise the decoded
+ * audio is used, as it is given to the audio player.
  */
 
 
 struct speex_st {
 	int16_t *out;
+	int16_t *refv;
+	size_t sampc;
+	struct aecref *ref;
 	SpeexEchoState *state;
 };
 
@@ -60,6 +67,8 @@ static void speex_aec_destructor(void *arg)
 	if (st->state)
 		speex_echo_state_destroy(st->state);
 
+	mem_deref(st->ref);
+	mem_deref(st->refv);
 	mem_deref(st->out);
 }
 
@@ -67,6 +76,7 @@ static void speex_aec_destructor(void *arg)
 static int aec_alloc(struct speex_st **stp, void **ctx, struct aufilt_prm *prm)
 {
 	struct speex_st *st;
+	struct aecref *ref;
 	uint32_t sampc;
 	int err, tmp, fl;
 
@@ -90,6 +100,20 @@ static int aec_alloc(struct speex_st **stp, void **ctx, struct aufilt_prm *prm)
 		goto out;
 	}
 
+	ref = audio_aecref(prm->au);
+	if (ref && aecref_srate(ref) == prm->srate && prm->ch == 1) {
+
+		st->refv = mem_alloc(2 * sampc, NULL);
+		if (!st->refv) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		st->ref = mem_ref(ref);
+	}
+
+	st->sampc = sampc;
+
 	/* Echo canceller with 200 ms tail length */
 	fl = 10 * sampc;
 	st->state = speex_echo_state_init(sampc, fl);
@@ -104,7 +128,8 @@ static int aec_alloc(struct speex_st **stp, void **ctx, struct aufilt_prm *prm)
 		warning("speex_aec: speex_echo_ctl: err=%d\n", err);
 	}
 
-	info("speex_aec: Speex AEC loaded: srate = %uHz\n", prm->srate);
+	info("speex_aec: Speex AEC loaded: srate = %uHz%s\n", prm->srate,
+	     st->ref ? " (far-end reference)" : "");
 
  out:
 	if (err)
@@ -175,7 +200,12 @@ static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
 	struct enc_st *est = (struct enc_st *)st;
 	struct speex_st *sp = est->st;
 
-	if (*sampc) {
+	if (sp->ref && *sampc == sp->sampc) {
+		(void)aecref_read(sp->ref, sp->refv, *sampc, NULL);
+		speex_echo_cancellation(sp->state, sampv, sp->refv, sp->out);
+		memcpy(sampv, sp->out, *sampc * 2);
+	}
+	else if (*sampc) {
 		speex_echo_capture(sp->state, sampv, sp->out);
 		memcpy(sampv, sp->out, *sampc * 2);
 	}
@@ -189,7 +219,8 @@ static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
 	struct dec_st *dst = (struct dec_st *)st;
 	struct speex_st *sp = dst->st;
 
-	if (*sampc)
+	/* the reference is taken from the player instead */
+	if (*sampc && !sp->ref)
 		speex_echo_playback(sp->state, sampv);
 
 	return 0;
@@ -0,0 +1,67 @@
+/**
+ * @file vidmcu/disp.c Video conference compositor -- display
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "vidmcu.h"
+
+
+static void destructor(void *arg)
+{
+	struct vidisp_st *st = arg;
+
+	mcu_room_remove_disp(st->room, st);
+	mem_deref(st->room);
+}
+
+
+int vidmcu_disp_alloc(struct vidisp_st **stp, const struct vidisp *vd,
+		      struct vidisp_prm *prm, const char *dev,
+		      vidisp_resize_h *resizeh, void *arg)
+{
+	struct vidisp_st *st;
+	int err;
+	(void)prm;
+	(void)resizeh;
+	(void)arg;
+
+	if (!stp || !vd || !dev)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->vd = vd;
+
+	err = mcu_room_get(&st->room, dev);
+	if (err)
+		goto out;
+
+	mcu_room_add_disp(st->room, st);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = st;
+
+	return err;
+}
+
+
+int vidmcu_disp_display(struct vidisp_st *st, const char *title,
+			const struct vidframe *frame)
+{
+	(void)title;
+
+	if (!st || !frame)
+		return EINVAL;
+
+	mcu_room_draw(st->room, st, frame);
+
+	return 0;
+}
@@ -0,0 +1,11 @@
+#
+# module.mk
+#
+# Copyright (C) 2010 Creytiv.com
+#
+
+MOD		:= vidmcu
+$(MOD)_SRCS	+= vidmcu.c room.c src.c disp.c
+$(MOD)_LFLAGS	+=
+
+include mk/mod.mk
@@ -0,0 +1,446 @@
+/**
+ * @file vidmcu/room.c Video conference compositor -- room
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <time.h>
+#include <pthread.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "vidmcu.h"
+
+
+/*
+ * A room composes the decoded video of all participants into one
+ * picture per encoder resolution. Video sources that share a picture
+ * also share the video encoder, so the cost is one encode per layout.
+ *
+ * The displays draw into the pictures with the room lock held. The
+ * compose thread copies the pictures with the room lock held, and
+ * encodes the copies with only the encode lock held. The sources and
+ * the pictures are added and removed with both locks held.
+ *
+ * The compose thread sleeps on a condition until a display has drawn
+ * a new frame, and composes at most once per frame interval.
+ */
+struct mcu_room {
+	struct le le;
+	char *name;
+	struct list displ;        /* Participants (struct vidisp_st)  */
+	struct list srcl;         /* Video sources (struct vidsrc_st) */
+	struct list canvasl;      /* Composed pictures                */
+	struct lock *lock;        /* Protects the pictures and lists  */
+	struct lock *lock_enc;    /* Held while encoding              */
+	pthread_t thread;
+	pthread_mutex_t mutex;    /* Protects run and dirty, for cond */
+	pthread_cond_t cond;      /* Signalled on a new frame or stop */
+	bool dirty;               /* A new frame was drawn            */
+	bool run;
+	int fps;
+};
+
+
+static void canvas_destructor(void *arg)
+{
+	struct mcu_canvas *canvas = arg;
+
+	list_unlink(&canvas->le);
+	mem_deref(canvas->frame);
+	mem_deref(canvas->snap);
+}
+
+
+static void room_destructor(void *arg)
+{
+	struct mcu_room *room = arg;
+
+	if (room->run) {
+		pthread_mutex_lock(&room->mutex);
+		room->run = false;
+		pthread_cond_signal(&room->cond);
+		pthread_mutex_unlock(&room->mutex);
+
+		pthread_join(room->thread, NULL);
+	}
+
+	pthread_cond_destroy(&room->cond);
+	pthread_mutex_destroy(&room->mutex);
+
+	hash_unlink(&room->le);
+	mem_deref(room->lock);
+	mem_deref(room->lock_enc);
+	mem_deref(room->name);
+}
+
+
+static bool room_cmp_handler(struct le *le, void *arg)
+{
+	struct mcu_room *room = le->data;
+
+	return 0 == str_cmp(room->name, arg);
+}
+
+
+static void tile_rect(struct vidrect *r, const struct vidsz *sz,
+		      unsigned idx, unsigned n)
+{
+	unsigned cols = 1, rows;
+
+	while (cols * cols < n)
+		++cols;
+
+	rows = (n + cols - 1) / cols;
+
+	/* YUV420P needs even coordinates */
+	r->w = (sz->w / cols) & ~1u;
+	r->h = (sz->h / rows) & ~1u;
+	r->x = (idx % cols) * r->w;
+	r->y = (idx / cols) * r->h;
+}
+
+
+static void room_layout(struct mcu_room *room)
+{
+	struct le *le;
+	unsigned idx = 0;
+
+	for (le = room->displ.head; le; le = le->next) {
+
+		struct vidisp_st *st = le->data;
+
+		st->idx = idx++;
+	}
+
+	for (le = room->canvasl.head; le; le = le->next) {
+
+		struct mcu_canvas *canvas = le->data;
+
+		vidframe_fill(canvas->frame, 0, 0, 0);
+	}
+}
+
+
+/*
+ * The first source of each canvas does the encoding, and all other
+ * sources of the same canvas send the output of that encoder.
+ * A source is encoding itself if the sharing is not possible,
+ * e.g. with different video codecs or format parameters.
+ *
+ * This is checked on every frame, since the codec of a call can
+ * change. An unchanged sharing costs one comparison per source.
+ */
+static void room_share(struct mcu_room *room)
+{
+	struct le *le;
+
+	for (le = room->canvasl.head; le; le = le->next) {
+
+		struct mcu_canvas *canvas = le->data;
+
+		canvas->leader = NULL;
+	}
+
+	for (le = room->srcl.head; le; le = le->next) {
+
+		struct vidsrc_st *st = le->data;
+		struct mcu_canvas *canvas = st->canvas;
+
+		if (!canvas->leader) {
+			canvas->leader = st;
+			(void)video_encoder_share(st->arg, NULL);
+			st->shared = false;
+		}
+		else {
+			st->shared = (0 == video_encoder_share(st->arg,
+						     canvas->leader->arg));
+
+			/* not compatible, encode on its own */
+			if (!st->shared)
+				(void)video_encoder_share(st->arg, NULL);
+		}
+	}
+}
+
+
+static void timespec_add_ms(struct timespec *ts, uint32_t ms)
+{
+	const uint64_t ns = ts->tv_nsec + (uint64_t)ms * 1000000;
+
+	ts->tv_sec  += ns / 1000000000;
+	ts->tv_nsec  = ns % 1000000000;
+}
+
+
+static void compose(struct mcu_room *room)
+{
+	struct le *le;
+
+	lock_write_get(room->lock_enc);
+
+	/* the displays keep drawing while the copies are encoded */
+	lock_write_get(room->lock);
+
+	for (le = room->canvasl.head; le; le = le->next) {
+
+		struct mcu_canvas *canvas = le->data;
+
+		vidframe_copy(canvas->snap, canvas->frame);
+	}
+
+	lock_rel(room->lock);
+
+	room_share(room);
+
+	for (le = room->srcl.head; le; le = le->next) {
+
+		struct vidsrc_st *st = le->data;
+
+		if (!st->shared)
+			st->frameh(st->canvas->snap, st->arg);
+	}
+
+	lock_rel(room->lock_enc);
+}
+
+
+static void *compose_thread(void *arg)
+{
+	struct mcu_room *room = arg;
+	struct timespec ts, now;
+
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+
+	pthread_mutex_lock(&room->mutex);
+
+	while (room->run) {
+
+		/* sleep until a display has drawn a new frame */
+		if (!room->dirty) {
+			pthread_cond_wait(&room->cond, &room->mutex);
+			continue;
+		}
+
+		/* and until the next frame interval */
+		if (ETIMEDOUT != pthread_cond_timedwait(&room->cond,
+							&room->mutex, &ts))
+			continue;
+
+		room->dirty = false;
+
+		pthread_mutex_unlock(&room->mutex);
+
+		compose(room);
+
+		/* the interval starts again after an idle period */
+		timespec_add_ms(&ts, 1000/room->fps);
+
+		(void)clock_gettime(CLOCK_REALTIME, &now);
+		if (ts.tv_sec < now.tv_sec ||
+		    (ts.tv_sec == now.tv_sec && ts.tv_nsec < now.tv_nsec))
+			ts = now;
+
+		pthread_mutex_lock(&room->mutex);
+	}
+
+	pthread_mutex_unlock(&room->mutex);
+
+	return NULL;
+}
+
+
+int mcu_room_get(struct mcu_room **roomp, const char *name)
+{
+	struct mcu_room *room;
+	int err;
+
+	if (!roomp || !name)
+		return EINVAL;
+
+	room = list_ledata(hash_lookup(ht_room, hash_joaat_str(name),
+				       room_cmp_handler, (void *)name));
+	if (room) {
+		*roomp = mem_ref(room);
+		return 0;
+	}
+
+	room = mem_zalloc(sizeof(*room), room_destructor);
+	if (!room)
+		return ENOMEM;
+
+	pthread_mutex_init(&room->mutex, NULL);
+	pthread_cond_init(&room->cond, NULL);
+
+	err  = str_dup(&room->name, name);
+	err |= lock_alloc(&room->lock);
+	err |= lock_alloc(&room->lock_enc);
+	if (err)
+		goto out;
+
+	hash_append(ht_room, hash_joaat_str(name), &room->le, room);
+
+	info("vidmcu: room '%s' created\n", name);
+
+ out:
+	if (err)
+		mem_deref(room);
+	else
+		*roomp = room;
+
+	return err;
+}
+
+
+int mcu_room_add_src(struct mcu_room *room, struct vidsrc_st *st,
+		     const struct vidsz *size, int fps)
+{
+	struct mcu_canvas *canvas = NULL;
+	struct le *le;
+	int err = 0;
+
+	if (!room || !st || !size)
+		return EINVAL;
+
+	lock_write_get(room->lock_enc);
+	lock_write_get(room->lock);
+
+	for (le = room->canvasl.head; le; le = le->next) {
+
+		struct mcu_canvas *c = le->data;
+
+		if (vidsz_cmp(&c->frame->size, size)) {
+			canvas = mem_ref(c);
+			break;
+		}
+	}
+
+	if (!canvas) {
+
+		canvas = mem_zalloc(sizeof(*canvas), canvas_destructor);
+		if (!canvas) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		err  = vidframe_alloc(&canvas->frame, VID_FMT_YUV420P, size);
+		err |= vidframe_alloc(&canvas->snap, VID_FMT_YUV420P, size);
+		if (err) {
+			mem_deref(canvas);
+			goto out;
+		}
+
+		vidframe_fill(canvas->frame, 0, 0, 0);
+
+		list_append(&room->canvasl, &canvas->le, canvas);
+	}
+
+	st->canvas = canvas;
+	list_append(&room->srcl, &st->le, st);
+
+	if (!room->run) {
+
+		room->fps = fps > 0 ? fps : 15;
+		room->run = true;
+
+		err = pthread_create(&room->thread, NULL, compose_thread,
+				     room);
+		if (err)
+			room->run = false;
+	}
+
+ out:
+	lock_rel(room->lock);
+	lock_rel(room->lock_enc);
+
+	return err;
+}
+
+
+void mcu_room_remove_src(struct mcu_room *room, struct vidsrc_st *st)
+{
+	if (!room || !st)
+		return;
+
+	/* waits until the source is not encoding */
+	lock_write_get(room->lock_enc);
+	lock_write_get(room->lock);
+
+	list_unlink(&st->le);
+	st->canvas = mem_deref(st->canvas);
+
+	room_share(room);
+
+	lock_rel(room->lock);
+	lock_rel(room->lock_enc);
+
+	(void)video_encoder_share(st->arg, NULL);
+}
+
+
+void mcu_room_add_disp(struct mcu_room *room, struct vidisp_st *st)
+{
+	if (!room || !st)
+		return;
+
+	lock_write_get(room->lock);
+
+	list_append(&room->displ, &st->le, st);
+	room_layout(room);
+
+	lock_rel(room->lock);
+
+	info("vidmcu: room '%s' has %u participants\n",
+	     room->name, list_count(&room->displ));
+}
+
+
+void mcu_room_remove_disp(struct mcu_room *room, struct vidisp_st *st)
+{
+	if (!room || !st)
+		return;
+
+	lock_write_get(room->lock);
+
+	list_unlink(&st->le);
+	room_layout(room);
+
+	lock_rel(room->lock);
+}
+
+
+/**
+ * Scale a decoded frame into the tile of the participant, in every
+ * composed picture of the room
+ */
+void mcu_room_draw(struct mcu_room *room, const struct vidisp_st *st,
+		   const struct vidframe *frame)
+{
+	unsigned n;
+	struct le *le;
+
+	if (!room || !st || !frame)
+		return;
+
+	lock_write_get(room->lock);
+
+	n = list_count(&room->displ);
+
+	for (le = room->canvasl.head; le; le = le->next) {
+
+		struct mcu_canvas *canvas = le->data;
+		struct vidrect r;
+
+		tile_rect(&r, &canvas->frame->size, st->idx, n);
+
+		if (r.w && r.h)
+			vidconv(canvas->frame, frame, &r);
+	}
+
+	lock_rel(room->lock);
+
+	/* wake up the compose thread */
+	pthread_mutex_lock(&room->mutex);
+	room->dirty = true;
+	pthread_cond_signal(&room->cond);
+	pthread_mutex_unlock(&room->mutex);
+}
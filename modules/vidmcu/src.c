@@ -0,0 +1,59 @@
+/**
+ * @file vidmcu/src.c Video conference compositor -- source
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "vidmcu.h"
+
+
+static void destructor(void *arg)
+{
+	struct vidsrc_st *st = arg;
+
+	mcu_room_remove_src(st->room, st);
+	mem_deref(st->room);
+}
+
+
+int vidmcu_src_alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
+		     struct media_ctx **ctx, struct vidsrc_prm *prm,
+		     const struct vidsz *size, const char *fmt,
+		     const char *dev, vidsrc_frame_h *frameh,
+		     vidsrc_error_h *errorh, void *arg)
+{
+	struct vidsrc_st *st;
+	int err;
+	(void)ctx;
+	(void)fmt;
+	(void)errorh;
+
+	if (!stp || !prm || !size || !frameh || !dev)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->vs     = vs;
+	st->frameh = frameh;
+	st->arg    = arg;
+
+	err = mcu_room_get(&st->room, dev);
+	if (err)
+		goto out;
+
+	err = mcu_room_add_src(st->room, st, size, prm->fps);
+	if (err)
+		goto out;
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = st;
+
+	return err;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file vidmcu.c Video conference compositor
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "vidmcu.h"
+
+
+/**
+ * @defgroup vidmcu vidmcu
+ *
+ * Video conference compositor (MCU mode)
+ *
+ * This module composes the decoded video of all calls in a room into
+ * one tiled picture, which is sent back to every participant. The
+ * display of each call is one tile, and the video source of each call
+ * is the composed picture.
+ *
+ * The picture is composed once per encoder resolution, and all calls
+ * with the same resolution and video codec share one video encoder.
+ * A 9-party conference therefore costs one encode per layout, instead
+ * of one encode per participant. Since all participants get the same
+ * layout, each participant also sees its own tile.
+ *
+ * Sample config:
+ *
+ \verbatim
+  video_display           vidmcu,room0
+  video_source            vidmcu,room0
+ \endverbatim
+ */
+
+
+static struct vidisp *vidisp;
+static struct vidsrc *vidsrc;
+
+struct hash *ht_room;
+
+
+static int module_init(void)
+{
+	int err;
+
+	err = hash_alloc(&ht_room, 16);
+	if (err)
+		return err;
+
+	err = vidisp_register(&vidisp, baresip_vidispl(),
+			      "vidmcu", vidmcu_disp_alloc,
+			      NULL, vidmcu_disp_display, 0);
+	if (err)
+		return err;
+
+	err = vidsrc_register(&vidsrc, baresip_vidsrcl(),
+			      "vidmcu", vidmcu_src_alloc, NULL);
+	if (err)
+		return err;
+
+	return err;
+}
+
+
+static int module_close(void)
+{
+	vidsrc = mem_deref(vidsrc);
+	vidisp = mem_deref(vidisp);
+
+	ht_room = mem_deref(ht_room);
+
+	return 0;
+}
+
+
+EXPORT_SYM const struct mod_export DECL_EXPORTS(vidmcu) = {
+	"vidmcu",
+	"video",
+	module_init,
+	module_close,
+};
@@ -0,0 +1,67 @@
+/**
+ * @file vidmcu.h Video conference compositor -- internal interface
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+struct mcu_room;
+
+
+/* One composed picture per distinct encoder resolution */
+struct mcu_canvas {
+	struct le le;
+	struct vidframe *frame;     /* Composed by the displays        */
+	struct vidframe *snap;      /* Copy of frame, for the encoder  */
+	struct vidsrc_st *leader;   /* First source of the canvas      */
+};
+
+
+struct vidsrc_st {
+	const struct vidsrc *vs;  /* inheritance (1st) */
+
+	struct le le;
+	struct mcu_room *room;
+	struct mcu_canvas *canvas;
+	vidsrc_frame_h *frameh;
+	void *arg;
+	bool shared;
+};
+
+
+struct vidisp_st {
+	const struct vidisp *vd;  /* inheritance (1st) */
+
+	struct le le;
+	struct mcu_room *room;
+	unsigned idx;
+};
+
+
+/* Room */
+extern struct hash *ht_room;
+
+int  mcu_room_get(struct mcu_room **roomp, const char *name);
+int  mcu_room_add_src(struct mcu_room *room, struct vidsrc_st *st,
+		      const struct vidsz *size, int fps);
+void mcu_room_remove_src(struct mcu_room *room, struct vidsrc_st *st);
+void mcu_room_add_disp(struct mcu_room *room, struct vidisp_st *st);
+void mcu_room_remove_disp(struct mcu_room *room, struct vidisp_st *st);
+void mcu_room_draw(struct mcu_room *room, const struct vidisp_st *st,
+		   const struct vidframe *frame);
+
+
+/* Source */
+int vidmcu_src_alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
+		     struct media_ctx **ctx, struct vidsrc_prm *prm,
+		     const struct vidsz *size, const char *fmt,
+		     const char *dev, vidsrc_frame_h *frameh,
+		     vidsrc_error_h *errorh, void *arg);
+
+
+/* Display */
+int vidmcu_disp_alloc(struct vidisp_st **stp, const struct vidisp *vd,
+		      struct vidisp_prm *prm, const char *dev,
+		      vidisp_resize_h *resizeh, void *arg);
+int vidmcu_disp_display(struct vidisp_st *st, const char *title,
+			const struct vidframe *frame);
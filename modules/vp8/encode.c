@@ -29,6 +29,7 @@ struct videnc_state {
 	uint16_t picid;
 	videnc_packet_h *pkth;
 	void *arg;
+	const struct vp8_vidcodec *vp8;
 };
 
 
@@ -48,7 +49,6 @@ int vp8_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 	const struct vp8_vidcodec *vp8 = (struct vp8_vidcodec *)vc;
 	struct videnc_state *ves;
 	uint32_t max_fs;
-	(void)vp8;
 
 	if (!vesp || !vc || !prm || prm->pktsize < (HDR_SIZE + 1))
 		return EINVAL;
@@ -62,6 +62,7 @@ int vp8_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 			return ENOMEM;
 
 		ves->picid = rand_u16();
+		ves->vp8   = vp8;
 
 		*vesp = ves;
 	}
@@ -90,26 +91,35 @@ int vp8_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 
 static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 {
+	const struct vp8_vidcodec *vp8 = ves->vp8;
 	vpx_codec_enc_cfg_t cfg;
 	vpx_codec_err_t res;
 	vpx_codec_flags_t flags = 0;
+	unsigned threads, partitions = 0;
 
 	res = vpx_codec_enc_config_default(&vpx_codec_vp8_cx_algo, &cfg, 0);
 	if (res)
 		return EPROTO;
 
+	threads = vp8->threads ? vp8->threads : video_calc_threads(size, 4);
+
 	cfg.g_profile = 2;
 	cfg.g_w = size->w;
 	cfg.g_h = size->h;
 	cfg.g_timebase.num    = 1;
 	cfg.g_timebase.den    = ves->fps;
+	cfg.g_threads         = threads;
 #ifdef VPX_ERROR_RESILIENT_DEFAULT
-	cfg.g_error_resilient = VPX_ERROR_RESILIENT_DEFAULT;
+	if (vp8->error_resilient)
+		cfg.g_error_resilient = VPX_ERROR_RESILIENT_DEFAULT;
 #endif
 	cfg.g_pass            = VPX_RC_ONE_PASS;
 	cfg.g_lag_in_frames   = 0;
 	cfg.rc_end_usage      = VPX_VBR;
 	cfg.rc_target_bitrate = ves->bitrate;
+	cfg.rc_buf_initial_sz = 500;
+	cfg.rc_buf_optimal_sz = 600;
+	cfg.rc_buf_sz         = 1000;
 	cfg.kf_mode           = VPX_KF_AUTO;
 
 	if (ves->ctxup) {
@@ -131,7 +141,8 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 
 	ves->ctxup = true;
 
-	res = vpx_codec_control(&ves->ctx, VP8E_SET_CPUUSED, 16);
+	res = vpx_codec_control(&ves->ctx, VP8E_SET_CPUUSED,
+				(int)vp8->cpu_used);
 	if (res) {
 		warning("vp8: codec ctrl: %s\n", vpx_codec_err_to_string(res));
 	}
@@ -141,6 +152,38 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 		warning("vp8: codec ctrl: %s\n", vpx_codec_err_to_string(res));
 	}
 
+	/* one token partition per thread, for parallel encoding */
+	while ((2u << partitions) <= threads && partitions < 3)
+		++partitions;
+
+	res = vpx_codec_control(&ves->ctx, VP8E_SET_TOKEN_PARTITIONS,
+				partitions);
+	if (res) {
+		warning("vp8: codec ctrl: %s\n", vpx_codec_err_to_string(res));
+	}
+
+	res = vpx_codec_control(&ves->ctx, VP8E_SET_STATIC_THRESHOLD,
+				vp8->screen_content ? 100 : 1);
+	if (res) {
+		warning("vp8: codec ctrl: %s\n", vpx_codec_err_to_string(res));
+	}
+
+#ifdef VPX_CTRL_VP8E_SET_SCREEN_CONTENT_MODE
+	if (vp8->screen_content) {
+		res = vpx_codec_control(&ves->ctx,
+					VP8E_SET_SCREEN_CONTENT_MODE, 1);
+		if (res) {
+			warning("vp8: codec ctrl: %s\n",
+				vpx_codec_err_to_string(res));
+		}
+	}
+#endif
+
+	debug("vp8: encoder opened, picture size %u x %u"
+	      " (threads=%u, partitions=%u, cpu_used=%d)\n",
+	      size->w, size->h, threads, 1u << partitions,
+	      (int)vp8->cpu_used);
+
 	return 0;
 }
 
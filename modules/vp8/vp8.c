@@ -22,6 +22,18 @@
  *     http://www.webmproject.org/
  *
  *     https://tools.ietf.org/html/rfc7741
+ *
+ * The real-time encoder profile can be tuned with these options:
+ *
+ \verbatim
+  vp8_threads             0    # Encoder threads, 0 = from resolution
+  vp8_cpu_used            16   # Speed setting (0-16)
+  vp8_error_resilient     yes  # Error resilient mode
+  vp8_screen_content      no   # Tune for screen content
+ \endverbatim
+ *
+ * By default the number of threads and token partitions are selected
+ * from the picture size, and limited by the number of CPU cores.
  */
 
 
@@ -35,11 +47,23 @@ static struct vp8_vidcodec vp8 = {
 		.fmtp_ench = vp8_fmtp_enc,
 	},
 	.max_fs   = 3600,
+	.threads  = 0,
+	.cpu_used = 16,
+	.error_resilient = true,
+	.screen_content  = false,
 };
 
 
 static int module_init(void)
 {
+	struct conf *conf = conf_cur();
+
+	(void)conf_get_u32(conf, "vp8_threads", &vp8.threads);
+	(void)conf_get_u32(conf, "vp8_cpu_used", &vp8.cpu_used);
+	(void)conf_get_bool(conf, "vp8_error_resilient",
+			    &vp8.error_resilient);
+	(void)conf_get_bool(conf, "vp8_screen_content", &vp8.screen_content);
+
 	vidcodec_register(baresip_vidcodecl(), (struct vidcodec *)&vp8);
 
 	return 0;
@@ -7,6 +7,12 @@
 struct vp8_vidcodec {
 	struct vidcodec vc;
 	uint32_t max_fs;
+
+	/* Real-time encoder profile */
+	uint32_t threads;        /* 0 = auto (from resolution)          */
+	uint32_t cpu_used;
+	bool error_resilient;
+	bool screen_content;
 };
 
 /* Encode */
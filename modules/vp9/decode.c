@@ -30,6 +30,13 @@ struct hdr {
 
 	/* extension fields */
 	uint16_t picid;
+
+	/* layer indices */
+	unsigned tid:3;  /* TID: Temporal layer ID                  */
+	unsigned u:1;    /* U: Switching up point                   */
+	unsigned sid:3;  /* SID: Spatial layer ID                   */
+	unsigned d:1;    /* D: Inter-layer dependency used          */
+	uint8_t tl0picidx;
 };
 
 struct viddec_state {
@@ -38,8 +45,11 @@ struct viddec_state {
 	bool ctxup;
 	bool started;
 	uint16_t seq;
+	unsigned tid;
+	unsigned tid_max;
 
 	unsigned n_frames;
+	unsigned n_layer_errors;
 	size_t n_bytes;
 };
 
@@ -49,8 +59,9 @@ static void destructor(void *arg)
 	struct viddec_state *vds = arg;
 
 	if (vds->ctxup) {
-		debug("vp9: decoder stats: frames=%u, bytes=%zu\n",
-		      vds->n_frames, vds->n_bytes);
+		debug("vp9: decoder stats: frames=%u, bytes=%zu,"
+		      " layer_errors=%u\n",
+		      vds->n_frames, vds->n_bytes, vds->n_layer_errors);
 
 		vpx_codec_destroy(&vds->ctx);
 	}
@@ -123,14 +134,6 @@ static inline int hdr_decode(struct hdr *hdr, struct mbuf *mb)
 	hdr->e      = v>>2 & 0x1;
 	hdr->v      = v>>1 & 0x1;
 
-	if (hdr->p) {
-		warning("vp9: decode: P-bit not supported\n");
-		return EPROTO;
-	}
-	if (hdr->l) {
-		warning("vp9: decode: L-bit not supported\n");
-		return EPROTO;
-	}
 	if (hdr->f) {
 		warning("vp9: decode: F-bit not supported\n");
 		return EPROTO;
@@ -160,6 +163,22 @@ static inline int hdr_decode(struct hdr *hdr, struct mbuf *mb)
 		}
 	}
 
+	if (hdr->l) {
+
+		if (mbuf_get_left(mb) < 2)
+			return EBADMSG;
+
+		v = mbuf_read_u8(mb);
+
+		hdr->tid = v>>5 & 0x7;
+		hdr->u   = v>>4 & 0x1;
+		hdr->sid = v>>1 & 0x7;
+		hdr->d   = v>>0 & 0x1;
+
+		/* non-flexible mode */
+		hdr->tl0picidx = mbuf_read_u8(mb);
+	}
+
 	return 0;
 }
 
@@ -220,6 +239,8 @@ int vp9_decode(struct viddec_state *vds, struct vidframe *frame,
 
 		mbuf_rewind(vds->mb);
 		vds->started = true;
+		vds->tid = hdr.tid;
+		vds->tid_max = max(vds->tid_max, hdr.tid);
 	}
 	else {
 		if (!vds->started)
@@ -253,6 +274,15 @@ int vp9_decode(struct viddec_state *vds, struct vidframe *frame,
 			       (unsigned int)vds->mb->end, NULL, 1);
 	if (res) {
 		debug("vp9: decode error: %s\n", vpx_codec_err_to_string(res));
+
+		/* no other frame refers to a frame of the top temporal
+		   layer, so there is no need to request a new key-frame.
+		   The frames of the other layers are references. */
+		if (vds->tid > 0 && vds->tid == vds->tid_max) {
+			++vds->n_layer_errors;
+			goto out;
+		}
+
 		err = EPROTO;
 		goto out;
 	}
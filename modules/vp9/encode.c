@@ -14,10 +14,67 @@
 
 
 enum {
-	HDR_SIZE = 3,
+	HDR_SIZE = 5,
+	TL_PERIOD_MAX = 4,
 };
 
 
+/*
+ * Temporal layering is done in bypass mode, where the application
+ * controls the layer id and the reference buffers of each frame.
+ *
+ *   L1T2:  TL0 TL1 TL0 TL1 ...
+ *   L1T3:  TL0 TL2 TL1 TL2 ...
+ *
+ * The frames in the highest temporal layer are never used as a
+ * reference, and can be dropped without affecting the other layers.
+ */
+#if VPX_ENCODER_ABI_VERSION >= (5 + VPX_CODEC_ABI_VERSION)
+#define USE_TEMPORAL_LAYERS 1
+#endif
+
+struct tl_pattern {
+	unsigned period;
+	unsigned tid[TL_PERIOD_MAX];
+	vpx_enc_frame_flags_t flags[TL_PERIOD_MAX];
+	unsigned rate[3];       /* cumulative bitrate in [percent] */
+};
+
+#ifdef USE_TEMPORAL_LAYERS
+#define NO_REF_GA  (VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF)
+#define NO_UPD_ALL (VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_GF | \
+		    VP8_EFLAG_NO_UPD_ARF)
+
+static const struct tl_pattern tl_patterns[2] = {
+
+	/* L1T2 */
+	{
+		2,
+		{0, 1},
+		{
+			NO_REF_GA | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF,
+			NO_REF_GA | NO_UPD_ALL,
+		},
+		{60, 100, 0}
+	},
+
+	/* L1T3 */
+	{
+		4,
+		{0, 2, 1, 2},
+		{
+			NO_REF_GA | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF,
+			NO_REF_GA | NO_UPD_ALL,
+			NO_REF_GA | VP8_EFLAG_NO_UPD_LAST |
+			VP8_EFLAG_NO_UPD_ARF,
+			VP8_EFLAG_NO_REF_ARF | NO_UPD_ALL,
+		},
+		{40, 60, 100}
+	},
+};
+#endif
+
+
 struct videnc_state {
 	vpx_codec_ctx_t ctx;
 	struct vidsz size;
@@ -30,8 +87,14 @@ struct videnc_state {
 	videnc_packet_h *pkth;
 	void *arg;
 
+	const struct vp9_vidcodec *vp9;
+	const struct tl_pattern *tlp;
+	unsigned tl_idx;
+	uint8_t tl0picidx;
+
 	unsigned n_frames;
 	unsigned n_key_frames;
+	unsigned n_layer_frames[3];
 	size_t n_bytes;
 };
 
@@ -48,6 +111,14 @@ static void destructor(void *arg)
 		      ves->n_key_frames,
 		      ves->n_bytes);
 
+		if (ves->tlp) {
+			debug("vp9: temporal layer frames:"
+			      " TL0=%u, TL1=%u, TL2=%u\n",
+			      ves->n_layer_frames[0],
+			      ves->n_layer_frames[1],
+			      ves->n_layer_frames[2]);
+		}
+
 		vpx_codec_destroy(&ves->ctx);
 	}
 }
@@ -60,7 +131,6 @@ int vp9_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 	const struct vp9_vidcodec *vp9 = (struct vp9_vidcodec *)vc;
 	struct videnc_state *ves;
 	uint32_t max_fs;
-	(void)vp9;
 
 	if (!vesp || !vc || !prm || prm->pktsize < (HDR_SIZE + 1))
 		return EINVAL;
@@ -74,6 +144,14 @@ int vp9_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 			return ENOMEM;
 
 		ves->picid = rand_u16();
+		ves->vp9   = vp9;
+
+#ifdef USE_TEMPORAL_LAYERS
+		if (vp9->tlayers == 2)
+			ves->tlp = &tl_patterns[0];
+		else if (vp9->tlayers == 3)
+			ves->tlp = &tl_patterns[1];
+#endif
 
 		*vesp = ves;
 	}
@@ -100,10 +178,28 @@ int vp9_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 }
 
 
+/*
+ * One tile column per thread, where each tile column must be
+ * at least 256 pixels wide
+ */
+static int tile_columns_auto(const struct vidsz *size, unsigned threads)
+{
+	int log2 = 0;
+
+	while ((2u << log2) <= threads && (256u << (log2 + 1)) <= size->w)
+		++log2;
+
+	return log2;
+}
+
+
 static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 {
+	const struct vp9_vidcodec *vp9 = ves->vp9;
 	vpx_codec_enc_cfg_t cfg;
 	vpx_codec_err_t res;
+	unsigned threads;
+	int tile_columns;
 
 	res = vpx_codec_enc_config_default(&vpx_codec_vp9_cx_algo, &cfg, 0);
 	if (res)
@@ -116,18 +212,55 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 	  Profile 3 = 10/12 bit yuv422/440/444p
 	 */
 
+	threads = vp9->threads ? vp9->threads : video_calc_threads(size, 8);
+	tile_columns = vp9->tile_columns >= 0 ? vp9->tile_columns
+		: tile_columns_auto(size, threads);
+
 	cfg.g_profile         = 0;
 	cfg.g_w               = size->w;
 	cfg.g_h               = size->h;
 	cfg.g_timebase.num    = 1;
 	cfg.g_timebase.den    = ves->fps;
+	cfg.g_threads         = threads;
 	cfg.rc_target_bitrate = ves->bitrate / 1000;
-	cfg.g_error_resilient = VPX_ERROR_RESILIENT_DEFAULT;
+	cfg.g_error_resilient = vp9->error_resilient ?
+		VPX_ERROR_RESILIENT_DEFAULT : 0;
 	cfg.g_pass            = VPX_RC_ONE_PASS;
 	cfg.g_lag_in_frames   = 0;
 	cfg.rc_end_usage      = VPX_VBR;
+	cfg.rc_buf_initial_sz = 500;
+	cfg.rc_buf_optimal_sz = 600;
+	cfg.rc_buf_sz         = 1000;
+	cfg.rc_undershoot_pct = 50;
+	cfg.rc_overshoot_pct  = 50;
 	cfg.kf_mode           = VPX_KF_AUTO;
 
+#ifdef USE_TEMPORAL_LAYERS
+	if (ves->tlp) {
+		const struct tl_pattern *tlp = ves->tlp;
+		unsigned i;
+
+		cfg.ss_number_layers = 1;
+		cfg.ts_number_layers = tlp == &tl_patterns[0] ? 2 : 3;
+		cfg.ts_periodicity   = tlp->period;
+		cfg.temporal_layering_mode =
+			VP9E_TEMPORAL_LAYERING_MODE_BYPASS;
+
+		for (i=0; i<cfg.ts_number_layers; i++) {
+
+			cfg.ts_target_bitrate[i] =
+				cfg.rc_target_bitrate * tlp->rate[i] / 100;
+			cfg.ts_rate_decimator[i] =
+				1 << (cfg.ts_number_layers - 1 - i);
+		}
+
+		for (i=0; i<tlp->period; i++)
+			cfg.ts_layer_id[i] = tlp->tid[i];
+
+		ves->tl_idx = 0;
+	}
+#endif
+
 	if (ves->ctxup) {
 		debug("vp9: re-opening encoder\n");
 		vpx_codec_destroy(&ves->ctx);
@@ -143,29 +276,81 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 
 	ves->ctxup = true;
 
-	res = vpx_codec_control(&ves->ctx, VP8E_SET_CPUUSED, 8);
+	res = vpx_codec_control(&ves->ctx, VP8E_SET_CPUUSED, vp9->cpu_used);
 	if (res) {
 		warning("vp9: codec ctrl: %s\n", vpx_codec_err_to_string(res));
 	}
+#ifdef VPX_CTRL_VP9E_SET_TILE_COLUMNS
+	res = vpx_codec_control(&ves->ctx, VP9E_SET_TILE_COLUMNS,
+				tile_columns);
+	if (res) {
+		warning("vp9: codec ctrl: %s\n", vpx_codec_err_to_string(res));
+	}
+#endif
+#ifdef VPX_CTRL_VP9E_SET_ROW_MT
+	res = vpx_codec_control(&ves->ctx, VP9E_SET_ROW_MT, vp9->row_mt);
+	if (res) {
+		warning("vp9: codec ctrl: %s\n", vpx_codec_err_to_string(res));
+	}
+#endif
+#ifdef VPX_CTRL_VP9E_SET_AQ_MODE
+	/* cyclic refresh */
+	res = vpx_codec_control(&ves->ctx, VP9E_SET_AQ_MODE, 3);
+	if (res) {
+		warning("vp9: codec ctrl: %s\n", vpx_codec_err_to_string(res));
+	}
+#endif
+#ifdef VPX_CTRL_VP9E_SET_TUNE_CONTENT
+	if (vp9->screen_content) {
+		res = vpx_codec_control(&ves->ctx, VP9E_SET_TUNE_CONTENT,
+					VP9E_CONTENT_SCREEN);
+		if (res) {
+			warning("vp9: codec ctrl: %s\n",
+				vpx_codec_err_to_string(res));
+		}
+	}
+#endif
 #ifdef VP9E_SET_NOISE_SENSITIVITY
 	res = vpx_codec_control(&ves->ctx, VP9E_SET_NOISE_SENSITIVITY, 0);
 	if (res) {
 		warning("vp9: codec ctrl: %s\n", vpx_codec_err_to_string(res));
 	}
 #endif
+#ifdef USE_TEMPORAL_LAYERS
+	if (ves->tlp) {
+		res = vpx_codec_control(&ves->ctx, VP9E_SET_SVC, 1);
+		if (res) {
+			warning("vp9: codec ctrl: %s\n",
+				vpx_codec_err_to_string(res));
+		}
+	}
+#endif
 
-	info("vp9: encoder opened, picture size %u x %u\n", size->w, size->h);
+	info("vp9: encoder opened, picture size %u x %u"
+	     " (threads=%u, tile_columns=%d, cpu_used=%u)\n",
+	     size->w, size->h, threads, tile_columns, vp9->cpu_used);
 
 	return 0;
 }
 
 
-static inline void hdr_encode(uint8_t hdr[HDR_SIZE], bool start, bool end,
-			      uint16_t picid)
+static inline size_t hdr_encode(uint8_t hdr[HDR_SIZE], bool start, bool end,
+				uint16_t picid, const struct videnc_state *ves,
+				int tid)
 {
 	hdr[0] = 1<<7 | start<<3 | end<<2;
 	hdr[1] = 1<<7 | (picid>>8 & 0x7f);
 	hdr[2] = picid & 0xff;
+
+	if (tid < 0)
+		return 3;
+
+	/* Layer indices, non-flexible mode: TID | U | SID | D, TL0PICIDX */
+	hdr[0] |= 1<<5;
+	hdr[3] = (tid & 0x7)<<5 | (tid > 0)<<4;
+	hdr[4] = ves->tl0picidx;
+
+	return 5;
 }
 
 
@@ -183,10 +368,11 @@ static int send_packet(struct videnc_state *ves, bool marker,
 
 static inline int packetize(struct videnc_state *ves,
 			    bool marker, const uint8_t *buf, size_t len,
-			    size_t maxlen, uint16_t picid,
+			    size_t maxlen, uint16_t picid, int tid,
 			    uint32_t rtp_ts)
 {
 	uint8_t hdr[HDR_SIZE];
+	size_t hdr_len;
 	bool start = true;
 	int err = 0;
 
@@ -194,9 +380,9 @@ static inline int packetize(struct videnc_state *ves,
 
 	while (len > maxlen) {
 
-		hdr_encode(hdr, start, false, picid);
+		hdr_len = hdr_encode(hdr, start, false, picid, ves, tid);
 
-		err |= send_packet(ves, false, hdr, sizeof(hdr), buf, maxlen,
+		err |= send_packet(ves, false, hdr, hdr_len, buf, maxlen,
 				   rtp_ts);
 
 		buf  += maxlen;
@@ -204,9 +390,9 @@ static inline int packetize(struct videnc_state *ves,
 		start = false;
 	}
 
-	hdr_encode(hdr, start, true, picid);
+	hdr_len = hdr_encode(hdr, start, true, picid, ves, tid);
 
-	err |= send_packet(ves, marker, hdr, sizeof(hdr), buf, len,
+	err |= send_packet(ves, marker, hdr, hdr_len, buf, len,
 			   rtp_ts);
 
 	return err;
@@ -221,6 +407,7 @@ int vp9_encode(struct videnc_state *ves, bool update,
 	vpx_codec_err_t res;
 	vpx_image_t *img = NULL;
 	vpx_img_fmt_t img_fmt;
+	int tid = -1;
 	int err, i;
 
 	if (!ves || !frame)
@@ -254,6 +441,30 @@ int vp9_encode(struct videnc_state *ves, bool update,
 		flags |= VPX_EFLAG_FORCE_KF;
 	}
 
+#ifdef USE_TEMPORAL_LAYERS
+	if (ves->tlp) {
+		vpx_svc_layer_id_t layer_id;
+
+		if (update)
+			ves->tl_idx = 0;
+
+		tid    = ves->tlp->tid[ves->tl_idx];
+		flags |= ves->tlp->flags[ves->tl_idx];
+
+		memset(&layer_id, 0, sizeof(layer_id));
+		layer_id.temporal_layer_id = tid;
+
+		res = vpx_codec_control(&ves->ctx, VP9E_SET_SVC_LAYER_ID,
+					&layer_id);
+		if (res) {
+			warning("vp9: codec ctrl: %s\n",
+				vpx_codec_err_to_string(res));
+		}
+
+		ves->tl_idx = (ves->tl_idx + 1) % ves->tlp->period;
+	}
+#endif
+
 	img = vpx_img_wrap(NULL, img_fmt, frame->size.w, frame->size.h,
 			   16, NULL);
 	if (!img) {
@@ -277,6 +488,9 @@ int vp9_encode(struct videnc_state *ves, bool update,
 
 	++ves->picid;
 
+	if (tid == 0)
+		++ves->tl0picidx;
+
 	for (;;) {
 		bool marker = true;
 		const vpx_codec_cx_pkt_t *pkt;
@@ -292,6 +506,13 @@ int vp9_encode(struct videnc_state *ves, bool update,
 
 		if (pkt->data.frame.flags & VPX_FRAME_IS_KEY) {
 			++ves->n_key_frames;
+
+			/* a key-frame always starts a new pattern */
+			if (ves->tlp && tid != 0) {
+				tid = 0;
+				ves->tl_idx = 1;
+				++ves->tl0picidx;
+			}
 		}
 
 		if (pkt->data.frame.flags & VPX_FRAME_IS_FRAGMENT)
@@ -303,10 +524,13 @@ int vp9_encode(struct videnc_state *ves, bool update,
 				marker,
 				pkt->data.frame.buf,
 				pkt->data.frame.sz,
-				ves->pktsize, ves->picid,
+				ves->pktsize, ves->picid, tid,
 				ts);
 		if (err)
 			return err;
+
+		if (tid >= 0 && marker)
+			++ves->n_layer_frames[tid];
 	}
 
  out:
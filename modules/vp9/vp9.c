@@ -20,6 +20,30 @@
  *
  * Libvpx version 1.3.0 or later is required.
  *
+ * Temporal scalability (L1T2 or L1T3) requires libvpx 1.5.0 or later,
+ * and is enabled with the following config option:
+ *
+ \verbatim
+  vp9_temporal_layers     3    # Number of temporal layers (1-3)
+ \endverbatim
+ *
+ * The real-time encoder profile can be tuned with these options:
+ *
+ \verbatim
+  vp9_threads             0    # Encoder threads, 0 = from resolution
+  vp9_cpu_used            8    # Speed setting (0-9)
+  vp9_tile_columns        2    # log2 of tile columns, default auto
+  vp9_row_mt              yes  # Row based multi-threading
+  vp9_error_resilient     yes  # Error resilient mode
+  vp9_screen_content      no   # Tune for screen content
+ \endverbatim
+ *
+ * By default the number of threads and tile columns are selected from
+ * the picture size, and limited by the number of CPU cores.
+ *
+ * The frames in the highest temporal layer are marked as discardable,
+ * so that they are dropped first when the video send-queue is congested.
+ *
  *
  * References:
  *
@@ -29,6 +53,9 @@
  */
 
 
+static bool vp9_discard(const uint8_t *hdr, size_t hdr_len);
+
+
 static struct vp9_vidcodec vp9 = {
 	.vc = {
 		.name      = "VP9",
@@ -37,13 +64,79 @@ static struct vp9_vidcodec vp9 = {
 		.decupdh   = vp9_decode_update,
 		.dech      = vp9_decode,
 		.fmtp_ench = vp9_fmtp_enc,
+		.discardh  = vp9_discard,
 	},
-	.max_fs = 3600
+	.max_fs = 3600,
+	.tlayers = 1,
+	.threads = 0,
+	.cpu_used = 8,
+	.tile_columns = -1,
+	.row_mt = true,
+	.error_resilient = true,
+	.screen_content = false,
 };
 
 
+/*
+ * Returns true if the packet belongs to a frame in the highest
+ * temporal layer, which is never used as a reference.
+ */
+static bool vp9_discard(const uint8_t *hdr, size_t hdr_len)
+{
+	size_t pos = 1;
+	unsigned tid;
+
+	if (hdr_len < 1 || vp9.tlayers < 2)
+		return false;
+
+	/* L: Layer indices present */
+	if (!(hdr[0] & 1<<5))
+		return false;
+
+	/* I: Picture ID present, M: 15-bit Picture ID */
+	if (hdr[0] & 1<<7) {
+		if (hdr_len < 2)
+			return false;
+		pos += (hdr[1] & 1<<7) ? 2 : 1;
+	}
+
+	if (hdr_len <= pos)
+		return false;
+
+	tid = hdr[pos]>>5 & 0x7;
+
+	return tid > 0 && tid == vp9.tlayers - 1;
+}
+
+
 static int module_init(void)
 {
+	struct conf *conf = conf_cur();
+	uint32_t tile_columns;
+
+	(void)conf_get_u32(conf, "vp9_temporal_layers", &vp9.tlayers);
+	(void)conf_get_u32(conf, "vp9_threads", &vp9.threads);
+	(void)conf_get_u32(conf, "vp9_cpu_used", &vp9.cpu_used);
+	(void)conf_get_bool(conf, "vp9_row_mt", &vp9.row_mt);
+	(void)conf_get_bool(conf, "vp9_error_resilient",
+			    &vp9.error_resilient);
+	(void)conf_get_bool(conf, "vp9_screen_content", &vp9.screen_content);
+
+	if (0 == conf_get_u32(conf, "vp9_tile_columns", &tile_columns))
+		vp9.tile_columns = (int)min(tile_columns, 6u);
+
+	if (vp9.cpu_used > 9) {
+		warning("vp9: vp9_cpu_used must be 0-9 (%u)\n",
+			vp9.cpu_used);
+		vp9.cpu_used = 9;
+	}
+
+	if (vp9.tlayers < 1 || vp9.tlayers > 3) {
+		warning("vp9: invalid number of temporal layers (%u)\n",
+			vp9.tlayers);
+		return EINVAL;
+	}
+
 	vidcodec_register(baresip_vidcodecl(), (struct vidcodec *)&vp9);
 	return 0;
 }
@@ -7,6 +7,15 @@
 struct vp9_vidcodec {
 	struct vidcodec vc;
 	uint32_t max_fs;
+	uint32_t tlayers;
+
+	/* Real-time encoder profile */
+	uint32_t threads;        /* 0 = auto (from resolution)          */
+	uint32_t cpu_used;
+	int tile_columns;        /* log2 of columns, -1 = auto          */
+	bool row_mt;
+	bool error_resilient;
+	bool screen_content;
 };
 
 /* Encode */
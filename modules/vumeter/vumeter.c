@@ -16,22 +16,22 @@
  *
  * The Volume unit (VU) meter module takes the audio-signal as input
  * and prints a simple ASCII-art bar for the recording and playback levels.
- * It is using the aufilt API to get the audio samples.
+ * It is using the aufilt API to follow the audio streams, and shows the
+ * level of each frame as computed by the audio core, i.e. as it is sent
+ * and as it is played.
  */
 
 
 struct vumeter_enc {
 	struct aufilt_enc_st af;  /* inheritance */
 	struct tmr tmr;
-	double avg_rec;
-	volatile bool started;
+	const struct audio *au;
 };
 
 struct vumeter_dec {
 	struct aufilt_dec_st af;  /* inheritance */
 	struct tmr tmr;
-	double avg_play;
-	volatile bool started;
+	const struct audio *au;
 };
 
 
@@ -85,22 +85,24 @@ static void print_vumeter(int pos, int color, double value)
 static void enc_tmr_handler(void *arg)
 {
 	struct vumeter_enc *st = arg;
+	struct aulevel lvl;
 
 	tmr_start(&st->tmr, 100, enc_tmr_handler, st);
 
-	if (st->started)
-		print_vumeter(60, 31, st->avg_rec);
+	if (0 == audio_level_frame(st->au, true, &lvl))
+		print_vumeter(60, 31, aulevel_dbov(&lvl));
 }
 
 
 static void dec_tmr_handler(void *arg)
 {
 	struct vumeter_dec *st = arg;
+	struct aulevel lvl;
 
 	tmr_start(&st->tmr, 100, dec_tmr_handler, st);
 
-	if (st->started)
-		print_vumeter(80, 32, st->avg_play);
+	if (0 == audio_level_frame(st->au, false, &lvl))
+		print_vumeter(80, 32, aulevel_dbov(&lvl));
 }
 
 
@@ -109,9 +111,8 @@ static int encode_update(struct aufilt_enc_st **stp, void **ctx,
 {
 	struct vumeter_enc *st;
 	(void)ctx;
-	(void)prm;
 
-	if (!stp || !af)
+	if (!stp || !af || !prm)
 		return EINVAL;
 
 	if (*stp)
@@ -121,6 +122,8 @@ static int encode_update(struct aufilt_enc_st **stp, void **ctx,
 	if (!st)
 		return ENOMEM;
 
+	st->au = prm->au;
+
 	tmr_start(&st->tmr, 100, enc_tmr_handler, st);
 
 	*stp = (struct aufilt_enc_st *)st;
@@ -134,9 +137,8 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 {
 	struct vumeter_dec *st;
 	(void)ctx;
-	(void)prm;
 
-	if (!stp || !af)
+	if (!stp || !af || !prm)
 		return EINVAL;
 
 	if (*stp)
@@ -146,6 +148,8 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 	if (!st)
 		return ENOMEM;
 
+	st->au = prm->au;
+
 	tmr_start(&st->tmr, 100, dec_tmr_handler, st);
 
 	*stp = (struct aufilt_dec_st *)st;
@@ -154,30 +158,8 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 }
 
 
-static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
-{
-	struct vumeter_enc *vu = (void *)st;
-
-	vu->avg_rec = aulevel_calc_dbov(sampv, *sampc);
-	vu->started = true;
-
-	return 0;
-}
-
-
-static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
-{
-	struct vumeter_dec *vu = (void *)st;
-
-	vu->avg_play = aulevel_calc_dbov(sampv, *sampc);
-	vu->started = true;
-
-	return 0;
-}
-
-
 static struct aufilt vumeter = {
-	LE_INIT, "vumeter", encode_update, encode, decode_update, decode
+	LE_INIT, "vumeter", encode_update, NULL, decode_update, NULL
 };
 
 
@@ -0,0 +1,441 @@
+/**
+ * @file src/aecref.c  Far-end reference for echo cancellation
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * The samples given to the audio player are kept in a ring buffer, as
+ * mono at the sample rate of the echo canceller.
+ *
+ * Each device has a clock that maps its running sample count to the
+ * wall clock. The player clock gives the time at which a reference
+ * sample is played. The source clock gives the time at which a captured
+ * sample was recorded. The callback jitter of the devices is smoothed
+ * out of both clocks.
+ *
+ * With the two clocks, the reference that was played while a frame was
+ * captured can be found. The timestamps are taken in the device
+ * callbacks, so the reference is read too late by the output latency
+ * of the player and the input latency of the source, plus the acoustic
+ * path. The echo canceller estimates this delay itself.
+ *
+ * Reads are contiguous as long as the clocks agree within RESYNC_MS.
+ * Beyond that, the read position jumps and the reader is told so.
+ */
+
+
+#define CLOCK_SMOOTH  0.02    /* weight of a new clock measurement */
+
+enum {
+	REF_MS    = 1000,     /* reference history [ms]           */
+	RESYNC_MS = 4,        /* drift before the reader jumps    */
+	PLAY_MAXC = 8192,     /* max. samples per player block    */
+};
+
+
+/** Running sample count of a device, mapped to the wall clock */
+struct devclock {
+	uint64_t n;           /**< Samples per channel so far        */
+	double off;           /**< Smoothed time of sample 0 in [s]  */
+	uint32_t srate;       /**< Sample rate in [Hz]               */
+	uint8_t ch;           /**< Number of channels                */
+	bool valid;           /**< Clock has been set                */
+};
+
+/** Far-end reference */
+struct aecref {
+	struct lock *lock;    /**< Protects all fields below         */
+	int16_t *bufv;        /**< Reference samples, mono           */
+	size_t bufsz;         /**< Size of bufv in [samples]         */
+	uint32_t srate;       /**< Reference sample rate in [Hz]     */
+	struct devclock play; /**< Player clock, in reference rate   */
+	struct devclock src;  /**< Source clock                      */
+	uint64_t rpos;        /**< Next read position                */
+	bool rvalid;          /**< Read position is set              */
+	double frame;         /**< Capture time of next frame [s]    */
+	struct resampler *rs; /**< Player format to reference        */
+	uint32_t rs_srate;    /**< Input sample rate of resampler    */
+	uint8_t rs_ch;        /**< Input channels of resampler       */
+	int16_t *tmpv;        /**< Resampler output                  */
+	size_t tmpsz;         /**< Size of tmpv in [samples]         */
+	uint64_t n_jump;      /**< Number of read position jumps     */
+};
+
+
+static void destructor(void *arg)
+{
+	struct aecref *ref = arg;
+
+	mem_deref(ref->rs);
+	mem_deref(ref->tmpv);
+	mem_deref(ref->bufv);
+	mem_deref(ref->lock);
+}
+
+
+static void devclock_set(struct devclock *clk, uint32_t srate, uint8_t ch)
+{
+	if (clk->valid && clk->srate == srate && clk->ch == ch)
+		return;
+
+	memset(clk, 0, sizeof(*clk));
+
+	clk->srate = srate;
+	clk->ch    = ch;
+}
+
+
+/* usec is the wall clock time of the first sample of the block */
+static void devclock_update(struct devclock *clk, size_t frames,
+			    uint64_t usec)
+{
+	const double off = usec * 1e-6 - (double)clk->n / clk->srate;
+
+	if (clk->valid) {
+		clk->off += (off - clk->off) * CLOCK_SMOOTH;
+	}
+	else {
+		clk->off   = off;
+		clk->valid = true;
+	}
+
+	clk->n += frames;
+}
+
+
+/**
+ * Allocate a far-end reference for echo cancellation
+ *
+ * @param refp  Pointer to allocated far-end reference
+ * @param srate Sample rate of the echo canceller in [Hz]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aecref_alloc(struct aecref **refp, uint32_t srate)
+{
+	struct aecref *ref;
+	int err;
+
+	if (!refp || !srate)
+		return EINVAL;
+
+	ref = mem_zalloc(sizeof(*ref), destructor);
+	if (!ref)
+		return ENOMEM;
+
+	ref->srate = srate;
+	ref->bufsz = (size_t)srate * REF_MS / 1000;
+
+	ref->bufv = mem_zalloc(ref->bufsz * sizeof(int16_t), NULL);
+	if (!ref->bufv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = lock_alloc(&ref->lock);
+	if (err)
+		goto out;
+
+	devclock_set(&ref->play, srate, 1);
+
+ out:
+	if (err)
+		mem_deref(ref);
+	else
+		*refp = ref;
+
+	return err;
+}
+
+
+/**
+ * Set the format of the audio player, before it is started. This
+ * allocates the conversion to the reference format, so that
+ * aecref_play() does not allocate memory.
+ *
+ * @param ref   Far-end reference
+ * @param srate Sample rate of the player in [Hz]
+ * @param ch    Number of channels of the player
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aecref_player_set(struct aecref *ref, uint32_t srate, uint8_t ch)
+{
+	struct resampler *rs = NULL;
+	int16_t *tmpv = NULL;
+	size_t tmpsz;
+	bool same;
+	int err;
+
+	if (!ref || !srate || !ch)
+		return EINVAL;
+
+	if (srate == ref->srate && ch == 1)
+		return 0;
+
+	lock_write_get(ref->lock);
+	same = ref->rs && ref->rs_srate == srate && ref->rs_ch == ch;
+	lock_rel(ref->lock);
+
+	if (same)
+		return 0;
+
+	tmpsz = (size_t)PLAY_MAXC / ch * ref->srate / srate + 2;
+
+	err = resampler_alloc(&rs, RESAMPLER_FAST, srate, ch, ref->srate, 1);
+	if (err)
+		return err;
+
+	tmpv = mem_alloc(tmpsz * sizeof(int16_t), NULL);
+	if (!tmpv) {
+		mem_deref(rs);
+		return ENOMEM;
+	}
+
+	lock_write_get(ref->lock);
+
+	mem_deref(ref->rs);
+	mem_deref(ref->tmpv);
+
+	ref->rs       = rs;
+	ref->rs_srate = srate;
+	ref->rs_ch    = ch;
+	ref->tmpv     = tmpv;
+	ref->tmpsz    = tmpsz;
+
+	lock_rel(ref->lock);
+
+	return 0;
+}
+
+
+/* must be called with the lock held, and must not allocate memory */
+static int play_convert(struct aecref *ref, const int16_t **sampvp,
+			size_t *sampcp, uint32_t srate, uint8_t ch)
+{
+	size_t outc;
+	int err;
+
+	/* the player format was not set with aecref_player_set() */
+	if (!ref->rs || ref->rs_srate != srate || ref->rs_ch != ch)
+		return ENOTSUP;
+
+	outc = ref->tmpsz;
+
+	err = resampler_process(ref->rs, ref->tmpv, &outc, *sampvp, *sampcp);
+	if (err)
+		return err;
+
+	*sampvp = ref->tmpv;
+	*sampcp = outc;
+
+	return 0;
+}
+
+
+/**
+ * Add samples that are given to the audio player. If the player does
+ * not use the reference format, it must be set with aecref_player_set()
+ *
+ * @note This function has REAL-TIME properties
+ *
+ * @param ref   Far-end reference
+ * @param sampv Samples to be played
+ * @param sampc Number of samples
+ * @param srate Sample rate of the player in [Hz]
+ * @param ch    Number of channels of the player
+ * @param usec  Time when the first sample is played in [us]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aecref_play(struct aecref *ref, const int16_t *sampv, size_t sampc,
+		uint32_t srate, uint8_t ch, uint64_t usec)
+{
+	size_t i;
+	int err = 0;
+
+	if (!ref || !sampv || !srate || !ch)
+		return EINVAL;
+
+	if (sampc > PLAY_MAXC)
+		return EOVERFLOW;
+
+	lock_write_get(ref->lock);
+
+	if (srate != ref->srate || ch != 1) {
+		err = play_convert(ref, &sampv, &sampc, srate, ch);
+		if (err)
+			goto out;
+	}
+
+	devclock_update(&ref->play, sampc, usec);
+
+	for (i=0; i<sampc; i++)
+		ref->bufv[(ref->play.n - sampc + i) % ref->bufsz] = sampv[i];
+
+ out:
+	lock_rel(ref->lock);
+
+	return err;
+}
+
+
+/**
+ * Register samples that are captured from the audio source
+ *
+ * @note This function has REAL-TIME properties
+ *
+ * @param ref   Far-end reference
+ * @param sampc Number of samples
+ * @param srate Sample rate of the source in [Hz]
+ * @param ch    Number of channels of the source
+ * @param usec  Time when the first sample was captured in [us]
+ */
+void aecref_capture(struct aecref *ref, size_t sampc,
+		    uint32_t srate, uint8_t ch, uint64_t usec)
+{
+	if (!ref || !srate || !ch)
+		return;
+
+	lock_write_get(ref->lock);
+
+	devclock_set(&ref->src, srate, ch);
+	devclock_update(&ref->src, sampc / ch, usec);
+
+	lock_rel(ref->lock);
+}
+
+
+/**
+ * Set the capture time of the next frame to be read from the source
+ *
+ * @param ref     Far-end reference
+ * @param pending Captured samples that are not read yet, including
+ *                the next frame
+ */
+void aecref_frame(struct aecref *ref, size_t pending)
+{
+	const struct devclock *src;
+
+	if (!ref)
+		return;
+
+	lock_write_get(ref->lock);
+
+	src = &ref->src;
+
+	if (src->valid) {
+		const uint64_t pend = min(pending / src->ch, src->n);
+
+		ref->frame = src->off + (double)(src->n - pend) / src->srate;
+	}
+
+	lock_rel(ref->lock);
+}
+
+
+/**
+ * Read the reference that was played while the current frame was
+ * captured, as mono at the sample rate of the echo canceller
+ *
+ * @param ref   Far-end reference
+ * @param refv  Buffer for the reference samples
+ * @param sampc Number of samples to read
+ * @param jump  Optional, set to true if the read is not contiguous
+ *              with the previous read
+ *
+ * @return 0 if success, ENOENT if there is no reference
+ */
+int aecref_read(struct aecref *ref, int16_t *refv, size_t sampc,
+		bool *jump)
+{
+	int64_t pos, tol;
+	size_t i;
+	int err = 0;
+
+	if (!ref || !refv)
+		return EINVAL;
+
+	tol = (int64_t)ref->srate * RESYNC_MS / 1000;
+
+	if (jump)
+		*jump = false;
+
+	lock_write_get(ref->lock);
+
+	if (!ref->play.valid || !ref->src.valid) {
+		memset(refv, 0, sampc * sizeof(int16_t));
+		err = ENOENT;
+		goto out;
+	}
+
+	pos = (int64_t)((ref->frame - ref->play.off) * ref->srate);
+
+	if (!ref->rvalid || pos > (int64_t)ref->rpos + tol ||
+	    pos < (int64_t)ref->rpos - tol) {
+
+		if (ref->rvalid) {
+			++ref->n_jump;
+			if (jump)
+				*jump = true;
+		}
+
+		ref->rpos   = (uint64_t)max(pos, (int64_t)0);
+		ref->rvalid = true;
+	}
+
+	for (i=0; i<sampc; i++) {
+
+		const uint64_t p = ref->rpos + i;
+
+		/* not played yet, or no longer in the buffer */
+		if (p >= ref->play.n || p + ref->bufsz < ref->play.n)
+			refv[i] = 0;
+		else
+			refv[i] = ref->bufv[p % ref->bufsz];
+	}
+
+	ref->rpos += sampc;
+
+ out:
+	lock_rel(ref->lock);
+
+	return err;
+}
+
+
+/**
+ * Get the sample rate of the far-end reference
+ *
+ * @param ref Far-end reference
+ *
+ * @return Sample rate in [Hz]
+ */
+uint32_t aecref_srate(const struct aecref *ref)
+{
+	return ref ? ref->srate : 0;
+}
+
+
+int aecref_debug(struct re_printf *pf, const struct aecref *ref)
+{
+	double lag = 0;
+
+	if (!ref)
+		return 0;
+
+	/* how far the reference is ahead of the capture */
+	if (ref->play.valid && ref->src.valid) {
+		lag = ((double)ref->play.n / ref->srate + ref->play.off)
+			- ref->frame;
+	}
+
+	return re_hprintf(pf, "srate=%uHz lead=%.1fms jumps=%llu",
+			  ref->srate, lag * 1000.0, ref->n_jump);
+}
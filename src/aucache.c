@@ -0,0 +1,347 @@
+/**
+ * @file aucache.c  Cache of decoded audio files
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * Audio files are decoded once to native-endian 16-bit PCM and kept
+ * in memory. All players of the same file share one read-only buffer,
+ * each with its own read position. An entry is reloaded when the
+ * size or modification time of the file changes.
+ *
+ * The cache is not locked, it must only be used from the main thread.
+ */
+
+
+enum {
+	AUCACHE_HASH_SIZE = 16,
+	READ_SIZE = 4096,
+};
+
+
+struct aucache {
+	struct hash *ht;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t reloads;
+};
+
+struct aucache_ent {
+	struct le he;
+	char *path;
+	struct mbuf *mb;        /**< Decoded PCM, shared read-only     */
+	uint32_t srate;
+	uint8_t ch;
+	time_t mtime;
+	uint64_t fsize;
+};
+
+
+static void ent_destructor(void *data)
+{
+	struct aucache_ent *ent = data;
+
+	hash_unlink(&ent->he);
+	mem_deref(ent->mb);
+	mem_deref(ent->path);
+}
+
+
+static void cache_destructor(void *data)
+{
+	struct aucache *ac = data;
+
+	hash_flush(ac->ht);
+	mem_deref(ac->ht);
+}
+
+
+static bool ent_cmp_handler(struct le *le, void *arg)
+{
+	const struct aucache_ent *ent = le->data;
+
+	return 0 == str_cmp(ent->path, arg);
+}
+
+
+/*
+ * Decode a whole WAV file to native-endian S16. The buffer is sized
+ * from the file size up front, and each block is converted in place
+ * at the end of the buffer.
+ */
+static int load_pcm(struct aucache_ent *ent, size_t fsize)
+{
+	struct aufile_prm prm;
+	struct aufile *af;
+	struct mbuf *mb = NULL;
+	size_t sz;
+	int err;
+
+	err = aufile_open(&af, &prm, ent->path, AUFILE_READ);
+	if (err)
+		return err;
+
+	switch (prm.fmt) {
+
+	case AUFMT_S16LE:
+		sz = fsize;
+		break;
+
+	case AUFMT_PCMA:
+	case AUFMT_PCMU:
+		sz = fsize * 2;
+		break;
+
+	default:
+		err = ENOSYS;
+		goto out;
+	}
+
+	mb = mbuf_alloc(sz ? sz : READ_SIZE);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (;;) {
+		uint8_t buf[READ_SIZE];
+		const int16_t *s16 = (void *)buf;
+		size_t i, n = sizeof(buf), sampc;
+		int16_t *p;
+
+		err = aufile_read(af, buf, &n);
+		if (err || !n)
+			break;
+
+		sampc = (prm.fmt == AUFMT_S16LE) ? n / 2 : n;
+
+		if (mb->size - mb->end < sampc * 2) {
+			err = mbuf_resize(mb, mb->end + sampc * 2);
+			if (err)
+				break;
+		}
+
+		p = (void *)(mb->buf + mb->end);
+
+		switch (prm.fmt) {
+
+		case AUFMT_S16LE:
+			for (i=0; i<sampc; i++)
+				p[i] = sys_ltohs(s16[i]);
+			break;
+
+		case AUFMT_PCMA:
+			g711_alaw_dec(p, buf, sampc);
+			break;
+
+		case AUFMT_PCMU:
+			g711_ulaw_dec(p, buf, sampc);
+			break;
+
+		default:
+			break;
+		}
+
+		mb->end += sampc * 2;
+	}
+	if (err)
+		goto out;
+
+	/* give back what the size estimate overshot */
+	if (mb->end && mb->end < mb->size)
+		(void)mbuf_resize(mb, mb->end);
+
+	mb->pos    = 0;
+	ent->mb    = mem_ref(mb);
+	ent->srate = prm.srate;
+	ent->ch    = prm.channels;
+
+ out:
+	mem_deref(mb);
+	mem_deref(af);
+
+	return err;
+}
+
+
+static int ent_alloc(struct aucache_ent **entp, struct aucache *ac,
+		     const char *path, const struct stat *st)
+{
+	struct aucache_ent *ent;
+	int err;
+
+	ent = mem_zalloc(sizeof(*ent), ent_destructor);
+	if (!ent)
+		return ENOMEM;
+
+	ent->mtime = st->st_mtime;
+	ent->fsize = st->st_size;
+
+	err = str_dup(&ent->path, path);
+	if (err)
+		goto out;
+
+	err = load_pcm(ent, (size_t)st->st_size);
+	if (err)
+		goto out;
+
+	hash_append(ac->ht, hash_joaat_str(path), &ent->he, ent);
+
+ out:
+	if (err)
+		mem_deref(ent);
+	else
+		*entp = ent;
+
+	return err;
+}
+
+
+int aucache_alloc(struct aucache **acp)
+{
+	struct aucache *ac;
+	int err;
+
+	if (!acp)
+		return EINVAL;
+
+	ac = mem_zalloc(sizeof(*ac), cache_destructor);
+	if (!ac)
+		return ENOMEM;
+
+	err = hash_alloc(&ac->ht, AUCACHE_HASH_SIZE);
+	if (err)
+		goto out;
+
+ out:
+	if (err)
+		mem_deref(ac);
+	else
+		*acp = ac;
+
+	return err;
+}
+
+
+/**
+ * Get the decoded PCM samples of an audio file
+ *
+ * @param ac    Audio file cache
+ * @param mbp   Returns a reference to the shared PCM buffer
+ * @param srate Returns the sampling rate
+ * @param ch    Returns the number of channels
+ * @param path  Full path of the audio file
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note The returned buffer is shared and must not be modified,
+ *       including its position.
+ */
+int aucache_get(struct aucache *ac, struct mbuf **mbp,
+		uint32_t *srate, uint8_t *ch, const char *path)
+{
+	struct aucache_ent *ent;
+	struct stat st;
+	int err;
+
+	if (!ac || !mbp || !path)
+		return EINVAL;
+
+	if (stat(path, &st))
+		return errno;
+
+	ent = list_ledata(hash_lookup(ac->ht, hash_joaat_str(path),
+				      ent_cmp_handler, (void *)path));
+	if (ent) {
+		if (ent->mtime == st.st_mtime &&
+		    ent->fsize == (uint64_t)st.st_size) {
+			++ac->hits;
+			goto out;
+		}
+
+		debug("aucache: %s has changed, reloading\n", path);
+
+		++ac->reloads;
+		ent = mem_deref(ent);
+	}
+
+	++ac->misses;
+
+	err = ent_alloc(&ent, ac, path, &st);
+	if (err)
+		return err;
+
+ out:
+	*mbp = mem_ref(ent->mb);
+
+	if (srate)
+		*srate = ent->srate;
+	if (ch)
+		*ch = ent->ch;
+
+	return 0;
+}
+
+
+static bool debug_handler(struct le *le, void *arg)
+{
+	const struct aucache_ent *ent = le->data;
+	struct re_printf *pf = arg;
+
+	/* the cache holds one reference itself */
+	(void)re_hprintf(pf, "  %s: %u Hz, %u ch, %zu bytes, %u users\n",
+			 ent->path, ent->srate, ent->ch, ent->mb->size,
+			 mem_nrefs(ent->mb) - 1);
+
+	return false;
+}
+
+
+struct usage {
+	uint32_t n;
+	size_t sz;
+};
+
+
+static bool usage_handler(struct le *le, void *arg)
+{
+	const struct aucache_ent *ent = le->data;
+	struct usage *usage = arg;
+
+	++usage->n;
+	usage->sz += ent->mb->size;
+
+	return false;
+}
+
+
+int aucache_debug(struct re_printf *pf, const struct aucache *ac)
+{
+	struct usage usage = {0, 0};
+	int err;
+
+	if (!ac)
+		return 0;
+
+	(void)hash_apply(ac->ht, usage_handler, &usage);
+
+	err  = re_hprintf(pf, "Audio file cache:\n");
+	err |= re_hprintf(pf, "  files:   %u (%zu bytes)\n",
+			  usage.n, usage.sz);
+	err |= re_hprintf(pf, "  hits:    %u\n", ac->hits);
+	err |= re_hprintf(pf, "  misses:  %u (%u reloaded)\n",
+			  ac->misses, ac->reloads);
+
+	(void)hash_apply(ac->ht, debug_handler, pf);
+
+	return err;
+}
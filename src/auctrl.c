@@ -0,0 +1,221 @@
+/**
+ * @file src/auctrl.c  Adaptive audio encoder control
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * Encoder parameters are derived from the RTCP receiver reports of the
+ * peer, and from the time spent in the encoder:
+ *
+ * - The expected packet loss follows the smoothed fraction lost.
+ *
+ * - Above LOSS_HIGH the bitrate is cut in proportion to the loss,
+ *   starting from the measured send rate. Below LOSS_LOW, and while
+ *   the round-trip time is normal, the limit is raised again step by
+ *   step, and dropped when it no longer limits the encoder.
+ *
+ * - An available bandwidth reported by the peer (REMB) caps the limit.
+ *
+ * - When encoding takes more than LOAD_HIGH of the frame duration,
+ *   the host is considered saturated and the complexity is lowered.
+ *   It is raised again when the load is below LOAD_LOW.
+ */
+
+
+#define LOSS_SMOOTH  0.3      /* weight of a new loss report          */
+#define LOSS_HIGH   10.0      /* cut the bitrate above [%]            */
+#define LOSS_LOW     2.0      /* raise the bitrate below [%]          */
+#define RAISE        1.08     /* bitrate step up per report           */
+#define LOAD_HIGH    0.20     /* lower complexity above this load     */
+#define LOAD_LOW     0.05     /* raise complexity below this load     */
+#define LOAD_SMOOTH  0.05     /* weight of a new load measurement     */
+
+enum {
+	BITRATE_MIN    = 6000,    /* lowest bitrate limit [bit/s]     */
+	BITRATE_MAX    = 510000,  /* no limit above [bit/s]           */
+	RTT_HIGH       = 400,     /* do not raise above [ms]          */
+	COMPLEXITY_MIN = 2,
+	COMPLEXITY_MAX = 10,
+	LOAD_FRAMES    = 50,      /* frames between complexity steps  */
+};
+
+
+/**
+ * Initialise an encoder controller
+ *
+ * @param ctl Encoder controller
+ */
+void auctrl_init(struct auctrl *ctl)
+{
+	if (!ctl)
+		return;
+
+	memset(ctl, 0, sizeof(*ctl));
+
+	ctl->complexity = COMPLEXITY_MAX;
+}
+
+
+/**
+ * Feed an RTCP report into the encoder controller
+ *
+ * @param ctl      Encoder controller
+ * @param loss     Fraction of packets lost in [%]
+ * @param rtt      Round-trip time in [ms], 0 if unknown
+ * @param bw       Available bandwidth in [bit/s], 0 if unknown
+ * @param send_bps Measured send rate in [bit/s]
+ */
+void auctrl_feedback(struct auctrl *ctl, double loss, uint32_t rtt,
+		     uint32_t bw, uint32_t send_bps)
+{
+	uint32_t bitrate, pkt_loss;
+
+	if (!ctl)
+		return;
+
+	loss = min(max(loss, 0.0), 100.0);
+
+	if (ctl->n_reports++)
+		ctl->loss += (loss - ctl->loss) * LOSS_SMOOTH;
+	else
+		ctl->loss = loss;
+
+	ctl->rtt = rtt;
+	if (bw)
+		ctl->bw = bw;
+
+	bitrate = ctl->bitrate;
+
+	if (loss > LOSS_HIGH) {
+		const uint32_t base = bitrate ? bitrate : send_bps;
+
+		if (base)
+			bitrate = (uint32_t)(base * (1.0 - loss / 200.0));
+	}
+	else if (loss < LOSS_LOW && bitrate && rtt < RTT_HIGH) {
+
+		bitrate = (uint32_t)(bitrate * RAISE);
+
+		/* the limit is no longer reached by the encoder */
+		if (bitrate >= BITRATE_MAX ||
+		    (send_bps && bitrate > send_bps * 3 / 2))
+			bitrate = 0;
+	}
+
+	if (ctl->bw && (!bitrate || bitrate > ctl->bw))
+		bitrate = ctl->bw;
+
+	if (bitrate)
+		bitrate = max(bitrate, (uint32_t)BITRATE_MIN);
+
+	pkt_loss = (uint32_t)(ctl->loss + 0.5);
+
+	if (bitrate != ctl->bitrate || pkt_loss != ctl->pkt_loss) {
+		ctl->bitrate  = bitrate;
+		ctl->pkt_loss = pkt_loss;
+		ctl->changed  = true;
+	}
+}
+
+
+/**
+ * Feed the time spent encoding one frame into the encoder controller
+ *
+ * @param ctl        Encoder controller
+ * @param enc_usec   Encoding time in [us]
+ * @param frame_usec Frame duration in [us]
+ */
+void auctrl_load(struct auctrl *ctl, uint32_t enc_usec, uint32_t frame_usec)
+{
+	if (!ctl || !frame_usec)
+		return;
+
+	ctl->load += ((double)enc_usec / frame_usec - ctl->load) * LOAD_SMOOTH;
+
+	if (++ctl->n_frames < LOAD_FRAMES)
+		return;
+
+	ctl->n_frames = 0;
+
+	if (ctl->load > LOAD_HIGH && ctl->complexity > COMPLEXITY_MIN) {
+		--ctl->complexity;
+		ctl->changed = true;
+	}
+	else if (ctl->load < LOAD_LOW && ctl->complexity < COMPLEXITY_MAX) {
+		++ctl->complexity;
+		ctl->changed = true;
+	}
+}
+
+
+/**
+ * Get the encoder parameters, if they have changed
+ *
+ * @param ctl Encoder controller
+ * @param prm Encoder parameters to update
+ *
+ * @return true if changed, otherwise false
+ */
+bool auctrl_update(struct auctrl *ctl, struct auenc_param *prm)
+{
+	if (!ctl || !prm || !ctl->changed)
+		return false;
+
+	prm->bitrate    = ctl->bitrate;
+	prm->pkt_loss   = ctl->pkt_loss;
+	prm->complexity = ctl->complexity;
+
+	ctl->changed = false;
+
+	return true;
+}
+
+
+/**
+ * Decode the bitrate of a REMB message (draft-alvestrand-rmcat-remb)
+ *
+ * @param mb Application layer feedback of an RTCP PSFB message
+ *
+ * @return Available bandwidth in [bit/s], 0 if not REMB
+ */
+uint32_t auctrl_remb_decode(const struct mbuf *mb)
+{
+	const uint8_t *p;
+	uint32_t mantissa;
+	unsigned exp;
+
+	if (!mb || mbuf_get_left(mb) < 8)
+		return 0;
+
+	p = mbuf_buf(mb);
+
+	if (memcmp(p, "REMB", 4))
+		return 0;
+
+	exp      = p[5] >> 2;
+	mantissa = (uint32_t)(p[5] & 0x3) << 16 | p[6] << 8 | p[7];
+
+	/* saturate, the encoder has no use for more */
+	if (exp > 13)
+		return UINT32_MAX;
+
+	return mantissa << exp;
+}
+
+
+int auctrl_debug(struct re_printf *pf, const struct auctrl *ctl)
+{
+	if (!ctl)
+		return 0;
+
+	return re_hprintf(pf, "bitrate=%u loss=%.1f%% rtt=%ums bw=%u"
+			  " complexity=%u load=%.1f%%",
+			  ctl->bitrate, ctl->loss, ctl->rtt, ctl->bw,
+			  ctl->complexity, ctl->load * 100.0);
+}
@@ -8,6 +8,7 @@
 #define _BSD_SOURCE 1
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -53,7 +54,23 @@
  */
 
 enum {
-	AUDIO_SAMPSZ    = 3*1920  /* Max samples, 48000Hz 2ch at 60ms */
+	AUDIO_SAMPSZ    = 3*1920, /* Max samples, 48000Hz 2ch at 60ms */
+	AUDIO_PTIME_MAX = 120,    /* Sample buffers hold 120ms audio  */
+	AUDIO_MB_HDRSZ  = 64,     /* Space for RTP extension headers  */
+	SILENCE_HANGOVER = 5,     /* Silent packets before skipping   */
+	CN_REFRESH      = 1000,   /* Resend CN in silence after [ms]  */
+	CN_DELTA        = 3,      /* Resend CN on level change [dB]   */
+	CTRL_HISTORY    = 8,      /* Encoder changes kept for debug   */
+	PACK_AUTO_MAX   = 3,      /* Max frames/packet from budget    */
+	EVENT_TELEV     = 0,      /* Receive event, telephone-event   */
+	EVENT_PT        = 1,      /* Receive event, payload type      */
+};
+
+
+/** A change of the encoder parameters, for debugging */
+struct ctrl_change {
+	double time;                  /**< Stream time in [s]              */
+	struct auenc_param prm;       /**< New encoder parameters          */
 };
 
 
@@ -81,33 +98,74 @@ struct autx {
 	struct auenc_state *enc;      /**< Audio encoder state (optional)  */
 	struct aubuf *aubuf;          /**< Packetize outgoing stream       */
 	size_t aubuf_maxsz;           /**< Maximum aubuf size in [bytes]   */
-	struct auresamp resamp;       /**< Optional resampler for DSP      */
+	struct resampler *rs;         /**< Optional resampler for DSP      */
 	struct list filtl;            /**< Audio filters in encoding order */
 	struct mbuf *mb;              /**< Buffer for outgoing RTP packets */
 	char device[64];              /**< Audio source device name        */
 	int16_t *sampv;               /**< Sample buffer                   */
 	int16_t *sampv_rs;            /**< Sample buffer for resampler     */
+	size_t sampvsz;               /**< Size of sampv in [samples]      */
+	size_t sampv_rssz;            /**< Size of sampv_rs in [samples]   */
 	uint32_t ptime;               /**< Packet time for sending         */
 	uint64_t ts_ext;              /**< Ext. Timestamp for outgoing RTP */
 	uint32_t ts_base;
 	uint32_t ts_tel;              /**< Timestamp for Telephony Events  */
-	size_t psize;                 /**< Packet size for sending         */
+	size_t psize;                 /**< Frame size for sending          */
+	uint32_t maxptime;            /**< Max packet time of peer [ms]    */
+	uint32_t nframes;             /**< Frames per packet               */
+	uint32_t nframes_cmd;         /**< Frames per packet, 0 for auto   */
+	uint32_t nframes_max;         /**< Frames the encoder takes, or 0  */
+	int16_t *packv;               /**< Frames waiting to be sent       */
+	size_t packvsz;               /**< Size of packv in [samples]      */
+	size_t packc;                 /**< Samples in packv                */
+	uint32_t packn;               /**< Frames in packv                 */
+	bool counted;                 /**< Counted in audio_txc            */
+	struct lock *lock;            /**< Protects encoder and packing    */
 	bool marker;                  /**< Marker bit for outgoing RTP     */
 	bool muted;                   /**< Audio source is muted           */
+	struct vad vad;               /**< Voice Activity Detector         */
+	int cn_pt;                    /**< Comfort Noise payload, or -1    */
+	double cn_level;              /**< Last sent noise level [dBov]    */
+	uint32_t cn_age;              /**< Time since CN was sent [ms]     */
+	bool silent;                  /**< Sending Comfort Noise           */
+	struct auctrl ctrl;           /**< Adaptive encoder control        */
+	struct auenc_param enc_prm;   /**< Current encoder parameters      */
+	char *enc_fmtp;               /**< Encoder format parameters       */
+	uint32_t fb_seq;              /**< Last RTCP feedback applied      */
+	struct ctrl_change ctrlv[CTRL_HISTORY]; /**< Recent changes        */
+	uint32_t n_ctrl;              /**< Number of encoder changes       */
 	int cur_key;                  /**< Currently transmitted event     */
 	enum aufmt src_fmt;
 	bool need_conv;
+	void *convv;                  /**< Buffer for source conversion    */
+	size_t convsz;                /**< Size of convv in [bytes]        */
+	struct aecref *aecref;        /**< Far-end reference (optional)    */
+	struct aulevel lvl;           /**< Level of the last frame         */
+	struct aulevel pack_lvl;      /**< Level of the packed frames      */
 
 	struct {
 		uint64_t aubuf_overrun;
 		uint64_t aubuf_underrun;
+		uint64_t n_silent;    /**< Frames not sent (silence)       */
+		uint64_t n_cn;        /**< Comfort Noise packets sent      */
+		uint64_t n_clip;      /**< Samples at full scale           */
 	} stats;
 
+	/* written by the RTCP handler, read by the encoder */
+	struct {
+		double loss;          /**< Fraction lost in [%]            */
+		uint32_t rtt;         /**< Round-trip time in [ms]         */
+		uint32_t bw;          /**< Available bandwidth [bit/s]     */
+		uint32_t seq;         /**< Incremented for each report     */
+	} fb;
+
 #ifdef HAVE_PTHREAD
 	union {
 		struct {
 			pthread_t tid;/**< Audio transmit thread           */
 			bool run;     /**< Audio transmit thread running   */
+			pthread_mutex_t mutex; /**< For the cond only      */
+			pthread_cond_t cond;   /**< Signalled by source    */
 		} thr;
 	} u;
 #endif
@@ -135,19 +193,39 @@ struct aurx {
 	const struct aucodec *ac;     /**< Current audio decoder           */
 	struct audec_state *dec;      /**< Audio decoder state (optional)  */
 	struct aubuf *aubuf;          /**< Incoming audio buffer           */
-	struct auresamp resamp;       /**< Optional resampler for DSP      */
+	struct resampler *rs;         /**< Optional resampler for DSP      */
 	struct list filtl;            /**< Audio filters in decoding order */
 	char device[64];              /**< Audio player device name        */
 	int16_t *sampv;               /**< Sample buffer                   */
 	int16_t *sampv_rs;            /**< Sample buffer for resampler     */
+	size_t sampvsz;               /**< Size of sampv in [samples]      */
+	size_t sampv_rssz;            /**< Size of sampv_rs in [samples]   */
 	uint32_t ptime;               /**< Packet time for receiving       */
 	int pt;                       /**< Payload type for incoming RTP   */
+	int pt_req;                   /**< Payload type change requested   */
 	double level_last;
 	bool level_set;
 	enum aufmt play_fmt;
 	bool need_conv;
+	void *convv;                  /**< Buffer for player conversion    */
+	size_t convsz;                /**< Size of convv in [bytes]        */
+	int16_t *playv;               /**< Buffer in the player thread     */
+	size_t playsz;                /**< Size of playv in [bytes]        */
 	struct timestamp_recv ts_recv;
 	uint64_t n_discard;
+	uint64_t n_skip;              /**< Packets not decoded (silence)   */
+	unsigned n_silent;            /**< Consecutive silent packets      */
+	uint32_t frame_ts;            /**< RTP timestamp interval of frame */
+	uint16_t seq_last;            /**< Sequence number of last packet  */
+	struct cngen cng;             /**< Comfort Noise generator         */
+	bool cn;                      /**< Sender is in silence            */
+	uint64_t n_cn;                /**< Comfort Noise packets received  */
+	struct aecref *aecref;        /**< Far-end reference (optional)    */
+	struct auplc *plc;            /**< Packet Loss Concealment         */
+	uint64_t n_plc;               /**< Frames concealed                */
+	struct aulevel lvl;           /**< Level of the last frame         */
+	struct lock *lock;            /**< Protects the level              */
+	uint64_t n_clip;              /**< Samples at full scale           */
 };
 
 
@@ -158,6 +236,7 @@ struct audio {
 	struct aurx rx;               /**< Receive                         */
 	struct stream *strm;          /**< Generic media stream            */
 	struct telev *telev;          /**< Telephony events                */
+	struct aecref *aecref;        /**< Far-end reference for AEC       */
 	struct config_audio cfg;      /**< Audio configuration             */
 	bool started;                 /**< Stream is started flag          */
 	bool level_enabled;           /**< Audio level RTP ext. enabled    */
@@ -171,6 +250,41 @@ struct audio {
 /* RFC 6464 */
 static const char *uri_aulevel = "urn:ietf:params:rtp-hdrext:ssrc-audio-level";
 
+/* Number of audio streams that are sending, for the packet budget */
+static uint32_t audio_txc;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t audio_txc_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+/* audio_txc is changed by the main thread, and read by the encoders */
+static void audio_txc_add(int delta)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&audio_txc_mutex);
+#endif
+	audio_txc += delta;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&audio_txc_mutex);
+#endif
+}
+
+
+static uint32_t audio_txc_get(void)
+{
+	uint32_t n;
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&audio_txc_mutex);
+#endif
+	n = audio_txc;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&audio_txc_mutex);
+#endif
+
+	return n;
+}
+
 
 static double audio_calc_seconds(uint64_t rtp_ts, uint32_t clock_rate)
 {
@@ -209,18 +323,23 @@ static double aurx_calc_seconds(const struct aurx *aurx)
 }
 
 
-static void stop_tx(struct autx *tx, struct audio *a)
+/* stop the audio source and the transmit thread, keep the filters */
+static void stop_source(struct autx *tx, struct audio *a)
 {
-	if (!tx || !a)
-		return;
+	bool thread = false;
 
 	switch (a->cfg.txmode) {
 
 #ifdef HAVE_PTHREAD
 	case AUDIO_MODE_THREAD:
 		if (tx->u.thr.run) {
+			pthread_mutex_lock(&tx->u.thr.mutex);
 			tx->u.thr.run = false;
+			pthread_cond_signal(&tx->u.thr.cond);
+			pthread_mutex_unlock(&tx->u.thr.mutex);
+
 			pthread_join(tx->u.thr.tid, NULL);
+			thread = true;
 		}
 		break;
 #endif
@@ -229,8 +348,33 @@ static void stop_tx(struct autx *tx, struct audio *a)
 	}
 
 	/* audio source must be stopped first */
-	tx->ausrc = mem_deref(tx->ausrc);
-	tx->aubuf = mem_deref(tx->aubuf);
+	tx->ausrc  = mem_deref(tx->ausrc);
+	tx->aubuf  = mem_deref(tx->aubuf);
+	tx->aecref = mem_deref(tx->aecref);
+
+#ifdef HAVE_PTHREAD
+	/* the source signals the thread until it is stopped */
+	if (thread) {
+		pthread_cond_destroy(&tx->u.thr.cond);
+		pthread_mutex_destroy(&tx->u.thr.mutex);
+	}
+#else
+	(void)thread;
+#endif
+
+	if (tx->counted) {
+		tx->counted = false;
+		audio_txc_add(-1);
+	}
+}
+
+
+static void stop_tx(struct autx *tx, struct audio *a)
+{
+	if (!tx || !a)
+		return;
+
+	stop_source(tx, a);
 
 	list_flush(&tx->filtl);
 }
@@ -244,6 +388,7 @@ static void stop_rx(struct aurx *rx)
 	/* audio player must be stopped first */
 	rx->auplay = mem_deref(rx->auplay);
 	rx->aubuf  = mem_deref(rx->aubuf);
+	rx->aecref = mem_deref(rx->aecref);
 
 	list_flush(&rx->filtl);
 }
@@ -253,6 +398,8 @@ static void audio_destructor(void *arg)
 {
 	struct audio *a = arg;
 
+	stream_thread_detach(a->strm);
+
 	stop_tx(&a->tx, a);
 	stop_rx(&a->rx);
 
@@ -265,12 +412,23 @@ static void audio_destructor(void *arg)
 	mem_deref(a->rx.aubuf);
 	mem_deref(a->tx.sampv_rs);
 	mem_deref(a->rx.sampv_rs);
+	mem_deref(a->tx.packv);
+	mem_deref(a->tx.convv);
+	mem_deref(a->rx.convv);
+	mem_deref(a->rx.playv);
+	mem_deref(a->tx.rs);
+	mem_deref(a->rx.rs);
+	mem_deref(a->rx.plc);
+	mem_deref(a->tx.enc_fmtp);
+	mem_deref(a->tx.lock);
+	mem_deref(a->rx.lock);
 
 	list_flush(&a->tx.filtl);
 	list_flush(&a->rx.filtl);
 
 	mem_deref(a->strm);
 	mem_deref(a->telev);
+	mem_deref(a->aecref);
 }
 
 
@@ -300,6 +458,79 @@ static inline double calc_ptime(size_t nsamp, uint32_t srate, uint8_t channels)
 }
 
 
+/*
+ * Sample buffers are sized for the negotiated format, instead of for
+ * the largest format (48000Hz stereo). They only grow, if the codec
+ * or the sample rate is changed.
+ */
+static size_t sampv_size(uint32_t srate, uint8_t ch, uint32_t ptime)
+{
+	size_t sampc;
+
+	sampc = calc_nsamp(srate, ch, max(ptime, (uint32_t)AUDIO_PTIME_MAX));
+
+	return min(sampc, (size_t)AUDIO_SAMPSZ);
+}
+
+
+static bool sampv_fits(const int16_t *sampv, size_t sz,
+		       uint32_t srate, uint8_t ch, uint32_t ptime)
+{
+	return sampv && sz >= sampv_size(srate, ch, ptime);
+}
+
+
+static int sampv_alloc(int16_t **sampvp, size_t *szp,
+		       uint32_t srate, uint8_t ch, uint32_t ptime)
+{
+	size_t sampc;
+	int16_t *sampv;
+
+	if (sampv_fits(*sampvp, *szp, srate, ch, ptime))
+		return 0;
+
+	sampc = sampv_size(srate, ch, ptime);
+
+	sampv = mem_zalloc(sampc * sizeof(int16_t), NULL);
+	if (!sampv)
+		return ENOMEM;
+
+	mem_deref(*sampvp);
+	*sampvp = sampv;
+	*szp    = sampc;
+
+	return 0;
+}
+
+
+/*
+ * Buffer for sample format conversion. It is allocated when the device
+ * is started, so that the real-time handlers never allocate memory.
+ */
+static int convbuf_alloc(void **bufp, size_t *szp, size_t sz)
+{
+	void *buf;
+
+	if (*bufp && *szp >= sz)
+		return 0;
+
+	buf = mem_realloc(*bufp, sz);
+	if (!buf)
+		return ENOMEM;
+
+	*bufp = buf;
+	*szp  = sz;
+
+	return 0;
+}
+
+
+static inline void *convbuf_get(void *buf, size_t bufsz, size_t sz)
+{
+	return sz <= bufsz ? buf : NULL;
+}
+
+
 /**
  * Get the DSP samplerate for an audio-codec (exception for G.722 and MPA)
  */
@@ -370,7 +601,7 @@ static int add_audio_codec(struct audio *a, struct sdp_media *m,
 
 
 static int append_rtpext(struct audio *au, struct mbuf *mb,
-			 int16_t *sampv, size_t sampc)
+			 const struct aulevel *lvl)
 {
 	uint8_t data[1];
 	double level;
@@ -378,7 +609,7 @@ static int append_rtpext(struct audio *au, struct mbuf *mb,
 
 	/* audio level must be calculated from the audio samples that
 	 * are actually sent on the network. */
-	level = aulevel_calc_dbov(sampv, sampc);
+	level = aulevel_dbov(lvl);
 
 	data[0] = (int)-level & 0x7f;
 
@@ -392,6 +623,61 @@ static int append_rtpext(struct audio *au, struct mbuf *mb,
 }
 
 
+/* Advance the RTP timestamp by one frame */
+static void autx_ts_advance(struct autx *tx, size_t sampc)
+{
+	size_t frame_size;  /* number of samples per channel */
+	size_t sampc_rtp;
+
+	/* Convert from audio samplerate to RTP clockrate */
+	sampc_rtp = sampc * tx->ac->crate / tx->ac->srate;
+
+	/* The RTP clock rate used for generating the RTP timestamp is
+	 * independent of the number of channels and the encoding
+	 * However, MPA support variable packet durations. Thus, MPA
+	 * should update the ts according to its current internal state.
+	 */
+	frame_size = sampc_rtp / get_ch(tx->ac);
+
+	tx->ts_ext += (uint32_t)frame_size;
+}
+
+
+/*
+ * Apply the latest RTCP feedback, and update the encoder if the
+ * controller has changed its parameters.
+ *
+ * @note This function has REAL-TIME properties
+ * @note Must be called with the tx lock held
+ */
+static void autx_adapt(struct audio *a, struct autx *tx)
+{
+	const uint32_t seq = tx->fb.seq;
+	struct ctrl_change *chg;
+	int err;
+
+	if (seq != tx->fb_seq) {
+		tx->fb_seq = seq;
+
+		auctrl_feedback(&tx->ctrl, tx->fb.loss, tx->fb.rtt,
+				tx->fb.bw, a->strm->metric_tx.cur_bitrate);
+	}
+
+	if (!tx->ac->encupdh || !auctrl_update(&tx->ctrl, &tx->enc_prm))
+		return;
+
+	err = tx->ac->encupdh(&tx->enc, tx->ac, &tx->enc_prm, tx->enc_fmtp);
+	if (err) {
+		warning("audio: encoder update: %m\n", err);
+		return;
+	}
+
+	chg = &tx->ctrlv[tx->n_ctrl++ % CTRL_HISTORY];
+	chg->time = autx_calc_seconds(tx);
+	chg->prm  = tx->enc_prm;
+}
+
+
 /**
  * Encoder audio and send via stream
  *
@@ -401,18 +687,26 @@ static int append_rtpext(struct audio *au, struct mbuf *mb,
  * @param tx    Audio transmit object
  * @param sampv Audio samples
  * @param sampc Number of audio samples
+ * @param lvl   Level statistics of the audio samples
+ *
+ * @return 0 if success, otherwise errorcode
  */
-static void encode_rtp_send(struct audio *a, struct autx *tx,
-			    int16_t *sampv, size_t sampc)
+static int encode_rtp_send(struct audio *a, struct autx *tx,
+			   int16_t *sampv, size_t sampc,
+			   const struct aulevel *lvl)
 {
-	size_t frame_size;  /* number of samples per channel */
-	size_t sampc_rtp;
 	size_t len;
 	size_t ext_len = 0;
+	uint64_t t0 = 0;
 	int err;
 
 	if (!tx->ac || !tx->ac->ench)
-		return;
+		return 0;
+
+	if (a->cfg.adaptive) {
+		autx_adapt(a, tx);
+		t0 = time_usec();
+	}
 
 	tx->mb->pos = tx->mb->end = STREAM_PRESZ;
 
@@ -421,9 +715,9 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 		/* skip the extension header */
 		tx->mb->pos += RTPEXT_HDR_SIZE;
 
-		err = append_rtpext(a, tx->mb, sampv, sampc);
+		err = append_rtpext(a, tx->mb, lvl);
 		if (err)
-			return;
+			return err;
 
 		ext_len = tx->mb->pos - STREAM_PRESZ;
 
@@ -432,7 +726,7 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 
 		err = rtpext_hdr_encode(tx->mb, ext_len - RTPEXT_HDR_SIZE);
 		if (err)
-			return;
+			return err;
 
 		tx->mb->pos = STREAM_PRESZ + ext_len;
 		tx->mb->end = STREAM_PRESZ + ext_len;
@@ -441,6 +735,16 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 	len = mbuf_get_space(tx->mb);
 
 	err = tx->ac->ench(tx->enc, mbuf_buf(tx->mb), &len, sampv, sampc);
+
+	/* a saturated host shows as a long encoding time */
+	if (a->cfg.adaptive) {
+		const double ptime = calc_ptime(sampc, get_srate(tx->ac),
+						get_ch(tx->ac));
+
+		auctrl_load(&tx->ctrl, (uint32_t)(time_usec() - t0),
+			    (uint32_t)(ptime * 1000));
+	}
+
 	if ((err & 0xffff0000) == 0x00010000) {
 		/* MPA needs some special treatment here */
 		tx->ts_ext = err & 0xffff;
@@ -467,43 +771,213 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 		}
 	}
 
-	/* Convert from audio samplerate to RTP clockrate */
-	sampc_rtp = sampc * tx->ac->crate / tx->ac->srate;
+	autx_ts_advance(tx, sampc);
 
-	/* The RTP clock rate used for generating the RTP timestamp is
-	 * independent of the number of channels and the encoding
-	 * However, MPA support variable packet durations. Thus, MPA
-	 * should update the ts according to its current internal state.
-	 */
-	frame_size = sampc_rtp / get_ch(tx->ac);
+ out:
+	tx->marker = false;
 
-	tx->ts_ext += (uint32_t)frame_size;
+	return err;
+}
+
+
+/*
+ * Silence suppression: instead of the silent frame, send a Comfort
+ * Noise packet when the silence starts, when the noise level changes
+ * and every CN_REFRESH ms.
+ *
+ * @note This function has REAL-TIME properties
+ */
+static void send_cn(struct audio *a, struct autx *tx, size_t sampc)
+{
+	const double level = tx->vad.noise;
+	int err;
+
+	if (!tx->silent || tx->cn_age >= CN_REFRESH ||
+	    level > tx->cn_level + CN_DELTA ||
+	    level < tx->cn_level - CN_DELTA) {
+
+		tx->mb->pos = tx->mb->end = STREAM_PRESZ;
+
+		err = cn_encode(tx->mb, level);
+		if (err)
+			goto out;
+
+		tx->mb->pos = STREAM_PRESZ;
+
+		err = stream_send(a->strm, false, false, tx->cn_pt,
+				  tx->ts_ext & 0xffffffff, tx->mb);
+		if (err)
+			goto out;
+
+		tx->cn_level = level;
+		tx->cn_age   = 0;
+		++tx->stats.n_cn;
+	}
 
  out:
-	tx->marker = false;
+	tx->silent = true;
+	tx->cn_age += (uint32_t)calc_ptime(sampc, get_srate(tx->ac),
+					   get_ch(tx->ac));
+	++tx->stats.n_silent;
+
+	autx_ts_advance(tx, sampc);
 }
 
 
 /*
+ * Codecs whose encoder takes several frames in one call, and produces
+ * a valid payload for them. Other encoders take exactly one frame, and
+ * some of them silently encode only the first frame of a longer buffer.
+ */
+static bool aucodec_can_pack(const struct aucodec *ac)
+{
+	static const char *namev[] = {"opus", "PCMU", "PCMA", "G722", "L16"};
+	size_t i;
+
+	if (!ac)
+		return false;
+
+	for (i=0; i<ARRAY_SIZE(namev); i++) {
+		if (0 == str_casecmp(ac->name, namev[i]))
+			return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * Number of frames per packet, set by command or derived from the
+ * packet rate budget, and limited by the maxptime of the peer.
+ *
+ * @note Must be called with the tx lock held
+ */
+static uint32_t autx_nframes(const struct audio *a, const struct autx *tx)
+{
+	uint32_t n = tx->nframes_cmd;
+	uint32_t maxptime;
+
+	if (!tx->ptime || !aucodec_can_pack(tx->ac))
+		return 1;
+
+	if (!n && a->cfg.pps_max) {
+		const uint32_t pps = audio_txc_get() * 1000 / tx->ptime;
+
+		n = (pps + a->cfg.pps_max - 1) / a->cfg.pps_max;
+		n = min(n, (uint32_t)PACK_AUTO_MAX);
+	}
+
+	maxptime = tx->maxptime ? tx->maxptime : AUDIO_PTIME_MAX;
+	maxptime = min(maxptime, (uint32_t)AUDIO_PTIME_MAX);
+
+	n = min(n, maxptime / tx->ptime);
+
+	if (tx->nframes_max)
+		n = min(n, tx->nframes_max);
+
+	return max(n, 1u);
+}
+
+
+/*
+ * Send the frames in the packing buffer as one packet
+ *
  * @note This function has REAL-TIME properties
  */
-static void poll_aubuf_tx(struct audio *a)
+static void autx_flush(struct audio *a, struct autx *tx)
+{
+	int err;
+
+	if (!tx->packc)
+		return;
+
+	err = encode_rtp_send(a, tx, tx->packv, tx->packc, &tx->pack_lvl);
+
+	/* the encoder only takes one frame at a time */
+	if (err && tx->packn > 1) {
+		warning("audio: %s cannot pack %u frames per packet\n",
+			tx->ac->name, tx->packn);
+		tx->nframes_max = 1;
+	}
+
+	tx->packc = 0;
+	tx->packn = 0;
+	memset(&tx->pack_lvl, 0, sizeof(tx->pack_lvl));
+}
+
+
+/*
+ * Encode and send one frame, or collect it until there are enough
+ * frames for one packet. The codec encodes the packed frames in one
+ * go, e.g. as a multi-frame Opus packet or as concatenated G.711.
+ *
+ * @note This function has REAL-TIME properties
+ */
+static void autx_pack(struct audio *a, struct autx *tx,
+		      int16_t *sampv, size_t sampc)
+{
+	/* the packet time only changes between packets */
+	if (!tx->packn)
+		tx->nframes = autx_nframes(a, tx);
+
+	if (tx->nframes < 2 || !tx->packv) {
+		(void)encode_rtp_send(a, tx, sampv, sampc, &tx->lvl);
+		return;
+	}
+
+	if (tx->packc + sampc > tx->packvsz)
+		autx_flush(a, tx);
+
+	memcpy(&tx->packv[tx->packc], sampv, sampc * sizeof(int16_t));
+	tx->packc += sampc;
+	aulevel_add(&tx->pack_lvl, &tx->lvl);
+
+	if (++tx->packn >= tx->nframes)
+		autx_flush(a, tx);
+}
+
+
+/*
+ * Encode and send one frame from the source buffer
+ *
+ * @return True if the frame was processed
+ *
+ * @note This function has REAL-TIME properties
+ */
+static bool poll_aubuf_tx(struct audio *a)
 {
 	struct autx *tx = &a->tx;
 	int16_t *sampv = tx->sampv;
 	size_t sampc;
 	size_t sz;
 	size_t num_bytes;
+	struct aulevel lvl;
 	struct le *le;
+	bool done = false;
 	int err = 0;
 
 	sz = aufmt_sample_size(tx->src_fmt);
-	if (!sz)
-		return;
+	if (!sz || !tx->sampv)
+		return false;
+
+	/* In poll mode this is the real-time source callback, which must
+	   not wait for an encoder update in the main thread. The frame
+	   stays in the buffer until the next callback. */
+	if (a->cfg.txmode == AUDIO_MODE_POLL) {
+		if (lock_write_try(tx->lock))
+			return false;
+	}
+	else {
+		lock_write_get(tx->lock);
+	}
 
 	num_bytes = tx->psize;
 	sampc = tx->psize / sz;
 
+	/* the frame starts with the oldest samples in the buffer */
+	if (tx->aecref)
+		aecref_frame(tx->aecref, aubuf_cur_size(tx->aubuf) / sz);
+
 	/* timed read from audio-buffer */
 
 	if (tx->src_fmt == AUFMT_S16LE) {
@@ -522,26 +996,23 @@ static void poll_aubuf_tx(struct audio *a)
 			tx->need_conv = true;
 		}
 
-		tmp_sampv = mem_zalloc(num_bytes, NULL);
+		tmp_sampv = convbuf_get(tx->convv, tx->convsz, num_bytes);
 		if (!tmp_sampv)
-			return;
+			goto out;
 
 		aubuf_read(tx->aubuf, tmp_sampv, num_bytes);
 
 		auconv_to_s16(sampv, tx->src_fmt, tmp_sampv, sampc);
-
-		mem_deref(tmp_sampv);
 	}
 
 	/* optional resampler */
-	if (tx->resamp.resample) {
-		size_t sampc_rs = AUDIO_SAMPSZ;
+	if (tx->rs) {
+		size_t sampc_rs = tx->sampv_rssz;
 
-		err = auresamp(&tx->resamp,
-			       tx->sampv_rs, &sampc_rs,
-			       tx->sampv, sampc);
+		err = resampler_process(tx->rs, tx->sampv_rs, &sampc_rs,
+					tx->sampv, sampc);
 		if (err)
-			return;
+			goto out;
 
 		sampv = tx->sampv_rs;
 		sampc = sampc_rs;
@@ -558,8 +1029,36 @@ static void poll_aubuf_tx(struct audio *a)
 		warning("audio: aufilter encode: %m\n", err);
 	}
 
+	/* the level of the frame as sent, shared by all its users.
+	   It is published under the tx lock, which is held here */
+	aulevel_calc(&lvl, sampv, sampc);
+	tx->lvl = lvl;
+	tx->stats.n_clip += lvl.clip;
+	done = true;
+
+	/* Silence suppression, if the peer accepts Comfort Noise */
+	if (tx->cn_pt >= 0 && tx->ac) {
+
+		if (!vad_process_level(&tx->vad, aulevel_dbov(&tx->lvl))) {
+			autx_flush(a, tx);
+			send_cn(a, tx, sampc);
+			goto out;
+		}
+
+		/* RFC 3551: the marker bit starts a talkspurt */
+		if (tx->silent) {
+			tx->silent = false;
+			tx->marker = true;
+		}
+	}
+
 	/* Encode and send */
-	encode_rtp_send(a, tx, sampv, sampc);
+	autx_pack(a, tx, sampv, sampc);
+
+ out:
+	lock_rel(tx->lock);
+
+	return done;
 }
 
 
@@ -590,6 +1089,58 @@ static void check_telev(struct audio *a, struct autx *tx)
 }
 
 
+/*
+ * @note This function has REAL-TIME properties
+ */
+static void auplay_write_cn(struct aurx *rx, void *sampv, size_t sampc)
+{
+	int16_t *tmp_sampv;
+
+	if (rx->play_fmt == AUFMT_S16LE) {
+		cngen_generate(&rx->cng, sampv, sampc, rx->auplay_prm.ch);
+		return;
+	}
+
+	tmp_sampv = convbuf_get(rx->playv, rx->playsz,
+				sampc * sizeof(int16_t));
+	if (!tmp_sampv)
+		return;
+
+	cngen_generate(&rx->cng, tmp_sampv, sampc, rx->auplay_prm.ch);
+
+	auconv_from_s16(rx->play_fmt, sampv, tmp_sampv, sampc);
+}
+
+
+/*
+ * Keep what is played as far-end reference for echo cancellation
+ *
+ * @note This function has REAL-TIME properties
+ */
+static void auplay_write_ref(struct aurx *rx, void *sampv, size_t sampc)
+{
+	const struct auplay_prm *prm = &rx->auplay_prm;
+	const uint64_t now = time_usec();
+	int16_t *tmp_sampv;
+
+	if (rx->play_fmt == AUFMT_S16LE) {
+		(void)aecref_play(rx->aecref, sampv, sampc,
+				  prm->srate, prm->ch, now);
+		return;
+	}
+
+	tmp_sampv = convbuf_get(rx->playv, rx->playsz,
+				sampc * sizeof(int16_t));
+	if (!tmp_sampv)
+		return;
+
+	auconv_to_s16(tmp_sampv, rx->play_fmt, sampv, sampc);
+
+	(void)aecref_play(rx->aecref, tmp_sampv, sampc,
+			  prm->srate, prm->ch, now);
+}
+
+
 /**
  * Write samples to Audio Player.
  *
@@ -611,7 +1162,14 @@ static void auplay_write_handler(void *sampv, size_t sampc, void *arg)
 	struct aurx *rx = arg;
 	size_t num_bytes = sampc * aufmt_sample_size(rx->play_fmt);
 
-	aubuf_read(rx->aubuf, sampv, num_bytes);
+	/* Comfort Noise while the sender is silent */
+	if (rx->cn && aubuf_cur_size(rx->aubuf) < num_bytes)
+		auplay_write_cn(rx, sampv, sampc);
+	else
+		aubuf_read(rx->aubuf, sampv, num_bytes);
+
+	if (rx->aecref)
+		auplay_write_ref(rx, sampv, sampc);
 }
 
 
@@ -635,6 +1193,16 @@ static void ausrc_read_handler(const void *sampv, size_t sampc, void *arg)
 	if (tx->muted)
 		memset((void *)sampv, 0, num_bytes);
 
+	/* the block was captured during its duration until now */
+	if (tx->aecref && tx->ausrc_prm.srate && tx->ausrc_prm.ch) {
+		const struct ausrc_prm *prm = &tx->ausrc_prm;
+		const uint64_t dur = sampc * UINT64_C(1000000)
+			/ (prm->srate * prm->ch);
+
+		aecref_capture(tx->aecref, sampc, prm->srate, prm->ch,
+			       time_usec() - dur);
+	}
+
 	if (aubuf_cur_size(tx->aubuf) >= tx->aubuf_maxsz) {
 
 		++tx->stats.aubuf_overrun;
@@ -653,9 +1221,21 @@ static void ausrc_read_handler(const void *sampv, size_t sampc, void *arg)
 			if (aubuf_cur_size(tx->aubuf) < tx->psize)
 				break;
 
-			poll_aubuf_tx(a);
+			if (!poll_aubuf_tx(a))
+				break;
 		}
 	}
+#ifdef HAVE_PTHREAD
+	else if (a->cfg.txmode == AUDIO_MODE_THREAD && tx->u.thr.run &&
+		 aubuf_cur_size(tx->aubuf) >= tx->psize) {
+
+		/* the transmit thread encodes, on the clock of the source.
+		   The mutex is not taken here, so the real-time thread
+		   never blocks. A wakeup that is missed by the waiter
+		   only delays the frame until its timeout. */
+		pthread_cond_signal(&tx->u.thr.cond);
+	}
+#endif
 
 	/* Exact timing: send Telephony-Events from here */
 	check_telev(a, tx);
@@ -699,50 +1279,44 @@ static void handle_telev(struct audio *a, struct mbuf *mb)
 	if (telev_recv(a->telev, mb, &event, &end))
 		return;
 
+	/* the event handler runs in the main thread */
 	digit = telev_code2digit(event);
-	if (digit >= 0 && a->eventh)
-		a->eventh(digit, end, a->arg);
+	if (digit >= 0) {
+		(void)stream_event_post(a->strm, EVENT_TELEV,
+					(uint32_t)digit | (end ? 0x100 : 0));
+	}
 }
 
 
-static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
+/* Receive events, handled in the main thread */
+static void stream_event_handler(int id, uint32_t val, void *arg)
 {
-	size_t sampc = AUDIO_SAMPSZ;
-	int16_t *sampv;
-	struct le *le;
-	int err = 0;
+	struct audio *a = arg;
 
-	/* No decoder set */
-	if (!rx->ac)
-		return 0;
+	switch (id) {
 
-	if (mbuf_get_left(mb)) {
-		err = rx->ac->dech(rx->dec, rx->sampv, &sampc,
-				   mbuf_buf(mb), mbuf_get_left(mb));
-	}
-	else if (rx->ac->plch) {
-		sampc = rx->ac->srate * rx->ac->ch * rx->ptime / 1000;
+	case EVENT_TELEV:
+		if (a->eventh)
+			a->eventh(val & 0xff, (val & 0x100) != 0, a->arg);
+		break;
 
-		err = rx->ac->plch(rx->dec, rx->sampv, &sampc);
-	}
-	else {
-		/* no PLC in the codec, might be done in filters below */
-		sampc = 0;
-	}
+	case EVENT_PT:
+		stream_thread_enter(a->strm);
+		(void)pt_handler(a, a->rx.pt, val);
+		stream_thread_leave(a->strm);
+		break;
 
-	if (err) {
-		warning("audio: %s codec decode %u bytes: %m\n",
-			rx->ac->name, mbuf_get_left(mb), err);
-		goto out;
+	default:
+		break;
 	}
+}
 
-	/* Process exactly one audio-frame in reverse list order */
-	for (le = rx->filtl.tail; le; le = le->prev) {
-		struct aufilt_dec_st *st = le->data;
 
-		if (st->af && st->af->dech)
-			err |= st->af->dech(st, rx->sampv, &sampc);
-	}
+/* Write one frame of decoded audio to the player buffer */
+static int aurx_write(struct aurx *rx, size_t sampc)
+{
+	int16_t *sampv;
+	int err = 0;
 
 	if (!rx->aubuf)
 		goto out;
@@ -750,12 +1324,11 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 	sampv = rx->sampv;
 
 	/* optional resampler */
-	if (rx->resamp.resample) {
-		size_t sampc_rs = AUDIO_SAMPSZ;
+	if (rx->rs) {
+		size_t sampc_rs = rx->sampv_rssz;
 
-		err = auresamp(&rx->resamp,
-			       rx->sampv_rs, &sampc_rs,
-			       rx->sampv, sampc);
+		err = resampler_process(rx->rs, rx->sampv_rs, &sampc_rs,
+					rx->sampv, sampc);
 		if (err)
 			return err;
 
@@ -783,16 +1356,13 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 			rx->need_conv = true;
 		}
 
-		tmp_sampv = mem_zalloc(num_bytes, NULL);
+		tmp_sampv = convbuf_get(rx->convv, rx->convsz, num_bytes);
 		if (!tmp_sampv)
 			return ENOMEM;
 
 		auconv_from_s16(rx->play_fmt, tmp_sampv, sampv, sampc);
 
 		err = aubuf_write(rx->aubuf, tmp_sampv, num_bytes);
-
-		mem_deref(tmp_sampv);
-
 		if (err)
 			goto out;
 	}
@@ -802,6 +1372,169 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 }
 
 
+/*
+ * Number of samples in one received frame, from the RTP timestamp
+ * interval between packets. Falls back to the packet time until two
+ * packets have been received.
+ */
+static size_t aurx_frame_sampc(const struct aurx *rx)
+{
+	size_t sampc;
+
+	if (rx->frame_ts && rx->ac->crate) {
+		sampc = (size_t)rx->frame_ts * rx->ac->srate / rx->ac->crate;
+		sampc *= rx->ac->ch;
+	}
+	else {
+		sampc = rx->ac->srate * rx->ac->ch * rx->ptime / 1000;
+	}
+
+	return min(sampc, rx->sampvsz);
+}
+
+
+/* Filter one frame of audio, and write it to the player buffer */
+static int aurx_process(struct aurx *rx, size_t sampc)
+{
+	struct aulevel lvl;
+	struct le *le;
+	int err = 0;
+
+	/* Process exactly one audio-frame in reverse list order */
+	for (le = rx->filtl.tail; le; le = le->prev) {
+		struct aufilt_dec_st *st = le->data;
+
+		if (st->af && st->af->dech)
+			err |= st->af->dech(st, rx->sampv, &sampc);
+	}
+
+	/* the level of the frame as played, read by other threads */
+	aulevel_calc(&lvl, rx->sampv, sampc);
+	rx->n_clip += lvl.clip;
+
+	lock_write_get(rx->lock);
+	rx->lvl = lvl;
+	lock_rel(rx->lock);
+
+	err |= aurx_write(rx, sampc);
+
+	return err;
+}
+
+
+static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
+{
+	size_t sampc = rx->sampvsz;
+	int err = 0;
+
+	/* No decoder set */
+	if (!rx->ac || !rx->sampv)
+		return 0;
+
+	if (mbuf_get_left(mb)) {
+		err = rx->ac->dech(rx->dec, rx->sampv, &sampc,
+				   mbuf_buf(mb), mbuf_get_left(mb));
+	}
+	else if (rx->ac->plch) {
+		sampc = rx->ac->srate * rx->ac->ch * rx->ptime / 1000;
+		sampc = min(sampc, rx->sampvsz);
+
+		err = rx->ac->plch(rx->dec, rx->sampv, &sampc);
+	}
+	else if (rx->plc && !rx->cn) {
+		sampc = rx->ac->srate * rx->ac->ch * rx->ptime / 1000;
+		sampc = min(sampc, rx->sampvsz);
+
+		auplc_conceal(rx->plc, rx->sampv, sampc);
+		++rx->n_plc;
+	}
+	else {
+		/* no PLC in the codec, might be done in filters below */
+		sampc = 0;
+	}
+
+	if (err) {
+		warning("audio: %s codec decode %u bytes: %m\n",
+			rx->ac->name, mbuf_get_left(mb), err);
+		goto out;
+	}
+
+	if (rx->plc && mbuf_get_left(mb))
+		auplc_rx(rx->plc, rx->sampv, sampc);
+
+	err = aurx_process(rx, sampc);
+
+ out:
+	return err;
+}
+
+
+/*
+ * Silent packet, write one frame of silence to the player
+ * without decoding. The frame still goes through the filters,
+ * so that they see a continuous stream.
+ */
+static int aurx_stream_skip(struct aurx *rx)
+{
+	size_t sampc;
+
+	if (!rx->ac || !rx->sampv)
+		return 0;
+
+	sampc = aurx_frame_sampc(rx);
+
+	memset(rx->sampv, 0, sampc * sizeof(int16_t));
+
+	/* a loss after the silence is concealed with silence */
+	auplc_rx(rx->plc, rx->sampv, sampc);
+
+	++rx->n_skip;
+
+	return aurx_process(rx, sampc);
+}
+
+
+/*
+ * Skip decoding of packets with an audio level below the threshold,
+ * after a hangover period. The hangover makes sure the decoder state
+ * has converged to silence, so that it resumes cleanly when the speech
+ * restarts.
+ */
+static bool aurx_silence_check(struct aurx *rx, uint32_t threshold,
+			       bool level_set, double level)
+{
+	if (!threshold)
+		return false;
+
+	if (!level_set || level >= -(double)threshold) {
+		rx->n_silent = 0;
+		return false;
+	}
+
+	return ++rx->n_silent > SILENCE_HANGOVER;
+}
+
+
+/* Comfort Noise (CN) as of RFC 3389 */
+static void handle_cn(struct audio *a, struct mbuf *mb)
+{
+	struct aurx *rx = &a->rx;
+	double level;
+
+	++rx->n_cn;
+
+	/* the player generates noise until the next audio packet */
+	if (a->cfg.cn && 0 == cn_decode(&level, mb)) {
+		cngen_set_level(&rx->cng, level);
+		rx->cn = true;
+		return;
+	}
+
+	if (a->cfg.silence_skip)
+		(void)aurx_stream_skip(rx);
+}
+
+
 /* Handle incoming stream data from the network */
 static void stream_recv_handler(const struct rtp_header *hdr,
 				struct rtpext *extv, size_t extc,
@@ -810,14 +1543,14 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	struct audio *a = arg;
 	struct aurx *rx = &a->rx;
 	bool discard = false;
+	bool level_pkt = false;
 	size_t i;
 	int wrap;
-	int err;
 
 	if (!mb)
 		goto out;
 
-	/* Telephone event? */
+	/* Telephone event or Comfort Noise? */
 	if (hdr->pt != rx->pt) {
 		const struct sdp_format *fmt;
 
@@ -827,18 +1560,25 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 			handle_telev(a, mb);
 			return;
 		}
-	}
 
-	/* Comfort Noise (CN) as of RFC 3389 */
-	if (PT_CN == hdr->pt)
-		return;
+		if (PT_CN == hdr->pt ||
+		    (fmt && !str_casecmp(fmt->name, cn_rtpfmt))) {
+			handle_cn(a, mb);
+			return;
+		}
+	}
 
-	/* Audio payload-type changed? */
+	/* Audio payload-type changed? The decoder is changed in the
+	   main thread, the packets are dropped until then */
 	/* XXX: this logic should be moved to stream.c */
 	if (hdr->pt != rx->pt) {
 
-		err = pt_handler(a, rx->pt, hdr->pt);
-		if (err)
+		if (hdr->pt != rx->pt_req) {
+			rx->pt_req = hdr->pt;
+			(void)stream_event_post(a->strm, EVENT_PT, hdr->pt);
+		}
+
+		if (hdr->pt != rx->pt)
 			return;
 	}
 
@@ -849,6 +1589,7 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 
 			a->rx.level_last = -(double)(extv[i].data[0] & 0x7f);
 			a->rx.level_set = true;
+			level_pkt = true;
 		}
 		else {
 			info("audio: rtp header ext ignored (id=%u)\n",
@@ -885,44 +1626,163 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 		rx->ts_recv.first = hdr->ts;
 		rx->ts_recv.last = hdr->ts;
 		rx->ts_recv.is_set = true;
+		rx->seq_last = hdr->seq;
 	}
 
-	wrap = timestamp_wrap(hdr->ts, rx->ts_recv.last);
+	wrap = timestamp_wrap(hdr->ts, rx->ts_recv.last);
+
+	switch (wrap) {
+
+	case -1:
+		warning("audio: rtp timestamp wraps backwards"
+			" (delta = %d) -- discard\n",
+			(int32_t)(rx->ts_recv.last - hdr->ts));
+		discard = true;
+		break;
+
+	case 0:
+		break;
+
+	case 1:
+		++rx->ts_recv.num_wraps;
+		break;
+
+	default:
+		break;
+	}
+
+	/* the frame interval, also across lost packets */
+	if (!discard && hdr->seq != rx->seq_last) {
+		const uint16_t nseq = hdr->seq - rx->seq_last;
+		const uint32_t frame_ts = (hdr->ts - rx->ts_recv.last) / nseq;
+
+		/* a timestamp jump after a pause is not a frame interval */
+		if (nseq < 0x8000 &&
+		    frame_ts <= rx->ac->crate * AUDIO_PTIME_MAX / 1000)
+			rx->frame_ts = frame_ts;
+	}
+
+	rx->ts_recv.last = hdr->ts;
+	rx->seq_last = hdr->seq;
+
+#if 0
+	re_printf("[time=%.3f]    wrap=%d  discard=%d\n",
+		  aurx_calc_seconds(rx), wrap, discard);
+#endif
+
+	if (discard) {
+		++a->rx.n_discard;
+		return;
+	}
+
+	/* end of silence */
+	rx->cn = false;
+
+	/* Silent packet, no need to decode it */
+	if (aurx_silence_check(rx, a->cfg.silence_skip,
+			       level_pkt, rx->level_last)) {
+		(void)aurx_stream_skip(rx);
+		return;
+	}
+
+ out:
+	(void)aurx_stream_decode(&a->rx, mb);
+}
+
+
+/*
+ * Feedback for the adaptive encoder control, from the report blocks
+ * about our source and from REMB messages.
+ */
+static void rtcp_handler(struct rtcp_msg *msg, void *arg)
+{
+	struct audio *a = arg;
+	struct autx *tx = &a->tx;
+	const struct rtcp_rr *rrv;
+	uint32_t ssrc, bw;
+	size_t i;
+
+	if (!a->cfg.adaptive)
+		return;
 
-	switch (wrap) {
+	switch (msg->hdr.pt) {
 
-	case -1:
-		warning("audio: rtp timestamp wraps backwards"
-			" (delta = %d) -- discard\n",
-			(int32_t)(rx->ts_recv.last - hdr->ts));
-		discard = true;
+	case RTCP_SR:
+		rrv = msg->r.sr.rrv;
 		break;
 
-	case 0:
+	case RTCP_RR:
+		rrv = msg->r.rr.rrv;
 		break;
 
-	case 1:
-		++rx->ts_recv.num_wraps;
-		break;
+	case RTCP_PSFB:
+		if (msg->hdr.count != RTCP_PSFB_AFB)
+			return;
+
+		bw = auctrl_remb_decode(msg->r.fb.fci.afb);
+		if (bw) {
+			lock_write_get(tx->lock);
+			tx->fb.bw = bw;
+			++tx->fb.seq;
+			lock_rel(tx->lock);
+		}
+		return;
 
 	default:
-		break;
+		return;
 	}
 
-	rx->ts_recv.last = hdr->ts;
+	ssrc = rtp_sess_ssrc(a->strm->rtp);
 
-#if 0
-	re_printf("[time=%.3f]    wrap=%d  discard=%d\n",
-		  aurx_calc_seconds(rx), wrap, discard);
-#endif
+	for (i=0; i<msg->hdr.count; i++) {
 
-	if (discard) {
-		++a->rx.n_discard;
-		return;
+		if (rrv[i].ssrc != ssrc)
+			continue;
+
+		lock_write_get(tx->lock);
+		tx->fb.loss = 100.0 * rrv[i].fraction / 256;
+		tx->fb.rtt  = a->strm->rtcp_stats.rtt / 1000;
+		++tx->fb.seq;
+		lock_rel(tx->lock);
 	}
+}
 
- out:
-	(void)aurx_stream_decode(&a->rx, mb);
+
+/*
+ * Offer Comfort Noise with the static payload type for 8000 Hz, and
+ * with a dynamic payload type for the other clock rates of the codecs.
+ */
+static int add_cn_codec(struct audio *a, const struct list *aucodecl)
+{
+	struct sdp_media *m = stream_sdpmedia(audio_strm(a));
+	struct le *le;
+	int err;
+
+	err = sdp_format_add(NULL, m, false, "13", cn_rtpfmt, 8000, 1,
+			     NULL, NULL, NULL, false, NULL);
+	if (err)
+		return err;
+
+	for (le = list_head(aucodecl); le; le = le->next) {
+		const struct aucodec *ac = le->data;
+
+		/* skip codecs that were not offered */
+		if (!sdp_media_format(m, true, NULL, -1, ac->name,
+				      ac->crate, ac->ch))
+			continue;
+
+		if (sdp_media_format(m, true, NULL, -1, cn_rtpfmt,
+				     ac->crate, 1))
+			continue;
+
+		err = sdp_format_add(NULL, m, false, NULL, cn_rtpfmt,
+				     ac->crate, 1, NULL, NULL, NULL,
+				     false, NULL);
+		if (err)
+			return err;
+	}
+
+	return 0;
 }
 
 
@@ -1033,10 +1893,12 @@ int audio_alloc(struct audio **ap, const struct stream_param *stream_prm,
 			   "audio", label,
 			   mnat, mnat_sess, menc, menc_sess,
 			   call_localuri(call),
-			   stream_recv_handler, NULL, a);
+			   stream_recv_handler, rtcp_handler, a);
 	if (err)
 		goto out;
 
+	stream_set_event_handler(a->strm, stream_event_handler);
+
 	if (cfg->avt.rtp_bw.max) {
 		stream_set_bw(a->strm, AUDIO_BANDWIDTH);
 	}
@@ -1072,14 +1934,18 @@ int audio_alloc(struct audio **ap, const struct stream_param *stream_prm,
 			goto out;
 	}
 
-	tx->mb = mbuf_alloc(STREAM_PRESZ + 4096);
-	tx->sampv = mem_zalloc(AUDIO_SAMPSZ * sizeof(int16_t), NULL);
-	rx->sampv = mem_zalloc(AUDIO_SAMPSZ * sizeof(int16_t), NULL);
-	if (!tx->mb || !tx->sampv || !rx->sampv) {
+	/* the buffer grows when the encoder is known */
+	tx->mb = mbuf_alloc(STREAM_PRESZ + AUDIO_MB_HDRSZ);
+	if (!tx->mb) {
 		err = ENOMEM;
 		goto out;
 	}
 
+	err  = lock_alloc(&tx->lock);
+	err |= lock_alloc(&rx->lock);
+	if (err)
+		goto out;
+
 	err = telev_alloc(&a->telev, ptime);
 	if (err)
 		goto out;
@@ -1088,15 +1954,23 @@ int audio_alloc(struct audio **ap, const struct stream_param *stream_prm,
 	if (err)
 		goto out;
 
-	auresamp_init(&tx->resamp);
+	if (cfg->audio.cn) {
+		err = add_cn_codec(a, aucodecl);
+		if (err)
+			goto out;
+	}
+
 	str_ncpy(tx->device, a->cfg.src_dev, sizeof(tx->device));
 	tx->ptime  = ptime;
 	tx->ts_ext = tx->ts_base = rand_u16();
 	tx->marker = true;
+	tx->cn_pt  = -1;
+
+	auctrl_init(&tx->ctrl);
 
-	auresamp_init(&rx->resamp);
 	str_ncpy(rx->device, a->cfg.play_dev, sizeof(rx->device));
 	rx->pt     = -1;
+	rx->pt_req = -1;
 	rx->ptime  = ptime;
 
 	a->eventh  = eventh;
@@ -1114,6 +1988,32 @@ int audio_alloc(struct audio **ap, const struct stream_param *stream_prm,
 
 
 #ifdef HAVE_PTHREAD
+/*
+ * Wait until the source has written a frame. The timeout only matters
+ * if the source stops.
+ */
+static void tx_thread_wait(struct autx *tx)
+{
+	struct timespec ts;
+	uint64_t ns;
+
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+
+	ns = ts.tv_nsec + (uint64_t)max(tx->ptime, 5u) * 1000000;
+	ts.tv_sec  += ns / 1000000000;
+	ts.tv_nsec  = ns % 1000000000;
+
+	pthread_mutex_lock(&tx->u.thr.mutex);
+
+	if (tx->u.thr.run && aubuf_cur_size(tx->aubuf) < tx->psize) {
+		(void)pthread_cond_timedwait(&tx->u.thr.cond,
+					     &tx->u.thr.mutex, &ts);
+	}
+
+	pthread_mutex_unlock(&tx->u.thr.mutex);
+}
+
+
 static void *tx_thread(void *arg)
 {
 	struct audio *a = arg;
@@ -1127,14 +2027,35 @@ static void *tx_thread(void *arg)
 			if (aubuf_cur_size(tx->aubuf) < tx->psize)
 				break;
 
-			poll_aubuf_tx(a);
+			if (!poll_aubuf_tx(a))
+				break;
 		}
 
-		sys_msleep(5);
+		tx_thread_wait(tx);
 	}
 
 	return NULL;
 }
+
+
+static int tx_thread_start(struct audio *a)
+{
+	struct autx *tx = &a->tx;
+	int err;
+
+	pthread_mutex_init(&tx->u.thr.mutex, NULL);
+	pthread_cond_init(&tx->u.thr.cond, NULL);
+
+	tx->u.thr.run = true;
+	err = pthread_create(&tx->u.thr.tid, NULL, tx_thread, a);
+	if (err) {
+		tx->u.thr.run = false;
+		pthread_cond_destroy(&tx->u.thr.cond);
+		pthread_mutex_destroy(&tx->u.thr.mutex);
+	}
+
+	return err;
+}
 #endif
 
 
@@ -1217,6 +2138,7 @@ static int aufilt_setup(struct audio *a)
 	struct autx *tx = &a->tx;
 	struct aurx *rx = &a->rx;
 	struct le *le;
+	uint32_t nrefs;
 	int err = 0;
 
 	/* wait until we have both Encoder and Decoder */
@@ -1228,6 +2150,20 @@ static int aufilt_setup(struct audio *a)
 
 	aufilt_param_set(&encprm, tx->ac, tx->ptime);
 	aufilt_param_set(&decprm, rx->ac, rx->ptime);
+	encprm.au = decprm.au = a;
+
+	/* what is played, for echo cancellers in the encoding filters.
+	 * A running device keeps its own reference to the old one. */
+	if (a->aecref && aecref_srate(a->aecref) != encprm.srate)
+		a->aecref = mem_deref(a->aecref);
+
+	if (!a->aecref) {
+		err = aecref_alloc(&a->aecref, encprm.srate);
+		if (err)
+			return err;
+	}
+
+	nrefs = mem_nrefs(a->aecref);
 
 	/* Audio filters */
 	for (le = list_head(baresip_aufiltl()); le; le = le->next) {
@@ -1261,6 +2197,11 @@ static int aufilt_setup(struct audio *a)
 		}
 	}
 
+	/* the devices are only tapped while a filter holds the reference,
+	 * from when they are started next */
+	if (mem_nrefs(a->aecref) <= nrefs)
+		a->aecref = mem_deref(a->aecref);
+
 	return 0;
 }
 
@@ -1288,19 +2229,16 @@ static int start_player(struct aurx *rx, struct audio *a)
 	}
 
 	/* Optional resampler, if configured */
-	if (resamp && !rx->sampv_rs) {
+	if (resamp && !rx->rs) {
 
-		info("audio: enable auplay resampler:"
+		info("audio: enable auplay resampler (%s):"
 		     " %uHz/%uch --> %uHz/%uch\n",
+		     resampler_quality_name(a->cfg.resamp),
 		     get_srate(ac), get_ch(ac), srate_dsp, channels_dsp);
 
-		rx->sampv_rs = mem_zalloc(AUDIO_SAMPSZ * 2, NULL);
-		if (!rx->sampv_rs)
-			return ENOMEM;
-
-		err = auresamp_setup(&rx->resamp,
-				     get_srate(ac), get_ch(ac),
-				     srate_dsp, channels_dsp);
+		err = resampler_alloc(&rx->rs, a->cfg.resamp,
+				      get_srate(ac), get_ch(ac),
+				      srate_dsp, channels_dsp);
 		if (err) {
 			warning("audio: could not setup auplay resampler"
 				" (%m)\n", err);
@@ -1308,6 +2246,26 @@ static int start_player(struct aurx *rx, struct audio *a)
 		}
 	}
 
+	if (resamp) {
+		err = sampv_alloc(&rx->sampv_rs, &rx->sampv_rssz,
+				  srate_dsp, channels_dsp, rx->ptime);
+		if (err)
+			return err;
+	}
+
+	err = sampv_alloc(&rx->sampv, &rx->sampvsz,
+			  get_srate(ac), get_ch(ac), rx->ptime);
+	if (err)
+		return err;
+
+	/* for codecs without Packet Loss Concealment of their own */
+	rx->plc = mem_deref(rx->plc);
+	if (a->cfg.plc && !ac->plch) {
+		err = auplc_alloc(&rx->plc, get_srate(ac), get_ch(ac));
+		if (err)
+			return err;
+	}
+
 	/* Start Audio Player */
 	if (!rx->auplay && auplay_find(baresip_auplayl(), NULL)) {
 
@@ -1329,6 +2287,31 @@ static int start_player(struct aurx *rx, struct audio *a)
 				return err;
 		}
 
+		/* the player can ask for up to the largest frame */
+		if (rx->play_fmt != AUFMT_S16LE) {
+			const size_t sampc = sampv_size(prm.srate, prm.ch,
+							prm.ptime);
+
+			err  = convbuf_alloc(&rx->convv, &rx->convsz, sampc *
+					     aufmt_sample_size(rx->play_fmt));
+			err |= convbuf_alloc((void **)&rx->playv,
+					     &rx->playsz,
+					     sampc * sizeof(int16_t));
+			if (err)
+				return err;
+		}
+
+		/* the player is stopped, its reference tap can change */
+		mem_deref(rx->aecref);
+		rx->aecref = mem_ref(a->aecref);
+
+		if (rx->aecref) {
+			err = aecref_player_set(rx->aecref,
+						prm.srate, prm.ch);
+			if (err)
+				return err;
+		}
+
 		err = auplay_alloc(&rx->auplay, baresip_auplayl(),
 				   a->cfg.play_mod,
 				   &prm, rx->device,
@@ -1355,6 +2338,7 @@ static int start_source(struct autx *tx, struct audio *a)
 	uint32_t srate_dsp = get_srate(ac);
 	uint32_t channels_dsp;
 	bool resamp = false;
+	size_t mbsz;
 	int err;
 
 	if (!ac)
@@ -1371,20 +2355,38 @@ static int start_source(struct autx *tx, struct audio *a)
 		channels_dsp = a->cfg.channels_src;
 	}
 
+	/* The running source and the transmit thread use the buffers below.
+	 * Stop them if a buffer has to grow, they are started again. */
+	mbsz = STREAM_PRESZ + AUDIO_MB_HDRSZ
+		+ sampv_size(max(srate_dsp, get_srate(ac)),
+			     max(channels_dsp, get_ch(ac)), tx->ptime)
+		* sizeof(int16_t);
+
+	if (tx->ausrc &&
+	    ((resamp && !tx->rs) ||
+	     (resamp && !sampv_fits(tx->sampv_rs, tx->sampv_rssz,
+				    get_srate(ac), get_ch(ac), tx->ptime)) ||
+	     !sampv_fits(tx->sampv, tx->sampvsz,
+			 srate_dsp, channels_dsp, tx->ptime) ||
+	     !sampv_fits(tx->packv, tx->packvsz,
+			 get_srate(ac), get_ch(ac), AUDIO_PTIME_MAX) ||
+	     tx->mb->size < mbsz)) {
+
+		info("audio: restarting source for new buffer sizes\n");
+		stop_source(tx, a);
+	}
+
 	/* Optional resampler, if configured */
-	if (resamp && !tx->sampv_rs) {
+	if (resamp && !tx->rs) {
 
-		info("audio: enable ausrc resampler:"
+		info("audio: enable ausrc resampler (%s):"
 		     " %uHz/%uch <-- %uHz/%uch\n",
+		     resampler_quality_name(a->cfg.resamp),
 		     get_srate(ac), get_ch(ac), srate_dsp, channels_dsp);
 
-		tx->sampv_rs = mem_zalloc(AUDIO_SAMPSZ * 2, NULL);
-		if (!tx->sampv_rs)
-			return ENOMEM;
-
-		err = auresamp_setup(&tx->resamp,
-				     srate_dsp, channels_dsp,
-				     get_srate(ac), get_ch(ac));
+		err = resampler_alloc(&tx->rs, a->cfg.resamp,
+				      srate_dsp, channels_dsp,
+				      get_srate(ac), get_ch(ac));
 		if (err) {
 			warning("audio: could not setup ausrc resampler"
 				" (%m)\n", err);
@@ -1392,6 +2394,32 @@ static int start_source(struct autx *tx, struct audio *a)
 		}
 	}
 
+	if (resamp) {
+		err = sampv_alloc(&tx->sampv_rs, &tx->sampv_rssz,
+				  get_srate(ac), get_ch(ac), tx->ptime);
+		if (err)
+			return err;
+	}
+
+	/* the source buffer holds samples in the DSP format */
+	err = sampv_alloc(&tx->sampv, &tx->sampvsz,
+			  srate_dsp, channels_dsp, tx->ptime);
+	if (err)
+		return err;
+
+	/* frames waiting to be packed, at the codec rate */
+	err = sampv_alloc(&tx->packv, &tx->packvsz,
+			  get_srate(ac), get_ch(ac), AUDIO_PTIME_MAX);
+	if (err)
+		return err;
+
+	/* room for one packet of 16-bit PCM */
+	if (tx->mb->size < mbsz) {
+		err = mbuf_resize(tx->mb, mbsz);
+		if (err)
+			return err;
+	}
+
 	/* Start Audio Source */
 	if (!tx->ausrc && ausrc_find(baresip_ausrcl(), NULL)) {
 
@@ -1416,6 +2444,17 @@ static int start_source(struct autx *tx, struct audio *a)
 				return err;
 		}
 
+		if (tx->src_fmt != AUFMT_S16LE) {
+			err = convbuf_alloc(&tx->convv, &tx->convsz,
+					    tx->psize);
+			if (err)
+				return err;
+		}
+
+		/* the source is stopped, its reference tap can change */
+		mem_deref(tx->aecref);
+		tx->aecref = mem_ref(a->aecref);
+
 		err = ausrc_alloc(&tx->ausrc, baresip_ausrcl(),
 				  NULL, a->cfg.src_mod,
 				  &prm, tx->device,
@@ -1426,17 +2465,18 @@ static int start_source(struct autx *tx, struct audio *a)
 			return err;
 		}
 
+		if (!tx->counted) {
+			tx->counted = true;
+			audio_txc_add(+1);
+		}
+
 		switch (a->cfg.txmode) {
 #ifdef HAVE_PTHREAD
 		case AUDIO_MODE_THREAD:
 			if (!tx->u.thr.run) {
-				tx->u.thr.run = true;
-				err = pthread_create(&tx->u.thr.tid, NULL,
-						     tx_thread, a);
-				if (err) {
-					tx->u.thr.tid = false;
+				err = tx_thread_start(a);
+				if (err)
 					return err;
-				}
 			}
 			break;
 #endif
@@ -1522,6 +2562,7 @@ int audio_encoder_set(struct audio *a, const struct aucodec *ac,
 		      int pt_tx, const char *params)
 {
 	struct autx *tx;
+	char *fmtp = NULL;
 	int err = 0;
 	bool reset;
 
@@ -1536,27 +2577,71 @@ int audio_encoder_set(struct audio *a, const struct aucodec *ac,
 		info("audio: Set audio encoder: %s %uHz %dch\n",
 		     ac->name, get_srate(ac), get_ch(ac));
 
-		/* Audio source must be stopped first */
+		/* Audio source and transmit thread must be stopped
+		   first, start_source() changes their buffers */
 		if (reset) {
-			tx->ausrc = mem_deref(tx->ausrc);
+			stop_source(tx, a);
+		}
+	}
+
+	if (params != tx->enc_fmtp) {
+
+		if (params) {
+			err = str_dup(&fmtp, params);
+			if (err)
+				return err;
 		}
+	}
+
+	/* the encoder thread uses and updates the encoder too */
+	lock_write_get(tx->lock);
+
+	if (ac != tx->ac) {
 
 		tx->enc = mem_deref(tx->enc);
 		tx->ac = ac;
+
+		auctrl_init(&tx->ctrl);
+		memset(&tx->enc_prm, 0, sizeof(tx->enc_prm));
+
+		/* drop the frames packed for the old codec */
+		tx->packc = 0;
+		tx->packn = 0;
+		tx->nframes_max = 0;
 	}
 
-	if (ac->encupdh) {
-		struct auenc_param prm;
+	if (params != tx->enc_fmtp) {
+		mem_deref(tx->enc_fmtp);
+		tx->enc_fmtp = fmtp;
+	}
 
-		prm.ptime = tx->ptime;
+	if (ac->encupdh) {
+		tx->enc_prm.ptime = tx->ptime;
 
-		err = ac->encupdh(&tx->enc, ac, &prm, params);
-		if (err) {
+		err = ac->encupdh(&tx->enc, ac, &tx->enc_prm, params);
+		if (err)
 			warning("audio: alloc encoder: %m\n", err);
-			return err;
-		}
 	}
 
+	/* Silence suppression, if the peer accepts Comfort Noise */
+	tx->cn_pt = -1;
+	if (a->cfg.cn) {
+		const struct sdp_format *cn;
+
+		cn = sdp_media_format(stream_sdpmedia(a->strm), false, NULL,
+				      -1, cn_rtpfmt, ac->crate, -1);
+		if (cn)
+			tx->cn_pt = cn->pt;
+
+		vad_init(&tx->vad, tx->ptime);
+		tx->silent = false;
+	}
+
+	lock_rel(tx->lock);
+
+	if (err)
+		return err;
+
 	stream_set_srate(a->strm, ac->crate, ac->crate);
 	stream_update_encoder(a->strm, pt_tx);
 
@@ -1582,6 +2667,9 @@ int audio_decoder_set(struct audio *a, const struct aucodec *ac,
 
 	rx = &a->rx;
 
+	/* a new change of payload type can be requested */
+	rx->pt_req = -1;
+
 	reset = !aucodec_equal(ac, rx->ac);
 
 	if (ac != rx->ac) {
@@ -1592,6 +2680,7 @@ int audio_decoder_set(struct audio *a, const struct aucodec *ac,
 		rx->pt = pt_rx;
 		rx->ac = ac;
 		rx->dec = mem_deref(rx->dec);
+		rx->frame_ts = 0;
 	}
 
 	if (ac->decupdh) {
@@ -1775,6 +2864,12 @@ void audio_sdp_attr_decode(struct audio *a)
 		}
 	}
 
+	/* the upper limit for packing several frames per packet */
+	attr = sdp_media_rattr(stream_sdpmedia(a->strm), "maxptime");
+	lock_write_get(a->tx.lock);
+	a->tx.maxptime = attr ? atoi(attr) : 0;
+	lock_rel(a->tx.lock);
+
 	/* Client-to-Mixer Audio Level Indication */
 	if (a->cfg.level) {
 		sdp_media_rattr_apply(stream_sdpmedia(a->strm),
@@ -1784,6 +2879,66 @@ void audio_sdp_attr_decode(struct audio *a)
 }
 
 
+/**
+ * Set the packet time for sending. The frame time is kept, and the
+ * frames are packed into packets of the given packet time.
+ *
+ * @param a     Audio object
+ * @param ptime Packet time in [ms], multiple of the frame time, or 0
+ *              for the packet budget (audio_pps_max)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int audio_set_ptime(struct audio *a, uint32_t ptime)
+{
+	struct autx *tx;
+	uint32_t maxptime;
+
+	if (!a)
+		return EINVAL;
+
+	tx = &a->tx;
+
+	if (!ptime) {
+		lock_write_get(tx->lock);
+		tx->nframes_cmd = 0;
+		lock_rel(tx->lock);
+		return 0;
+	}
+
+	if (!tx->ptime || ptime % tx->ptime)
+		return EINVAL;
+
+	maxptime = tx->maxptime ? tx->maxptime : AUDIO_PTIME_MAX;
+	if (ptime > min(maxptime, (uint32_t)AUDIO_PTIME_MAX))
+		return ERANGE;
+
+	info("audio: packet time %ums (%u frames of %ums)\n",
+	     ptime, ptime / tx->ptime, tx->ptime);
+
+	lock_write_get(tx->lock);
+	tx->nframes_cmd = ptime / tx->ptime;
+	lock_rel(tx->lock);
+
+	return 0;
+}
+
+
+/**
+ * Get the far-end reference for echo cancellation. It is available to
+ * the audio filters, from their update handlers. A filter that uses it
+ * must hold a reference to it (mem_ref).
+ *
+ * @param a Audio object
+ *
+ * @return Far-end reference, or NULL if none
+ */
+struct aecref *audio_aecref(const struct audio *a)
+{
+	return a ? a->aecref : NULL;
+}
+
+
 /**
  * Get the last value of the audio level from incoming RTP packets
  *
@@ -1810,6 +2965,42 @@ int audio_level_get(const struct audio *au, double *levelp)
 }
 
 
+/* Copy the level of the last frame, it is written by the audio threads */
+static void level_get(const struct audio *au, bool tx, struct aulevel *lvl)
+{
+	struct lock *lock = tx ? au->tx.lock : au->rx.lock;
+
+	lock_read_get(lock);
+	*lvl = tx ? au->tx.lvl : au->rx.lvl;
+	lock_rel(lock);
+}
+
+
+/**
+ * Get the level statistics of the last audio frame, as it was sent
+ * (after the encode filters) or as it was played (after the decode
+ * filters)
+ *
+ * @param au  Audio object
+ * @param tx  True for the transmitted, false for the received audio
+ * @param lvl Pointer to where to write the level statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int audio_level_frame(const struct audio *au, bool tx,
+		      struct aulevel *lvl)
+{
+	if (!au || !lvl)
+		return EINVAL;
+
+	level_get(au, tx, lvl);
+	if (!lvl->sampc)
+		return ENOENT;
+
+	return 0;
+}
+
+
 static int aucodec_print(struct re_printf *pf, const struct aucodec *ac)
 {
 	if (!ac)
@@ -1820,10 +3011,38 @@ static int aucodec_print(struct re_printf *pf, const struct aucodec *ac)
 }
 
 
+/**
+ * Get the memory used by an audio object, incl. sample buffers
+ *
+ * @param a Audio object
+ *
+ * @return Number of bytes
+ */
+size_t audio_mem(const struct audio *a)
+{
+	const struct autx *tx;
+	const struct aurx *rx;
+
+	if (!a)
+		return 0;
+
+	tx = &a->tx;
+	rx = &a->rx;
+
+	return sizeof(*a)
+		+ (tx->sampvsz + tx->sampv_rssz) * sizeof(int16_t)
+		+ (rx->sampvsz + rx->sampv_rssz) * sizeof(int16_t)
+		+ (tx->mb ? tx->mb->size : 0)
+		+ aubuf_cur_size(tx->aubuf)
+		+ aubuf_cur_size(rx->aubuf);
+}
+
+
 int audio_debug(struct re_printf *pf, const struct audio *a)
 {
 	const struct autx *tx;
 	const struct aurx *rx;
+	struct aulevel lvl;
 	size_t sz;
 	int err;
 
@@ -1840,6 +3059,12 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 	err |= re_hprintf(pf, " tx:   %H ptime=%ums\n",
 			  aucodec_print, tx->ac,
 			  tx->ptime);
+	if (tx->nframes > 1) {
+		err |= re_hprintf(pf, "       packing: %u frames, %ums"
+				  " (maxptime %ums)\n",
+				  tx->nframes, tx->nframes * tx->ptime,
+				  tx->maxptime);
+	}
 	err |= re_hprintf(pf, "       aubuf: %H"
 			  " (cur %.2fms, max %.2fms, or %llu, ur %llu)\n",
 			  aubuf_debug, tx->aubuf,
@@ -1854,6 +3079,42 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 
 	err |= re_hprintf(pf, "       time = %.3f sec\n",
 			  autx_calc_seconds(tx));
+	if (a->aecref) {
+		err |= re_hprintf(pf, "       aec reference: %H\n",
+				  aecref_debug, a->aecref);
+	}
+	if (a->cfg.adaptive) {
+		uint32_t i, n = min(tx->n_ctrl, (uint32_t)CTRL_HISTORY);
+
+		err |= re_hprintf(pf, "       encoder control: %H\n",
+				  auctrl_debug, &tx->ctrl);
+
+		/* the most recent changes, oldest first */
+		for (i = tx->n_ctrl - n; i < tx->n_ctrl; i++) {
+			const struct ctrl_change *chg;
+
+			chg = &tx->ctrlv[i % CTRL_HISTORY];
+
+			err |= re_hprintf(pf, "         %8.3f sec: bitrate=%u"
+					  " loss=%u%% complexity=%u\n",
+					  chg->time, chg->prm.bitrate,
+					  chg->prm.pkt_loss,
+					  chg->prm.complexity);
+		}
+	}
+	if (tx->cn_pt >= 0) {
+		err |= re_hprintf(pf, "       vad: %s, noise %.1f dBov,"
+				  " n_silent:%llu n_cn:%llu\n",
+				  tx->vad.active ? "voice" : "silence",
+				  tx->vad.noise,
+				  tx->stats.n_silent, tx->stats.n_cn);
+	}
+	level_get(a, true, &lvl);
+	err |= re_hprintf(pf, "       level %.1f dBov, peak %.1f dBov,"
+			  " clipped:%llu\n",
+			  aulevel_dbov(&lvl),
+			  aulevel_peak_dbov(&lvl),
+			  tx->stats.n_clip);
 
 	err |= re_hprintf(pf,
 			  " rx:   %H\n"
@@ -1864,10 +3125,22 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  aubuf_debug, rx->aubuf);
 	err |= re_hprintf(pf, "       n_discard:%llu\n",
 			  rx->n_discard);
+	err |= re_hprintf(pf, "       n_skip:%llu\n",
+			  rx->n_skip);
+	err |= re_hprintf(pf, "       n_plc:%llu\n",
+			  rx->n_plc);
+	err |= re_hprintf(pf, "       n_cn:%llu%s\n",
+			  rx->n_cn, rx->cn ? " (comfort noise)" : "");
 	if (rx->level_set) {
 		err |= re_hprintf(pf, "       level %.3f dBov\n",
 				  rx->level_last);
 	}
+	level_get(a, false, &lvl);
+	err |= re_hprintf(pf, "       played %.1f dBov, peak %.1f dBov,"
+			  " clipped:%llu\n",
+			  aulevel_dbov(&lvl),
+			  aulevel_peak_dbov(&lvl),
+			  rx->n_clip);
 	if (rx->ts_recv.is_set) {
 		err |= re_hprintf(pf, "       time = %.3f sec\n",
 				  aurx_calc_seconds(rx));
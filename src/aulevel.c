@@ -5,52 +5,182 @@
  */
 
 #include <math.h>
+#include <string.h>
 #include <re.h>
 #include <baresip.h>
 #include "core.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+ * The level statistics are computed in integer arithmetic: the sum of
+ * the squared samples is exact in 64 bits, for any realistic frame
+ * size. With SSE2, 8 samples are squared and summed pairwise per
+ * iteration (pmaddwd); the pair sums are unsigned 32-bit values, which
+ * are widened to 64 bits before they are accumulated.
+ *
+ * The level in dBov is derived from the statistics, so that the level
+ * of a frame is computed once and shared by all its users.
+ */
+
+
+static const double full_scale = 32767.0;
+
+
+static inline unsigned bits(unsigned x)
+{
+	unsigned n = 0;
+
+	for (; x; x &= x - 1)
+		++n;
+
+	return n;
+}
+
 
 /**
- * Generic routine to calculate RMS (Root-Mean-Square) from
- * a set of signed 16-bit values
+ * Calculate the level statistics of a set of audio samples
  *
- * \verbatim
-
-	     .---------------
-	     |   N-1
-	     |  ----.
-	     |  \
-	     |   \        2
-	     |    |   s[n]
-	     |   /
-	     |  /
-	 _   |  ----'
-	  \  |   n=0
-	   \ |  ------------
-	    \|       N
-
-   \endverbatim
+ * @param lvl   Level statistics
+ * @param sampv Audio samples
+ * @param sampc Number of audio samples
+ */
+void aulevel_calc(struct aulevel *lvl, const int16_t *sampv, size_t sampc)
+{
+	uint64_t sumsq = 0;
+	int hi = 0, lo = 0;
+	uint32_t clip = 0;
+	size_t i = 0;
+
+	if (!lvl)
+		return;
+
+	memset(lvl, 0, sizeof(*lvl));
+
+	if (!sampv || !sampc)
+		return;
+
+#if defined(__SSE2__)
+	if (sampc >= 8) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i smax = _mm_set1_epi16(32767);
+		const __m128i smin = _mm_set1_epi16(-32768);
+		__m128i acc = zero, vhi = zero, vlo = zero;
+		uint64_t s2[2];
+		int16_t t[8];
+		int k;
+
+		for (; i + 8 <= sampc; i += 8) {
+
+			const __m128i x =
+				_mm_loadu_si128((const __m128i *)(sampv + i));
+			const __m128i sq = _mm_madd_epi16(x, x);
+			const __m128i c1 = _mm_cmpeq_epi16(x, smax);
+			const __m128i c2 = _mm_cmpeq_epi16(x, smin);
+			const int m = _mm_movemask_epi8(_mm_or_si128(c1, c2));
+
+			acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+			acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+
+			vhi = _mm_max_epi16(vhi, x);
+			vlo = _mm_min_epi16(vlo, x);
+
+			/* two mask bits per sample */
+			if (m)
+				clip += bits(m) / 2;
+		}
+
+		_mm_storeu_si128((__m128i *)s2, acc);
+		sumsq = s2[0] + s2[1];
+
+		_mm_storeu_si128((__m128i *)t, vhi);
+		for (k=0; k<8; k++)
+			hi = max(hi, (int)t[k]);
+
+		_mm_storeu_si128((__m128i *)t, vlo);
+		for (k=0; k<8; k++)
+			lo = min(lo, (int)t[k]);
+	}
+#endif
+
+	for (; i < sampc; i++) {
+
+		const int32_t s = sampv[i];
+
+		sumsq += (uint64_t)(s * s);
+
+		hi = max(hi, (int)s);
+		lo = min(lo, (int)s);
+
+		if (s == 32767 || s == -32768)
+			++clip;
+	}
+
+	lvl->sumsq = sumsq;
+	lvl->sampc = sampc;
+	lvl->peak  = (uint32_t)max(hi, -lo);
+	lvl->clip  = clip;
+}
+
+
+/**
+ * Add the level statistics of more samples, e.g. of the next frame
+ *
+ * @param lvl Level statistics to add to
+ * @param add Level statistics to add
+ */
+void aulevel_add(struct aulevel *lvl, const struct aulevel *add)
+{
+	if (!lvl || !add)
+		return;
+
+	lvl->sumsq += add->sumsq;
+	lvl->sampc += add->sampc;
+	lvl->peak   = max(lvl->peak, add->peak);
+	lvl->clip  += add->clip;
+}
+
+
+static double dbov(double v)
+{
+	const double db = v > 0 ? 20 * log10(v / full_scale) : AULEVEL_MIN;
+
+	return min(max(db, AULEVEL_MIN), AULEVEL_MAX);
+}
+
+
+/**
+ * Get the RMS level in dBov from level statistics
  *
- * @param data Array of signed 16-bit values
- * @param len  Number of values
+ * @param lvl Level statistics
  *
- * @return RMS value from 0 to 32768
+ * @return Audio level expressed in dBov
  */
-static double calc_rms(const int16_t *data, size_t len)
+double aulevel_dbov(const struct aulevel *lvl)
 {
-	double sum = 0;
-	size_t i;
+	if (!lvl || !lvl->sampc)
+		return AULEVEL_MIN;
 
-	if (!data || !len)
-		return .0;
+	return dbov(sqrt((double)lvl->sumsq / (double)lvl->sampc));
+}
 
-	for (i = 0; i < len; i++) {
-		const double sample = data[i];
 
-		sum += sample * sample;
-	}
+/**
+ * Get the peak level in dBov from level statistics
+ *
+ * @param lvl Level statistics
+ *
+ * @return Peak level expressed in dBov
+ */
+double aulevel_peak_dbov(const struct aulevel *lvl)
+{
+	if (!lvl || !lvl->sampc)
+		return AULEVEL_MIN;
 
-	return sqrt(sum / (double)len);
+	return dbov(lvl->peak);
 }
 
 
@@ -66,20 +196,9 @@ static double calc_rms(const int16_t *data, size_t len)
  */
 double aulevel_calc_dbov(const int16_t *sampv, size_t sampc)
 {
-	static const double peak = 32767.0;
-	double rms, dbov;
-
-	if (!sampv || !sampc)
-		return AULEVEL_MIN;
-
-	rms = calc_rms(sampv, sampc) / peak;
-
-	dbov = 20 * log10(rms);
+	struct aulevel lvl;
 
-	if (dbov < AULEVEL_MIN)
-		dbov = AULEVEL_MIN;
-	else if (dbov > AULEVEL_MAX)
-		dbov = AULEVEL_MAX;
+	aulevel_calc(&lvl, sampv, sampc);
 
-	return dbov;
+	return aulevel_dbov(&lvl);
 }
@@ -0,0 +1,318 @@
+/**
+ * @file src/auplc.c  Packet Loss Concealment
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * Pitch based waveform substitution, after ITU-T G.711 Appendix I.
+ *
+ * The decoded audio is kept in a short history. When a frame is lost,
+ * the pitch period of the history is found by normalised
+ * cross-correlation. The history is then repeated one period at a time.
+ * After every 10 ms of loss, one more period is used, up to three, so
+ * that a long loss does not sound tonal. The end of each period is
+ * faded into the period before it, so that the wrap is smooth.
+ *
+ * After 10 ms the substitution is attenuated by 20% per 10 ms. It is
+ * silent after 60 ms. The first good frame after a loss is faded in over
+ * the continued substitution.
+ *
+ * The pitch is found on the first channel, and used for all channels.
+ */
+
+
+enum {
+	PITCH_MIN_HZ = 66,    /* lowest pitch [Hz]                    */
+	PITCH_MAX_HZ = 200,   /* highest pitch [Hz]                   */
+	CORR_MS      = 20,    /* correlation window [ms]              */
+	STEP_MS      = 10,    /* one more period, or less gain [ms]   */
+	PERIODS_MAX  = 3,     /* max. periods in the substitution     */
+	FADE_STEPS   = 5,     /* steps until silence                  */
+	OLA_MS       = 4,     /* more fade-in per step of loss [ms]   */
+	COARSE_HZ    = 8000,  /* sample rate of the coarse search     */
+};
+
+
+/** Packet Loss Concealment state */
+struct auplc {
+	int16_t *histv;       /**< Decoded history, interleaved       */
+	size_t histc;         /**< History length per channel         */
+	int16_t *synv;        /**< Substitution to fade in from       */
+	size_t synsz;         /**< Size of synv per channel           */
+	uint32_t srate;       /**< Sample rate in [Hz]                */
+	uint8_t ch;           /**< Number of channels                 */
+	size_t pmin, pmax;    /**< Pitch range in [samples]           */
+	size_t step;          /**< Samples per step of the loss       */
+	size_t pitch;         /**< Pitch period of the history        */
+	size_t periods;       /**< Periods in the substitution        */
+	size_t pos;           /**< Position in the substitution       */
+	size_t lost;          /**< Samples concealed in this loss     */
+};
+
+
+static void destructor(void *arg)
+{
+	struct auplc *plc = arg;
+
+	mem_deref(plc->synv);
+	mem_deref(plc->histv);
+}
+
+
+/**
+ * Allocate a Packet Loss Concealment state
+ *
+ * @param plcp  Pointer to allocated state
+ * @param srate Sample rate in [Hz]
+ * @param ch    Number of channels
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int auplc_alloc(struct auplc **plcp, uint32_t srate, uint8_t ch)
+{
+	struct auplc *plc;
+
+	if (!plcp || !srate || !ch)
+		return EINVAL;
+
+	plc = mem_zalloc(sizeof(*plc), destructor);
+	if (!plc)
+		return ENOMEM;
+
+	plc->srate = srate;
+	plc->ch    = ch;
+	plc->pmin  = srate / PITCH_MAX_HZ;
+	plc->pmax  = srate / PITCH_MIN_HZ;
+	plc->step  = srate * STEP_MS / 1000;
+
+	/* room for the periods, and for the fade at their end */
+	plc->histc = PERIODS_MAX * plc->pmax + plc->pmax / 4;
+	plc->histc = max(plc->histc, srate * CORR_MS / 1000 + plc->pmax);
+
+	/* the longest fade-in, after a loss until silence */
+	plc->synsz = plc->pmax / 4
+		+ FADE_STEPS * srate * OLA_MS / 1000;
+
+	plc->histv = mem_zalloc(plc->histc * ch * sizeof(int16_t), NULL);
+	plc->synv  = mem_alloc(plc->synsz * ch * sizeof(int16_t), NULL);
+	if (!plc->histv || !plc->synv) {
+		mem_deref(plc);
+		return ENOMEM;
+	}
+
+	*plcp = plc;
+
+	return 0;
+}
+
+
+static double corr(const struct auplc *plc, size_t lag, size_t len,
+		   size_t inc)
+{
+	const int16_t *x = &plc->histv[(plc->histc - len) * plc->ch];
+	const int16_t *y = &plc->histv[(plc->histc - len - lag) * plc->ch];
+	const size_t stride = inc * plc->ch;
+	double xy = 0, yy = 1;
+	size_t i;
+
+	for (i=0; i<len * plc->ch; i+=stride) {
+		xy += (double)x[i] * y[i];
+		yy += (double)y[i] * y[i];
+	}
+
+	return xy / sqrt(yy);
+}
+
+
+/* coarse search at about 8 kHz, refined around the best lag */
+static size_t pitch_find(const struct auplc *plc)
+{
+	const size_t len = plc->srate * CORR_MS / 1000;
+	const size_t inc = max(plc->srate / COARSE_HZ, 1u);
+	size_t lag, lo, hi, best = plc->pmax;
+	double c, cmax = -1e30;
+
+	for (lag=plc->pmin; lag<=plc->pmax; lag+=inc) {
+
+		c = corr(plc, lag, len, inc);
+		if (c > cmax) {
+			cmax = c;
+			best = lag;
+		}
+	}
+
+	lo = best > plc->pmin + inc ? best - inc : plc->pmin;
+	hi = min(best + inc, plc->pmax);
+	cmax = -1e30;
+
+	for (lag=lo; lag<=hi; lag++) {
+
+		c = corr(plc, lag, len, 1);
+		if (c > cmax) {
+			cmax = c;
+			best = lag;
+		}
+	}
+
+	return best;
+}
+
+
+/* gain of the substitution, after the given samples of loss */
+static inline float fade(const struct auplc *plc, size_t lost)
+{
+	const size_t steps = lost / plc->step;
+
+	if (!steps)
+		return 1.0f;
+	else if (steps >= FADE_STEPS + 1)
+		return 0.0f;
+
+	/* linear within each step */
+	return 1.0f - ((float)lost / plc->step - 1.0f) / FADE_STEPS;
+}
+
+
+/* the next frame of the substitution, for all channels */
+static void synthesize(struct auplc *plc, int16_t *sampv, size_t frames,
+		       bool advance)
+{
+	const size_t ola = plc->pitch / 4;
+	size_t pos = plc->pos, periods = plc->periods, lost = plc->lost;
+	size_t i, c;
+
+	for (i=0; i<frames; i++) {
+
+		const size_t span = periods * plc->pitch;
+		const size_t src  = plc->histc - span + pos;
+		const float g = fade(plc, lost);
+
+		for (c=0; c<plc->ch; c++) {
+
+			float v = plc->histv[src * plc->ch + c];
+
+			/* fade into the sample one span back, to wrap */
+			if (pos >= span - ola) {
+				const float w = (span - pos) / (ola + 1.0f);
+				const size_t j = (src - span) * plc->ch + c;
+
+				v = v * w + plc->histv[j] * (1.0f - w);
+			}
+
+			sampv[i * plc->ch + c] = (int16_t)(v * g);
+		}
+
+		++lost;
+
+		if (++pos < span)
+			continue;
+
+		pos = 0;
+
+		/* one more period at the wrap, every step */
+		if (periods < PERIODS_MAX && lost >= periods * plc->step)
+			++periods;
+	}
+
+	if (advance) {
+		plc->pos     = pos;
+		plc->periods = periods;
+		plc->lost    = lost;
+	}
+}
+
+
+static void history_add(struct auplc *plc, const int16_t *sampv,
+			size_t frames)
+{
+	const size_t ch = plc->ch;
+
+	if (frames >= plc->histc) {
+		memcpy(plc->histv, &sampv[(frames - plc->histc) * ch],
+		       plc->histc * ch * sizeof(int16_t));
+		return;
+	}
+
+	memmove(plc->histv, &plc->histv[frames * ch],
+		(plc->histc - frames) * ch * sizeof(int16_t));
+	memcpy(&plc->histv[(plc->histc - frames) * ch], sampv,
+	       frames * ch * sizeof(int16_t));
+}
+
+
+/**
+ * Conceal a lost frame
+ *
+ * @param plc   Packet Loss Concealment state
+ * @param sampv Buffer for the concealed samples
+ * @param sampc Number of samples, all channels
+ */
+void auplc_conceal(struct auplc *plc, int16_t *sampv, size_t sampc)
+{
+	if (!plc || !sampv)
+		return;
+
+	if (!plc->lost) {
+		plc->pitch   = pitch_find(plc);
+		plc->periods = 1;
+		plc->pos     = 0;
+	}
+
+	synthesize(plc, sampv, sampc / plc->ch, true);
+}
+
+
+/**
+ * Handle a good frame. After a loss, its start is faded in over the
+ * concealed signal.
+ *
+ * @param plc   Packet Loss Concealment state
+ * @param sampv Decoded samples, modified after a loss
+ * @param sampc Number of samples, all channels
+ */
+void auplc_rx(struct auplc *plc, int16_t *sampv, size_t sampc)
+{
+	size_t frames;
+
+	if (!plc || !sampv)
+		return;
+
+	frames = sampc / plc->ch;
+
+	if (plc->lost) {
+
+		const size_t steps = (plc->lost + plc->step - 1) / plc->step;
+		size_t ola, i, c;
+
+		ola = plc->pitch / 4
+			+ min(steps - 1, (size_t)FADE_STEPS)
+			* plc->srate * OLA_MS / 1000;
+		ola = min(ola, frames);
+
+		synthesize(plc, plc->synv, ola, false);
+
+		for (i=0; i<ola; i++) {
+
+			const float w = (float)(i + 1) / (ola + 1);
+
+			for (c=0; c<plc->ch; c++) {
+
+				const size_t j = i * plc->ch + c;
+
+				sampv[j] = (int16_t)(sampv[j] * w
+						     + plc->synv[j] * (1 - w));
+			}
+		}
+
+		plc->lost = 0;
+	}
+
+	history_add(plc, sampv, frames);
+}
@@ -76,6 +76,8 @@ static const struct cmd corecmdv[] = {
 	{"quit", 'q', 0, "Quit",                     cmd_quit             },
 	{"insmod", 0, CMD_PRM, "Load module",        insmod_handler       },
 	{"rmmod",  0, CMD_PRM, "Unload module",      rmmod_handler        },
+	{"rtppool", 0,      0, "RTP socket pool",    rtppool_debug        },
+	{"mthread", 0,      0, "Media threads",      mthread_debug        },
 };
 
 
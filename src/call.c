@@ -53,6 +53,8 @@ struct call {
 #ifdef USE_VIDEO
 	struct video *video;      /**< Video stream                         */
 	struct bfcp *bfcp;        /**< BFCP Client                          */
+	enum vidmode vidmode;     /**< Video mode for this call             */
+	struct stream_param stream_prm;  /**< Parameters for new streams   */
 #endif
 	enum state state;         /**< Call state                           */
 	char *local_uri;          /**< Local SIP uri                        */
@@ -112,8 +114,16 @@ static void set_state(struct call *call, enum state st)
 static void call_stream_start(struct call *call, bool active)
 {
 	const struct sdp_format *sc;
+	struct le *le;
 	int err;
 
+	FOREACH_STREAM {
+		stream_thread_pause(le->data);
+	}
+	FOREACH_STREAM {
+		stream_thread_wait(le->data);
+	}
+
 	/* Audio Stream */
 	sc = sdp_media_rformat(stream_sdpmedia(audio_strm(call->audio)), NULL);
 	if (sc) {
@@ -177,9 +187,11 @@ static void call_stream_start(struct call *call, bool active)
 	}
 #endif
 
-	if (active) {
-		struct le *le;
+	FOREACH_STREAM {
+		stream_thread_leave(le->data);
+	}
 
+	if (active) {
 		tmr_cancel(&call->tmr_inv);
 		call->time_start = time(NULL);
 
@@ -192,11 +204,18 @@ static void call_stream_start(struct call *call, bool active)
 
 static void call_stream_stop(struct call *call)
 {
+	struct le *le;
+
 	if (!call)
 		return;
 
 	call->time_stop = time(NULL);
 
+	/* media is handled by the main thread from now on */
+	FOREACH_STREAM {
+		stream_thread_detach(le->data);
+	}
+
 	/* Audio */
 	audio_stop(call->audio);
 
@@ -286,14 +305,12 @@ static void mnat_handler(int err, uint16_t scode, const char *reason,
 }
 
 
-static int update_media(struct call *call)
+static int update_streams(struct call *call)
 {
 	const struct sdp_format *sc;
 	struct le *le;
 	int err = 0;
 
-	debug("call: update media\n");
-
 	/* media attributes */
 	audio_sdp_attr_decode(call->audio);
 
@@ -355,6 +372,64 @@ static int update_media(struct call *call)
 }
 
 
+static int update_media(struct call *call)
+{
+	struct le *le;
+	int err;
+
+	debug("call: update media\n");
+
+	/* park the media threads while the streams are reconfigured */
+	FOREACH_STREAM {
+		stream_thread_pause(le->data);
+	}
+	FOREACH_STREAM {
+		stream_thread_wait(le->data);
+	}
+
+	err = update_streams(call);
+
+	FOREACH_STREAM {
+		stream_thread_leave(le->data);
+	}
+
+	FOREACH_STREAM {
+		(void)stream_thread_attach(le->data);
+	}
+
+	return err;
+}
+
+
+#ifdef USE_VIDEO
+/* true if the SDP has an enabled video m-line (port is not zero) */
+static bool sdp_has_video(const struct mbuf *mb)
+{
+	struct pl sdp, line, media, port;
+
+	sdp.p = (const char *)mbuf_buf(mb);
+	sdp.l = mbuf_get_left(mb);
+
+	while (sdp.l) {
+		const char *lb = pl_strchr(&sdp, '\n');
+
+		line.p = sdp.p;
+		line.l = lb ? (size_t)(lb - sdp.p) : sdp.l;
+		pl_advance(&sdp, lb ? line.l + 1 : line.l);
+
+		if (re_regex(line.p, line.l, "^m=[^ ]+ [0-9]+",
+			     &media, &port))
+			continue;
+
+		if (!pl_strcasecmp(&media, "video") && pl_u32(&port))
+			return true;
+	}
+
+	return false;
+}
+#endif
+
+
 static void print_summary(const struct call *call)
 {
 	uint32_t dur = call_duration(call);
@@ -480,6 +555,44 @@ static int assign_linenum(uint32_t *linenum, const struct list *lst)
 }
 
 
+#ifdef USE_VIDEO
+static int video_stream_alloc(struct call *call, const struct config *cfg,
+			      int label)
+{
+	struct account *acc = call->acc;
+	bool use_video;
+	int err;
+
+	/* We require at least one video codec, and at least one
+	   video source or video display */
+	use_video = (call->vidmode != VIDMODE_OFF)
+		&& (list_head(account_vidcodecl(acc)) != NULL)
+		&& (NULL != vidsrc_find(baresip_vidsrcl(), NULL)
+		    || NULL != vidisp_find(baresip_vidispl(), NULL));
+
+	debug("call: use_video=%d\n", use_video);
+
+	if (!use_video)
+		return 0;
+
+	err = video_alloc(&call->video, &call->stream_prm, cfg,
+			  call, call->sdp, label,
+			  acc->mnat, call->mnats,
+			  acc->menc, call->mencs,
+			  "main",
+			  account_vidcodecl(acc),
+			  video_error_handler, call);
+	if (err)
+		return err;
+
+	stream_set_error_handler(video_strm(call->video),
+				 stream_error_handler, call);
+
+	return 0;
+}
+#endif
+
+
 /**
  * Allocate a new Call state object
  *
@@ -509,8 +622,7 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 	struct call *call;
 	struct le *le;
 	struct stream_param stream_prm;
-	enum vidmode vidmode = prm ? prm->vidmode : VIDMODE_OFF;
-	bool use_video = true, got_offer = false;
+	bool got_offer = false;
 	int label = 0;
 	int err = 0;
 
@@ -599,27 +711,17 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 		goto out;
 
 #ifdef USE_VIDEO
-	/* We require at least one video codec, and at least one
-	   video source or video display */
-	use_video = (vidmode != VIDMODE_OFF)
-		&& (list_head(account_vidcodecl(call->acc)) != NULL)
-		&& (NULL != vidsrc_find(baresip_vidsrcl(), NULL)
-		    || NULL != vidisp_find(baresip_vidispl(), NULL));
-
-	debug("call: use_video=%d\n", use_video);
-
-	/* Video stream */
-	if (use_video) {
-		err = video_alloc(&call->video, &stream_prm, cfg,
-				  call, call->sdp, ++label,
-				  acc->mnat, call->mnats,
-				  acc->menc, call->mencs,
-				  "main",
-				  account_vidcodecl(call->acc),
-				  video_error_handler, call);
+	call->vidmode    = prm->vidmode;
+	call->stream_prm = stream_prm;
+
+	/* Video stream. If the offer has no video, the video state is
+	   allocated when a re-INVITE adds video. Media NAT traversal
+	   gathers for all streams up front, so it always needs it. */
+	if (!got_offer || sdp_has_video(msg->mb) || acc->mnat) {
+		err = video_stream_alloc(call, cfg, ++label);
 		if (err)
 			goto out;
- 	}
+	}
 
 	if (str_isset(cfg->bfcp.proto)) {
 
@@ -629,9 +731,6 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 		if (err)
 			goto out;
 	}
-#else
-	(void)use_video;
-	(void)vidmode;
 #endif
 
 	/* inherit certain properties from original call */
@@ -926,6 +1025,33 @@ const char *call_peername(const struct call *call)
 }
 
 
+/**
+ * Add the memory used by a call to the memory statistics
+ *
+ * @param ms   Memory statistics
+ * @param call Call object
+ */
+void call_memstat_add(struct call_memstat *ms, const struct call *call)
+{
+	struct le *le;
+
+	if (!ms || !call)
+		return;
+
+	++ms->n_calls;
+
+	ms->call  += sizeof(*call);
+	ms->audio += audio_mem(call->audio);
+#ifdef USE_VIDEO
+	ms->video += video_mem(call->video);
+#endif
+
+	FOREACH_STREAM {
+		ms->stream += stream_mem(le->data);
+	}
+}
+
+
 int call_debug(struct re_printf *pf, const struct call *call)
 {
 	int err;
@@ -1076,6 +1202,28 @@ static int sipsess_offer_handler(struct mbuf **descp,
 
 	if (got_offer) {
 
+#ifdef USE_VIDEO
+		/* the offer adds video to an audio-only call */
+		if (!call->video && sdp_has_video(msg->mb)) {
+
+			/* label 2, as if it was allocated after audio */
+			err = video_stream_alloc(call, conf_config(), 2);
+			if (err) {
+				warning("call: reinvite: could not add video"
+					" (%m)\n", err);
+			}
+			else if (call->video) {
+				info("call: reinvite: video stream added\n");
+
+				if (call->rtp_timeout_ms) {
+					stream_enable_rtp_timeout(
+						video_strm(call->video),
+						call->rtp_timeout_ms);
+				}
+			}
+		}
+#endif
+
 		/* Decode SDP Offer */
 		err = sdp_decode(call->sdp, msg->mb, true);
 		if (err) {
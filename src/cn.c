@@ -0,0 +1,231 @@
+/**
+ * @file src/cn.c  Voice Activity Detection and Comfort Noise (RFC 3389)
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * The VAD compares the level of each frame with a running estimate of
+ * the background noise. The estimate follows the level down at once,
+ * and creeps up slowly, so that it settles on the pauses between
+ * words. After the last voiced frame a hangover keeps the stream
+ * active, so that word endings are not clipped.
+ *
+ * The Comfort Noise payload only carries the noise level. Spectral
+ * information is optional in RFC 3389; it is ignored when received.
+ */
+
+
+#define VAD_SILENCE   -60.0   /* always silence below [dBov]          */
+#define VAD_SPEECH    -30.0   /* always speech above [dBov]           */
+#define VAD_MARGIN      9.0   /* speech above the noise floor [dB]    */
+#define VAD_FLOOR     -55.0   /* initial noise floor [dBov]           */
+#define VAD_RISE        5.0   /* noise floor rise [dB/s]              */
+
+enum {
+	VAD_HANGOVER = 200,   /* hangover after speech [ms]           */
+	CN_MAXLEVEL  = 127,   /* lowest level in a CN payload [-dBov] */
+};
+
+
+/** SDP format name of Comfort Noise */
+const char cn_rtpfmt[] = "CN";
+
+
+/**
+ * Initialise a Voice Activity Detector
+ *
+ * @param vad   Voice Activity Detector
+ * @param ptime Packet time in [ms]
+ */
+void vad_init(struct vad *vad, uint32_t ptime)
+{
+	if (!vad)
+		return;
+
+	ptime = max(ptime, 1u);
+
+	vad->floor  = VAD_FLOOR;
+	vad->noise  = VAD_FLOOR;
+	vad->rise   = VAD_RISE * ptime / 1000.0;
+	vad->hang_n = (VAD_HANGOVER + ptime - 1) / ptime;
+	vad->hang   = vad->hang_n;
+	vad->active = true;
+}
+
+
+/**
+ * Process the level of one frame of audio
+ *
+ * @param vad   Voice Activity Detector
+ * @param level Audio level of the frame in [dBov]
+ *
+ * @return true if the frame should be sent, false if silent
+ */
+bool vad_process_level(struct vad *vad, double level)
+{
+	bool speech;
+
+	if (!vad)
+		return true;
+
+	if (level < vad->floor)
+		vad->floor = level;
+	else
+		vad->floor = min(vad->floor + vad->rise, level);
+
+	speech = level > VAD_SPEECH ||
+		(level > VAD_SILENCE && level > vad->floor + VAD_MARGIN);
+
+	if (speech) {
+		vad->hang   = vad->hang_n;
+		vad->active = true;
+		return true;
+	}
+
+	/* smoothed level of the background noise */
+	vad->noise += (level - vad->noise) * 0.25;
+
+	if (vad->hang) {
+		--vad->hang;
+		return true;
+	}
+
+	vad->active = false;
+
+	return false;
+}
+
+
+/**
+ * Process one frame of audio
+ *
+ * @param vad   Voice Activity Detector
+ * @param sampv Audio samples
+ * @param sampc Number of samples
+ *
+ * @return true if the frame should be sent, false if silent
+ */
+bool vad_process(struct vad *vad, const int16_t *sampv, size_t sampc)
+{
+	if (!vad)
+		return true;
+
+	return vad_process_level(vad, aulevel_calc_dbov(sampv, sampc));
+}
+
+
+/**
+ * Encode a Comfort Noise payload, without spectral information
+ *
+ * @param mb    Buffer to append the payload to
+ * @param level Noise level in [dBov]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int cn_encode(struct mbuf *mb, double level)
+{
+	int lvl;
+
+	if (!mb)
+		return EINVAL;
+
+	lvl = (int)lrint(-level);
+	lvl = max(lvl, 0);
+	lvl = min(lvl, CN_MAXLEVEL);
+
+	return mbuf_write_u8(mb, (uint8_t)lvl);
+}
+
+
+/**
+ * Decode the noise level of a Comfort Noise payload
+ *
+ * @param level Returns the noise level in [dBov]
+ * @param mb    Buffer with the payload
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int cn_decode(double *level, const struct mbuf *mb)
+{
+	if (!level || !mb)
+		return EINVAL;
+
+	if (mbuf_get_left(mb) < 1)
+		return EBADMSG;
+
+	*level = -(double)(mbuf_buf(mb)[0] & 0x7f);
+
+	return 0;
+}
+
+
+/**
+ * Set the level of a Comfort Noise generator
+ *
+ * @param cg    Comfort Noise generator
+ * @param level Noise level in [dBov]
+ */
+void cngen_set_level(struct cngen *cg, double level)
+{
+	if (!cg)
+		return;
+
+	/* peak of uniform noise is sqrt(3) times the RMS */
+	cg->amp = (uint32_t)(32767.0 * sqrt(3.0) * pow(10.0, level / 20.0));
+	cg->amp = min(cg->amp, 32767u);
+
+	if (!cg->seed)
+		cg->seed = 0x2545f491;
+}
+
+
+/**
+ * Generate Comfort Noise, the same on all channels
+ *
+ * @param cg    Comfort Noise generator
+ * @param sampv Buffer for the samples
+ * @param sampc Number of samples
+ * @param ch    Number of channels
+ */
+void cngen_generate(struct cngen *cg, int16_t *sampv, size_t sampc,
+		    uint8_t ch)
+{
+	const uint32_t amp = cg ? cg->amp : 0;
+	size_t i;
+	uint8_t c;
+
+	if (!sampv)
+		return;
+
+	if (!amp || !ch) {
+		memset(sampv, 0, sampc * sizeof(int16_t));
+		return;
+	}
+
+	for (i=0; i + ch <= sampc; i += ch) {
+
+		uint32_t x = cg->seed;
+		int16_t s;
+
+		/* xorshift32 */
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		cg->seed = x;
+
+		s = (int16_t)((int64_t)(x % (2 * amp + 1)) - amp);
+
+		for (c=0; c<ch; c++)
+			sampv[i + c] = s;
+	}
+
+	for (; i < sampc; i++)
+		sampv[i] = 0;
+}
@@ -32,7 +32,9 @@ static struct config core_config = {
 		16,
 		"",
 		"",
-		""
+		"",
+		0,
+		0
 	},
 
 	/** Call config */
@@ -53,11 +55,17 @@ static struct config core_config = {
 		0,
 		0,
 		0,
+		RESAMPLER_MEDIUM,
 		false,
 		AUDIO_MODE_POLL,
 		false,
 		AUFMT_S16LE,
 		AUFMT_S16LE,
+		0,
+		false,
+		false,
+		0,
+		true,
 	},
 
 #ifdef USE_VIDEO
@@ -81,6 +89,8 @@ static struct config core_config = {
 		false,
 		{5, 10},
 		false,
+		0,
+		0,
 		0
 	},
 
@@ -159,7 +169,7 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	struct pl pollm, as, ap;
 	enum poll_method method;
 	struct vidsz size = {0, 0};
-	struct pl fmt, txmode;
+	struct pl fmt, txmode, resamp;
 	uint32_t v;
 	int err = 0;
 
@@ -186,6 +196,10 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 			   sizeof(cfg->sip.local));
 	(void)conf_get_str(conf, "sip_certificate", cfg->sip.cert,
 			   sizeof(cfg->sip.cert));
+	(void)conf_get_u32(conf, "sip_reg_rate", &cfg->sip.reg_rate);
+	cfg->sip.reg_rate = min(cfg->sip.reg_rate, 10000u);
+	(void)conf_get_u32(conf, "sip_reg_spread", &cfg->sip.reg_spread);
+	cfg->sip.reg_spread = min(cfg->sip.reg_spread, 50u);
 
 	/* Call */
 	(void)conf_get_u32(conf, "call_local_timeout",
@@ -219,6 +233,14 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	(void)conf_get_u32(conf, "ausrc_channels", &cfg->audio.channels_src);
 	(void)conf_get_u32(conf, "auplay_channels", &cfg->audio.channels_play);
 
+	if (0 == conf_get(conf, "audio_resampler", &resamp)) {
+
+		if (resampler_quality_resolve(&cfg->audio.resamp, &resamp)) {
+			warning("unsupported audio resampler quality (%r)\n",
+				&resamp);
+		}
+	}
+
 	if (0 == conf_get(conf, "audio_source", &as) &&
 	    0 == conf_get(conf, "audio_player", &ap))
 		cfg->audio.src_first = as.p < ap.p;
@@ -235,6 +257,12 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	}
 
 	(void)conf_get_bool(conf, "audio_level", &cfg->audio.level);
+	(void)conf_get_u32(conf, "audio_silence_skip",
+			   &cfg->audio.silence_skip);
+	(void)conf_get_bool(conf, "audio_cn", &cfg->audio.cn);
+	(void)conf_get_bool(conf, "audio_adaptive", &cfg->audio.adaptive);
+	(void)conf_get_u32(conf, "audio_pps_max", &cfg->audio.pps_max);
+	(void)conf_get_bool(conf, "audio_plc", &cfg->audio.plc);
 
 	if (0 == conf_get(conf, "ausrc_format", &fmt)) {
 
@@ -296,6 +324,8 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 			     &cfg->avt.jbuf_del);
 	(void)conf_get_bool(conf, "rtp_stats", &cfg->avt.rtp_stats);
 	(void)conf_get_u32(conf, "rtp_timeout", &cfg->avt.rtp_timeout);
+	(void)conf_get_u32(conf, "rtp_pool", &cfg->avt.rtp_pool);
+	(void)conf_get_u32(conf, "media_threads", &cfg->avt.media_threads);
 
 	if (err) {
 		warning("config: configure parse error (%m)\n", err);
@@ -332,6 +362,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "sip_trans_bsize\t\t%u\n"
 			 "sip_listen\t\t%s\n"
 			 "sip_certificate\t%s\n"
+			 "sip_reg_rate\t\t%u\n"
+			 "sip_reg_spread\t\t%u\n"
 			 "\n"
 			 "# Call\n"
 			 "call_local_timeout\t%u\n"
@@ -348,7 +380,13 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "ausrc_srate\t\t%u\n"
 			 "auplay_channels\t\t%u\n"
 			 "ausrc_channels\t\t%u\n"
+			 "audio_resampler\t\t%s\n"
 			 "audio_level\t\t%s\n"
+			 "audio_silence_skip\t%u\n"
+			 "audio_cn\t\t%s\n"
+			 "audio_adaptive\t\t%s\n"
+			 "audio_pps_max\t\t%u\n"
+			 "audio_plc\t\t%s\n"
 			 "\n"
 #ifdef USE_VIDEO
 			 "# Video\n"
@@ -368,6 +406,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "jitter_buffer_delay\t%H\n"
 			 "rtp_stats\t\t%s\n"
 			 "rtp_timeout\t\t%u # in seconds\n"
+			 "rtp_pool\t\t%u\n"
+			 "media_threads\t\t%u\n"
 			 "\n"
 			 "# Network\n"
 			 "net_interface\t\t%s\n"
@@ -380,6 +420,7 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 ,
 
 			 cfg->sip.trans_bsize, cfg->sip.local, cfg->sip.cert,
+			 cfg->sip.reg_rate, cfg->sip.reg_spread,
 
 			 cfg->call.local_timeout,
 			 cfg->call.max_calls,
@@ -392,7 +433,13 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 range_print, &cfg->audio.channels,
 			 cfg->audio.srate_play, cfg->audio.srate_src,
 			 cfg->audio.channels_play, cfg->audio.channels_src,
+			 resampler_quality_name(cfg->audio.resamp),
 			 cfg->audio.level ? "yes" : "no",
+			 cfg->audio.silence_skip,
+			 cfg->audio.cn ? "yes" : "no",
+			 cfg->audio.adaptive ? "yes" : "no",
+			 cfg->audio.pps_max,
+			 cfg->audio.plc ? "yes" : "no",
 
 #ifdef USE_VIDEO
 			 cfg->video.src_mod, cfg->video.src_dev,
@@ -409,6 +456,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 range_print, &cfg->avt.jbuf_del,
 			 cfg->avt.rtp_stats ? "yes" : "no",
 			 cfg->avt.rtp_timeout,
+			 cfg->avt.rtp_pool,
+			 cfg->avt.media_threads,
 
 			 cfg->net.ifname
 
@@ -500,6 +549,8 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "sip_trans_bsize\t\t128\n"
 			  "#sip_listen\t\t0.0.0.0:5060\n"
 			  "#sip_certificate\tcert.pem\n"
+			  "#sip_reg_rate\t\t50\t\t# max REGISTER/sec\n"
+			  "#sip_reg_spread\t\t10\t\t# expiry spread [%%]\n"
 			  "\n"
 			  "# Call\n"
 			  "call_local_timeout\t%u\n"
@@ -520,8 +571,18 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "#auplay_srate\t\t48000\n"
 			  "#ausrc_channels\t\t0\n"
 			  "#auplay_channels\t\t0\n"
+			  "#audio_resampler\tmedium\t\t# fast, medium, high\n"
 			  "#audio_txmode\t\tpoll\t\t# poll, thread\n"
 			  "audio_level\t\tno\n"
+			  "#audio_silence_skip\t50\t\t# skip decoding"
+			  " below -50 dBov\n"
+			  "#audio_cn\t\tno\t\t# VAD and Comfort Noise\n"
+			  "#audio_adaptive\t\tno\t\t# adapt encoder to"
+			  " RTCP reports\n"
+			  "#audio_pps_max\t\t0\t\t# packets/s of all"
+			  " calls\n"
+			  "#audio_plc\t\tyes\t\t# packet loss"
+			  " concealment\n"
 			  "ausrc_format\t\ts16\t\t# s16, float, ..\n"
 			  "auplay_format\t\ts16\t\t# s16, float, ..\n"
 			  ,
@@ -560,6 +621,8 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "jitter_buffer_delay\t%u-%u\t\t# frames\n"
 			  "rtp_stats\t\tno\n"
 			  "#rtp_timeout\t\t60\n"
+			  "#rtp_pool\t\t16\t\t# pre-bound RTP sockets\n"
+			  "#media_threads\t\t4\t\t# RTP worker threads\n"
 			  "\n# Network\n"
 			  "#dns_server\t\t10.0.0.1:53\n"
 			  "#net_interface\t\t%H\n",
@@ -674,6 +737,8 @@ int config_write_template(const char *file, const struct config *cfg)
 	modpath = detect_module_path(&modpath_valid);
 	(void)re_fprintf(f, "%smodule_path\t\t%s\n",
 			 modpath_valid ? "" : "#", modpath);
+	(void)re_fprintf(f, "#module_parallel\tyes\t\t"
+			 "# no speedup on glibc\n");
 
 	(void)re_fprintf(f, "\n# UI Modules\n");
 #if defined (WIN32)
@@ -705,9 +770,11 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "\n# Audio filter Modules (in encoding order)\n");
 	(void)re_fprintf(f, "module\t\t\t" MOD_PRE "vumeter" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "sndfile" MOD_EXT "\n");
+	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "aec" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "speex_aec" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "speex_pp" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "plc" MOD_EXT "\n");
+	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "auconf" MOD_EXT "\n");
 
 	(void)re_fprintf(f, "\n# Audio driver Modules\n");
 #if defined (ANDROID)
@@ -771,6 +838,7 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "x11grab" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "cairo" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "vidbridge" MOD_EXT "\n");
+	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "vidmcu" MOD_EXT "\n");
 
 	(void)re_fprintf(f, "\n# Video display modules\n");
 #ifdef DARWIN
@@ -877,6 +945,11 @@ int config_write_template(const char *file, const struct config *cfg)
 			"#zrtp_hash\t\tno  # Disable SDP zrtp-hash "
 			"(not recommended)\n");
 
+	(void)re_fprintf(f,
+			"\n# Presence\n"
+			"#presence_sub_rate\t50 # SUBSCRIBE per second\n"
+			"#presence_rls\t\tsip:buddies@example.com\n");
+
 	(void)re_fprintf(f,
 			"\n# Menu\n"
 			"#redial_attempts\t\t3 # Num or <inf>\n"
@@ -81,6 +81,18 @@ struct account {
 };
 
 
+/*
+ * Audio file cache
+ */
+
+struct aucache;
+
+int aucache_alloc(struct aucache **acp);
+int aucache_get(struct aucache *ac, struct mbuf **mbp,
+		uint32_t *srate, uint8_t *ch, const char *path);
+int aucache_debug(struct re_printf *pf, const struct aucache *ac);
+
+
 /*
  * Audio Player
  */
@@ -137,6 +149,7 @@ struct stream *audio_strm(const struct audio *a);
 int  audio_send_digit(struct audio *a, char key);
 void audio_sdp_attr_decode(struct audio *a);
 int  audio_print_rtpstat(struct re_printf *pf, const struct audio *au);
+size_t audio_mem(const struct audio *a);
 
 
 /*
@@ -192,6 +205,17 @@ int  call_af(const struct call *call);
 void call_set_xrtpstat(struct call *call);
 struct account *call_account(const struct call *call);
 
+/** Memory used by calls, per subsystem [bytes] */
+struct call_memstat {
+	uint32_t n_calls;            /**< Number of calls                    */
+	size_t call;                 /**< Call objects                       */
+	size_t stream;               /**< Generic media streams              */
+	size_t audio;                /**< Audio objects and buffers          */
+	size_t video;                /**< Video objects and frames           */
+};
+
+void call_memstat_add(struct call_memstat *ms, const struct call *call);
+
 
 /*
  * Conf
@@ -232,7 +256,6 @@ const struct mnat *mnat_find(const struct list *mnatl, const char *id);
 
 struct metric {
 	/* internal stuff: */
-	struct tmr tmr;
 	uint64_t ts_start;
 	bool started;
 
@@ -247,8 +270,7 @@ struct metric {
 	uint32_t n_bytes_last;
 };
 
-void     metric_init(struct metric *metric);
-void     metric_reset(struct metric *metric);
+void     metric_tick(struct metric *metric, uint64_t now);
 void     metric_add_packet(struct metric *metric, size_t packetsize);
 uint32_t metric_avg_bitrate(const struct metric *metric);
 
@@ -261,6 +283,33 @@ int module_init(const struct conf *conf);
 void module_app_unload(void);
 
 
+/*
+ * Media worker threads
+ */
+
+struct mthread;
+
+typedef void (mthread_exec_h)(void *arg);
+
+int  mthread_init(unsigned n);
+void mthread_close(void);
+struct mthread *mthread_assign(void);
+int  mthread_exec(struct mthread *mt, mthread_exec_h *h, void *arg);
+void mthread_enter(struct mthread *mt);
+void mthread_pause(struct mthread *mt);
+void mthread_pause_wait(struct mthread *mt);
+void mthread_leave(struct mthread *mt);
+void mthread_stream_count(struct mthread *mt, int delta);
+int  mthread_debug(struct re_printf *pf, void *unused);
+
+
+/*
+ * Real-Time
+ */
+
+uint64_t time_usec(void);
+
+
 /*
  * Register client
  */
@@ -276,6 +325,43 @@ int  reg_debug(struct re_printf *pf, const struct reg *reg);
 int  reg_status(struct re_printf *pf, const struct reg *reg);
 
 
+/*
+ * Registration scheduler
+ */
+
+typedef int (regsched_h)(void *arg);
+
+/** Registration scheduler entry */
+struct regent {
+	struct le le;                /**< Linked list element (queue)        */
+	regsched_h *h;               /**< Send handler                       */
+	void *arg;                   /**< Handler argument                   */
+	uint64_t due;                /**< Time when entry is due [ms]        */
+	unsigned failc;              /**< Number of consecutive failures     */
+};
+
+void regsched_set_rate(uint32_t rate);
+int  regsched_add(struct regent *ent, regsched_h *h, void *arg);
+void regsched_cancel(struct regent *ent);
+void regsched_latency(uint32_t ms);
+void regsched_close(void);
+int  regsched_debug(struct re_printf *pf, void *unused);
+
+
+/*
+ * RTP Socket pool
+ */
+
+struct rtpsock;
+
+void rtppool_init(const struct config_avt *cfg, int af, uint32_t size);
+void rtppool_close(void);
+int  rtppool_get(struct rtpsock **rsp, const struct config_avt *cfg, int af,
+		 rtp_recv_h *rtph, rtcp_recv_h *rtcph, void *arg);
+struct rtp_sock *rtpsock_rtp(const struct rtpsock *rs);
+int  rtppool_debug(struct re_printf *pf, void *unused);
+
+
 /*
  * RTP Header Extensions
  */
@@ -315,6 +401,7 @@ struct rtpkeep;
 int  rtpkeep_alloc(struct rtpkeep **rkp, const char *method, int proto,
 		   struct rtp_sock *rtp, struct sdp_media *sdp);
 void rtpkeep_refresh(struct rtpkeep *rk, uint32_t ts);
+void rtpkeep_tick(struct rtpkeep *rk, uint64_t now);
 
 
 /*
@@ -339,6 +426,8 @@ typedef void (stream_rtp_h)(const struct rtp_header *hdr,
 typedef void (stream_rtcp_h)(struct rtcp_msg *msg, void *arg);
 
 typedef void (stream_error_h)(struct stream *strm, int err, void *arg);
+typedef void (stream_event_h)(int id, uint32_t val, void *arg);
+typedef void (stream_tick_h)(uint64_t now, void *arg);
 
 /** Common parameters for media stream */
 struct stream_param {
@@ -351,6 +440,7 @@ struct stream {
 	struct config_avt cfg;   /**< Stream configuration                  */
 	struct call *call;       /**< Ref. to call object                   */
 	struct sdp_media *sdp;   /**< SDP Media line                        */
+	struct rtpsock *rtps;    /**< RTP Socket pair, owns rtp             */
 	struct rtp_sock *rtp;    /**< RTP Socket                            */
 	struct rtpkeep *rtpkeep; /**< RTP Keepalive                         */
 	struct rtcp_stats rtcp_stats;/**< RTCP statistics                   */
@@ -373,7 +463,11 @@ struct stream {
 	void *arg;               /**< Handler argument                      */
 	stream_error_h *errorh;  /**< Stream error handler                  */
 	void *errorh_arg;        /**< Error handler argument                */
-	struct tmr tmr_rtp;      /**< Timer for detecting RTP timeout       */
+	stream_event_h *eventh;  /**< Receive events for the main thread    */
+	struct le le_tick;       /**< Media housekeeping element            */
+	stream_tick_h *tickh;    /**< Media housekeeping handler            */
+	struct mthread *mt;      /**< Media worker thread, NULL for main    */
+	struct mqueue *mq;       /**< Events from the worker to main thread */
 	uint64_t ts_last;        /**< Timestamp of last received RTP pkt    */
 	bool terminated;         /**< Stream is terminated flag             */
 	uint32_t rtp_timeout_ms; /**< RTP Timeout value in [ms]             */
@@ -400,9 +494,19 @@ void stream_reset(struct stream *s);
 void stream_set_bw(struct stream *s, uint32_t bps);
 void stream_set_error_handler(struct stream *strm,
 			      stream_error_h *errorh, void *arg);
+void stream_set_event_handler(struct stream *strm, stream_event_h *eventh);
+void stream_set_tick_handler(struct stream *strm, stream_tick_h *tickh);
+int  stream_event_post(struct stream *s, int id, uint32_t val);
 int  stream_debug(struct re_printf *pf, const struct stream *s);
+size_t stream_mem(const struct stream *s);
 int  stream_print(struct re_printf *pf, const struct stream *s);
 void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms);
+int  stream_thread_attach(struct stream *s);
+void stream_thread_detach(struct stream *s);
+void stream_thread_enter(struct stream *s);
+void stream_thread_pause(struct stream *s);
+void stream_thread_wait(struct stream *s);
+void stream_thread_leave(struct stream *s);
 
 
 /*
@@ -475,6 +579,7 @@ struct stream *video_strm(const struct video *v);
 void video_update_picture(struct video *v);
 void video_sdp_attr_decode(struct video *v);
 int  video_print(struct re_printf *pf, const struct video *v);
+size_t video_mem(const struct video *v);
 
 
 /*
@@ -0,0 +1,233 @@
+/**
+ * @file src/g711.c  Batch G.711 conversion
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "core.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+ * The encoders compute the segment and mantissa with compares and
+ * shifts instead of librem's 16 KB and 8 KB lookup tables. With SSE2,
+ * 16 samples are encoded per iteration, as two vectors of 8 that are
+ * packed into one vector of bytes. The per-lane variable shift is done
+ * as a multiply by a power of two that halves once per segment.
+ *
+ * The companding follows the ITU-T G.711 reference: u-law works on the
+ * 14-bit magnitude with a bias of 33, A-law on the 13-bit magnitude,
+ * with one's complement for negative A-law values.
+ *
+ * Decoding is a single 256-entry table lookup per sample, which is
+ * already cheaper than any bit manipulation.
+ */
+
+
+static inline uint8_t ulaw_enc(int16_t x)
+{
+	int v = x >> 2;
+	uint8_t mask = 0xff;
+	unsigned seg = 0;
+
+	if (v < 0) {
+		v = -v;
+		mask = 0x7f;
+	}
+
+	v = min(v + 33, 0x1fff);
+
+	while (seg < 7 && v >= (0x40 << seg))
+		++seg;
+
+	return ((seg << 4) | ((v >> (seg + 1)) & 0xf)) ^ mask;
+}
+
+
+static inline uint8_t alaw_enc(int16_t x)
+{
+	int v = x >> 3;
+	uint8_t mask = 0xd5;
+	unsigned seg = 0;
+
+	if (v < 0) {
+		v = ~v;
+		mask = 0x55;
+	}
+
+	while (seg < 7 && v >= (0x20 << seg))
+		++seg;
+
+	return ((seg << 4) | ((v >> (seg ? seg : 1)) & 0xf)) ^ mask;
+}
+
+
+#if defined(__SSE2__)
+static inline __m128i ulaw_enc8(__m128i x)
+{
+	const __m128i sign = _mm_srai_epi16(x, 15);
+	__m128i v, seg, p, mant, mask;
+	int k;
+
+	/* |x >> 2| + 33, at most 0x1fff */
+	v = _mm_srai_epi16(x, 2);
+	v = _mm_sub_epi16(_mm_xor_si128(v, sign), sign);
+	v = _mm_add_epi16(v, _mm_set1_epi16(33));
+	v = _mm_min_epi16(v, _mm_set1_epi16(0x1fff));
+
+	seg = _mm_setzero_si128();
+	p   = _mm_set1_epi16(128);
+
+	for (k=0; k<7; k++) {
+		const __m128i end = _mm_set1_epi16((0x40 << k) - 1);
+		const __m128i gt  = _mm_cmpgt_epi16(v, end);
+
+		seg = _mm_sub_epi16(seg, gt);
+		p   = _mm_or_si128(_mm_andnot_si128(gt, p),
+				   _mm_and_si128(gt, _mm_srli_epi16(p, 1)));
+	}
+
+	/* (v >> (seg + 1)) & 0xf  ==  ((v << (7 - seg)) >> 8) & 0xf */
+	mant = _mm_srli_epi16(_mm_mullo_epi16(v, p), 8);
+	mant = _mm_and_si128(mant, _mm_set1_epi16(0xf));
+
+	mask = _mm_xor_si128(_mm_set1_epi16(0xff),
+			     _mm_and_si128(sign, _mm_set1_epi16(0x80)));
+
+	return _mm_xor_si128(_mm_or_si128(_mm_slli_epi16(seg, 4), mant), mask);
+}
+
+
+static inline __m128i alaw_enc8(__m128i x)
+{
+	const __m128i sign = _mm_srai_epi16(x, 15);
+	__m128i v, seg, p, mant, mask;
+	int k;
+
+	/* x >> 3, one's complement if negative */
+	v = _mm_xor_si128(_mm_srai_epi16(x, 3), sign);
+
+	seg = _mm_cmpgt_epi16(v, _mm_set1_epi16(0x1f));
+	seg = _mm_sub_epi16(_mm_setzero_si128(), seg);
+	p   = _mm_set1_epi16(64);
+
+	for (k=1; k<7; k++) {
+		const __m128i end = _mm_set1_epi16((0x20 << k) - 1);
+		const __m128i gt  = _mm_cmpgt_epi16(v, end);
+
+		seg = _mm_sub_epi16(seg, gt);
+		p   = _mm_or_si128(_mm_andnot_si128(gt, p),
+				   _mm_and_si128(gt, _mm_srli_epi16(p, 1)));
+	}
+
+	/* (v >> max(seg, 1)) & 0xf  ==  ((v << (7 - max)) >> 7) & 0xf */
+	mant = _mm_srli_epi16(_mm_mullo_epi16(v, p), 7);
+	mant = _mm_and_si128(mant, _mm_set1_epi16(0xf));
+
+	mask = _mm_xor_si128(_mm_set1_epi16(0xd5),
+			     _mm_and_si128(sign, _mm_set1_epi16(0x80)));
+
+	return _mm_xor_si128(_mm_or_si128(_mm_slli_epi16(seg, 4), mant), mask);
+}
+#endif
+
+
+/**
+ * Encode linear 16-bit samples to G.711 u-law
+ *
+ * @param dst Destination buffer, n bytes
+ * @param src Source samples
+ * @param n   Number of samples
+ */
+void g711_ulaw_enc(uint8_t *dst, const int16_t *src, size_t n)
+{
+	size_t i = 0;
+
+	if (!dst || !src)
+		return;
+
+#if defined(__SSE2__)
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_packus_epi16(ulaw_enc8(a), ulaw_enc8(b)));
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = ulaw_enc(src[i]);
+}
+
+
+/**
+ * Encode linear 16-bit samples to G.711 A-law
+ *
+ * @param dst Destination buffer, n bytes
+ * @param src Source samples
+ * @param n   Number of samples
+ */
+void g711_alaw_enc(uint8_t *dst, const int16_t *src, size_t n)
+{
+	size_t i = 0;
+
+	if (!dst || !src)
+		return;
+
+#if defined(__SSE2__)
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_packus_epi16(alaw_enc8(a), alaw_enc8(b)));
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = alaw_enc(src[i]);
+}
+
+
+/**
+ * Decode G.711 u-law to linear 16-bit samples
+ *
+ * @param dst Destination samples
+ * @param src Source buffer, n bytes
+ * @param n   Number of samples
+ */
+void g711_ulaw_dec(int16_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i;
+
+	if (!dst || !src)
+		return;
+
+	for (i=0; i<n; i++)
+		dst[i] = g711_ulaw2pcm(src[i]);
+}
+
+
+/**
+ * Decode G.711 A-law to linear 16-bit samples
+ *
+ * @param dst Destination samples
+ * @param src Source buffer, n bytes
+ * @param n   Number of samples
+ */
+void g711_alaw_dec(int16_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i;
+
+	if (!dst || !src)
+		return;
+
+	for (i=0; i<n; i++)
+		dst[i] = g711_alaw2pcm(src[i]);
+}
@@ -8,31 +8,7 @@
 #include "core.h"
 
 
-enum {TMR_INTERVAL = 3};
-static void tmr_handler(void *arg)
-{
-	struct metric *metric = arg;
-	const uint64_t now = tmr_jiffies();
-	uint32_t diff;
-
-	tmr_start(&metric->tmr, TMR_INTERVAL * 1000, tmr_handler, metric);
-
-	if (!metric->started)
-		return;
-
- 	if (now <= metric->ts_last)
-		return;
-
-	if (metric->ts_last) {
-		uint32_t bytes = metric->n_bytes - metric->n_bytes_last;
-		diff = (uint32_t)(now - metric->ts_last);
-		metric->cur_bitrate = 1000 * 8 * bytes / diff;
-	}
-
-	/* Update counters */
-	metric->ts_last = now;
-	metric->n_bytes_last = metric->n_bytes;
-}
+enum {METRIC_INTERVAL = 3000};  /* Bitrate calculation interval [ms] */
 
 
 static void metric_start(struct metric *metric)
@@ -46,21 +22,36 @@ static void metric_start(struct metric *metric)
 }
 
 
-void metric_init(struct metric *metric)
+/**
+ * Update the current bitrate, called from the media housekeeping tick
+ *
+ * @param metric Metric object
+ * @param now    Current time [ms]
+ */
+void metric_tick(struct metric *metric, uint64_t now)
 {
-	if (!metric)
+	uint32_t diff;
+
+	if (!metric || !metric->started)
 		return;
 
-	tmr_start(&metric->tmr, 100, tmr_handler, metric);
-}
+	if (now <= metric->ts_last)
+		return;
 
+	if (metric->ts_last) {
+		uint32_t bytes;
 
-void metric_reset(struct metric *metric)
-{
-	if (!metric)
-		return;
+		diff = (uint32_t)(now - metric->ts_last);
+		if (diff < METRIC_INTERVAL)
+			return;
 
-	tmr_cancel(&metric->tmr);
+		bytes = metric->n_bytes - metric->n_bytes_last;
+		metric->cur_bitrate = 1000 * 8 * bytes / diff;
+	}
+
+	/* Update counters */
+	metric->ts_last = now;
+	metric->n_bytes_last = metric->n_bytes;
 }
 
 
@@ -3,11 +3,51 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re.h>
 #include <baresip.h>
 #include "core.h"
 
 
+#if defined(HAVE_PTHREAD) && defined(HAVE_DLFCN) && !defined(STATIC)
+#include <dlfcn.h>
+#include <pthread.h>
+#define MODULE_PRELOAD 1
+#endif
+
+
+enum {
+	PRELOAD_THREADS = 4,
+};
+
+
+/** Time spent loading one module */
+struct modtime {
+	struct le le;
+	char name[64];
+	uint64_t usec;
+	int err;
+};
+
+static struct list modtimel;
+
+
+static void modtime_add(const struct pl *name, uint64_t usec, int err)
+{
+	struct modtime *mt;
+
+	mt = mem_zalloc(sizeof(*mt), NULL);
+	if (!mt)
+		return;
+
+	pl_strcpy(name, mt->name, sizeof(mt->name));
+	mt->usec = usec;
+	mt->err  = err;
+
+	list_append(&modtimel, &mt->le, mt);
+}
+
+
 /*
  * Append module extension, if not exist
  *
@@ -59,11 +99,14 @@ static int load_module(struct mod **modp, const struct pl *modpath,
 	char file[FS_PATH_MAX];
 	char namestr[256];
 	struct mod *m = NULL;
+	uint64_t start;
 	int err = 0;
 
 	if (!name)
 		return EINVAL;
 
+	start = time_usec();
+
 #ifdef STATIC
 	/* Try static first */
 	pl_strcpy(name, namestr, sizeof(namestr));
@@ -90,6 +133,8 @@ static int load_module(struct mod **modp, const struct pl *modpath,
 		goto out;
 
  out:
+	modtime_add(name, time_usec() - start, err);
+
 	if (err) {
 		warning("module %r: %m\n", name, err);
 	}
@@ -137,10 +182,128 @@ static int module_app_handler(const struct pl *val, void *arg)
 }
 
 
+#ifdef MODULE_PRELOAD
+struct preload_ent {
+	struct le le;
+	char file[FS_PATH_MAX];
+	void *handle;
+};
+
+struct preload {
+	struct list entl;
+	struct le *cur;
+	const struct pl *path;
+	pthread_mutex_t mutex;
+};
+
+
+static void preload_ent_destructor(void *data)
+{
+	struct preload_ent *ent = data;
+
+	if (ent->handle)
+		dlclose(ent->handle);
+}
+
+
+static int preload_handler(const struct pl *val, void *arg)
+{
+	struct preload *pre = arg;
+	struct preload_ent *ent;
+
+	ent = mem_zalloc(sizeof(*ent), preload_ent_destructor);
+	if (!ent)
+		return ENOMEM;
+
+	if (re_snprintf(ent->file, sizeof(ent->file), "%r/%r",
+			pre->path, val) < 0) {
+		mem_deref(ent);
+		return ENOMEM;
+	}
+
+	list_append(&pre->entl, &ent->le, ent);
+
+	return 0;
+}
+
+
+static void *preload_thread(void *arg)
+{
+	struct preload *pre = arg;
+
+	for (;;) {
+		struct preload_ent *ent;
+
+		pthread_mutex_lock(&pre->mutex);
+		ent = pre->cur ? pre->cur->data : NULL;
+		if (pre->cur)
+			pre->cur = pre->cur->next;
+		pthread_mutex_unlock(&pre->mutex);
+
+		if (!ent)
+			break;
+
+		/* same flags as mod_load(), so the handle is shared */
+		ent->handle = dlopen(ent->file, RTLD_NOW | RTLD_LOCAL);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Open all module files from a pool of threads. The modules are then
+ * initialised in config order by mod_load(), which only takes another
+ * reference on the already-open handle.
+ *
+ * NOTE: glibc holds its global loader lock in dlopen() for the whole
+ *       load and relocation, so the threads run one after another and
+ *       there is no speedup. Only a loader that opens objects
+ *       concurrently gains from this.
+ */
+static void preload_modules(struct preload *pre, const struct conf *conf)
+{
+	pthread_t tidv[PRELOAD_THREADS];
+	uint32_t i, n;
+
+	(void)conf_apply(conf, "module", preload_handler, pre);
+	(void)conf_apply(conf, "module_tmp", preload_handler, pre);
+	(void)conf_apply(conf, "module_app", preload_handler, pre);
+
+	pre->cur = pre->entl.head;
+
+	n = min(list_count(&pre->entl), PRELOAD_THREADS);
+
+	for (i=0; i<n; i++) {
+		if (pthread_create(&tidv[i], NULL, preload_thread, pre))
+			break;
+	}
+
+	n = i;
+
+	/* if no thread could be started, the list is opened here */
+	if (!n)
+		(void)preload_thread(pre);
+
+	for (i=0; i<n; i++)
+		pthread_join(tidv[i], NULL);
+
+	debug("module: pre-opened %u modules with %u threads\n",
+	      list_count(&pre->entl), n);
+}
+#endif
+
+
 int module_init(const struct conf *conf)
 {
 	struct pl path;
+	bool parallel = false;
+	uint64_t start;
+	uint32_t n;
 	int err;
+#ifdef MODULE_PRELOAD
+	struct preload pre;
+#endif
 
 	if (!conf)
 		return EINVAL;
@@ -148,19 +311,45 @@ int module_init(const struct conf *conf)
 	if (conf_get(conf, "module_path", &path))
 		pl_set_str(&path, ".");
 
+	(void)conf_get_bool(conf, "module_parallel", &parallel);
+
+	start = time_usec();
+	n = list_count(&modtimel);
+
+#ifdef MODULE_PRELOAD
+	memset(&pre, 0, sizeof(pre));
+	pre.path = &path;
+	pthread_mutex_init(&pre.mutex, NULL);
+
+	if (parallel)
+		preload_modules(&pre, conf);
+#else
+	if (parallel)
+		info("module: parallel loading not supported\n");
+#endif
+
 	err = conf_apply(conf, "module", module_handler, &path);
 	if (err)
-		return err;
+		goto out;
 
 	err = conf_apply(conf, "module_tmp", module_tmp_handler, &path);
 	if (err)
-		return err;
+		goto out;
 
 	err = conf_apply(conf, "module_app", module_app_handler, &path);
 	if (err)
-		return err;
+		goto out;
 
-	return 0;
+	info("module: %u modules loaded in %.1f ms\n",
+	     list_count(&modtimel) - n, (time_usec() - start) / 1000.0);
+
+ out:
+#ifdef MODULE_PRELOAD
+	list_flush(&pre.entl);
+	pthread_mutex_destroy(&pre.mutex);
+#endif
+
+	return err;
 }
 
 
@@ -180,6 +369,8 @@ void module_app_unload(void)
 			mem_deref(mod);
 		}
 	}
+
+	list_flush(&modtimel);
 }
 
 
@@ -197,6 +388,40 @@ int module_preload(const char *module)
 }
 
 
+/**
+ * Print the time spent loading each module
+ *
+ * @param pf     Print handler
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int module_print_timing(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	uint64_t total = 0;
+	int err;
+	(void)unused;
+
+	err = re_hprintf(pf, "Module load time:\n");
+
+	for (le = modtimel.head; le; le = le->next) {
+		const struct modtime *mt = le->data;
+
+		err |= re_hprintf(pf, "  %-24s %8.2f ms%s\n",
+				  mt->name, mt->usec / 1000.0,
+				  mt->err ? "  (failed)" : "");
+
+		total += mt->usec;
+	}
+
+	err |= re_hprintf(pf, "  %-24s %8.2f ms\n", "total",
+			  total / 1000.0);
+
+	return err;
+}
+
+
 /**
  * Load a module by name or by filename
  *
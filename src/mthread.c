@@ -0,0 +1,503 @@
+/**
+ * @file mthread.c  Media worker threads
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * Media worker threads
+ *
+ * Each worker thread runs its own libre event loop. The RTP and RTCP
+ * sockets of an audio stream can be moved to one of the workers, so
+ * that receive, SRTP and decoding of many streams run on all cores
+ * while SIP and video stay on the main thread.
+ *
+ * The main thread controls a worker with messages on a mqueue:
+ *
+ *   JOB    run a function in the worker thread and wait for it
+ *   PAUSE  park the worker while the main thread changes the state
+ *          of its streams (codec change, reset, teardown). The
+ *          main thread can ask several workers to park before it
+ *          waits for them.
+ *   STOP   stop the event loop of the worker
+ */
+
+
+#ifdef HAVE_PTHREAD
+
+
+enum {
+	MSG_JOB   = 1,
+	MSG_PAUSE = 2,
+	MSG_STOP  = 3,
+};
+
+
+struct mthread {
+	pthread_t tid;               /**< Worker thread ID                   */
+	pthread_mutex_t mutex;       /**< Protects the fields below          */
+	pthread_cond_t cond;         /**< Signals job done / paused / resume */
+	struct mqueue *mq;           /**< Message queue, owned by the worker */
+	mthread_exec_h *jobh;        /**< Pending job handler                */
+	void *jobarg;                /**< Pending job argument               */
+	unsigned pausec;             /**< Pause count, from the main thread  */
+	bool paused;                 /**< Worker is parked                   */
+	bool ready;                  /**< Worker has started                 */
+	bool started;                /**< Thread was created                 */
+	int err;                     /**< Startup error                      */
+	uint32_t n_streams;          /**< Number of attached streams         */
+};
+
+
+static struct {
+	struct mthread *mtv;         /**< Worker threads                     */
+	unsigned mtc;                /**< Number of worker threads           */
+	unsigned next;               /**< Next worker for round-robin        */
+} mts;
+
+
+/* must be called with the mutex held */
+static void run_job(struct mthread *mt)
+{
+	if (!mt->jobh)
+		return;
+
+	mt->jobh(mt->jobarg);
+
+	mt->jobh   = NULL;
+	mt->jobarg = NULL;
+
+	pthread_cond_broadcast(&mt->cond);
+}
+
+
+static void pause_wait(struct mthread *mt)
+{
+	pthread_mutex_lock(&mt->mutex);
+
+	mt->paused = true;
+	pthread_cond_broadcast(&mt->cond);
+
+	while (mt->pausec) {
+
+		/* jobs can be executed while paused */
+		if (mt->jobh)
+			run_job(mt);
+		else
+			pthread_cond_wait(&mt->cond, &mt->mutex);
+	}
+
+	mt->paused = false;
+
+	pthread_mutex_unlock(&mt->mutex);
+}
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct mthread *mt = arg;
+	(void)data;
+
+	switch (id) {
+
+	case MSG_JOB:
+		pthread_mutex_lock(&mt->mutex);
+		run_job(mt);
+		pthread_mutex_unlock(&mt->mutex);
+		break;
+
+	case MSG_PAUSE:
+		pause_wait(mt);
+		break;
+
+	case MSG_STOP:
+		re_cancel();
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static void *thread_main(void *arg)
+{
+	struct mthread *mt = arg;
+	int err;
+
+	err = re_thread_init();
+	if (err) {
+		warning("mthread: re_thread_init failed (%m)\n", err);
+		goto out;
+	}
+
+	err = mqueue_alloc(&mt->mq, mqueue_handler, mt);
+	if (err)
+		goto out;
+
+ out:
+	pthread_mutex_lock(&mt->mutex);
+	mt->err   = err;
+	mt->ready = true;
+	pthread_cond_broadcast(&mt->cond);
+	pthread_mutex_unlock(&mt->mutex);
+
+	if (!err)
+		(void)re_main(NULL);
+
+	mt->mq = mem_deref(mt->mq);
+
+	re_thread_close();
+
+	return NULL;
+}
+
+
+static int mthread_start(struct mthread *mt)
+{
+	int err;
+
+	pthread_mutex_init(&mt->mutex, NULL);
+	pthread_cond_init(&mt->cond, NULL);
+
+	err = pthread_create(&mt->tid, NULL, thread_main, mt);
+	if (err)
+		return err;
+
+	mt->started = true;
+
+	pthread_mutex_lock(&mt->mutex);
+	while (!mt->ready)
+		pthread_cond_wait(&mt->cond, &mt->mutex);
+	err = mt->err;
+	pthread_mutex_unlock(&mt->mutex);
+
+	return err;
+}
+
+
+static void mthread_stop(struct mthread *mt)
+{
+	if (!mt->started)
+		return;
+
+	if (mt->mq)
+		(void)mqueue_push(mt->mq, MSG_STOP, NULL);
+
+	pthread_join(mt->tid, NULL);
+
+	pthread_cond_destroy(&mt->cond);
+	pthread_mutex_destroy(&mt->mutex);
+
+	mt->started = false;
+}
+
+
+/**
+ * Start the media worker threads
+ *
+ * @param n Number of worker threads, 0 to run all media on the main thread
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mthread_init(unsigned n)
+{
+	unsigned i;
+	int err = 0;
+
+	mthread_close();
+
+	if (!n)
+		return 0;
+
+	mts.mtv = mem_zalloc(n * sizeof(*mts.mtv), NULL);
+	if (!mts.mtv)
+		return ENOMEM;
+
+	for (i=0; i<n; i++) {
+
+		err = mthread_start(&mts.mtv[i]);
+		if (err) {
+			warning("mthread: could not start worker %u (%m)\n",
+				i, err);
+			break;
+		}
+
+		++mts.mtc;
+	}
+
+	if (err) {
+		mthread_close();
+		return err;
+	}
+
+	info("mthread: started %u media worker threads\n", n);
+
+	return 0;
+}
+
+
+/**
+ * Stop all media worker threads. All streams must be detached.
+ */
+void mthread_close(void)
+{
+	unsigned i;
+
+	for (i=0; mts.mtv && i<mts.mtc; i++)
+		mthread_stop(&mts.mtv[i]);
+
+	mts.mtv  = mem_deref(mts.mtv);
+	mts.mtc  = 0;
+	mts.next = 0;
+}
+
+
+/**
+ * Select a worker thread for a new stream, round-robin
+ *
+ * @return Worker thread, or NULL if media runs on the main thread
+ */
+struct mthread *mthread_assign(void)
+{
+	struct mthread *mt;
+
+	if (!mts.mtc)
+		return NULL;
+
+	mt = &mts.mtv[mts.next];
+	mts.next = (mts.next + 1) % mts.mtc;
+
+	return mt;
+}
+
+
+/**
+ * Execute a function in a worker thread and wait until it is done
+ *
+ * @param mt  Worker thread
+ * @param h   Function to execute
+ * @param arg Function argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mthread_exec(struct mthread *mt, mthread_exec_h *h, void *arg)
+{
+	int err = 0;
+
+	if (!mt || !h)
+		return EINVAL;
+
+	if (pthread_equal(pthread_self(), mt->tid)) {
+		h(arg);
+		return 0;
+	}
+
+	pthread_mutex_lock(&mt->mutex);
+
+	mt->jobh   = h;
+	mt->jobarg = arg;
+
+	if (mt->pausec) {
+		/* the worker is parked and will pick up the job */
+		pthread_cond_broadcast(&mt->cond);
+	}
+	else {
+		err = mqueue_push(mt->mq, MSG_JOB, NULL);
+		if (err) {
+			mt->jobh   = NULL;
+			mt->jobarg = NULL;
+			goto out;
+		}
+	}
+
+	while (mt->jobh)
+		pthread_cond_wait(&mt->cond, &mt->mutex);
+
+ out:
+	pthread_mutex_unlock(&mt->mutex);
+
+	return err;
+}
+
+
+/**
+ * Ask a worker thread to park, without waiting for it. Every call must
+ * be balanced by mthread_leave(). Calls can be nested.
+ *
+ * @param mt Worker thread
+ */
+void mthread_pause(struct mthread *mt)
+{
+	if (!mt || pthread_equal(pthread_self(), mt->tid))
+		return;
+
+	pthread_mutex_lock(&mt->mutex);
+
+	if (mt->pausec++ == 0) {
+
+		if (mqueue_push(mt->mq, MSG_PAUSE, NULL))
+			--mt->pausec;
+	}
+
+	pthread_mutex_unlock(&mt->mutex);
+}
+
+
+/**
+ * Wait until a worker thread, asked by mthread_pause(), is parked
+ *
+ * @param mt Worker thread
+ */
+void mthread_pause_wait(struct mthread *mt)
+{
+	if (!mt || pthread_equal(pthread_self(), mt->tid))
+		return;
+
+	pthread_mutex_lock(&mt->mutex);
+
+	while (mt->pausec && !mt->paused)
+		pthread_cond_wait(&mt->cond, &mt->mutex);
+
+	pthread_mutex_unlock(&mt->mutex);
+}
+
+
+/**
+ * Park a worker thread, so that the main thread can safely change the
+ * state of its streams. Calls can be nested.
+ *
+ * @param mt Worker thread
+ */
+void mthread_enter(struct mthread *mt)
+{
+	mthread_pause(mt);
+	mthread_pause_wait(mt);
+}
+
+
+/**
+ * Resume a worker thread, parked by mthread_enter()
+ *
+ * @param mt Worker thread
+ */
+void mthread_leave(struct mthread *mt)
+{
+	if (!mt || pthread_equal(pthread_self(), mt->tid))
+		return;
+
+	pthread_mutex_lock(&mt->mutex);
+
+	if (mt->pausec && --mt->pausec == 0)
+		pthread_cond_broadcast(&mt->cond);
+
+	pthread_mutex_unlock(&mt->mutex);
+}
+
+
+void mthread_stream_count(struct mthread *mt, int delta)
+{
+	if (!mt)
+		return;
+
+	mt->n_streams += delta;
+}
+
+
+int mthread_debug(struct re_printf *pf, void *unused)
+{
+	unsigned i;
+	int err;
+	(void)unused;
+
+	err = re_hprintf(pf, "Media worker threads: %u\n", mts.mtc);
+
+	for (i=0; i<mts.mtc; i++) {
+		err |= re_hprintf(pf, " #%u: streams=%u\n",
+				  i, mts.mtv[i].n_streams);
+	}
+
+	return err;
+}
+
+
+#else
+
+
+int mthread_init(unsigned n)
+{
+	if (n)
+		warning("mthread: media threads need pthread support\n");
+
+	return 0;
+}
+
+
+void mthread_close(void)
+{
+}
+
+
+struct mthread *mthread_assign(void)
+{
+	return NULL;
+}
+
+
+int mthread_exec(struct mthread *mt, mthread_exec_h *h, void *arg)
+{
+	(void)mt;
+	(void)h;
+	(void)arg;
+
+	return ENOSYS;
+}
+
+
+void mthread_pause(struct mthread *mt)
+{
+	(void)mt;
+}
+
+
+void mthread_pause_wait(struct mthread *mt)
+{
+	(void)mt;
+}
+
+
+void mthread_enter(struct mthread *mt)
+{
+	(void)mt;
+}
+
+
+void mthread_leave(struct mthread *mt)
+{
+	(void)mt;
+}
+
+
+void mthread_stream_count(struct mthread *mt, int delta)
+{
+	(void)mt;
+	(void)delta;
+}
+
+
+int mthread_debug(struct re_printf *pf, void *unused)
+{
+	(void)unused;
+
+	return re_hprintf(pf, "Media worker threads: not supported\n");
+}
+
+
+#endif
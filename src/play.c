@@ -18,7 +18,8 @@ struct play {
 	struct le le;
 	struct play **playp;
 	struct lock *lock;
-	struct mbuf *mb;
+	struct mbuf *mb;            /**< PCM samples, may be shared  */
+	size_t pos;                 /**< Read position in mb         */
 	struct auplay_st *auplay;
 	struct tmr tmr;
 	int repeat;
@@ -34,6 +35,7 @@ static const char default_play_path[FS_PATH_MAX] = PREFIX "/share/baresip";
 
 struct player {
 	struct list playl;
+	struct aucache *cache;
 	char play_path[FS_PATH_MAX];
 };
 
@@ -82,13 +84,17 @@ static void write_handler(void *sampv, size_t sampc, void *arg)
 	if (play->eof)
 		goto silence;
 
+	/* the buffer may be shared with other players, so only our
+	   own read position is moved */
 	while (pos < sz) {
-		left = mbuf_get_left(play->mb);
+		left = play->mb->end - play->pos;
 		count = (left > sz - pos) ? sz - pos : left;
 
-		(void)mbuf_read_mem(play->mb, (uint8_t *)sampv + pos, count);
+		memcpy((uint8_t *)sampv + pos, play->mb->buf + play->pos,
+		       count);
 
 		pos += count;
+		play->pos += count;
 
 		if (pos < sz) {
 			if (play->repeat > 0)
@@ -99,7 +105,7 @@ static void write_handler(void *sampv, size_t sampc, void *arg)
 				goto silence;
 			}
 
-			play->mb->pos = 0;
+			play->pos = 0;
 		}
 	}
 
@@ -131,72 +137,6 @@ static void destructor(void *arg)
 }
 
 
-static int aufile_load(struct mbuf *mb, const char *filename,
-		       uint32_t *srate, uint8_t *channels)
-{
-	struct aufile_prm prm;
-	struct aufile *af;
-	int err;
-
-	err = aufile_open(&af, &prm, filename, AUFILE_READ);
-	if (err)
-		return err;
-
-	while (!err) {
-		uint8_t buf[4096];
-		size_t i, n;
-		int16_t *p = (void *)buf;
-
-		n = sizeof(buf);
-
-		err = aufile_read(af, buf, &n);
-		if (err || !n)
-			break;
-
-		switch (prm.fmt) {
-
-		case AUFMT_S16LE:
-			/* convert from Little-Endian to Native-Endian */
-			for (i=0; i<n/2; i++) {
-				int16_t s = sys_ltohs(*p++);
-				err |= mbuf_write_u16(mb, s);
-			}
-
-			break;
-
-		case AUFMT_PCMA:
-			for (i=0; i<n; i++) {
-				err |= mbuf_write_u16(mb,
-						      g711_alaw2pcm(buf[i]));
-			}
-			break;
-
-		case AUFMT_PCMU:
-			for (i=0; i<n; i++) {
-				err |= mbuf_write_u16(mb,
-						      g711_ulaw2pcm(buf[i]));
-			}
-			break;
-
-		default:
-			err = ENOSYS;
-			break;
-		}
-	}
-
-	mem_deref(af);
-
-	if (!err) {
-		mb->pos = 0;
-
-		*srate    = prm.srate;
-		*channels = prm.channels;
-	}
-
-	return err;
-}
-
-
 /**
  * Play a tone from a PCM buffer
  *
@@ -218,7 +158,7 @@ int play_tone(struct play **playp, struct player *player,
 	struct config *cfg;
 	int err;
 
-	if (!player)
+	if (!player || !tone)
 		return EINVAL;
 	if (playp && *playp)
 		return EALREADY;
@@ -234,6 +174,7 @@ int play_tone(struct play **playp, struct player *player,
 	tmr_init(&play->tmr);
 	play->repeat = repeat;
 	play->mb     = mem_ref(tone);
+	play->pos    = tone->pos;
 
 	err = lock_alloc(&play->lock);
 	if (err)
@@ -279,7 +220,7 @@ int play_tone(struct play **playp, struct player *player,
 int play_file(struct play **playp, struct player *player,
 	      const char *filename, int repeat)
 {
-	struct mbuf *mb;
+	struct mbuf *mb = NULL;
 	char path[FS_PATH_MAX];
 	uint32_t srate = 0;
 	uint8_t ch = 0;
@@ -294,11 +235,7 @@ int play_file(struct play **playp, struct player *player,
 			player->play_path, filename) < 0)
 		return ENOMEM;
 
-	mb = mbuf_alloc(1024);
-	if (!mb)
-		return ENOMEM;
-
-	err = aufile_load(mb, path, &srate, &ch);
+	err = aucache_get(player->cache, &mb, &srate, &ch, path);
 	if (err) {
 		warning("play: %s: %m\n", path, err);
 		goto out;
@@ -318,12 +255,14 @@ static void player_destructor(void *data)
 	struct player *player = data;
 
 	list_flush(&player->playl);
+	mem_deref(player->cache);
 }
 
 
 int play_init(struct player **playerp)
 {
 	struct player *player;
+	int err;
 
 	if (!playerp)
 		return EINVAL;
@@ -334,6 +273,12 @@ int play_init(struct player **playerp)
 
 	list_init(&player->playl);
 
+	err = aucache_alloc(&player->cache);
+	if (err) {
+		mem_deref(player);
+		return err;
+	}
+
 	str_ncpy(player->play_path, default_play_path,
 		 sizeof(player->play_path));
 
@@ -350,3 +295,33 @@ void play_set_path(struct player *player, const char *path)
 
 	str_ncpy(player->play_path, path, sizeof(player->play_path));
 }
+
+
+/**
+ * Get the decoded samples of an audio file from the player's cache
+ *
+ * @param player Audio-file player
+ * @param mbp    Returns a reference to the shared, read-only samples
+ * @param srate  Returns the sampling rate
+ * @param ch     Returns the number of channels
+ * @param path   Full path of the audio file
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int play_cache_get(struct player *player, struct mbuf **mbp,
+		   uint32_t *srate, uint8_t *ch, const char *path)
+{
+	if (!player)
+		return EINVAL;
+
+	return aucache_get(player->cache, mbp, srate, ch, path);
+}
+
+
+int play_cache_debug(struct re_printf *pf, const struct player *player)
+{
+	if (!player)
+		return 0;
+
+	return aucache_debug(pf, player->cache);
+}
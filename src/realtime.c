@@ -3,8 +3,10 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <time.h>
 #include <re.h>
 #include <baresip.h>
+#include "core.h"
 #ifdef DARWIN
 #include <sys/types.h>
 #include <sys/sysctl.h>
@@ -98,3 +100,21 @@ int realtime_enable(bool enable, int fps)
 	return ENOSYS;
 #endif
 }
+
+
+/**
+ * Get a monotonic timestamp with microsecond resolution
+ *
+ * @return Time in [us]
+ */
+uint64_t time_usec(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (0 == clock_gettime(CLOCK_MONOTONIC, &ts))
+		return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+
+	return tmr_jiffies() * 1000;
+}
@@ -19,6 +19,7 @@ struct reg {
 	uint16_t scode;              /**< Registration status code           */
 	char *srv;                   /**< SIP Server id                      */
 	int af;                      /**< Cached address family for SIP conn */
+	uint64_t ts_req;             /**< Time of REGISTER request [ms]      */
 };
 
 
@@ -98,6 +99,11 @@ static void register_handler(int err, const struct sip_msg *msg, void *arg)
 	struct reg *reg = arg;
 	const struct sip_hdr *hdr;
 
+	if (reg->ts_req) {
+		regsched_latency((uint32_t)(tmr_jiffies() - reg->ts_req));
+		reg->ts_req = 0;
+	}
+
 	if (err) {
 		warning("reg: %s: Register: %m\n", ua_aor(reg->ua), err);
 
@@ -206,6 +212,8 @@ int reg_register(struct reg *reg, const char *reg_uri, const char *params,
 	if (err)
 		return err;
 
+	reg->ts_req = tmr_jiffies();
+
 	return 0;
 }
 
@@ -215,8 +223,9 @@ void reg_unregister(struct reg *reg)
 	if (!reg)
 		return;
 
-	reg->scode = 0;
-	reg->af    = 0;
+	reg->scode  = 0;
+	reg->af     = 0;
+	reg->ts_req = 0;
 
 	reg->sipreg = mem_deref(reg->sipreg);
 }
@@ -0,0 +1,258 @@
+/**
+ * @file regsched.c  Registration scheduler
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * The registration scheduler limits the rate of outgoing REGISTER
+ * requests, so that thousands of User-Agents do not register in the
+ * same event-loop turn. Entries which failed to send are re-queued
+ * with an exponential backoff.
+ */
+
+
+enum {
+	TICK_MIN     =   10,      /* Minimum timer interval [ms]       */
+	RATE_MAX     = 10000,     /* Maximum rate [1/s]                */
+	BACKOFF_BASE =   30,      /* Backoff after first failure [s]   */
+	BACKOFF_MAX  = 1800,      /* Maximum backoff [s]               */
+	LATENCY_MAX  =  512,      /* Number of latency samples kept    */
+};
+
+
+static struct {
+	struct list queue;        /**< Pending entries, sorted by due  */
+	struct tmr tmr;           /**< Send timer                      */
+	uint32_t rate;            /**< REGISTER per second, 0=no limit */
+	uint64_t n_sent;          /**< Number of entries sent          */
+	uint64_t n_fail;          /**< Number of failed sends          */
+	uint32_t latv[LATENCY_MAX];  /**< Latency samples [ms]         */
+	size_t latc;              /**< Number of latency samples       */
+	size_t lati;              /**< Next latency sample index       */
+} rs = {
+	LIST_INIT,
+	TMR_INIT,
+	0,
+	0,
+	0,
+	{0},
+	0,
+	0,
+};
+
+
+static uint32_t backoff(unsigned failc)
+{
+	uint32_t wait = BACKOFF_BASE;
+
+	while (--failc && wait < BACKOFF_MAX)
+		wait *= 2;
+
+	wait = min(wait, (uint32_t)BACKOFF_MAX) * 1000;
+
+	/* add up to 10% random jitter */
+	return wait + rand_u32() % (wait / 10 + 1);
+}
+
+
+static bool sort_handler(struct le *le1, struct le *le2, void *arg)
+{
+	const struct regent *ent1 = le1->data;
+	const struct regent *ent2 = le2->data;
+	(void)arg;
+
+	return ent1->due <= ent2->due;
+}
+
+
+static void enqueue(struct regent *ent, uint64_t due)
+{
+	ent->due = due;
+
+	list_insert_sorted(&rs.queue, sort_handler, NULL, &ent->le, ent);
+}
+
+
+static void tmr_handler(void *arg)
+{
+	const uint64_t now = tmr_jiffies();
+	uint32_t interval, burst;
+	(void)arg;
+
+	if (rs.rate) {
+		interval = max(1000 / rs.rate, (uint32_t)TICK_MIN);
+		burst    = max(rs.rate * interval / 1000, 1u);
+	}
+	else {
+		/* the limit was removed, send all entries that are due */
+		interval = TICK_MIN;
+		burst    = UINT32_MAX;
+	}
+
+	while (burst && !list_isempty(&rs.queue)) {
+
+		struct regent *ent = list_ledata(list_head(&rs.queue));
+		int err;
+
+		if (ent->due > now)
+			break;
+
+		list_unlink(&ent->le);
+		--burst;
+
+		err = ent->h(ent->arg);
+		if (err) {
+			++rs.n_fail;
+			++ent->failc;
+			enqueue(ent, now + backoff(ent->failc));
+		}
+		else {
+			++rs.n_sent;
+			ent->failc = 0;
+		}
+	}
+
+	if (!list_isempty(&rs.queue))
+		tmr_start(&rs.tmr, interval, tmr_handler, NULL);
+}
+
+
+/**
+ * Set the maximum rate of the registration scheduler
+ *
+ * @param rate Number of entries per second, 0 to disable rate limiting
+ */
+void regsched_set_rate(uint32_t rate)
+{
+	rs.rate = min(rate, (uint32_t)RATE_MAX);
+}
+
+
+/**
+ * Schedule an entry for sending. If rate limiting is disabled the
+ * send handler is called directly.
+ *
+ * @param ent Registration entry, owned by the caller
+ * @param h   Send handler
+ * @param arg Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int regsched_add(struct regent *ent, regsched_h *h, void *arg)
+{
+	if (!ent || !h)
+		return EINVAL;
+
+	ent->h   = h;
+	ent->arg = arg;
+
+	/* already queued */
+	if (ent->le.list)
+		return 0;
+
+	if (!rs.rate) {
+		ent->failc = 0;
+		return h(arg);
+	}
+
+	enqueue(ent, tmr_jiffies());
+
+	if (!tmr_isrunning(&rs.tmr))
+		tmr_start(&rs.tmr, 0, tmr_handler, NULL);
+
+	return 0;
+}
+
+
+/**
+ * Remove an entry from the registration scheduler
+ *
+ * @param ent Registration entry
+ */
+void regsched_cancel(struct regent *ent)
+{
+	if (!ent)
+		return;
+
+	list_unlink(&ent->le);
+	ent->failc = 0;
+
+	if (list_isempty(&rs.queue))
+		tmr_cancel(&rs.tmr);
+}
+
+
+/**
+ * Add a registration latency sample
+ *
+ * @param ms Time from sending the REGISTER to the final response [ms]
+ */
+void regsched_latency(uint32_t ms)
+{
+	rs.latv[rs.lati] = ms;
+	rs.lati = (rs.lati + 1) % LATENCY_MAX;
+
+	if (rs.latc < LATENCY_MAX)
+		++rs.latc;
+}
+
+
+/**
+ * Flush the registration scheduler
+ */
+void regsched_close(void)
+{
+	tmr_cancel(&rs.tmr);
+	list_clear(&rs.queue);
+}
+
+
+static int latency_cmp(const void *p1, const void *p2)
+{
+	const uint32_t l1 = *(const uint32_t *)p1;
+	const uint32_t l2 = *(const uint32_t *)p2;
+
+	return (l1 > l2) - (l1 < l2);
+}
+
+
+static uint32_t percentile(const uint32_t *v, size_t n, unsigned pct)
+{
+	return v[min((n * pct) / 100, n - 1)];
+}
+
+
+int regsched_debug(struct re_printf *pf, void *unused)
+{
+	uint32_t latv[LATENCY_MAX];
+	const size_t n = rs.latc;
+	int err = 0;
+	(void)unused;
+
+	err |= re_hprintf(pf, "\nRegistration scheduler:\n");
+	err |= re_hprintf(pf, " rate:     %u/s%s\n", rs.rate,
+			  rs.rate ? "" : " (unlimited)");
+	err |= re_hprintf(pf, " queue:    %u\n", list_count(&rs.queue));
+	err |= re_hprintf(pf, " sent:     %llu\n", rs.n_sent);
+	err |= re_hprintf(pf, " failed:   %llu\n", rs.n_fail);
+
+	if (!n)
+		return err;
+
+	memcpy(latv, rs.latv, n * sizeof(latv[0]));
+	qsort(latv, n, sizeof(latv[0]), latency_cmp);
+
+	err |= re_hprintf(pf, " latency:  p50=%ums p90=%ums p99=%ums"
+			  " max=%ums (%zu samples)\n",
+			  percentile(latv, n, 50), percentile(latv, n, 90),
+			  percentile(latv, n, 99), latv[n-1], n);
+
+	return err;
+}
@@ -0,0 +1,430 @@
+/**
+ * @file src/resampler.c  Polyphase audio resampler
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON 1
+#endif
+
+#if !defined (M_PI)
+#define M_PI 3.14159265358979323846264338327
+#endif
+
+
+/*
+ * Sample-rate conversion by a rational factor up/down, using a
+ * windowed-sinc lowpass filter split into `up' polyphase branches.
+ *
+ * For each output sample the position in the input is tracked in units
+ * of 1/up input samples, so no floating-point drift accumulates and a
+ * block of N*down input frames always gives exactly N*up output frames.
+ *
+ * The input is kept as planar float, with ntaps-1 frames of history in
+ * front of each block. The coefficients of each branch are stored in
+ * reverse, so every output sample is a plain dot product of two
+ * contiguous arrays.
+ */
+
+
+enum {
+	MAX_PHASES = 1024,
+	MAX_CHANNELS = 8,
+};
+
+
+struct resampler {
+	float *coeffv;          /**< up branches of ntaps coefficients    */
+	float *bufv;            /**< Planar input, history + one block     */
+	size_t bufsz;           /**< Frames per channel in bufv            */
+	uint32_t up;            /**< Interpolation factor                  */
+	uint32_t down;          /**< Decimation factor                     */
+	uint32_t ntaps;         /**< Filter taps per branch                */
+	uint32_t pos;           /**< Next output position [1/up samples]   */
+	uint8_t ich;            /**< Input channels                        */
+	uint8_t och;            /**< Output channels                       */
+	uint8_t fch;            /**< Filtered channels                     */
+};
+
+
+static const struct {
+	const char *name;
+	uint32_t taps;          /* taps per branch, when not decimating */
+	double rolloff;         /* passband edge, relative to Nyquist */
+} qualityv[] = {
+	{"fast",    8, 0.80},
+	{"medium", 16, 0.90},
+	{"high",   32, 0.95},
+};
+
+
+static void destructor(void *arg)
+{
+	struct resampler *rs = arg;
+
+	mem_deref(rs->coeffv);
+	mem_deref(rs->bufv);
+}
+
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+
+static double sinc(double x)
+{
+	if (fabs(x) < 1e-9)
+		return 1.0;
+
+	return sin(M_PI * x) / (M_PI * x);
+}
+
+
+static double blackman(uint32_t n, uint32_t len)
+{
+	const double a = 2.0 * M_PI * n / (len - 1);
+
+	return 0.42 - 0.5 * cos(a) + 0.08 * cos(2.0 * a);
+}
+
+
+/*
+ * Design the prototype lowpass at the upsampled rate and split it into
+ * branches. Each branch is normalised to unity DC gain.
+ */
+static int design_filter(struct resampler *rs, enum resampler_quality q)
+{
+	const uint32_t len = rs->ntaps * rs->up;
+	const double fc = qualityv[q].rolloff * 0.5 / max(rs->up, rs->down);
+	uint32_t p, k;
+
+	rs->coeffv = mem_alloc(len * sizeof(float), NULL);
+	if (!rs->coeffv)
+		return ENOMEM;
+
+	if (len == 1) {
+		rs->coeffv[0] = 1.0f;
+		return 0;
+	}
+
+	for (p=0; p<rs->up; p++) {
+
+		float *cv = &rs->coeffv[p * rs->ntaps];
+		double sum = 0.0;
+
+		for (k=0; k<rs->ntaps; k++) {
+
+			const uint32_t n = p + k * rs->up;
+			const double t = n - (len - 1) / 2.0;
+			const double h = 2.0 * fc * sinc(2.0 * fc * t)
+				* blackman(n, len);
+
+			cv[rs->ntaps - 1 - k] = (float)h;
+			sum += h;
+		}
+
+		for (k=0; k<rs->ntaps; k++)
+			cv[k] = (float)(cv[k] / sum);
+	}
+
+	return 0;
+}
+
+
+/**
+ * Allocate a new resampler
+ *
+ * @param rsp   Pointer to allocated resampler
+ * @param q     Quality preset
+ * @param irate Input sampling rate
+ * @param ich   Input channels
+ * @param orate Output sampling rate
+ * @param och   Output channels
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note Channel conversion is only supported between mono and stereo
+ */
+int resampler_alloc(struct resampler **rsp, enum resampler_quality q,
+		    uint32_t irate, uint8_t ich,
+		    uint32_t orate, uint8_t och)
+{
+	struct resampler *rs;
+	uint32_t g;
+	int err;
+
+	if (!rsp || !irate || !orate || !ich || !och)
+		return EINVAL;
+
+	if ((unsigned)q >= ARRAY_SIZE(qualityv))
+		return EINVAL;
+
+	if (ich > MAX_CHANNELS || och > MAX_CHANNELS)
+		return ENOTSUP;
+
+	if (ich != och && max(ich, och) != 2)
+		return ENOTSUP;
+
+	g = gcd(irate, orate);
+
+	if (orate / g > MAX_PHASES) {
+		warning("resampler: %u Hz to %u Hz needs %u phases\n",
+			irate, orate, orate / g);
+		return ENOTSUP;
+	}
+
+	rs = mem_zalloc(sizeof(*rs), destructor);
+	if (!rs)
+		return ENOMEM;
+
+	rs->up   = orate / g;
+	rs->down = irate / g;
+	rs->ich  = ich;
+	rs->och  = och;
+	rs->fch  = min(ich, och);
+
+	/* keep the transition band when decimating */
+	if (rs->up == rs->down) {
+		rs->ntaps = 1;
+	}
+	else {
+		rs->ntaps = qualityv[q].taps
+			* ((rs->down + rs->up - 1) / rs->up);
+	}
+
+	err = design_filter(rs, q);
+	if (err)
+		goto out;
+
+ out:
+	if (err)
+		mem_deref(rs);
+	else
+		*rsp = rs;
+
+	return err;
+}
+
+
+static inline float dot(const float *a, const float *b, uint32_t n)
+{
+	uint32_t i = 0;
+	float sum;
+
+#if defined(__SSE__)
+	__m128 acc = _mm_setzero_ps();
+	float v[4];
+
+	for (; i + 4 <= n; i += 4) {
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i),
+						 _mm_loadu_ps(b + i)));
+	}
+
+	_mm_storeu_ps(v, acc);
+	sum = v[0] + v[1] + v[2] + v[3];
+#elif defined(RESAMPLER_NEON)
+	float32x4_t acc = vdupq_n_f32(0.0f);
+
+	for (; i + 4 <= n; i += 4)
+		acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+
+	sum = vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1)
+		+ vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3);
+#else
+	float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		s0 += a[i]     * b[i];
+		s1 += a[i + 1] * b[i + 1];
+		s2 += a[i + 2] * b[i + 2];
+		s3 += a[i + 3] * b[i + 3];
+	}
+
+	sum = s0 + s1 + s2 + s3;
+#endif
+
+	for (; i < n; i++)
+		sum += a[i] * b[i];
+
+	return sum;
+}
+
+
+static inline int16_t saturate(float v)
+{
+	if (v >= 32767.0f)
+		return 32767;
+	if (v <= -32768.0f)
+		return -32768;
+
+	return (int16_t)lrintf(v);
+}
+
+
+static int buf_alloc(struct resampler *rs, size_t frames)
+{
+	const size_t hist = rs->ntaps - 1;
+	float *bufv;
+	uint8_t c;
+
+	if (frames <= rs->bufsz)
+		return 0;
+
+	bufv = mem_zalloc((hist + frames) * rs->fch * sizeof(float), NULL);
+	if (!bufv)
+		return ENOMEM;
+
+	/* carry over the history of each channel */
+	if (rs->bufv) {
+		for (c=0; c<rs->fch; c++) {
+			memcpy(&bufv[c * (hist + frames)],
+			       &rs->bufv[c * (hist + rs->bufsz)],
+			       hist * sizeof(float));
+		}
+	}
+
+	mem_deref(rs->bufv);
+	rs->bufv  = bufv;
+	rs->bufsz = frames;
+
+	return 0;
+}
+
+
+/**
+ * Resample a block of interleaved 16-bit samples
+ *
+ * @param rs   Resampler
+ * @param outv Output samples
+ * @param outc Size of outv on input, number of samples on output
+ * @param inv  Input samples
+ * @param inc  Number of input samples
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int resampler_process(struct resampler *rs, int16_t *outv, size_t *outc,
+		      const int16_t *inv, size_t inc)
+{
+	size_t i, n, frames, hist, nout;
+	uint8_t c;
+	int err;
+
+	if (!rs || !outv || !outc || !inv)
+		return EINVAL;
+
+	if (inc % rs->ich)
+		return EINVAL;
+
+	frames = inc / rs->ich;
+	hist   = rs->ntaps - 1;
+
+	/* number of output frames in this block */
+	if (rs->pos >= frames * rs->up)
+		nout = 0;
+	else
+		nout = (frames * rs->up - rs->pos + rs->down - 1) / rs->down;
+
+	if (*outc < nout * rs->och)
+		return ENOMEM;
+
+	err = buf_alloc(rs, frames);
+	if (err)
+		return err;
+
+	/* deinterleave, and downmix stereo to mono if needed */
+	for (c=0; c<rs->fch; c++) {
+
+		float *bv = &rs->bufv[c * (hist + rs->bufsz) + hist];
+
+		if (rs->ich == rs->fch) {
+			for (i=0; i<frames; i++)
+				bv[i] = inv[i * rs->ich + c];
+		}
+		else {
+			for (i=0; i<frames; i++)
+				bv[i] = (inv[2*i] + inv[2*i + 1]) * 0.5f;
+		}
+	}
+
+	for (n=0; n<nout; n++) {
+
+		const uint32_t base  = rs->pos / rs->up;
+		const uint32_t phase = rs->pos % rs->up;
+		const float *cv = &rs->coeffv[phase * rs->ntaps];
+
+		for (c=0; c<rs->fch; c++) {
+
+			const float *bv = &rs->bufv[c * (hist + rs->bufsz)];
+			const int16_t s = saturate(dot(cv, bv + base,
+						       rs->ntaps));
+
+			outv[n * rs->och + c] = s;
+
+			/* upmix mono to stereo */
+			if (rs->och > rs->fch)
+				outv[n * rs->och + 1] = s;
+		}
+
+		rs->pos += rs->down;
+	}
+
+	rs->pos -= (uint32_t)(frames * rs->up);
+
+	/* keep the last ntaps-1 frames as history for the next block */
+	for (c=0; c<rs->fch && hist; c++) {
+
+		float *bv = &rs->bufv[c * (hist + rs->bufsz)];
+
+		memmove(bv, bv + frames, hist * sizeof(float));
+	}
+
+	*outc = nout * rs->och;
+
+	return 0;
+}
+
+
+const char *resampler_quality_name(enum resampler_quality q)
+{
+	if ((unsigned)q >= ARRAY_SIZE(qualityv))
+		return "???";
+
+	return qualityv[q].name;
+}
+
+
+int resampler_quality_resolve(enum resampler_quality *qp,
+			      const struct pl *name)
+{
+	size_t i;
+
+	if (!qp || !name)
+		return EINVAL;
+
+	for (i=0; i<ARRAY_SIZE(qualityv); i++) {
+
+		if (0 == pl_strcasecmp(name, qualityv[i].name)) {
+			*qp = (enum resampler_quality)i;
+			return 0;
+		}
+	}
+
+	return ENOENT;
+}
@@ -27,7 +27,7 @@ enum {
 struct rtpkeep {
 	struct rtp_sock *rtp;
 	struct sdp_media *sdp;
-	struct tmr tmr;
+	uint64_t ts_next;
 	char *method;
 	uint32_t ts;
 	bool flag;
@@ -38,7 +38,6 @@ static void destructor(void *arg)
 {
 	struct rtpkeep *rk = arg;
 
-	tmr_cancel(&rk->tmr);
 	mem_deref(rk->method);
 }
 
@@ -102,14 +101,19 @@ static int send_keepalive(struct rtpkeep *rk)
  * last period of 0 - 15 seconds. Start transmitting RTP keepalives
  * now and every 15 seconds after that.
  *
- * @param arg Handler argument
+ * This is called from the media housekeeping tick.
+ *
+ * @param rk  RTP Keepalive object
+ * @param now Current time [ms]
  */
-static void timeout(void *arg)
+void rtpkeep_tick(struct rtpkeep *rk, uint64_t now)
 {
-	struct rtpkeep *rk = arg;
 	int err;
 
-	tmr_start(&rk->tmr, Tr_UDP * 1000, timeout, rk);
+	if (!rk || now < rk->ts_next)
+		return;
+
+	rk->ts_next = now + Tr_UDP * 1000;
 
 	if (rk->flag) {
 		rk->flag = false;
@@ -143,7 +147,8 @@ int rtpkeep_alloc(struct rtpkeep **rkp, const char *method, int proto,
 	if (err)
 		goto out;
 
-	tmr_start(&rk->tmr, 20, timeout, rk);
+	/* first check on the next housekeeping tick */
+	rk->ts_next = tmr_jiffies();
 
  out:
 	if (err)
@@ -0,0 +1,255 @@
+/**
+ * @file rtppool.c  Pool of pre-bound RTP sockets
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * Binding an RTP/RTCP socket pair probes random ports in the configured
+ * range until the bind succeeds, and then configures the sockets.
+ * The pool does this work in the background, so that a new media
+ * stream gets a ready socket pair without any syscalls.
+ *
+ * A socket pair is not returned to the pool when the stream is
+ * destroyed, since the RTP socket holds the state of the RTP session
+ * (SSRC, sequence numbers and RTCP members). Instead the pool is
+ * refilled with fresh sockets.
+ */
+
+
+enum {
+	RTP_RECV_SIZE = 8192,
+	FILL_INTERVAL =  100,  /* Pool refill interval [ms]            */
+	FILL_BURST    =    8,  /* Max number of sockets bound per tick */
+};
+
+
+/** Defines an RTP socket pair, from the pool or allocated on demand */
+struct rtpsock {
+	struct le le;             /**< Linked list element (idle pool)  */
+	struct rtp_sock *rtp;     /**< RTP socket                       */
+	rtp_recv_h *rtph;         /**< RTP receive handler              */
+	rtcp_recv_h *rtcph;       /**< RTCP receive handler             */
+	void *arg;                /**< Handler argument                 */
+	int af;                   /**< Address family                   */
+	bool rtcp;                /**< RTCP socket is enabled           */
+};
+
+
+static struct {
+	struct list idlel;        /**< Idle sockets (struct rtpsock)    */
+	struct tmr tmr;           /**< Refill timer                     */
+	struct config_avt cfg;    /**< Media transport configuration    */
+	int af;                   /**< Address family of pooled sockets */
+	uint32_t size;            /**< Target number of idle sockets    */
+	uint64_t n_hit;           /**< Sockets taken from the pool      */
+	uint64_t n_miss;          /**< Sockets allocated on demand      */
+} pool;
+
+
+static void destructor(void *arg)
+{
+	struct rtpsock *rs = arg;
+
+	list_unlink(&rs->le);
+	mem_deref(rs->rtp);
+}
+
+
+static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
+			struct mbuf *mb, void *arg)
+{
+	struct rtpsock *rs = arg;
+
+	/* drop packets while the socket is idle */
+	if (rs->rtph)
+		rs->rtph(src, hdr, mb, rs->arg);
+}
+
+
+static void rtcp_handler(const struct sa *src, struct rtcp_msg *msg,
+			 void *arg)
+{
+	struct rtpsock *rs = arg;
+
+	if (rs->rtcph)
+		rs->rtcph(src, msg, rs->arg);
+}
+
+
+static int rtpsock_alloc(struct rtpsock **rsp, const struct config_avt *cfg,
+			 int af)
+{
+	struct rtpsock *rs;
+	struct sa laddr;
+	int tos, err;
+
+	rs = mem_zalloc(sizeof(*rs), destructor);
+	if (!rs)
+		return ENOMEM;
+
+	rs->af   = af;
+	rs->rtcp = cfg->rtcp_enable;
+
+	/* we listen on all interfaces */
+	sa_init(&laddr, af);
+
+	err = rtp_listen(&rs->rtp, IPPROTO_UDP, &laddr,
+			 cfg->rtp_ports.min, cfg->rtp_ports.max,
+			 rs->rtcp, rtp_handler, rtcp_handler, rs);
+	if (err) {
+		warning("rtppool: rtp_listen failed: af=%s ports=%u-%u"
+			" (%m)\n", net_af2name(af),
+			cfg->rtp_ports.min, cfg->rtp_ports.max, err);
+		goto out;
+	}
+
+	tos = cfg->rtp_tos;
+	(void)udp_setsockopt(rtp_sock(rs->rtp), IPPROTO_IP, IP_TOS,
+			     &tos, sizeof(tos));
+	(void)udp_setsockopt(rtcp_sock(rs->rtp), IPPROTO_IP, IP_TOS,
+			     &tos, sizeof(tos));
+
+	udp_rxsz_set(rtp_sock(rs->rtp), RTP_RECV_SIZE);
+
+ out:
+	if (err)
+		mem_deref(rs);
+	else
+		*rsp = rs;
+
+	return err;
+}
+
+
+static void tmr_handler(void *arg)
+{
+	unsigned n = 0;
+	(void)arg;
+
+	while (list_count(&pool.idlel) < pool.size && n++ < FILL_BURST) {
+
+		struct rtpsock *rs;
+
+		if (rtpsock_alloc(&rs, &pool.cfg, pool.af))
+			break;
+
+		list_append(&pool.idlel, &rs->le, rs);
+	}
+
+	if (list_count(&pool.idlel) < pool.size)
+		tmr_start(&pool.tmr, FILL_INTERVAL, tmr_handler, NULL);
+}
+
+
+/**
+ * Initialise the RTP socket pool
+ *
+ * @param cfg  Media transport configuration
+ * @param af   Address family of pooled sockets
+ * @param size Number of idle sockets to keep, 0 to disable the pool
+ */
+void rtppool_init(const struct config_avt *cfg, int af, uint32_t size)
+{
+	if (!cfg)
+		return;
+
+	rtppool_close();
+
+	pool.cfg  = *cfg;
+	pool.af   = af;
+	pool.size = size;
+
+	if (size)
+		tmr_start(&pool.tmr, 0, tmr_handler, NULL);
+}
+
+
+/**
+ * Close the RTP socket pool and release all idle sockets
+ */
+void rtppool_close(void)
+{
+	tmr_cancel(&pool.tmr);
+	list_flush(&pool.idlel);
+
+	pool.size = 0;
+}
+
+
+/**
+ * Get an RTP socket pair, from the pool if possible
+ *
+ * @param rsp   Pointer to allocated RTP socket pair
+ * @param cfg   Media transport configuration
+ * @param af    Address family
+ * @param rtph  RTP receive handler
+ * @param rtcph RTCP receive handler
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtppool_get(struct rtpsock **rsp, const struct config_avt *cfg, int af,
+		rtp_recv_h *rtph, rtcp_recv_h *rtcph, void *arg)
+{
+	struct rtpsock *rs = NULL;
+	struct le *le;
+	int err;
+
+	if (!rsp || !cfg)
+		return EINVAL;
+
+	for (le = pool.idlel.head; le; le = le->next) {
+		struct rtpsock *idle = le->data;
+
+		if (idle->af == af && idle->rtcp == cfg->rtcp_enable) {
+			rs = idle;
+			break;
+		}
+	}
+
+	if (rs) {
+		list_unlink(&rs->le);
+		++pool.n_hit;
+
+		if (!tmr_isrunning(&pool.tmr))
+			tmr_start(&pool.tmr, FILL_INTERVAL, tmr_handler, NULL);
+	}
+	else {
+		err = rtpsock_alloc(&rs, cfg, af);
+		if (err)
+			return err;
+
+		if (pool.size)
+			++pool.n_miss;
+	}
+
+	rs->rtph  = rtph;
+	rs->rtcph = rtcph;
+	rs->arg   = arg;
+
+	*rsp = rs;
+
+	return 0;
+}
+
+
+struct rtp_sock *rtpsock_rtp(const struct rtpsock *rs)
+{
+	return rs ? rs->rtp : NULL;
+}
+
+
+int rtppool_debug(struct re_printf *pf, void *unused)
+{
+	(void)unused;
+
+	return re_hprintf(pf, "RTP socket pool: af=%s idle=%u/%u"
+			  " hit=%llu miss=%llu\n",
+			  net_af2name(pool.af), list_count(&pool.idlel),
+			  pool.size, pool.n_hit, pool.n_miss);
+}
@@ -5,31 +5,41 @@
 #
 
 SRCS	+= account.c
+SRCS	+= aecref.c
+SRCS	+= aucache.c
 SRCS	+= aucodec.c
+SRCS	+= auctrl.c
 SRCS	+= audio.c
 SRCS	+= aufilt.c
 SRCS	+= aulevel.c
 SRCS	+= auplay.c
+SRCS	+= auplc.c
 SRCS	+= ausrc.c
 SRCS	+= baresip.c
 SRCS	+= call.c
 SRCS	+= cmd.c
+SRCS	+= cn.c
 SRCS	+= conf.c
 SRCS	+= config.c
 SRCS	+= contact.c
+SRCS	+= g711.c
 SRCS	+= log.c
 SRCS	+= menc.c
 SRCS	+= message.c
 SRCS	+= metric.c
 SRCS	+= mnat.c
 SRCS	+= module.c
+SRCS	+= mthread.c
 SRCS	+= mos.c
 SRCS	+= net.c
 SRCS	+= play.c
 SRCS	+= realtime.c
 SRCS	+= reg.c
+SRCS	+= regsched.c
+SRCS	+= resampler.c
 SRCS	+= rtpext.c
 SRCS	+= rtpkeep.c
+SRCS	+= rtppool.c
 SRCS	+= sdp.c
 SRCS	+= sipreq.c
 SRCS	+= stream.c
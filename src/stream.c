@@ -11,10 +11,33 @@
 
 
 enum {
-	RTP_RECV_SIZE = 8192,
-	RTP_CHECK_INTERVAL = 1000  /* how often to check for RTP [ms] */
+	TICK_INTERVAL = 100,  /* Housekeeping tick interval [ms]         */
+	TICK_SLOTS    = 10,   /* Streams are visited every 10 ticks (1s) */
 };
 
+/* Receive events of the stream itself, below the application ids */
+enum {
+	EVENT_RTCP_SR = -1,   /* RTCP Sender Report, val is the SSRC     */
+};
+
+
+/*
+ * Media housekeeping
+ *
+ * Instead of a set of timers per stream, all streams are kept in a
+ * small timer wheel. Every tick visits the streams of one slot, so
+ * each stream is serviced once per revolution (RTP timeout check,
+ * bitrate calculation and RTP keepalive), and the work is spread
+ * evenly over the ticks.
+ */
+static struct {
+	struct list slotv[TICK_SLOTS];  /**< Streams per slot          */
+	struct tmr tmr;                 /**< Housekeeping timer        */
+	unsigned cur;                   /**< Current slot              */
+	unsigned next;                  /**< Slot for the next stream  */
+	uint32_t n;                     /**< Number of streams         */
+} wheel;
+
 
 static void stream_close(struct stream *strm, int err)
 {
@@ -29,18 +52,17 @@ static void stream_close(struct stream *strm, int err)
 }
 
 
-static void check_rtp_handler(void *arg)
+/* returns true if the stream was closed */
+static bool check_rtp(struct stream *strm, uint64_t now)
 {
-	struct stream *strm = arg;
-	const uint64_t now = tmr_jiffies();
 	int diff_ms;
 
-	tmr_start(&strm->tmr_rtp, RTP_CHECK_INTERVAL,
-		  check_rtp_handler, strm);
+	if (!strm->rtp_timeout_ms || strm->terminated)
+		return false;
 
 	/* If no RTP was received at all, check later */
 	if (!strm->ts_last)
-		return;
+		return false;
 
 	/* We are in sendrecv mode, check when the last RTP packet
 	 * was received.
@@ -59,12 +81,70 @@ static void check_rtp_handler(void *arg)
 			     sdp_media_name(strm->sdp), diff_ms);
 
 			stream_close(strm, ETIMEDOUT);
+			return true;
 		}
 	}
 	else {
 		re_printf("check_rtp: not checking (dir=%s)\n",
 			  sdp_dir_name(sdp_media_dir(strm->sdp)));
 	}
+
+	return false;
+}
+
+
+static void tick_handler(void *arg)
+{
+	const uint64_t now = tmr_jiffies();
+	struct list *slot = &wheel.slotv[wheel.cur];
+	struct le *le;
+	(void)arg;
+
+	wheel.cur = (wheel.cur + 1) % TICK_SLOTS;
+
+	le = slot->head;
+	while (le) {
+		struct stream *s = le->data;
+
+		metric_tick(&s->metric_tx, now);
+		metric_tick(&s->metric_rx, now);
+		rtpkeep_tick(s->rtpkeep, now);
+
+		if (s->tickh)
+			s->tickh(now, s->arg);
+
+		/* the error handler may destroy any stream of the call,
+		   so start over. Closed streams are not checked again */
+		if (check_rtp(s, now))
+			le = slot->head;
+		else
+			le = le->next;
+	}
+
+	if (wheel.n)
+		tmr_start(&wheel.tmr, TICK_INTERVAL, tick_handler, NULL);
+}
+
+
+static void wheel_add(struct stream *s)
+{
+	list_append(&wheel.slotv[wheel.next], &s->le_tick, s);
+	wheel.next = (wheel.next + 1) % TICK_SLOTS;
+
+	if (!wheel.n++)
+		tmr_start(&wheel.tmr, TICK_INTERVAL, tick_handler, NULL);
+}
+
+
+static void wheel_remove(struct stream *s)
+{
+	if (!s->le_tick.list)
+		return;
+
+	list_unlink(&s->le_tick);
+
+	if (!--wheel.n)
+		tmr_cancel(&wheel.tmr);
 }
 
 
@@ -122,25 +202,45 @@ static void print_rtp_stats(const struct stream *s)
 }
 
 
+static void sock_attach_handler(void *arg)
+{
+	struct stream *s = arg;
+
+	(void)udp_thread_attach(rtp_sock(s->rtp));
+	if (rtcp_sock(s->rtp))
+		(void)udp_thread_attach(rtcp_sock(s->rtp));
+}
+
+
+static void sock_detach_handler(void *arg)
+{
+	struct stream *s = arg;
+
+	udp_thread_detach(rtp_sock(s->rtp));
+	if (rtcp_sock(s->rtp))
+		udp_thread_detach(rtcp_sock(s->rtp));
+}
+
+
 static void stream_destructor(void *arg)
 {
 	struct stream *s = arg;
 
+	stream_thread_detach(s);
+
 	if (s->cfg.rtp_stats)
 		print_rtp_stats(s);
 
-	metric_reset(&s->metric_tx);
-	metric_reset(&s->metric_rx);
-
-	tmr_cancel(&s->tmr_rtp);
+	wheel_remove(s);
 	list_unlink(&s->le);
+	mem_deref(s->mq);
 	mem_deref(s->rtpkeep);
 	mem_deref(s->sdp);
 	mem_deref(s->mes);
 	mem_deref(s->mencs);
 	mem_deref(s->mns);
 	mem_deref(s->jbuf);
-	mem_deref(s->rtp);
+	mem_deref(s->rtps);
 	mem_deref(s->cname);
 }
 
@@ -284,44 +384,52 @@ static void rtcp_handler(const struct sa *src, struct rtcp_msg *msg, void *arg)
 	switch (msg->hdr.pt) {
 
 	case RTCP_SR:
-		(void)rtcp_stats(s->rtp, msg->r.sr.ssrc, &s->rtcp_stats);
+		(void)stream_event_post(s, EVENT_RTCP_SR, msg->r.sr.ssrc);
+		break;
+	}
+}
+
+
+/* Handle a receive event in the main thread */
+static void handle_event(struct stream *s, int id, uint32_t val)
+{
+	switch (id) {
+
+	case EVENT_RTCP_SR:
+		(void)rtcp_stats(s->rtp, val, &s->rtcp_stats);
 
 		if (s->cfg.rtp_stats)
 			call_set_xrtpstat(s->call);
+		break;
 
+	default:
+		if (s->eventh)
+			s->eventh(id, val, s->arg);
 		break;
 	}
 }
 
 
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct stream *s = arg;
+
+	handle_event(s, id, (uint32_t)(uintptr_t)data);
+}
+
+
 static int stream_sock_alloc(struct stream *s, int af)
 {
-	struct sa laddr;
-	int tos, err;
+	int err;
 
 	if (!s)
 		return EINVAL;
 
-	/* we listen on all interfaces */
-	sa_init(&laddr, af);
-
-	err = rtp_listen(&s->rtp, IPPROTO_UDP, &laddr,
-			 s->cfg.rtp_ports.min, s->cfg.rtp_ports.max,
-			 s->rtcp, rtp_handler, rtcp_handler, s);
-	if (err) {
-		warning("stream: rtp_listen failed: af=%s ports=%u-%u"
-			" (%m)\n", net_af2name(af),
-			s->cfg.rtp_ports.min, s->cfg.rtp_ports.max, err);
+	err = rtppool_get(&s->rtps, &s->cfg, af, rtp_handler, rtcp_handler, s);
+	if (err)
 		return err;
-	}
-
-	tos = s->cfg.rtp_tos;
-	(void)udp_setsockopt(rtp_sock(s->rtp), IPPROTO_IP, IP_TOS,
-			     &tos, sizeof(tos));
-	(void)udp_setsockopt(rtcp_sock(s->rtp), IPPROTO_IP, IP_TOS,
-			     &tos, sizeof(tos));
 
-	udp_rxsz_set(rtp_sock(s->rtp), RTP_RECV_SIZE);
+	s->rtp = rtpsock_rtp(s->rtps);
 
 	return 0;
 }
@@ -433,10 +541,8 @@ int stream_alloc(struct stream **sp, const struct stream_param *prm,
 
 	s->pt_enc = -1;
 
-	metric_init(&s->metric_tx);
-	metric_init(&s->metric_rx);
-
 	list_append(call_streaml(call), &s->le, s);
+	wheel_add(s);
 
  out:
 	if (err)
@@ -638,9 +744,13 @@ void stream_reset(struct stream *s)
 	if (!s)
 		return;
 
+	stream_thread_enter(s);
+
 	jbuf_flush(s->jbuf);
 
 	stream_start_keepalive(s);
+
+	stream_thread_leave(s);
 }
 
 
@@ -660,19 +770,147 @@ void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms)
 
 	strm->rtp_timeout_ms = timeout_ms;
 
-	tmr_cancel(&strm->tmr_rtp);
-
 	if (timeout_ms) {
 
 		info("stream: Enable RTP timeout (%u milliseconds)\n",
 		     timeout_ms);
 
 		strm->ts_last = tmr_jiffies();
-		tmr_start(&strm->tmr_rtp, 10, check_rtp_handler, strm);
 	}
 }
 
 
+/**
+ * Move the RTP and RTCP sockets of an audio stream to a media worker
+ * thread. Video streams use timers and the display from the receive
+ * path and stay on the main thread. Streams with media NAT traversal,
+ * or with a media encryption session (DTLS, ZRTP), have state in the
+ * main thread and are not moved either.
+ *
+ * Only RTP receive, the jitter buffer and decoding run in the worker.
+ * Events that change call or device state are sent to the main thread
+ * with stream_event_post().
+ *
+ * @param s Media stream
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_thread_attach(struct stream *s)
+{
+	struct mthread *mt;
+	int err;
+
+	if (!s || !s->rtp || s->mt)
+		return 0;
+
+	if (s->mns || (s->menc && s->menc->sessh))
+		return 0;
+
+	if (str_casecmp(sdp_media_name(s->sdp), "audio"))
+		return 0;
+
+	mt = mthread_assign();
+	if (!mt)
+		return 0;
+
+	/* kept until the stream is destroyed, so that no event is lost
+	   when the stream moves back to the main thread */
+	if (!s->mq) {
+		err = mqueue_alloc(&s->mq, mqueue_handler, s);
+		if (err)
+			return err;
+	}
+
+	sock_detach_handler(s);
+
+	/* events are queued from the first packet in the worker */
+	s->mt = mt;
+
+	err = mthread_exec(mt, sock_attach_handler, s);
+	if (err) {
+		warning("stream: could not move to media thread (%m)\n",
+			err);
+		s->mt = NULL;
+		sock_attach_handler(s);
+		return err;
+	}
+
+	mthread_stream_count(mt, +1);
+
+	return 0;
+}
+
+
+/**
+ * Move the RTP and RTCP sockets of a stream back to the main thread
+ *
+ * @param s Media stream
+ */
+void stream_thread_detach(struct stream *s)
+{
+	if (!s || !s->mt)
+		return;
+
+	(void)mthread_exec(s->mt, sock_detach_handler, s);
+
+	sock_attach_handler(s);
+
+	mthread_stream_count(s->mt, -1);
+	s->mt = NULL;
+}
+
+
+/**
+ * Park the media worker thread of a stream, before changing the
+ * receive state of the stream from the main thread
+ *
+ * @param s Media stream
+ */
+void stream_thread_enter(struct stream *s)
+{
+	if (s)
+		mthread_enter(s->mt);
+}
+
+
+/**
+ * Ask the media worker thread of a stream to park, without waiting for
+ * it. Used with stream_thread_wait() to park the workers of several
+ * streams in parallel; release with stream_thread_leave().
+ *
+ * @param s Media stream
+ */
+void stream_thread_pause(struct stream *s)
+{
+	if (s)
+		mthread_pause(s->mt);
+}
+
+
+/**
+ * Wait until the media worker thread of a stream is parked
+ *
+ * @param s Media stream
+ */
+void stream_thread_wait(struct stream *s)
+{
+	if (s)
+		mthread_pause_wait(s->mt);
+}
+
+
+/**
+ * Resume the media worker thread of a stream
+ *
+ * @param s Media stream
+ */
+void stream_thread_leave(struct stream *s)
+{
+	if (s)
+		mthread_leave(s->mt);
+}
+
+
 void stream_set_error_handler(struct stream *strm,
 			      stream_error_h *errorh, void *arg)
 {
@@ -684,6 +922,78 @@ void stream_set_error_handler(struct stream *strm,
 }
 
 
+/**
+ * Set the handler for receive events, called in the main thread with
+ * the argument of the stream handlers
+ *
+ * @param strm   Media stream
+ * @param eventh Event handler
+ */
+void stream_set_event_handler(struct stream *strm, stream_event_h *eventh)
+{
+	if (!strm)
+		return;
+
+	strm->eventh = eventh;
+}
+
+
+/**
+ * Set the media housekeeping handler, called in the main thread about
+ * once per second with the argument of the stream handlers
+ *
+ * @param strm  Media stream
+ * @param tickh Housekeeping handler
+ */
+void stream_set_tick_handler(struct stream *strm, stream_tick_h *tickh)
+{
+	if (!strm)
+		return;
+
+	strm->tickh = tickh;
+}
+
+
+/**
+ * Post a receive event to the main thread. If the stream is not on a
+ * media worker thread, the event is handled at once.
+ *
+ * @param s   Media stream
+ * @param id  Event id, must not be negative
+ * @param val Event value
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_event_post(struct stream *s, int id, uint32_t val)
+{
+	if (!s)
+		return EINVAL;
+
+	if (!s->mt) {
+		handle_event(s, id, val);
+		return 0;
+	}
+
+	return mqueue_push(s->mq, id, (void *)(uintptr_t)val);
+}
+
+
+/**
+ * Get the memory used by a media stream
+ *
+ * @param s Media stream
+ *
+ * @return Number of bytes
+ */
+size_t stream_mem(const struct stream *s)
+{
+	if (!s)
+		return 0;
+
+	return sizeof(*s) + str_len(s->cname) + 1;
+}
+
+
 int stream_debug(struct re_printf *pf, const struct stream *s)
 {
 	struct sa rrtcp;
@@ -20,8 +20,12 @@ struct ua {
 	MAGIC_DECL                   /**< Magic number for struct ua         */
 	struct ua **uap;             /**< Pointer to application's ua        */
 	struct le le;                /**< Linked list element                */
+	struct le he_cuser;          /**< Hash element, contact username     */
+	struct le he_user;           /**< Hash element, AOR username         */
+	struct le he_aor;            /**< Hash element, Address-of-Record    */
 	struct account *acc;         /**< Account Parameters                 */
 	struct list regl;            /**< List of Register clients           */
+	struct regent regent;        /**< Registration scheduler entry       */
 	struct list calls;           /**< List of active calls (struct call) */
 	struct pl extensionv[8];     /**< Vector of SIP extensions           */
 	size_t    extensionc;        /**< Number of SIP extensions           */
@@ -38,9 +42,16 @@ struct ua_eh {
 	void *arg;
 };
 
+enum {
+	UA_HASH_SIZE = 1024  /* Number of hash buckets for UA lookup */
+};
+
 static struct {
 	struct config_sip *cfg;        /**< SIP configuration               */
 	struct list ual;               /**< List of User-Agents (struct ua) */
+	struct hash *ht_cuser;         /**< UAs hashed by contact username  */
+	struct hash *ht_user;          /**< UAs hashed by AOR username      */
+	struct hash *ht_aor;           /**< UAs hashed by Address-of-Record */
 	struct list ehl;               /**< Event handlers (struct ua_eh)   */
 	struct sip *sip;               /**< SIP Stack                       */
 	struct sip_lsnr *lsnr;         /**< SIP Listener                    */
@@ -61,6 +72,9 @@ static struct {
 } uag = {
 	NULL,
 	LIST_INIT,
+	NULL,
+	NULL,
+	NULL,
 	LIST_INIT,
 	NULL,
 	NULL,
@@ -151,6 +165,7 @@ int ua_register(struct ua *ua)
 	struct uri uri;
 	char *reg_uri = NULL;
 	char params[256] = "";
+	uint32_t regint;
 	unsigned i;
 	int err;
 
@@ -192,13 +207,20 @@ int ua_register(struct ua *ua)
 		}
 	}
 
+	/* spread the refresh of many User-Agents over time */
+	regint = acc->regint;
+	if (uag.cfg && uag.cfg->reg_spread) {
+		regint -= rand_u32() %
+			(regint * uag.cfg->reg_spread / 100 + 1);
+	}
+
 	ua_event(ua, UA_EVENT_REGISTERING, NULL, NULL);
 
 	for (le = ua->regl.head, i=0; le; le = le->next, i++) {
 		struct reg *reg = le->data;
 
 		err = reg_register(reg, reg_uri, params,
-				   acc->regint, acc->outboundv[i]);
+				   regint, acc->outboundv[i]);
 		if (err) {
 			warning("ua: SIP register failed: %m\n", err);
 			goto out;
@@ -212,6 +234,12 @@ int ua_register(struct ua *ua)
 }
 
 
+static int register_send_handler(void *arg)
+{
+	return ua_register(arg);
+}
+
+
 /**
  * Unregister all Register clients of a User-Agent
  *
@@ -224,6 +252,8 @@ void ua_unregister(struct ua *ua)
 	if (!ua)
 		return;
 
+	regsched_cancel(&ua->regent);
+
 	if (!list_isempty(&ua->regl))
 		ua_event(ua, UA_EVENT_UNREGISTERING, NULL, NULL);
 
@@ -529,6 +559,10 @@ static void ua_destructor(void *arg)
 	}
 
 	list_unlink(&ua->le);
+	hash_unlink(&ua->he_cuser);
+	hash_unlink(&ua->he_user);
+	hash_unlink(&ua->he_aor);
+	regsched_cancel(&ua->regent);
 
 	if (!list_isempty(&ua->regl))
 		ua_event(ua, UA_EVENT_UNREGISTERING, NULL, NULL);
@@ -581,6 +615,21 @@ static void add_extension(struct ua *ua, const char *extension)
 }
 
 
+static int uag_hash_alloc(void)
+{
+	int err = 0;
+
+	if (!uag.ht_cuser)
+		err |= hash_alloc(&uag.ht_cuser, UA_HASH_SIZE);
+	if (!uag.ht_user)
+		err |= hash_alloc(&uag.ht_user, UA_HASH_SIZE);
+	if (!uag.ht_aor)
+		err |= hash_alloc(&uag.ht_aor, UA_HASH_SIZE);
+
+	return err;
+}
+
+
 /**
  * Allocate a SIP User-Agent
  *
@@ -680,10 +729,20 @@ int ua_alloc(struct ua **uap, const char *aor)
 	if (err)
 		goto out;
 
+	err = uag_hash_alloc();
+	if (err)
+		goto out;
+
 	list_append(&uag.ual, &ua->le, ua);
+	hash_append(uag.ht_cuser, hash_joaat_str_ci(ua->cuser),
+		    &ua->he_cuser, ua);
+	hash_append(uag.ht_user, hash_joaat_pl_ci(&ua->acc->luri.user),
+		    &ua->he_user, ua);
+	hash_append(uag.ht_aor, hash_joaat_str(ua->acc->aor),
+		    &ua->he_aor, ua);
 
 	if (ua->acc->regint) {
-		err = ua_register(ua);
+		err = regsched_add(&ua->regent, register_send_handler, ua);
 	}
 
 	if (!uag_current())
@@ -1351,6 +1410,13 @@ int ua_init(const char *software, bool udp, bool tcp, bool tls,
 
 	list_init(&uag.ual);
 
+	regsched_set_rate(cfg->sip.reg_rate);
+	rtppool_init(&cfg->avt, net_af(net), cfg->avt.rtp_pool);
+
+	err = mthread_init(cfg->avt.media_threads);
+	if (err)
+		goto out;
+
 	err = sip_alloc(&uag.sip, net_dnsc(net), bsize, bsize, bsize,
 			software, exit_handler, NULL);
 	if (err) {
@@ -1405,6 +1471,17 @@ void ua_close(void)
 	list_flush(&uag.ual);
 	list_flush(&uag.ehl);
 
+	regsched_close();
+	rtppool_close();
+	mthread_close();
+
+	hash_clear(uag.ht_cuser);
+	hash_clear(uag.ht_user);
+	hash_clear(uag.ht_aor);
+	uag.ht_cuser = mem_deref(uag.ht_cuser);
+	uag.ht_user  = mem_deref(uag.ht_user);
+	uag.ht_aor   = mem_deref(uag.ht_aor);
+
 	/* note: must be done before mod_close() */
 	module_app_unload();
 }
@@ -1505,7 +1582,8 @@ int uag_reset_transp(bool reg, bool reinvite)
 		struct ua *ua = le->data;
 
 		if (reg && ua->acc->regint) {
-			err |= ua_register(ua);
+			err |= regsched_add(&ua->regent,
+					    register_send_handler, ua);
 		}
 
 		/* update all active calls */
@@ -1537,8 +1615,66 @@ int uag_reset_transp(bool reg, bool reinvite)
  */
 int ua_print_sip_status(struct re_printf *pf, void *unused)
 {
+	int err;
+
+	err  = sip_debug(pf, uag.sip);
+	err |= regsched_debug(pf, unused);
+
+	return err;
+}
+
+
+static void print_memline(struct re_printf *pf, int *err, const char *name,
+			  size_t bytes, uint32_t n)
+{
+	*err |= re_hprintf(pf, " %-8s %10zu bytes  %8zu bytes/call\n",
+			   name, bytes, n ? bytes / n : 0);
+}
+
+
+/**
+ * Print the memory used by all calls, per subsystem
+ *
+ * @param pf     Print handler for debug output
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int ua_print_memory(struct re_printf *pf, void *unused)
+{
+	struct call_memstat ms;
+	struct memstat mstat;
+	struct le *le;
+	size_t total;
+	int err = 0;
 	(void)unused;
-	return sip_debug(pf, uag.sip);
+
+	memset(&ms, 0, sizeof(ms));
+
+	for (le = uag.ual.head; le; le = le->next) {
+		const struct ua *ua = le->data;
+		struct le *lec;
+
+		for (lec = ua->calls.head; lec; lec = lec->next)
+			call_memstat_add(&ms, lec->data);
+	}
+
+	total = ms.call + ms.stream + ms.audio + ms.video;
+
+	err |= re_hprintf(pf, "\nMemory used by %u calls:\n", ms.n_calls);
+	print_memline(pf, &err, "call",   ms.call,   ms.n_calls);
+	print_memline(pf, &err, "stream", ms.stream, ms.n_calls);
+	print_memline(pf, &err, "audio",  ms.audio,  ms.n_calls);
+	print_memline(pf, &err, "video",  ms.video,  ms.n_calls);
+	print_memline(pf, &err, "total",  total,     ms.n_calls);
+
+	/* only available if libre is built with memory debugging */
+	if (0 == mem_get_stat(&mstat)) {
+		err |= re_hprintf(pf, " heap:    %10zu bytes in %zu blocks\n",
+				  mstat.bytes_cur, mstat.blocks_cur);
+	}
+
+	return err;
 }
 
 
@@ -1662,6 +1798,30 @@ const char *uag_event_str(enum ua_event ev)
 }
 
 
+static bool cuser_cmp_handler(struct le *le, void *arg)
+{
+	struct ua *ua = le->data;
+
+	return 0 == pl_strcasecmp(arg, ua->cuser);
+}
+
+
+static bool user_cmp_handler(struct le *le, void *arg)
+{
+	struct ua *ua = le->data;
+
+	return 0 == pl_casecmp(arg, &ua->acc->luri.user);
+}
+
+
+static bool aor_cmp_handler(struct le *le, void *arg)
+{
+	struct ua *ua = le->data;
+
+	return 0 == str_cmp(ua->acc->aor, arg);
+}
+
+
 /**
  * Find the correct UA from the contact user
  *
@@ -1673,22 +1833,19 @@ struct ua *uag_find(const struct pl *cuser)
 {
 	struct le *le;
 
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
+	if (!cuser)
+		return NULL;
 
-		if (0 == pl_strcasecmp(cuser, ua->cuser))
-			return ua;
-	}
+	le = hash_lookup(uag.ht_cuser, hash_joaat_pl_ci(cuser),
+			 cuser_cmp_handler, (void *)cuser);
+	if (le)
+		return le->data;
 
 	/* Try also matching by AOR, for better interop */
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
+	le = hash_lookup(uag.ht_user, hash_joaat_pl_ci(cuser),
+			 user_cmp_handler, (void *)cuser);
 
-		if (0 == pl_casecmp(cuser, &ua->acc->luri.user))
-			return ua;
-	}
-
-	return NULL;
+	return list_ledata(le);
 }
 
 
@@ -1701,18 +1858,11 @@ struct ua *uag_find(const struct pl *cuser)
  */
 struct ua *uag_find_aor(const char *aor)
 {
-	struct le *le;
+	if (!str_isset(aor))
+		return list_ledata(uag.ual.head);
 
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
-
-		if (str_isset(aor) && str_cmp(ua->acc->aor, aor))
-			continue;
-
-		return ua;
-	}
-
-	return NULL;
+	return list_ledata(hash_lookup(uag.ht_aor, hash_joaat_str(aor),
+				       aor_cmp_handler, (void *)aor));
 }
 
 
@@ -7,6 +7,9 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -27,6 +30,7 @@
 enum {
 	SRATE = 90000,
 	MAX_MUTED_FRAMES = 3,
+	EFPS_INTERVAL = 5000,  /* Frame-rate estimation interval [ms] */
 };
 
 /** Video transmit parameters */
@@ -86,6 +90,7 @@ struct vtx {
 	struct video *video;               /**< Parent                    */
 	const struct vidcodec *vc;         /**< Current Video encoder     */
 	struct videnc_state *enc;          /**< Video encoder state       */
+	uint32_t enc_fmtp;                 /**< Hash of encoder fmtp      */
 	struct vidsrc_prm vsrc_prm;        /**< Video source parameters   */
 	struct vidsz vsrc_size;            /**< Video source size         */
 	struct vidsrc_st *vsrc;            /**< Video source              */
@@ -96,6 +101,13 @@ struct vtx {
 	struct list sendq;                 /**< Tx-Queue (struct vidqent) */
 	struct tmr tmr_rtp;                /**< Timer for sending RTP     */
 	unsigned skipc;                    /**< Number of frames skipped  */
+	unsigned discardc;                 /**< Number of packets dropped */
+	uint64_t enc_time;                 /**< Total encode time in [us] */
+	uint64_t enc_time_max;             /**< Max encode time in [us]   */
+	unsigned enc_frames;               /**< Number of frames encoded  */
+	struct vtx *leader;                /**< Shared encoder, if any    */
+	struct list followers;             /**< Sharing our encoder       */
+	struct le le_follow;               /**< Member of leader list     */
 	struct list filtl;                 /**< Filters in encoding order */
 	char device[64];                   /**< Source device name        */
 	int muted_frames;                  /**< # of muted frames sent    */
@@ -104,6 +116,7 @@ struct vtx {
 	bool muted;                        /**< Muted flag                */
 	int frames;                        /**< Number of frames sent     */
 	int efps;                          /**< Estimated frame-rate      */
+	uint64_t ts_efps;                  /**< Start of efps interval    */
 	uint32_t ts_min;
 	uint32_t ts_max;
 };
@@ -140,6 +153,7 @@ struct vrx {
 	int pt_rx;                         /**< Incoming RTP payload type */
 	int frames;                        /**< Number of frames received */
 	int efps;                          /**< Estimated frame-rate      */
+	uint64_t ts_efps;                  /**< Start of efps interval    */
 	unsigned n_intra;                  /**< Intra-frames decoded      */
 	unsigned n_picup;                  /**< Picture updates sent      */
 	uint32_t ts_min;
@@ -154,7 +168,6 @@ struct video {
 	struct stream *strm;    /**< Generic media stream                 */
 	struct vtx vtx;         /**< Transmit/encoder direction           */
 	struct vrx vrx;         /**< Receive/decoder direction            */
-	struct tmr tmr;         /**< Timer for frame-rate estimation      */
 	bool started;           /**< True if video is started             */
 	char *peer;             /**< Peer URI                             */
 	bool nack_pli;          /**< Send NACK/PLI to peer                */
@@ -169,6 +182,7 @@ struct vidqent {
 	bool marker;
 	uint8_t pt;
 	uint32_t ts;
+	bool discard;
 	struct mbuf *mb;
 };
 
@@ -275,6 +289,32 @@ static void vidqueue_poll(struct vtx *vtx, uint64_t jfs, uint64_t prev_jfs)
 }
 
 
+/*
+ * Drop all queued packets that belong to a discardable frame,
+ * e.g. a non-reference temporal enhancement layer. The base layer
+ * is left untouched, so the receiver can continue decoding at a
+ * lower framerate instead of losing whole frames.
+ *
+ * NOTE: must be called with the tx-lock held
+ */
+static void vidqueue_discard(struct vtx *vtx)
+{
+	struct le *le = vtx->sendq.head;
+
+	while (le) {
+
+		struct vidqent *qent = le->data;
+
+		le = le->next;
+
+		if (qent->discard) {
+			mem_deref(qent);
+			++vtx->discardc;
+		}
+	}
+}
+
+
 static void rtp_tmr_handler(void *arg)
 {
 	struct vtx *vtx = arg;
@@ -288,6 +328,33 @@ static void rtp_tmr_handler(void *arg)
 }
 
 
+static void vtx_detach(struct vtx *vtx)
+{
+	struct le *le;
+
+	if (vtx->leader) {
+		lock_write_get(vtx->leader->lock_tx);
+		list_unlink(&vtx->le_follow);
+		lock_rel(vtx->leader->lock_tx);
+		vtx->leader = NULL;
+	}
+
+	lock_write_get(vtx->lock_tx);
+	while ((le = list_head(&vtx->followers))) {
+
+		struct vtx *follower = le->data;
+
+		list_unlink(le);
+
+		lock_write_get(follower->lock_tx);
+		follower->leader = NULL;
+		follower->picup  = true;
+		lock_rel(follower->lock_tx);
+	}
+	lock_rel(vtx->lock_tx);
+}
+
+
 static void video_destructor(void *arg)
 {
 	struct video *v = arg;
@@ -295,13 +362,14 @@ static void video_destructor(void *arg)
 	struct vrx *vrx = &v->vrx;
 
 	/* transmit */
+	mem_deref(vtx->vsrc);
+	vtx_detach(vtx);
 	lock_write_get(vtx->lock_tx);
 	list_flush(&vtx->sendq);
 	lock_rel(vtx->lock_tx);
 	mem_deref(vtx->lock_tx);
 
 	tmr_cancel(&vtx->tmr_rtp);
-	mem_deref(vtx->vsrc);
 	lock_write_get(vtx->lock);
 	mem_deref(vtx->frame);
 	mem_deref(vtx->mute_frame);
@@ -319,12 +387,32 @@ static void video_destructor(void *arg)
 	lock_rel(vrx->lock);
 	mem_deref(vrx->lock);
 
-	tmr_cancel(&v->tmr);
 	mem_deref(v->strm);
 	mem_deref(v->peer);
 }
 
 
+/*
+ * Estimate the frame-rate, updated once per EFPS_INTERVAL from the
+ * frame path and from the housekeeping tick, so that the estimate
+ * drops to zero when the frames stop.
+ */
+static void efps_update(int *frames, int *efps, uint64_t *ts, uint64_t now)
+{
+	if (!*ts) {
+		*ts = now;
+		return;
+	}
+
+	if (now - *ts < EFPS_INTERVAL)
+		return;
+
+	*efps   = (int)(*frames * 1000 / (now - *ts));
+	*frames = 0;
+	*ts     = now;
+}
+
+
 static int get_fps(const struct video *v)
 {
 	const char *attr;
@@ -349,6 +437,7 @@ static int packet_handler(bool marker, uint32_t ts,
 	struct vtx *vtx = arg;
 	struct stream *strm = vtx->video->strm;
 	struct vidqent *qent;
+	struct le *le;
 	uint32_t rtp_ts;
 	int err;
 
@@ -366,9 +455,35 @@ static int packet_handler(bool marker, uint32_t ts,
 	if (err)
 		return err;
 
+	if (vtx->vc->discardh)
+		qent->discard = vtx->vc->discardh(hdr, hdr_len);
+
 	lock_write_get(vtx->lock_tx);
 	qent->dst = *sdp_media_raddr(strm->sdp);
 	list_append(&vtx->sendq, &qent->le, qent);
+
+	/* send the same encoded packet to all followers */
+	for (le = vtx->followers.head; le; le = le->next) {
+
+		struct vtx *follower = le->data;
+		struct stream *fstrm = follower->video->strm;
+
+		if (follower->vc != vtx->vc)
+			continue;
+
+		if (vidqent_alloc(&qent, marker, fstrm->pt_enc,
+				  follower->ts_offset + ts,
+				  hdr, hdr_len, pld, pld_len))
+			continue;
+
+		qent->discard = vtx->vc->discardh ?
+			vtx->vc->discardh(hdr, hdr_len) : false;
+
+		lock_write_get(follower->lock_tx);
+		qent->dst = *sdp_media_raddr(fstrm->sdp);
+		list_append(&follower->sendq, &qent->le, qent);
+		lock_rel(follower->lock_tx);
+	}
 	lock_rel(vtx->lock_tx);
 
 	return err;
@@ -386,6 +501,7 @@ static int packet_handler(bool marker, uint32_t ts,
 static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame)
 {
 	struct le *le;
+	uint64_t ts, dur;
 	int err = 0;
 	bool sendq_empty;
 
@@ -393,7 +509,31 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame)
 		return;
 
 	lock_write_get(vtx->lock_tx);
+
+	/* the leader encodes for us */
+	if (vtx->leader) {
+		lock_rel(vtx->lock_tx);
+		return;
+	}
+
+	if (vtx->sendq.head)
+		vidqueue_discard(vtx);
 	sendq_empty = (vtx->sendq.head == NULL);
+
+	/* a picture update from any follower is handled by the leader,
+	   and their backlog is thinned the same way as ours */
+	for (le = vtx->followers.head; le; le = le->next) {
+
+		struct vtx *follower = le->data;
+
+		vtx->picup |= follower->picup;
+		follower->picup = false;
+
+		lock_write_get(follower->lock_tx);
+		if (follower->sendq.head)
+			vidqueue_discard(follower);
+		lock_rel(follower->lock_tx);
+	}
 	lock_rel(vtx->lock_tx);
 
 	if (!sendq_empty) {
@@ -436,10 +576,16 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame)
 		return;
 
 	/* Encode the whole picture frame */
+	ts = time_usec();
 	err = vtx->vc->ench(vtx->enc, vtx->picup, frame);
 	if (err)
 		return;
 
+	dur = time_usec() - ts;
+	vtx->enc_time += dur;
+	vtx->enc_time_max = max(vtx->enc_time_max, dur);
+	++vtx->enc_frames;
+
 	vtx->picup = false;
 }
 
@@ -456,7 +602,10 @@ static void vidsrc_frame_handler(struct vidframe *frame, void *arg)
 {
 	struct vtx *vtx = arg;
 
+	lock_write_get(vtx->lock);
 	++vtx->frames;
+	efps_update(&vtx->frames, &vtx->efps, &vtx->ts_efps, tmr_jiffies());
+	lock_rel(vtx->lock);
 
 	/* Is the video muted? If so insert video mute image */
 	if (vtx->muted)
@@ -655,6 +804,7 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	}
 
 	++vrx->frames;
+	efps_update(&vrx->frames, &vrx->efps, &vrx->ts_efps, tmr_jiffies());
 
 out:
 	lock_rel(vrx->lock);
@@ -734,6 +884,20 @@ static void rtcp_handler(struct rtcp_msg *msg, void *arg)
 }
 
 
+static void tick_handler(uint64_t now, void *arg)
+{
+	struct video *v = arg;
+
+	lock_write_get(v->vtx.lock);
+	efps_update(&v->vtx.frames, &v->vtx.efps, &v->vtx.ts_efps, now);
+	lock_rel(v->vtx.lock);
+
+	lock_write_get(v->vrx.lock);
+	efps_update(&v->vrx.frames, &v->vrx.efps, &v->vrx.ts_efps, now);
+	lock_rel(v->vrx.lock);
+}
+
+
 static int vtx_print_pipeline(struct re_printf *pf, const struct vtx *vtx)
 {
 	struct le *le;
@@ -812,7 +976,6 @@ int video_alloc(struct video **vp, const struct stream_param *stream_prm,
 	MAGIC_INIT(v);
 
 	v->cfg = cfg->video;
-	tmr_init(&v->tmr);
 
 	err = stream_alloc(&v->strm, stream_prm,
 			   &cfg->avt, call, sdp_sess, "video", label,
@@ -822,6 +985,8 @@ int video_alloc(struct video **vp, const struct stream_param *stream_prm,
 	if (err)
 		goto out;
 
+	stream_set_tick_handler(v->strm, tick_handler);
+
 	if (cfg->avt.rtp_bw.max >= AUDIO_BANDWIDTH) {
 		stream_set_bw(v->strm, cfg->avt.rtp_bw.max - AUDIO_BANDWIDTH);
 	}
@@ -949,22 +1114,6 @@ static int set_encoder_format(struct vtx *vtx, const char *src,
 }
 
 
-enum {TMR_INTERVAL = 5};
-static void tmr_handler(void *arg)
-{
-	struct video *v = arg;
-
-	tmr_start(&v->tmr, TMR_INTERVAL * 1000, tmr_handler, v);
-
-	/* Estimate framerates */
-	v->vtx.efps = v->vtx.frames / TMR_INTERVAL;
-	v->vrx.efps = v->vrx.frames / TMR_INTERVAL;
-
-	v->vtx.frames = 0;
-	v->vrx.frames = 0;
-}
-
-
 int video_start(struct video *v, const char *peer)
 {
 	struct vidsz size;
@@ -1008,8 +1157,6 @@ int video_start(struct video *v, const char *peer)
 		info("video: no video source\n");
 	}
 
-	tmr_start(&v->tmr, TMR_INTERVAL * 1000, tmr_handler, v);
-
 	if (v->vtx.vc && v->vrx.vc) {
 		info("%H%H",
 		     vtx_print_pipeline, &v->vtx,
@@ -1161,6 +1308,8 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 		}
 
 		vtx->vc = vc;
+		vtx->enc_fmtp = str_isset(params) ?
+			hash_joaat_str_ci(params) : 0;
 	}
 
 	stream_update_encoder(v->strm, pt_tx);
@@ -1255,6 +1404,64 @@ void video_update_picture(struct video *v)
 }
 
 
+/**
+ * Share the video encoder of another video stream. The follower stops
+ * encoding, and instead sends the packets encoded by the leader.
+ *
+ * The arguments are the handler arguments given to the video source
+ * alloc handler, so that a video source can group its own streams.
+ *
+ * @param arg    Video source handler argument of the follower
+ * @param leader Video source handler argument of the leader, or NULL
+ *               to stop sharing
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int video_encoder_share(void *arg, void *leader)
+{
+	struct vtx *vtx = arg;
+	struct vtx *lead = leader;
+
+	if (!vtx || vtx == lead)
+		return EINVAL;
+
+	if (lead) {
+		if (lead->leader || !list_isempty(&vtx->followers))
+			return EINVAL;
+
+		if (!lead->vc || lead->vc != vtx->vc)
+			return ENOTSUP;
+
+		/* e.g. a different H.264 profile or packetization mode */
+		if (lead->enc_fmtp != vtx->enc_fmtp)
+			return ENOTSUP;
+	}
+
+	if (vtx->leader == lead)
+		return 0;
+
+	if (vtx->leader) {
+		lock_write_get(vtx->leader->lock_tx);
+		list_unlink(&vtx->le_follow);
+		lock_rel(vtx->leader->lock_tx);
+	}
+
+	lock_write_get(vtx->lock_tx);
+	vtx->leader = lead;
+	vtx->picup  = (lead == NULL);
+	lock_rel(vtx->lock_tx);
+
+	if (lead) {
+		lock_write_get(lead->lock_tx);
+		list_append(&lead->followers, &vtx->le_follow, vtx);
+		lead->picup = true;
+		lock_rel(lead->lock_tx);
+	}
+
+	return 0;
+}
+
+
 /**
  * Get the driver-specific view of the video stream
  *
@@ -1304,6 +1511,31 @@ void video_sdp_attr_decode(struct video *v)
 }
 
 
+static size_t frame_mem(const struct vidframe *frame)
+{
+	return frame ? sizeof(*frame) + vidframe_size(frame->fmt, &frame->size)
+		: 0;
+}
+
+
+/**
+ * Get the memory used by a video object, incl. video frames
+ *
+ * @param v Video object
+ *
+ * @return Number of bytes
+ */
+size_t video_mem(const struct video *v)
+{
+	if (!v)
+		return 0;
+
+	return sizeof(*v)
+		+ frame_mem(v->vtx.frame)
+		+ frame_mem(v->vtx.mute_frame);
+}
+
+
 int video_debug(struct re_printf *pf, const struct video *v)
 {
 	const struct vtx *vtx;
@@ -1323,6 +1555,14 @@ int video_debug(struct re_printf *pf, const struct video *v)
 			  vtx->vsrc_size.w,
 			  vtx->vsrc_size.h, vtx->vsrc_prm.fps);
 	err |= re_hprintf(pf, "     skipc=%u\n", vtx->skipc);
+	err |= re_hprintf(pf, "     discardc=%u\n", vtx->discardc);
+	if (vtx->enc_frames) {
+		err |= re_hprintf(pf, "     encode time: avg=%.2f ms,"
+				  " max=%.2f ms (%u frames)\n",
+				  vtx->enc_time * .001 / vtx->enc_frames,
+				  vtx->enc_time_max * .001,
+				  vtx->enc_frames);
+	}
 	err |= re_hprintf(pf, "     time = %.3f sec\n",
 			  video_calc_seconds(vtx->ts_max - vtx->ts_min));
 
@@ -1419,3 +1659,51 @@ double video_calc_seconds(uint32_t rtp_ts)
 
 	return timestamp;
 }
+
+
+static unsigned cpu_count(void)
+{
+#if defined (HAVE_UNISTD_H) && defined (_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n > 0)
+		return (unsigned)n;
+#endif
+
+	return 1;
+}
+
+
+/**
+ * Select the number of encoder threads from the picture size. It is
+ * doubled for each step of 360p, 720p and 1080p, and limited by the
+ * number of CPU cores.
+ *
+ * @param size Picture size
+ * @param nmax Maximum number of threads of the encoder
+ *
+ * @return Number of encoder threads
+ */
+unsigned video_calc_threads(const struct vidsz *size, unsigned nmax)
+{
+	unsigned pixels;
+	unsigned n;
+
+	if (!size || !nmax)
+		return 1;
+
+	pixels = size->w * size->h;
+
+	if (pixels >= 1920 * 1080)
+		n = 8;
+	else if (pixels >= 1280 * 720)
+		n = 4;
+	else if (pixels >= 640 * 360)
+		n = 2;
+	else
+		n = 1;
+
+	n = min(n, nmax);
+
+	return min(n, cpu_count());
+}
@@ -0,0 +1,116 @@
+/**
+ * @file test/aecref.c  Baresip selftest -- far-end reference for AEC
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	SRATE = 8000,
+	FRAME = 160,
+	FRAME_USEC = 20000,
+	START_USEC = 1000000,
+};
+
+
+/* each reference sample is its position in the played stream */
+static int play(struct aecref *ref, unsigned blocks)
+{
+	int16_t sampv[FRAME];
+	unsigned i, k;
+	int err = 0;
+
+	for (k=0; k<blocks && !err; k++) {
+
+		for (i=0; i<FRAME; i++)
+			sampv[i] = (int16_t)(k * FRAME + i);
+
+		err = aecref_play(ref, sampv, FRAME, SRATE, 1,
+				  START_USEC + k * FRAME_USEC);
+	}
+
+	return err;
+}
+
+
+int test_aecref(void)
+{
+	struct aecref *ref = NULL;
+	int16_t refv[FRAME];
+	unsigned i, k;
+	bool jump;
+	int err;
+
+	err = aecref_alloc(&ref, SRATE);
+	TEST_ERR(err);
+
+	ASSERT_EQ(SRATE, aecref_srate(ref));
+
+	/* no reference until both devices have a clock */
+	refv[0] = 1;
+	ASSERT_EQ(ENOENT, aecref_read(ref, refv, FRAME, &jump));
+	ASSERT_EQ(0, refv[0]);
+
+	err = play(ref, 20);
+	TEST_ERR(err);
+
+	/* the source started together with the player */
+	for (k=0; k<5; k++) {
+		aecref_capture(ref, FRAME, SRATE, 1,
+			       START_USEC + k * FRAME_USEC);
+	}
+
+	/* two frames are not read yet, the next one started at 60 ms */
+	aecref_frame(ref, 2 * FRAME);
+
+	err = aecref_read(ref, refv, FRAME, &jump);
+	TEST_ERR(err);
+	ASSERT_TRUE(!jump);
+	ASSERT_TRUE(refv[0] >= 3 * FRAME - 1 && refv[0] <= 3 * FRAME + 1);
+	for (i=1; i<FRAME; i++)
+		ASSERT_EQ(refv[0] + i, refv[i]);
+
+	/* the next frame follows without a gap */
+	aecref_capture(ref, FRAME, SRATE, 1, START_USEC + 5 * FRAME_USEC);
+	aecref_frame(ref, 2 * FRAME);
+
+	k = refv[0] + FRAME;
+	err = aecref_read(ref, refv, FRAME, &jump);
+	TEST_ERR(err);
+	ASSERT_TRUE(!jump);
+	ASSERT_EQ(k, refv[0]);
+
+	/* the source clock moves by 50 ms, the reader jumps once */
+	for (k=6; k<40; k++) {
+
+		aecref_capture(ref, FRAME, SRATE, 1,
+			       START_USEC + k * FRAME_USEC + 50000);
+		aecref_frame(ref, 2 * FRAME);
+
+		err = aecref_read(ref, refv, FRAME, &jump);
+		TEST_ERR(err);
+
+		if (jump)
+			break;
+	}
+
+	ASSERT_TRUE(jump);
+
+	/* a stereo player needs its format set before it plays */
+	memset(refv, 0, sizeof(refv));
+	ASSERT_EQ(ENOTSUP, aecref_play(ref, refv, FRAME, SRATE, 2, 0));
+
+	err = aecref_player_set(ref, SRATE, 2);
+	TEST_ERR(err);
+
+	err = aecref_play(ref, refv, FRAME, SRATE, 2, 0);
+	TEST_ERR(err);
+
+ out:
+	mem_deref(ref);
+	return err;
+}
@@ -0,0 +1,158 @@
+/**
+ * @file test/auctrl.c  Baresip selftest -- adaptive encoder control
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	SEND_BPS = 64000,
+	FRAME_USEC = 20000,
+};
+
+
+static int test_auctrl_loss(void)
+{
+	struct auctrl ctl;
+	struct auenc_param prm;
+	unsigned i;
+	int err = 0;
+
+	memset(&prm, 0, sizeof(prm));
+	auctrl_init(&ctl);
+
+	/* nothing to change until the first report */
+	ASSERT_TRUE(!auctrl_update(&ctl, &prm));
+
+	/* no loss, no limit */
+	auctrl_feedback(&ctl, 0.0, 50, 0, SEND_BPS);
+	ASSERT_TRUE(!auctrl_update(&ctl, &prm));
+
+	/* heavy loss cuts the bitrate from the send rate */
+	auctrl_feedback(&ctl, 20.0, 50, 0, SEND_BPS);
+	ASSERT_TRUE(auctrl_update(&ctl, &prm));
+	ASSERT_EQ(SEND_BPS * 9 / 10, prm.bitrate);
+	ASSERT_EQ(6, prm.pkt_loss);
+	ASSERT_EQ(10, prm.complexity);
+	ASSERT_TRUE(!auctrl_update(&ctl, &prm));
+
+	/* the cut is repeated, down to the minimum */
+	for (i=0; i<100; i++)
+		auctrl_feedback(&ctl, 50.0, 50, 0, SEND_BPS);
+	ASSERT_TRUE(auctrl_update(&ctl, &prm));
+	ASSERT_EQ(6000, prm.bitrate);
+	ASSERT_EQ(50, prm.pkt_loss);
+
+	/* not raised while the round-trip time is high */
+	for (i=0; i<20; i++)
+		auctrl_feedback(&ctl, 0.0, 500, 0, SEND_BPS);
+	ASSERT_TRUE(auctrl_update(&ctl, &prm));
+	ASSERT_EQ(6000, prm.bitrate);
+	ASSERT_EQ(0, prm.pkt_loss);
+
+	/* raised, and released when the encoder is below the limit */
+	auctrl_feedback(&ctl, 0.0, 50, 0, SEND_BPS);
+	ASSERT_TRUE(auctrl_update(&ctl, &prm));
+	ASSERT_EQ(6480, prm.bitrate);
+
+	for (i=0; i<100 && ctl.bitrate; i++)
+		auctrl_feedback(&ctl, 0.0, 50, 0, 4000);
+	ASSERT_TRUE(auctrl_update(&ctl, &prm));
+	ASSERT_EQ(0, prm.bitrate);
+
+ out:
+	return err;
+}
+
+
+static int test_auctrl_remb(void)
+{
+	static const uint8_t remb[] = {
+		'R', 'E', 'M', 'B', 0x01, 0x0d, 0x86, 0xa0,
+		0x11, 0x22, 0x33, 0x44
+	};
+	struct auctrl ctl;
+	struct auenc_param prm;
+	struct mbuf mb;
+	uint32_t bw;
+	int err = 0;
+
+	/* 100000 << 3 */
+	mbuf_init(&mb);
+	mb.buf  = (uint8_t *)remb;
+	mb.size = mb.end = sizeof(remb);
+
+	bw = auctrl_remb_decode(&mb);
+	ASSERT_EQ(800000, bw);
+
+	mb.pos = 1;
+	ASSERT_EQ(0, auctrl_remb_decode(&mb));
+
+	/* the available bandwidth caps the bitrate */
+	memset(&prm, 0, sizeof(prm));
+	auctrl_init(&ctl);
+
+	auctrl_feedback(&ctl, 0.0, 50, 24000, SEND_BPS);
+	ASSERT_TRUE(auctrl_update(&ctl, &prm));
+	ASSERT_EQ(24000, prm.bitrate);
+
+	/* a higher bandwidth does not lift the limit at once */
+	auctrl_feedback(&ctl, 0.0, 50, bw, SEND_BPS);
+	ASSERT_TRUE(auctrl_update(&ctl, &prm));
+	ASSERT_EQ(25920, prm.bitrate);
+
+ out:
+	return err;
+}
+
+
+static int test_auctrl_load(void)
+{
+	struct auctrl ctl;
+	struct auenc_param prm;
+	unsigned i;
+	int err = 0;
+
+	memset(&prm, 0, sizeof(prm));
+	auctrl_init(&ctl);
+
+	/* a saturated host lowers the complexity, step by step */
+	for (i=0; i<1000; i++)
+		auctrl_load(&ctl, FRAME_USEC / 2, FRAME_USEC);
+
+	ASSERT_TRUE(auctrl_update(&ctl, &prm));
+	ASSERT_EQ(2, prm.complexity);
+	ASSERT_EQ(0, prm.bitrate);
+
+	/* and it is restored when the load goes away */
+	for (i=0; i<2000; i++)
+		auctrl_load(&ctl, 0, FRAME_USEC);
+
+	ASSERT_TRUE(auctrl_update(&ctl, &prm));
+	ASSERT_EQ(10, prm.complexity);
+
+ out:
+	return err;
+}
+
+
+int test_auctrl(void)
+{
+	int err;
+
+	err = test_auctrl_loss();
+	TEST_ERR(err);
+
+	err = test_auctrl_remb();
+	TEST_ERR(err);
+
+	err = test_auctrl_load();
+	TEST_ERR(err);
+
+ out:
+	return err;
+}
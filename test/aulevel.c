@@ -17,6 +17,52 @@
 #define PREC .6
 
 
+/* a frame that is not a multiple of the SIMD width */
+static int test_aulevel_stats(void)
+{
+	int16_t sampv[165];
+	struct aulevel lvl, sum;
+	uint64_t sumsq = 0;
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(sampv); i++)
+		sampv[i] = (int16_t)((i % 2) ? -1000 : 1000);
+
+	sampv[3]   = 32767;
+	sampv[100] = -32768;
+	sampv[164] = 32767;
+
+	for (i=0; i<ARRAY_SIZE(sampv); i++)
+		sumsq += (uint64_t)((int32_t)sampv[i] * sampv[i]);
+
+	aulevel_calc(&lvl, sampv, ARRAY_SIZE(sampv));
+
+	ASSERT_EQ(ARRAY_SIZE(sampv), lvl.sampc);
+	ASSERT_EQ(sumsq, lvl.sumsq);
+	ASSERT_EQ(32768, lvl.peak);
+	ASSERT_EQ(3, lvl.clip);
+	ASSERT_DOUBLE_EQ(0.0, aulevel_peak_dbov(&lvl), PREC);
+
+	/* the sum of two frames has the level of their concatenation */
+	sum = lvl;
+	aulevel_calc(&lvl, sampv, 10);
+	aulevel_add(&sum, &lvl);
+
+	ASSERT_EQ(ARRAY_SIZE(sampv) + 10, sum.sampc);
+	ASSERT_EQ(4, sum.clip);
+	ASSERT_EQ(32768, sum.peak);
+
+	/* no samples */
+	aulevel_calc(&lvl, sampv, 0);
+	ASSERT_EQ(0, lvl.sampc);
+	ASSERT_DOUBLE_EQ(AULEVEL_MIN, aulevel_dbov(&lvl), PREC);
+
+ out:
+	return err;
+}
+
+
 int test_aulevel(void)
 {
 	static const struct {
@@ -56,6 +102,9 @@ int test_aulevel(void)
 		ASSERT_DOUBLE_EQ(testv[i].level, level, PREC);
 	}
 
+	err = test_aulevel_stats();
+	TEST_ERR(err);
+
  out:
 	return err;
 }
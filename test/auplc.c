@@ -0,0 +1,97 @@
+/**
+ * @file test/auplc.c  Baresip selftest -- Packet Loss Concealment
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	SRATE = 8000,
+	FRAME = 160,
+	PERIOD = 50,    /* 160 Hz */
+	AMP = 8000,
+};
+
+
+/* stereo, the same on both channels */
+static void tone(int16_t *sampv, size_t frames, size_t pos)
+{
+	size_t i;
+
+	for (i=0; i<frames; i++) {
+		const double t = 2 * 3.14159265358979 * (pos + i) / PERIOD;
+
+		sampv[2*i] = sampv[2*i + 1] = (int16_t)(AMP * sin(t));
+	}
+}
+
+
+static int peak(const int16_t *sampv, size_t sampc)
+{
+	int p = 0;
+	size_t i;
+
+	for (i=0; i<sampc; i++)
+		p = max(p, abs(sampv[i]));
+
+	return p;
+}
+
+
+int test_auplc(void)
+{
+	struct auplc *plc = NULL;
+	int16_t sampv[2 * FRAME], refv[2 * FRAME];
+	size_t i, pos = 0;
+	int err;
+
+	err = auplc_alloc(&plc, SRATE, 2);
+	TEST_ERR(err);
+
+	for (i=0; i<5; i++) {
+		tone(sampv, FRAME, pos);
+		auplc_rx(plc, sampv, ARRAY_SIZE(sampv));
+		pos += FRAME;
+	}
+
+	/* the first 10 ms continue the tone, on both channels */
+	auplc_conceal(plc, sampv, ARRAY_SIZE(sampv));
+	tone(refv, FRAME, pos);
+	pos += FRAME;
+
+	for (i=0; i<FRAME; i++) {
+
+		ASSERT_EQ(sampv[2*i], sampv[2*i + 1]);
+
+		if (i < FRAME / 2)
+			ASSERT_TRUE(abs(sampv[2*i] - refv[2*i]) < AMP / 20);
+	}
+
+	/* then fade out */
+	ASSERT_TRUE(peak(&sampv[FRAME], FRAME) < AMP);
+	ASSERT_TRUE(peak(&sampv[FRAME], FRAME) > AMP / 2);
+
+	/* silent after 60 ms */
+	for (i=0; i<3; i++)
+		auplc_conceal(plc, sampv, ARRAY_SIZE(sampv));
+	ASSERT_EQ(0, peak(sampv, ARRAY_SIZE(sampv)));
+	pos += 3 * FRAME;
+
+	/* the next good frame fades in from silence */
+	tone(sampv, FRAME, pos);
+	memcpy(refv, sampv, sizeof(refv));
+	auplc_rx(plc, sampv, ARRAY_SIZE(sampv));
+
+	ASSERT_TRUE(abs(sampv[0]) <= abs(refv[0]));
+	ASSERT_TRUE(peak(sampv, 20) < AMP / 4);
+	ASSERT_TRUE(abs(refv[2*FRAME - 1] - sampv[2*FRAME - 1]) < AMP / 100);
+
+ out:
+	mem_deref(plc);
+	return err;
+}
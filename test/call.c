@@ -271,6 +271,48 @@ int test_call_answer(void)
 }
 
 
+int test_call_memory(void)
+{
+	struct fixture fix, *f = &fix;
+	struct mbuf *mb = NULL;
+	int err = 0;
+
+	fixture_init(f);
+
+	f->behaviour = BEHAVIOUR_ANSWER;
+
+	/* Make a call from A to B */
+	err = ua_connect(f->a.ua, 0, NULL, f->buri, NULL, VIDMODE_OFF);
+	TEST_ERR(err);
+
+	/* run main-loop with timeout, wait for events */
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+
+	ASSERT_EQ(1, fix.a.n_established);
+	ASSERT_EQ(1, fix.b.n_established);
+
+	mb = mbuf_alloc(512);
+	ASSERT_TRUE(mb != NULL);
+
+	err = mbuf_printf(mb, "%H", ua_print_memory, NULL);
+	TEST_ERR(err);
+
+	/* both call legs are in this process, and have no video */
+	ASSERT_TRUE(0 == re_regex((char *)mb->buf, mb->end,
+				  "Memory used by 2 calls"));
+	ASSERT_TRUE(0 == re_regex((char *)mb->buf, mb->end,
+				  "video[ ]+0 bytes"));
+
+ out:
+	mem_deref(mb);
+	fixture_close(f);
+
+	return err;
+}
+
+
 int test_call_reject(void)
 {
 	struct fixture fix, *f = &fix;
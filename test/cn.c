@@ -0,0 +1,157 @@
+/**
+ * @file test/cn.c  Baresip selftest -- VAD and Comfort Noise
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	PTIME = 20,
+	FRAME = 160,
+};
+
+
+static void noise(int16_t *sampv, size_t sampc, double level)
+{
+	struct cngen cg;
+
+	memset(&cg, 0, sizeof(cg));
+	cngen_set_level(&cg, level);
+	cngen_generate(&cg, sampv, sampc, 1);
+}
+
+
+static void tone(int16_t *sampv, size_t sampc, int16_t amp)
+{
+	size_t i;
+
+	for (i=0; i<sampc; i++)
+		sampv[i] = (int16_t)(amp * sin(2 * 3.14159265358979 * i / 16));
+}
+
+
+static int test_vad(void)
+{
+	struct vad vad;
+	int16_t sampv[FRAME];
+	unsigned i, n_sent = 0;
+	int err = 0;
+
+	vad_init(&vad, PTIME);
+
+	/* background noise: sent during the 200 ms hangover only */
+	for (i=0; i<50; i++) {
+		noise(sampv, ARRAY_SIZE(sampv), -50.0);
+		if (vad_process(&vad, sampv, ARRAY_SIZE(sampv)))
+			++n_sent;
+	}
+
+	ASSERT_EQ(200 / PTIME, n_sent);
+	ASSERT_TRUE(!vad.active);
+	ASSERT_DOUBLE_EQ(-50.0, vad.noise, 2.0);
+
+	/* speech is detected in the first frame */
+	tone(sampv, ARRAY_SIZE(sampv), 3000);
+	ASSERT_TRUE(vad_process(&vad, sampv, ARRAY_SIZE(sampv)));
+	ASSERT_TRUE(vad.active);
+
+	/* a short pause within the hangover */
+	memset(sampv, 0, sizeof(sampv));
+	for (i=0; i<5; i++)
+		ASSERT_TRUE(vad_process(&vad, sampv, ARRAY_SIZE(sampv)));
+
+ out:
+	return err;
+}
+
+
+static int test_cn_payload(void)
+{
+	struct mbuf *mb;
+	double level;
+	int err = 0;
+
+	mb = mbuf_alloc(8);
+	if (!mb)
+		return ENOMEM;
+
+	err = cn_encode(mb, -42.4);
+	TEST_ERR(err);
+	err = cn_encode(mb, 3.0);
+	TEST_ERR(err);
+	err = cn_encode(mb, -200.0);
+	TEST_ERR(err);
+
+	ASSERT_EQ(3, mb->end);
+	ASSERT_EQ(42, mb->buf[0]);
+	ASSERT_EQ(0, mb->buf[1]);
+	ASSERT_EQ(127, mb->buf[2]);
+
+	mb->pos = 0;
+	err = cn_decode(&level, mb);
+	TEST_ERR(err);
+	ASSERT_DOUBLE_EQ(-42.0, level, 0.0001);
+
+	mb->pos = mb->end;
+	ASSERT_EQ(EBADMSG, cn_decode(&level, mb));
+	err = 0;
+
+ out:
+	mem_deref(mb);
+	return err;
+}
+
+
+static int test_cn_generate(void)
+{
+	struct cngen cg;
+	int16_t sampv[8000];
+	size_t i;
+	int err = 0;
+
+	memset(&cg, 0, sizeof(cg));
+
+	/* mono, at the given level */
+	cngen_set_level(&cg, -30.0);
+	cngen_generate(&cg, sampv, ARRAY_SIZE(sampv), 1);
+	ASSERT_DOUBLE_EQ(-30.0, aulevel_calc_dbov(sampv, ARRAY_SIZE(sampv)),
+			 0.5);
+
+	/* stereo, same on both channels */
+	cngen_generate(&cg, sampv, ARRAY_SIZE(sampv), 2);
+	for (i=0; i<ARRAY_SIZE(sampv); i+=2)
+		ASSERT_EQ(sampv[i], sampv[i + 1]);
+
+	/* too low to be audible */
+	cngen_set_level(&cg, -127.0);
+	cngen_generate(&cg, sampv, ARRAY_SIZE(sampv), 1);
+	for (i=0; i<ARRAY_SIZE(sampv); i++)
+		ASSERT_EQ(0, sampv[i]);
+
+ out:
+	return err;
+}
+
+
+int test_cn(void)
+{
+	int err;
+
+	err = test_vad();
+	TEST_ERR(err);
+
+	err = test_cn_payload();
+	TEST_ERR(err);
+
+	err = test_cn_generate();
+	TEST_ERR(err);
+
+ out:
+	return err;
+}
@@ -0,0 +1,221 @@
+/**
+ * @file test/g711.c  Baresip selftest -- batch G.711 conversion
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	NSAMP = 65536,
+	BENCH_ROUNDS = 200,
+};
+
+
+static int test_g711_law(bool alaw)
+{
+	int16_t *pcm = NULL, *dec = NULL;
+	uint8_t *enc = NULL, *one = NULL;
+	uint8_t codes[256];
+	int16_t lin[256];
+	size_t i;
+	int err = 0;
+
+	pcm = mem_alloc(NSAMP * sizeof(*pcm), NULL);
+	dec = mem_alloc(NSAMP * sizeof(*dec), NULL);
+	enc = mem_alloc(NSAMP, NULL);
+	one = mem_alloc(NSAMP, NULL);
+	if (!pcm || !dec || !enc || !one) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	/* decoding is the same as librem's per-sample decoder */
+	for (i=0; i<256; i++)
+		codes[i] = (uint8_t)i;
+
+	if (alaw)
+		g711_alaw_dec(lin, codes, 256);
+	else
+		g711_ulaw_dec(lin, codes, 256);
+
+	for (i=0; i<256; i++) {
+		const int16_t ref = alaw ? g711_alaw2pcm(codes[i])
+					 : g711_ulaw2pcm(codes[i]);
+		ASSERT_EQ(ref, lin[i]);
+	}
+
+	/* every code survives decode and encode, except u-law -0 */
+	if (alaw)
+		g711_alaw_enc(codes, lin, 256);
+	else
+		g711_ulaw_enc(codes, lin, 256);
+
+	for (i=0; i<256; i++) {
+		const uint8_t exp = (!alaw && i == 0x7f) ? 0xff : i;
+
+		ASSERT_EQ(exp, codes[i]);
+	}
+
+	/* all 16-bit inputs give the same code as librem's encoder */
+	for (i=0; i<NSAMP; i++)
+		pcm[i] = (int16_t)(i - 32768);
+
+	if (alaw)
+		g711_alaw_enc(enc, pcm, NSAMP);
+	else
+		g711_ulaw_enc(enc, pcm, NSAMP);
+
+	for (i=0; i<NSAMP; i++) {
+		const uint8_t ref = alaw ? g711_pcm2alaw(pcm[i])
+					 : g711_pcm2ulaw(pcm[i]);
+		ASSERT_EQ(ref, enc[i]);
+	}
+
+	/* an odd length also runs the scalar tail */
+	if (alaw)
+		g711_alaw_enc(enc, pcm, NSAMP - 1);
+	else
+		g711_ulaw_enc(enc, pcm, NSAMP - 1);
+
+	for (i=0; i<NSAMP - 1; i++) {
+		if (alaw)
+			g711_alaw_enc(&one[i], &pcm[i], 1);
+		else
+			g711_ulaw_enc(&one[i], &pcm[i], 1);
+	}
+
+	TEST_MEMCMP(one, NSAMP - 1, enc, NSAMP - 1);
+
+	if (alaw)
+		g711_alaw_dec(dec, enc, NSAMP - 1);
+	else
+		g711_ulaw_dec(dec, enc, NSAMP - 1);
+
+	/* the quantisation error grows with the segment */
+	for (i=0; i<NSAMP - 1; i++) {
+		const int x = pcm[i];
+
+		ASSERT_TRUE(abs(dec[i] - x) <= abs(x) / 16 + 16);
+	}
+
+ out:
+	mem_deref(one);
+	mem_deref(enc);
+	mem_deref(dec);
+	mem_deref(pcm);
+
+	return err;
+}
+
+
+int test_g711(void)
+{
+	int err;
+
+	err = test_g711_law(false);
+	TEST_ERR(err);
+
+	err = test_g711_law(true);
+	TEST_ERR(err);
+
+ out:
+	return err;
+}
+
+
+static void bench_print(const char *name, uint64_t ms)
+{
+	const double ns = 1e6 * ms;
+
+	if (ns > 0) {
+		info("g711: %-22s %6.2f samples/ns\n", name,
+		     (double)NSAMP * BENCH_ROUNDS / ns);
+	}
+	else {
+		info("g711: %-22s  (too fast to measure)\n", name);
+	}
+}
+
+
+/*
+ * Print the throughput of the batch functions, with librem's
+ * per-sample functions as reference.
+ */
+int test_g711_bench(void)
+{
+	int16_t *pcm = NULL;
+	uint8_t *enc = NULL;
+	uint64_t t0;
+	size_t i, r;
+	unsigned sum = 0;
+	int err = 0;
+
+	pcm = mem_alloc(NSAMP * sizeof(*pcm), NULL);
+	enc = mem_alloc(NSAMP, NULL);
+	if (!pcm || !enc) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<NSAMP; i++)
+		pcm[i] = (int16_t)(rand_u16());
+
+	t0 = tmr_jiffies();
+	for (r=0; r<BENCH_ROUNDS; r++) {
+		for (i=0; i<NSAMP; i++)
+			enc[i] = g711_pcm2ulaw(pcm[i]);
+		sum += enc[r];
+	}
+	bench_print("ulaw encode, librem", tmr_jiffies() - t0);
+
+	t0 = tmr_jiffies();
+	for (r=0; r<BENCH_ROUNDS; r++) {
+		g711_ulaw_enc(enc, pcm, NSAMP);
+		sum += enc[r];
+	}
+	bench_print("ulaw encode, batch", tmr_jiffies() - t0);
+
+	t0 = tmr_jiffies();
+	for (r=0; r<BENCH_ROUNDS; r++) {
+		for (i=0; i<NSAMP; i++)
+			enc[i] = g711_pcm2alaw(pcm[i]);
+		sum += enc[r];
+	}
+	bench_print("alaw encode, librem", tmr_jiffies() - t0);
+
+	t0 = tmr_jiffies();
+	for (r=0; r<BENCH_ROUNDS; r++) {
+		g711_alaw_enc(enc, pcm, NSAMP);
+		sum += enc[r];
+	}
+	bench_print("alaw encode, batch", tmr_jiffies() - t0);
+
+	t0 = tmr_jiffies();
+	for (r=0; r<BENCH_ROUNDS; r++) {
+		g711_ulaw_dec(pcm, enc, NSAMP);
+		sum += (uint16_t)pcm[r];
+	}
+	bench_print("ulaw decode, batch", tmr_jiffies() - t0);
+
+	t0 = tmr_jiffies();
+	for (r=0; r<BENCH_ROUNDS; r++) {
+		g711_alaw_dec(pcm, enc, NSAMP);
+		sum += (uint16_t)pcm[r];
+	}
+	bench_print("alaw decode, batch", tmr_jiffies() - t0);
+
+	/* keep the results alive */
+	if (sum == 0xffffffff)
+		info("g711: %u\n", sum);
+
+ out:
+	mem_deref(enc);
+	mem_deref(pcm);
+
+	return err;
+}
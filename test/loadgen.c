@@ -0,0 +1,645 @@
+/**
+ * @file test/loadgen.c  SIP call load generator
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifdef SOLARIS
+#define __EXTENSIONS__ 1
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#ifndef WIN32
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+#include "sip/sipsrv.h"
+
+
+/*
+ * The load generator runs the core User-Agent stack in two local
+ * processes. The callee process runs the mock SIP server as registrar,
+ * and a User-Agent which registers there and answers all calls.
+ * The caller process makes calls to the callee at a fixed rate, hangs
+ * up after the hold time, and reports the setup latency, failed
+ * calls, CPU time per call and memory per call.
+ *
+ *   $ baresip-loadgen -s -l 127.0.0.1:5070
+ *   $ baresip-loadgen -r 50 -t 2000 -n 1000 sip:b@127.0.0.1:5070
+ */
+
+
+enum {
+	TICK_MIN      =   10,     /* Minimum pacing interval [ms]       */
+	REPORT_PERIOD = 1000,     /* Progress report interval [ms]      */
+	HASH_SIZE     = 1024,     /* Size of active-call hash table     */
+};
+
+
+struct loadgen {
+	struct sip_server *srv;   /**< Registrar (callee only)          */
+	struct ua *ua;            /**< Local User-Agent                 */
+	struct hash *ht_call;     /**< Active calls (struct lgcall)     */
+	struct tmr tmr;           /**< Call pacing timer                */
+	struct tmr tmr_report;    /**< Progress report timer            */
+	const char *uri;          /**< Callee URI (caller only)         */
+	uint32_t rate;            /**< Calls per second                 */
+	uint32_t hold;            /**< Call hold time [ms]              */
+	uint32_t n_total;         /**< Number of calls, 0 for no limit  */
+	uint64_t ts_start;        /**< Start of the run [ms]            */
+
+	uint32_t n_started;       /**< Calls started                    */
+	uint32_t n_estab;         /**< Calls established                */
+	uint32_t n_failed;        /**< Calls failed before established  */
+	uint32_t n_active;        /**< Calls active now                 */
+	uint32_t max_active;      /**< Max. number of active calls      */
+
+	uint32_t *latv;           /**< Setup latency samples [ms]       */
+	size_t latc;              /**< Number of latency samples        */
+	size_t latsz;             /**< Size of latency sample array     */
+
+	size_t mem_base;          /**< Memory in use at start [bytes]   */
+	size_t mem_peak;          /**< Memory in use at max_active      */
+	bool callee;              /**< Callee mode                      */
+};
+
+
+/** Defines an outgoing call */
+struct lgcall {
+	struct le he;             /**< Hash element                     */
+	struct loadgen *lg;       /**< Parent load generator            */
+	struct call *call;        /**< Call object                      */
+	struct tmr tmr;           /**< Hangup timer                     */
+	uint64_t ts;              /**< Time when call was started [ms]  */
+	bool estab;               /**< Call is established              */
+};
+
+
+static struct loadgen lg;
+
+
+static size_t mem_inuse(void)
+{
+	struct memstat mstat;
+
+	if (0 == mem_get_stat(&mstat))
+		return mstat.bytes_cur;
+
+#ifndef WIN32
+	{
+		struct rusage ru;
+
+		/* fall back to the maximum resident set size */
+		if (0 == getrusage(RUSAGE_SELF, &ru))
+			return (size_t)ru.ru_maxrss * 1024;
+	}
+#endif
+
+	return 0;
+}
+
+
+static double cpu_time(void)
+{
+#ifndef WIN32
+	struct rusage ru;
+
+	if (0 == getrusage(RUSAGE_SELF, &ru)) {
+		return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6
+			+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+	}
+#endif
+
+	return 0.0;
+}
+
+
+static uint32_t call_hash(const struct call *call)
+{
+	return hash_joaat((const uint8_t *)&call, sizeof(call));
+}
+
+
+static bool call_cmp_handler(struct le *le, void *arg)
+{
+	const struct lgcall *lc = le->data;
+
+	return lc->call == arg;
+}
+
+
+static struct lgcall *lgcall_find(const struct call *call)
+{
+	return list_ledata(hash_lookup(lg.ht_call, call_hash(call),
+				       call_cmp_handler, (void *)call));
+}
+
+
+static void lgcall_destructor(void *arg)
+{
+	struct lgcall *lc = arg;
+
+	tmr_cancel(&lc->tmr);
+	hash_unlink(&lc->he);
+}
+
+
+static void latency_add(uint32_t ms)
+{
+	if (lg.latc >= lg.latsz) {
+
+		size_t sz = lg.latsz ? lg.latsz * 2 : 1024;
+		uint32_t *v;
+
+		v = mem_realloc(lg.latv, sz * sizeof(*v));
+		if (!v)
+			return;
+
+		lg.latv  = v;
+		lg.latsz = sz;
+	}
+
+	lg.latv[lg.latc++] = ms;
+}
+
+
+static void active_update(int delta)
+{
+	lg.n_active += delta;
+
+	if (lg.n_active > lg.max_active) {
+		lg.max_active = lg.n_active;
+		lg.mem_peak   = mem_inuse();
+	}
+}
+
+
+static void check_done(void)
+{
+	if (lg.callee || !lg.n_total)
+		return;
+
+	if (lg.n_started >= lg.n_total && lg.n_active == 0)
+		re_cancel();
+}
+
+
+static void hangup_handler(void *arg)
+{
+	struct lgcall *lc = arg;
+
+	/* NOTE: lc is destroyed by the CALL_CLOSED event */
+	ua_hangup(lg.ua, lc->call, 0, NULL);
+}
+
+
+static int call_start(void)
+{
+	struct lgcall *lc;
+	int err;
+
+	lc = mem_zalloc(sizeof(*lc), lgcall_destructor);
+	if (!lc)
+		return ENOMEM;
+
+	lc->lg = &lg;
+	lc->ts = tmr_jiffies();
+
+	++lg.n_started;
+
+	err = ua_connect(lg.ua, &lc->call, NULL, lg.uri, NULL, VIDMODE_OFF);
+	if (err) {
+		++lg.n_failed;
+		mem_deref(lc);
+		return err;
+	}
+
+	hash_append(lg.ht_call, call_hash(lc->call), &lc->he, lc);
+	active_update(+1);
+
+	return 0;
+}
+
+
+static int latency_cmp(const void *p1, const void *p2)
+{
+	const uint32_t l1 = *(const uint32_t *)p1;
+	const uint32_t l2 = *(const uint32_t *)p2;
+
+	return (l1 > l2) - (l1 < l2);
+}
+
+
+static uint32_t percentile(const uint32_t *v, size_t n, unsigned pct)
+{
+	return v[min((n * pct) / 100, n - 1)];
+}
+
+
+static void pacing_handler(void *arg)
+{
+	const uint64_t now = tmr_jiffies();
+	uint64_t due;
+	(void)arg;
+
+	/* number of calls which should have been started by now */
+	due = lg.rate * (now - lg.ts_start) / 1000 + 1;
+	if (lg.n_total)
+		due = min(due, (uint64_t)lg.n_total);
+
+	while (lg.n_started < due) {
+
+		int err = call_start();
+		if (err) {
+			warning("loadgen: call %u failed (%m)\n",
+				lg.n_started, err);
+		}
+	}
+
+	if (!lg.n_total || lg.n_started < lg.n_total) {
+		tmr_start(&lg.tmr, max(1000 / lg.rate, (uint32_t)TICK_MIN),
+			  pacing_handler, NULL);
+	}
+	else {
+		check_done();
+	}
+}
+
+
+static void report_handler(void *arg)
+{
+	(void)arg;
+
+	tmr_start(&lg.tmr_report, REPORT_PERIOD, report_handler, NULL);
+
+	re_printf("loadgen: started=%u established=%u failed=%u"
+		  " active=%u\n",
+		  lg.n_started, lg.n_estab, lg.n_failed, lg.n_active);
+}
+
+
+static void print_summary(double cpu)
+{
+	const uint64_t dur = tmr_jiffies() - lg.ts_start;
+	const uint32_t ncalls = lg.callee ? lg.n_estab : lg.n_started;
+
+	re_printf("\n--- loadgen summary (%s) ---\n",
+		  lg.callee ? "callee" : "caller");
+	re_printf("duration:         %llu ms\n", dur);
+	re_printf("calls:            %u\n", ncalls);
+	re_printf("established:      %u\n", lg.n_estab);
+	re_printf("failed:           %u\n", lg.n_failed);
+	re_printf("max active:       %u\n", lg.max_active);
+
+	if (lg.latc) {
+		qsort(lg.latv, lg.latc, sizeof(lg.latv[0]), latency_cmp);
+
+		re_printf("setup latency:    p50=%ums p90=%ums p99=%ums"
+			  " max=%ums\n",
+			  percentile(lg.latv, lg.latc, 50),
+			  percentile(lg.latv, lg.latc, 90),
+			  percentile(lg.latv, lg.latc, 99),
+			  lg.latv[lg.latc - 1]);
+	}
+
+	if (ncalls) {
+		re_printf("cpu per call:     %.3f ms\n",
+			  cpu * 1000.0 / ncalls);
+	}
+
+	if (lg.max_active && lg.mem_peak > lg.mem_base) {
+		re_printf("memory per call:  %zu bytes\n",
+			  (lg.mem_peak - lg.mem_base) / lg.max_active);
+	}
+}
+
+
+static void ua_event_handler(struct ua *ua, enum ua_event ev,
+			     struct call *call, const char *prm, void *arg)
+{
+	struct lgcall *lc;
+	(void)arg;
+
+	if (ua != lg.ua)
+		return;
+
+	switch (ev) {
+
+	case UA_EVENT_REGISTER_OK:
+		if (lg.callee)
+			re_printf("loadgen: registered %s\n", ua_aor(ua));
+		break;
+
+	case UA_EVENT_REGISTER_FAIL:
+		warning("loadgen: register failed: %s\n", prm);
+		break;
+
+	case UA_EVENT_CALL_ESTABLISHED:
+		++lg.n_estab;
+
+		if (lg.callee) {
+			active_update(+1);
+			break;
+		}
+
+		lc = lgcall_find(call);
+		if (!lc || lc->estab)
+			break;
+
+		lc->estab = true;
+		latency_add((uint32_t)(tmr_jiffies() - lc->ts));
+
+		tmr_start(&lc->tmr, lg.hold, hangup_handler, lc);
+		break;
+
+	case UA_EVENT_CALL_CLOSED:
+		if (lg.callee) {
+			if (lg.n_active)
+				active_update(-1);
+			break;
+		}
+
+		lc = lgcall_find(call);
+		if (!lc)
+			break;
+
+		if (!lc->estab) {
+			++lg.n_failed;
+			info("loadgen: call failed: %s\n", prm);
+		}
+
+		mem_deref(lc);
+		active_update(-1);
+		check_done();
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static void signal_handler(int sig)
+{
+	info("loadgen: terminated by signal %d\n", sig);
+
+	re_cancel();
+}
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr,
+			 "Usage: baresip-loadgen [options] [callee-uri]\n"
+			 "options:\n"
+			 "\t-s               Callee mode (registrar and"
+			 " auto-answer)\n"
+			 "\t-l <addr:port>   Local SIP address"
+			 " (default 127.0.0.1:0)\n"
+			 "\t-r <rate>        Calls per second (default 10)\n"
+			 "\t-t <ms>          Call hold time (default 1000)\n"
+			 "\t-n <calls>       Number of calls (default 100,"
+			 " 0 is no limit)\n"
+			 "\t-c <codec>       Audio codec"
+			 " (default mock codec)\n"
+			 "\t-e <mediaenc>    Media encryption,"
+			 " e.g. srtp-mand\n"
+			 "\t-m <module>      Pre-load modules (repeat)\n"
+			 "\t-v               Verbose output (INFO level)\n"
+			 "\t-h               Help\n"
+			 );
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct config *config;
+	struct ausrc *ausrc = NULL;
+	struct auplay *auplay = NULL;
+	const char *laddr = "127.0.0.1:0";
+	const char *codec = NULL;
+	const char *menc = NULL;
+	const char *modv[16];
+	size_t modc = 0;
+	char aor[256];
+	struct sa sa, laddr_sip;
+	double cpu;
+	size_t i;
+	int err;
+
+	err = libre_init();
+	if (err)
+		return err;
+
+	log_enable_info(false);
+
+	lg.rate    = 10;
+	lg.hold    = 1000;
+	lg.n_total = 100;
+
+	for (;;) {
+		const int c = getopt(argc, argv, "sl:r:t:n:c:e:m:vh");
+		if (0 > c)
+			break;
+
+		switch (c) {
+
+		case 's':
+			lg.callee = true;
+			break;
+
+		case 'l':
+			laddr = optarg;
+			break;
+
+		case 'r':
+			lg.rate = atoi(optarg);
+			break;
+
+		case 't':
+			lg.hold = atoi(optarg);
+			break;
+
+		case 'n':
+			lg.n_total = atoi(optarg);
+			break;
+
+		case 'c':
+			codec = optarg;
+			break;
+
+		case 'e':
+			menc = optarg;
+			break;
+
+		case 'm':
+			if (modc >= ARRAY_SIZE(modv)) {
+				warning("max %zu modules\n",
+					ARRAY_SIZE(modv));
+				err = EINVAL;
+				goto out;
+			}
+			modv[modc++] = optarg;
+			break;
+
+		case 'v':
+			log_enable_info(true);
+			break;
+
+		case '?':
+		case 'h':
+		default:
+			usage();
+			return -2;
+		}
+	}
+
+	if (!lg.callee) {
+
+		if (argc < optind + 1 || !lg.rate) {
+			usage();
+			return -2;
+		}
+
+		lg.uri = argv[optind];
+	}
+
+	config = conf_config();
+	if (!config) {
+		err = ENOENT;
+		goto out;
+	}
+
+	str_ncpy(config->sip.local, laddr, sizeof(config->sip.local));
+	config->sip.trans_bsize = HASH_SIZE;
+	config->call.max_calls  = 0;
+
+	err = baresip_init(config, false);
+	if (err)
+		goto out;
+
+	for (i=0; i<modc; i++) {
+
+		err = module_preload(modv[i]);
+		if (err) {
+			warning("loadgen: could not pre-load module"
+				" '%s' (%m)\n", modv[i], err);
+			goto out;
+		}
+	}
+
+	if (!codec)
+		mock_aucodec_register();
+
+	err  = mock_ausrc_register(&ausrc);
+	err |= mock_auplay_register(&auplay, NULL, NULL);
+	if (err)
+		goto out;
+
+	err = ua_init("baresip-loadgen", true, true, false, false);
+	if (err)
+		goto out;
+
+	err = sip_transp_laddr(uag_sip(), &laddr_sip, SIP_TRANSP_UDP, NULL);
+	if (err)
+		goto out;
+
+	err = hash_alloc(&lg.ht_call, HASH_SIZE);
+	if (err)
+		goto out;
+
+	err = uag_event_register(ua_event_handler, NULL);
+	if (err)
+		goto out;
+
+	if (lg.callee) {
+
+		err = sip_server_alloc(&lg.srv);
+		if (err) {
+			warning("loadgen: could not start registrar (%m)\n",
+				err);
+			goto out;
+		}
+
+		err = sip_transp_laddr(lg.srv->sip, &sa, SIP_TRANSP_UDP,
+				       NULL);
+		if (err)
+			goto out;
+
+		/* the AOR domain is the registrar */
+		re_snprintf(aor, sizeof(aor),
+			    "<sip:b@%J>;answermode=auto;regint=600", &sa);
+	}
+	else {
+		re_snprintf(aor, sizeof(aor), "<sip:a@%J>;regint=0",
+			    &laddr_sip);
+	}
+
+	if (codec) {
+		re_snprintf(aor + str_len(aor), sizeof(aor) - str_len(aor),
+			    ";audio_codecs=%s", codec);
+	}
+	if (menc) {
+		re_snprintf(aor + str_len(aor), sizeof(aor) - str_len(aor),
+			    ";mediaenc=%s", menc);
+	}
+
+	err = ua_alloc(&lg.ua, aor);
+	if (err)
+		goto out;
+
+	if (lg.callee) {
+		re_printf("loadgen: callee ready at sip:b@%J\n", &laddr_sip);
+	}
+	else {
+		re_printf("loadgen: calling %s at %u calls/s, hold %u ms,"
+			  " %u calls\n",
+			  lg.uri, lg.rate, lg.hold, lg.n_total);
+	}
+
+	lg.mem_base = mem_inuse();
+	lg.ts_start = tmr_jiffies();
+	cpu = cpu_time();
+
+	if (!lg.callee)
+		tmr_start(&lg.tmr, 0, pacing_handler, NULL);
+
+	tmr_start(&lg.tmr_report, REPORT_PERIOD, report_handler, NULL);
+
+	err = re_main(signal_handler);
+
+	print_summary(cpu_time() - cpu);
+
+ out:
+	if (err)
+		warning("loadgen: error (%m)\n", err);
+
+	tmr_cancel(&lg.tmr);
+	tmr_cancel(&lg.tmr_report);
+
+	uag_event_unregister(ua_event_handler);
+
+	hash_flush(lg.ht_call);
+	lg.ht_call = mem_deref(lg.ht_call);
+	lg.latv    = mem_deref(lg.latv);
+	lg.ua      = mem_deref(lg.ua);
+	lg.srv     = mem_deref(lg.srv);
+
+	ua_stop_all(true);
+	ua_close();
+
+	mem_deref(auplay);
+	mem_deref(ausrc);
+	if (!codec)
+		mock_aucodec_unregister();
+
+	baresip_close();
+	mod_close();
+
+	libre_close();
+
+	return err;
+}
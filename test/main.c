@@ -23,11 +23,15 @@ struct test {
 
 static const struct test tests[] = {
 	TEST(test_account),
+	TEST(test_aecref),
 	TEST(test_aulevel),
+	TEST(test_auplc),
+	TEST(test_auctrl),
 	TEST(test_call_af_mismatch),
 	TEST(test_call_answer),
 	TEST(test_call_answer_hangup_a),
 	TEST(test_call_answer_hangup_b),
+	TEST(test_call_memory),
 	TEST(test_call_reject),
 	TEST(test_call_rtp_timeout),
 	TEST(test_call_multiple),
@@ -42,22 +46,35 @@ static const struct test tests[] = {
 #endif
 	TEST(test_cmd),
 	TEST(test_cmd_long),
+	TEST(test_cn),
 	TEST(test_contact),
 	TEST(test_cplusplus),
+	TEST(test_g711),
 	TEST(test_message),
 	TEST(test_mos),
 	TEST(test_network),
 	TEST(test_play),
+	TEST(test_play_cache),
+	TEST(test_resampler),
 	TEST(test_ua_alloc),
 	TEST(test_ua_options),
 	TEST(test_ua_register),
 	TEST(test_ua_register_dns),
 	TEST(test_ua_register_auth),
 	TEST(test_ua_register_auth_dns),
+	TEST(test_uag_find),
 	TEST(test_uag_find_param),
 };
 
 
+/* benchmarks, only run with -b or by name */
+static const struct test benchmarks[] = {
+	TEST(test_g711_bench),
+	TEST(test_resampler_bench),
+	TEST(test_uag_find_perf),
+};
+
+
 static int run_one_test(const struct test *test)
 {
 	int err;
@@ -77,19 +94,19 @@ static int run_one_test(const struct test *test)
 }
 
 
-static int run_tests(void)
+static int run_tests(const struct test *testv, size_t n)
 {
 	size_t i;
 	int err;
 
-	for (i=0; i<ARRAY_SIZE(tests); i++) {
+	for (i=0; i<n; i++) {
 
-		re_printf("[ RUN      ] %s\n", tests[i].name);
+		re_printf("[ RUN      ] %s\n", testv[i].name);
 
-		err = tests[i].exec();
+		err = testv[i].exec();
 		if (err) {
 			warning("%s: test failed (%m)\n",
-				tests[i].name, err);
+				testv[i].name, err);
 			return err;
 		}
 
@@ -100,20 +117,26 @@ static int run_tests(void)
 }
 
 
-static void test_listcases(void)
+static void list_cases(const char *title, const struct test *testv,
+		       size_t n)
 {
-	size_t i, n;
-
-	n = ARRAY_SIZE(tests);
+	size_t i;
 
-	(void)re_printf("\n%zu test cases:\n", n);
+	(void)re_printf("\n%zu %s:\n", n, title);
 
 	for (i=0; i<(n+1)/2; i++) {
 
 		(void)re_printf("    %-32s    %s\n",
-				tests[i].name,
-				(i+(n+1)/2) < n ? tests[i+(n+1)/2].name : "");
+				testv[i].name,
+				(i+(n+1)/2) < n ? testv[i+(n+1)/2].name : "");
 	}
+}
+
+
+static void test_listcases(void)
+{
+	list_cases("test cases", tests, ARRAY_SIZE(tests));
+	list_cases("benchmarks", benchmarks, ARRAY_SIZE(benchmarks));
 
 	(void)re_printf("\n");
 }
@@ -129,6 +152,12 @@ static const struct test *find_test(const char *name)
 			return &tests[i];
 	}
 
+	for (i=0; i<ARRAY_SIZE(benchmarks); i++) {
+
+		if (0 == str_casecmp(name, benchmarks[i].name))
+			return &benchmarks[i];
+	}
+
 	return NULL;
 }
 
@@ -147,6 +176,7 @@ static void usage(void)
 	(void)re_fprintf(stderr,
 			 "Usage: selftest [options] <testcases..>\n"
 			 "options:\n"
+			 "\t-b               Run the benchmarks\n"
 			 "\t-l               List all testcases and exit\n"
 			 "\t-v               Verbose output (INFO level)\n"
 			 );
@@ -158,6 +188,7 @@ int main(int argc, char *argv[])
 	struct config *config;
 	size_t i, ntests;
 	bool verbose = false;
+	bool bench = false;
 	int err;
 
 	err = libre_init();
@@ -167,7 +198,7 @@ int main(int argc, char *argv[])
 	log_enable_info(false);
 
 	for (;;) {
-		const int c = getopt(argc, argv, "hlv");
+		const int c = getopt(argc, argv, "bhlv");
 		if (0 > c)
 			break;
 
@@ -178,6 +209,10 @@ int main(int argc, char *argv[])
 			usage();
 			return -2;
 
+		case 'b':
+			bench = true;
+			break;
+
 		case 'l':
 			test_listcases();
 			return 0;
@@ -197,6 +232,8 @@ int main(int argc, char *argv[])
 
 	if (argc >= (optind + 1))
 		ntests = argc - optind;
+	else if (bench)
+		ntests = ARRAY_SIZE(benchmarks);
 	else
 		ntests = ARRAY_SIZE(tests);
 
@@ -239,8 +276,13 @@ int main(int argc, char *argv[])
 			}
 		}
 	}
+	else if (bench) {
+		err = run_tests(benchmarks, ARRAY_SIZE(benchmarks));
+		if (err)
+			goto out;
+	}
 	else {
-		err = run_tests();
+		err = run_tests(tests, ARRAY_SIZE(tests));
 		if (err)
 			goto out;
 	}
@@ -3,8 +3,10 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <stdio.h>
 #include <string.h>
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
 #include "test.h"
 
@@ -97,3 +99,96 @@ int test_play(void)
 	mem_deref(auplay);
 	return err;
 }
+
+
+static int write_wav(const char *path, size_t sampc)
+{
+	struct aufile_prm prm = {8000, 1, AUFMT_S16LE};
+	struct aufile *af;
+	int16_t sampv[NUM_SAMPLES];
+	size_t i;
+	int err;
+
+	for (i=0; i<NUM_SAMPLES; i++)
+		sampv[i] = sys_htols((int16_t)(i * 7));
+
+	err = aufile_open(&af, &prm, path, AUFILE_WRITE);
+	if (err)
+		return err;
+
+	err = aufile_write(af, (void *)sampv, sampc * 2);
+
+	mem_deref(af);
+
+	return err;
+}
+
+
+int test_play_cache(void)
+{
+	struct player *player = NULL;
+	struct mbuf *mb1 = NULL, *mb2 = NULL, *mb3 = NULL;
+	struct mbuf *mb_dbg = NULL;
+	char path[256];
+	uint32_t srate = 0;
+	uint8_t ch = 0;
+	const int16_t *sampv;
+	size_t i;
+	int err;
+
+	re_snprintf(path, sizeof(path), "/tmp/baresip_selftest_%08x.wav",
+		    rand_u32());
+
+	err = play_init(&player);
+	TEST_ERR(err);
+
+	err = write_wav(path, NUM_SAMPLES);
+	TEST_ERR(err);
+
+	/* first load decodes the file */
+	err = play_cache_get(player, &mb1, &srate, &ch, path);
+	TEST_ERR(err);
+	ASSERT_EQ(8000, srate);
+	ASSERT_EQ(1, ch);
+	ASSERT_EQ(NUM_SAMPLES * 2, mb1->end);
+
+	sampv = (void *)mb1->buf;
+	for (i=0; i<NUM_SAMPLES; i++)
+		ASSERT_EQ((int16_t)(i * 7), sampv[i]);
+
+	/* second load shares the same buffer */
+	err = play_cache_get(player, &mb2, NULL, NULL, path);
+	TEST_ERR(err);
+	ASSERT_TRUE(mb1 == mb2);
+
+	/* a changed file is decoded again */
+	err = write_wav(path, NUM_SAMPLES / 2);
+	TEST_ERR(err);
+
+	err = play_cache_get(player, &mb3, NULL, NULL, path);
+	TEST_ERR(err);
+	ASSERT_TRUE(mb3 != mb1);
+	ASSERT_EQ(NUM_SAMPLES, mb3->end);
+
+	mb_dbg = mbuf_alloc(512);
+	ASSERT_TRUE(mb_dbg != NULL);
+
+	err = mbuf_printf(mb_dbg, "%H", play_cache_debug, player);
+	TEST_ERR(err);
+
+	ASSERT_EQ(0, re_regex((char *)mb_dbg->buf, mb_dbg->end,
+			      "hits:[ ]+1"));
+	ASSERT_EQ(0, re_regex((char *)mb_dbg->buf, mb_dbg->end,
+			      "misses:[ ]+2 \\(1 reloaded\\)"));
+
+ out:
+	(void)remove(path);
+
+	mem_deref(mb_dbg);
+	mem_deref(mb3);
+	mem_deref(mb2);
+	mem_deref(mb1);
+	mem_deref(player);
+
+	return err;
+}
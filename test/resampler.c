@@ -0,0 +1,272 @@
+/**
+ * @file test/resampler.c  Baresip selftest -- audio resampler
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define PTIME 20
+
+
+static void sine(int16_t *sampv, size_t sampc, uint32_t srate,
+		 double freq, size_t *n)
+{
+	size_t i;
+
+	for (i=0; i<sampc; i++, (*n)++)
+		sampv[i] = (int16_t)(10000.0 * sin(2.0 * 3.14159265358979 *
+						 freq * *n / srate));
+}
+
+
+/*
+ * 44100 Hz to 48000 Hz cannot be done by integer factors. Check that
+ * every block gives the exact number of samples, and that a 1 kHz tone
+ * keeps its frequency and level.
+ */
+static int test_resampler_ratio(enum resampler_quality q)
+{
+	struct resampler *rs = NULL;
+	int16_t inv[44100 * PTIME / 1000];
+	int16_t outv[48000 * PTIME / 1000];
+	size_t n = 0, i, blk;
+	unsigned crossings = 0;
+	double pwr = 0;
+	size_t cnt = 0;
+	int16_t prev = 0;
+	int err;
+
+	err = resampler_alloc(&rs, q, 44100, 1, 48000, 1);
+	TEST_ERR(err);
+
+	for (blk=0; blk<50; blk++) {
+
+		size_t outc = ARRAY_SIZE(outv);
+
+		sine(inv, ARRAY_SIZE(inv), 44100, 1000.0, &n);
+
+		err = resampler_process(rs, outv, &outc,
+					inv, ARRAY_SIZE(inv));
+		TEST_ERR(err);
+		ASSERT_EQ(ARRAY_SIZE(outv), outc);
+
+		/* skip the filter delay */
+		if (blk < 2)
+			continue;
+
+		for (i=0; i<outc; i++) {
+
+			if ((prev < 0) != (outv[i] < 0))
+				++crossings;
+
+			pwr += (double)outv[i] * outv[i];
+			prev = outv[i];
+			++cnt;
+		}
+	}
+
+	/* 1000 Hz gives 2 zero-crossings per millisecond */
+	ASSERT_TRUE(abs((int)crossings - (int)(cnt * 2000 / 48000)) <= 2);
+
+	/* RMS of the tone is 10000/sqrt(2) */
+	ASSERT_DOUBLE_EQ(7071.0, sqrt(pwr / cnt), 150.0);
+
+ out:
+	mem_deref(rs);
+	return err;
+}
+
+
+static int test_resampler_channels(void)
+{
+	struct resampler *rs = NULL;
+	int16_t inv[160 * 2], outv[320 * 2];
+	size_t i, outc;
+	int err;
+
+	for (i=0; i<160; i++) {
+		inv[2*i]     = 1000;
+		inv[2*i + 1] = 3000;
+	}
+
+	/* stereo to mono, same rate: the channels are averaged */
+	err = resampler_alloc(&rs, RESAMPLER_MEDIUM, 8000, 2, 8000, 1);
+	TEST_ERR(err);
+
+	outc = ARRAY_SIZE(outv);
+	err = resampler_process(rs, outv, &outc, inv, 320);
+	TEST_ERR(err);
+	ASSERT_EQ(160, outc);
+
+	for (i=0; i<outc; i++)
+		ASSERT_EQ(2000, outv[i]);
+
+	rs = mem_deref(rs);
+
+	/* mono 8000 Hz to stereo 16000 Hz */
+	err = resampler_alloc(&rs, RESAMPLER_MEDIUM, 8000, 1, 16000, 2);
+	TEST_ERR(err);
+
+	for (i=0; i<160; i++)
+		inv[i] = 2000;
+
+	for (i=0; i<3; i++) {
+		outc = ARRAY_SIZE(outv);
+		err = resampler_process(rs, outv, &outc, inv, 160);
+		TEST_ERR(err);
+		ASSERT_EQ(640, outc);
+	}
+
+	/* each branch has unity gain at DC */
+	for (i=0; i<outc; i+=2) {
+		ASSERT_TRUE(abs(outv[i] - 2000) <= 1);
+		ASSERT_EQ(outv[i], outv[i + 1]);
+	}
+
+ out:
+	mem_deref(rs);
+	return err;
+}
+
+
+int test_resampler(void)
+{
+	struct resampler *rs = NULL;
+	int16_t sampv[4];
+	size_t sampc = 1;
+	int err;
+
+	err = test_resampler_ratio(RESAMPLER_FAST);
+	TEST_ERR(err);
+	err = test_resampler_ratio(RESAMPLER_MEDIUM);
+	TEST_ERR(err);
+	err = test_resampler_ratio(RESAMPLER_HIGH);
+	TEST_ERR(err);
+
+	err = test_resampler_channels();
+	TEST_ERR(err);
+
+	/* ratio needs more than 1024 polyphase branches */
+	ASSERT_EQ(ENOTSUP, resampler_alloc(&rs, RESAMPLER_FAST,
+					   44100, 1, 47999, 1));
+
+	/* 3 channels cannot be mixed to 1 */
+	ASSERT_EQ(ENOTSUP, resampler_alloc(&rs, RESAMPLER_FAST,
+					   8000, 3, 8000, 1));
+
+	/* output buffer too small */
+	err = resampler_alloc(&rs, RESAMPLER_FAST, 8000, 1, 16000, 1);
+	TEST_ERR(err);
+
+	sampv[0] = sampv[1] = 0;
+	ASSERT_EQ(ENOMEM, resampler_process(rs, sampv, &sampc, sampv, 2));
+	err = 0;
+
+ out:
+	mem_deref(rs);
+	return err;
+}
+
+
+static double bench_resampler(enum resampler_quality q,
+			      uint32_t irate, uint32_t orate)
+{
+	struct resampler *rs = NULL;
+	int16_t inv[48000 * PTIME / 1000], outv[48000 * PTIME / 1000];
+	const size_t inc = irate * PTIME / 1000;
+	uint64_t t0, t;
+	size_t n = 0, i;
+
+	if (resampler_alloc(&rs, q, irate, 1, orate, 1))
+		return -1;
+
+	sine(inv, inc, irate, 1000.0, &n);
+
+	t0 = tmr_jiffies();
+
+	for (i=0; i<3000; i++) {
+		size_t outc = ARRAY_SIZE(outv);
+		(void)resampler_process(rs, outv, &outc, inv, inc);
+	}
+
+	t = tmr_jiffies() - t0;
+
+	mem_deref(rs);
+
+	return 1e6 * t / (3000.0 * inc);
+}
+
+
+static double bench_auresamp(uint32_t irate, uint32_t orate)
+{
+	struct auresamp ar;
+	int16_t inv[48000 * PTIME / 1000], outv[48000 * PTIME / 1000];
+	const size_t inc = irate * PTIME / 1000;
+	uint64_t t0, t;
+	size_t n = 0, i;
+
+	auresamp_init(&ar);
+	if (auresamp_setup(&ar, irate, 1, orate, 1))
+		return -1;
+
+	sine(inv, inc, irate, 1000.0, &n);
+
+	t0 = tmr_jiffies();
+
+	for (i=0; i<3000; i++) {
+		size_t outc = ARRAY_SIZE(outv);
+		(void)auresamp(&ar, outv, &outc, inv, inc);
+	}
+
+	t = tmr_jiffies() - t0;
+
+	return 1e6 * t / (3000.0 * inc);
+}
+
+
+/*
+ * Print the cost per input sample of the resampler presets,
+ * with librem's auresamp as reference. 60 seconds of audio each.
+ */
+int test_resampler_bench(void)
+{
+	static const struct {
+		uint32_t irate;
+		uint32_t orate;
+	} ratev[] = {
+		{48000, 16000},
+		{16000, 48000},
+		{44100, 48000},
+	};
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(ratev); i++) {
+
+		const uint32_t ir = ratev[i].irate, orr = ratev[i].orate;
+		double ns = bench_auresamp(ir, orr);
+
+		if (ns >= 0) {
+			info("resampler: %5u -> %5u  auresamp  %6.1f"
+			     " ns/sample\n", ir, orr, ns);
+		}
+		else {
+			info("resampler: %5u -> %5u  auresamp  unsupported\n",
+			     ir, orr);
+		}
+
+		info("resampler: %5u -> %5u  fast      %6.1f ns/sample\n",
+		     ir, orr, bench_resampler(RESAMPLER_FAST, ir, orr));
+		info("resampler: %5u -> %5u  medium    %6.1f ns/sample\n",
+		     ir, orr, bench_resampler(RESAMPLER_MEDIUM, ir, orr));
+		info("resampler: %5u -> %5u  high      %6.1f ns/sample\n",
+		     ir, orr, bench_resampler(RESAMPLER_HIGH, ir, orr));
+	}
+
+	return 0;
+}
@@ -9,15 +9,21 @@
 # Test-cases:
 #
 TEST_SRCS	+= account.c
+TEST_SRCS	+= aecref.c
 TEST_SRCS	+= aulevel.c
+TEST_SRCS	+= auplc.c
+TEST_SRCS	+= auctrl.c
 TEST_SRCS	+= call.c
 TEST_SRCS	+= cmd.c
+TEST_SRCS	+= cn.c
 TEST_SRCS	+= contact.c
 TEST_SRCS	+= cplusplus.c
+TEST_SRCS	+= g711.c
 TEST_SRCS	+= message.c
 TEST_SRCS	+= mos.c
 TEST_SRCS	+= net.c
 TEST_SRCS	+= play.c
+TEST_SRCS	+= resampler.c
 TEST_SRCS	+= ua.c
 ifneq ($(USE_VIDEO),)
 TEST_SRCS	+= video.c
@@ -52,3 +58,22 @@ endif
 TEST_SRCS	+= test.c
 
 TEST_SRCS	+= main.c
+
+
+#
+# Load generator
+#
+LOADGEN_SRCS	+= loadgen.c
+LOADGEN_SRCS	+= mock/mock_aucodec.c
+LOADGEN_SRCS	+= mock/mock_auplay.c
+LOADGEN_SRCS	+= mock/mock_ausrc.c
+LOADGEN_SRCS	+= sip/aor.c
+LOADGEN_SRCS	+= sip/auth.c
+LOADGEN_SRCS	+= sip/domain.c
+LOADGEN_SRCS	+= sip/location.c
+LOADGEN_SRCS	+= sip/sipsrv.c
+LOADGEN_SRCS	+= sip/user.c
+
+ifneq ($(USE_TLS),)
+LOADGEN_SRCS	+= mock/cert.c
+endif
@@ -178,12 +178,18 @@ int mock_vidisp_register(struct vidisp **vidispp);
 /* test cases */
 
 int test_account(void);
+int test_aecref(void);
 int test_aulevel(void);
+int test_auplc(void);
+int test_auctrl(void);
 int test_cmd(void);
 int test_cmd_long(void);
+int test_cn(void);
 int test_contact(void);
 int test_ua_alloc(void);
+int test_uag_find(void);
 int test_uag_find_param(void);
+int test_uag_find_perf(void);
 int test_ua_register(void);
 int test_ua_register_dns(void);
 int test_ua_register_auth(void);
@@ -193,12 +199,18 @@ int test_message(void);
 int test_mos(void);
 int test_network(void);
 int test_play(void);
+int test_play_cache(void);
+int test_g711(void);
+int test_g711_bench(void);
+int test_resampler(void);
+int test_resampler_bench(void);
 
 int test_call_answer(void);
 int test_call_reject(void);
 int test_call_af_mismatch(void);
 int test_call_answer_hangup_a(void);
 int test_call_answer_hangup_b(void);
+int test_call_memory(void);
 int test_call_rtp_timeout(void);
 int test_call_multiple(void);
 int test_call_max(void);
@@ -218,6 +218,122 @@ int test_uag_find_param(void)
 }
 
 
+int test_uag_find(void)
+{
+	struct ua *ua1 = NULL, *ua2 = NULL;
+	struct pl pl;
+	int err = 0;
+
+	err  = ua_alloc(&ua1, "<sip:alice@127.0.0.1>;regint=0");
+	err |= ua_alloc(&ua2, "<sip:bob@127.0.0.1>;regint=0");
+	if (err)
+		goto out;
+
+	/* contact username */
+	pl_set_str(&pl, ua_local_cuser(ua1));
+	ASSERT_TRUE(ua1 == uag_find(&pl));
+	pl_set_str(&pl, ua_local_cuser(ua2));
+	ASSERT_TRUE(ua2 == uag_find(&pl));
+
+	/* AOR username, case-insensitive */
+	pl_set_str(&pl, "ALICE");
+	ASSERT_TRUE(ua1 == uag_find(&pl));
+	pl_set_str(&pl, "bob");
+	ASSERT_TRUE(ua2 == uag_find(&pl));
+	pl_set_str(&pl, "carol");
+	ASSERT_TRUE(NULL == uag_find(&pl));
+
+	ASSERT_TRUE(ua2 == uag_find_aor("sip:bob@127.0.0.1"));
+
+	ua2 = mem_deref(ua2);
+
+	pl_set_str(&pl, "bob");
+	ASSERT_TRUE(NULL == uag_find(&pl));
+	ASSERT_TRUE(NULL == uag_find_aor("sip:bob@127.0.0.1"));
+
+ out:
+	mem_deref(ua2);
+	mem_deref(ua1);
+
+	return err;
+}
+
+
+static int uag_find_bench(unsigned n_accounts)
+{
+	const unsigned n_lookups = 100000;
+	struct ua **uav;
+	uint64_t t0, t1;
+	char user[32];
+	struct pl pl;
+	unsigned i;
+	int err = 0;
+
+	uav = mem_zalloc(n_accounts * sizeof(*uav), NULL);
+	if (!uav)
+		return ENOMEM;
+
+	for (i=0; i<n_accounts; i++) {
+		char aor[64];
+
+		re_snprintf(aor, sizeof(aor),
+			    "<sip:bench%u@127.0.0.1>;regint=0", i);
+
+		err = ua_alloc(&uav[i], aor);
+		if (err)
+			goto out;
+	}
+
+	t0 = tmr_jiffies();
+
+	for (i=0; i<n_lookups; i++) {
+
+		const unsigned ix = (i * 7919) % n_accounts;
+
+		re_snprintf(user, sizeof(user), "bench%u", ix);
+		pl_set_str(&pl, user);
+
+		if (uav[ix] != uag_find(&pl)) {
+			err = ENOENT;
+			goto out;
+		}
+	}
+
+	t1 = tmr_jiffies();
+
+	info("uag_find: %5u accounts: %.3f usec per lookup\n",
+	     n_accounts, (double)(t1 - t0) * 1000.0 / n_lookups);
+
+ out:
+	for (i=0; i<n_accounts; i++)
+		mem_deref(uav[i]);
+	mem_deref(uav);
+
+	return err;
+}
+
+
+/*
+ * Benchmark of the lookup latency vs. number of accounts,
+ * use -v to see the results.
+ */
+int test_uag_find_perf(void)
+{
+	static const unsigned countv[] = {10, 100, 1000, 5000};
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(countv); i++) {
+
+		err = uag_find_bench(countv[i]);
+		TEST_ERR(err);
+	}
+
+ out:
+	return err;
+}
+
+
 static const char *_sip_transp_srvid(enum sip_transp tp)
 {
 	switch (tp) {
@@ -5,6 +5,7 @@
  */
 
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
 #include "test.h"
 
@@ -33,6 +34,19 @@ int test_video(void)
 	ASSERT_EQ(4294965000, video_calc_rtp_timestamp(1431655, 30));
 	ASSERT_EQ(       704, video_calc_rtp_timestamp(1431656, 30));
 
+	/* encoder threads, the upper limit depends on the CPU cores */
+	{
+		const struct vidsz qcif = {176, 144}, hd = {1920, 1080};
+		unsigned n;
+
+		ASSERT_EQ(1, video_calc_threads(NULL, 8));
+		ASSERT_EQ(1, video_calc_threads(&qcif, 8));
+		ASSERT_EQ(1, video_calc_threads(&hd, 1));
+
+		n = video_calc_threads(&hd, 4);
+		ASSERT_TRUE(n >= 1 && n <= 4);
+	}
+
  out:
 	return err;
 }